@@ -0,0 +1,115 @@
+#pragma once
+/***********************************************************************
+ Moses - factored phrase-based, hierarchical and syntactic language decoder
+ Copyright (C) 2012 University of Edinburgh
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ ***********************************************************************/
+#include <string>
+#include "../moses/src/TypeDef.h"
+
+// Variable length integers and bit packing used by the compact (version 4)
+// target phrase format.
+
+namespace OnDiskPt
+{
+
+//! append value using 7 bits per byte, low bits first
+inline void WriteVarint(std::string &out, UINT64 value)
+{
+  while (value >= 0x80) {
+    out += (char) ((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  out += (char) value;
+}
+
+//! read a value written by WriteVarint and advance mem past it
+inline UINT64 ReadVarint(const char *&mem)
+{
+  UINT64 value = 0;
+  unsigned int shift = 0;
+  unsigned char byte;
+  do {
+    byte = (unsigned char) *mem++;
+    value |= (UINT64) (byte & 0x7f) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+  return value;
+}
+
+//! packs codes of up to 32 bits, low bits first, into whole bytes
+class BitWriter
+{
+  std::string &m_out;
+  UINT64 m_buffer;
+  size_t m_numBits;
+
+public:
+  explicit BitWriter(std::string &out)
+    :m_out(out)
+    ,m_buffer(0)
+    ,m_numBits(0)
+  {}
+
+  void Write(UINT32 code, size_t numBits) {
+    m_buffer |= (UINT64) code << m_numBits;
+    m_numBits += numBits;
+    while (m_numBits >= 8) {
+      m_out += (char) (m_buffer & 0xff);
+      m_buffer >>= 8;
+      m_numBits -= 8;
+    }
+  }
+
+  //! write out the last partial byte
+  void Flush() {
+    if (m_numBits > 0)
+      m_out += (char) (m_buffer & 0xff);
+    m_buffer = 0;
+    m_numBits = 0;
+  }
+};
+
+//! reads codes packed by BitWriter
+class BitReader
+{
+  const unsigned char *m_mem;
+  size_t m_bitPos;
+
+public:
+  explicit BitReader(const char *mem)
+    :m_mem((const unsigned char*) mem)
+    ,m_bitPos(0)
+  {}
+
+  UINT32 Read(size_t numBits) {
+    const unsigned char *mem = m_mem + (m_bitPos >> 3);
+    size_t shift = m_bitPos & 7;
+    size_t numBytes = (shift + numBits + 7) >> 3;
+    UINT64 buffer = 0;
+    for (size_t ind = 0; ind < numBytes; ++ind)
+      buffer |= (UINT64) mem[ind] << (8 * ind);
+    m_bitPos += numBits;
+    return (UINT32) ((buffer >> shift) & ((((UINT64) 1) << numBits) - 1));
+  }
+
+  //! number of whole bytes touched so far
+  size_t GetBytesRead() const {
+    return (m_bitPos + 7) >> 3;
+  }
+};
+
+}
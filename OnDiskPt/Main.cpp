@@ -33,6 +33,7 @@
 #include "../OnDiskPt/TargetPhraseCollection.h"
 #include "../OnDiskPt/Word.h"
 #include "../OnDiskPt/Vocab.h"
+#include "TableBuilder.h"
 #include "Main.h"
 
 using namespace std;
@@ -40,51 +41,66 @@ using namespace OnDiskPt;
 
 int main (int argc, char * const argv[])
 {
-  // insert code here...
+  // options before the positional arguments
+  size_t numThreads = 1, memoryMB = 1024;
+  string tempPath;
+  int argInd = 1;
+  while (argInd + 1 < argc && argv[argInd][0] == '-') {
+    const string option = argv[argInd];
+    if (option == "-threads")
+      numThreads = Moses::Scan<size_t>(argv[argInd + 1]);
+    else if (option == "-memory")
+      memoryMB = Moses::Scan<size_t>(argv[argInd + 1]);
+    else if (option == "-temp")
+      tempPath = argv[argInd + 1];
+    else
+      break;
+    argInd += 2;
+  }
+
+  int numArgs = argc - argInd;
+  if (numArgs != 7 && numArgs != 8) {
+    cerr << "Usage: " << argv[0] << " [-threads N] [-memory MB] [-temp DIR] numSourceFactors numTargetFactors numScores tableLimit sortScoreIndex inputPath outputPath [bitsPerScore]" << endl
+         << "  The rules may come in any order." << endl
+         << "  -threads: number of threads building parts of the table (default 1)" << endl
+         << "  -memory: memory for sorting rules over all threads, in MB (default 1024)" << endl
+         << "  -temp: directory for temporary files (default outputPath/tmp)" << endl
+         << "  bitsPerScore: quantize the scores to codes of this many bits, at most " << Quantizer::MaxBits
+         << ", either one number for all scores or a comma separated list. 0 keeps the float (default)" << endl;
+    return 1;
+  }
+  char * const *args = argv + argInd - 1;
+
   Moses::ResetUserTime();
   Moses::PrintUserTime("Starting");
 
-  assert(argc == 8);
-
-  int numSourceFactors		= Moses::Scan<int>(argv[1])
-                            , numTargetFactors	= Moses::Scan<int>(argv[2])
-                                , numScores					= Moses::Scan<int>(argv[3])
-                                    , tableLimit				= Moses::Scan<int>(argv[4]);
-  TargetPhraseCollection::s_sortScoreInd			= Moses::Scan<int>(argv[5]);
+  int numSourceFactors		= Moses::Scan<int>(args[1])
+                            , numTargetFactors	= Moses::Scan<int>(args[2])
+                                , numScores					= Moses::Scan<int>(args[3])
+                                    , tableLimit				= Moses::Scan<int>(args[4]);
+  TargetPhraseCollection::s_sortScoreInd			= Moses::Scan<int>(args[5]);
   assert(TargetPhraseCollection::s_sortScoreInd < numScores);
   
-  const string filePath = argv[6]
-                          ,destPath = argv[7];
-
-
-  Moses::InputFileStream inStream(filePath);
+  const string filePath = args[6]
+                          ,destPath = args[7];
+  if (tempPath.empty())
+    tempPath = destPath + "/tmp";
 
   OnDiskWrapper onDiskWrapper;
   bool retDb = onDiskWrapper.BeginSave(destPath, numSourceFactors, numTargetFactors, numScores);
   assert(retDb);
 
-  PhraseNode &rootNode = onDiskWrapper.GetRootSourceNode();
-  size_t lineNum = 0;
-  char line[100000];
-
-  //while(getline(inStream, line))
-  while(inStream.getline(line, 100000)) {
-    lineNum++;
-    if (lineNum%1000 == 0) cerr << "." << flush;
-    if (lineNum%10000 == 0) cerr << ":" << flush;
-    if (lineNum%100000 == 0) cerr << lineNum << flush;
-    //cerr << lineNum << " " << line << endl;
-
-    std::vector<float> misc(1);
-    SourcePhrase sourcePhrase;
-    TargetPhrase *targetPhrase = new TargetPhrase(numScores);
-    Tokenize(sourcePhrase, *targetPhrase, line, onDiskWrapper, numScores, misc);
-    assert(misc.size() == onDiskWrapper.GetNumCounts());
-
-    rootNode.AddTargetPhrase(sourcePhrase, targetPhrase, onDiskWrapper, tableLimit, misc);
+  if (numArgs == 8) {
+    // scores are quantized with codebooks trained while the rules are sharded
+    vector<size_t> bits = Moses::Tokenize<size_t>(args[8], ",");
+    if (bits.size() == 1)
+      bits.resize(numScores, bits[0]);
+    assert(bits.size() == (size_t) numScores);
+    onDiskWrapper.GetQuantizer().Init(bits);
   }
 
-  rootNode.Save(onDiskWrapper, 0, tableLimit);
+  TableBuilder builder(onDiskWrapper, tempPath, numThreads, memoryMB << 20, tableLimit);
+  builder.Build(filePath);
   onDiskWrapper.EndSave();
 
   Moses::PrintUserTime("Finished");
@@ -106,7 +122,7 @@ bool Flush(const OnDiskPt::SourcePhrase *prevSourcePhrase, const OnDiskPt::Sourc
   return ret;
 }
 
-void Tokenize(SourcePhrase &sourcePhrase, TargetPhrase &targetPhrase, char *line, OnDiskWrapper &onDiskWrapper, int numScores, vector<float> &misc)
+void Tokenize(SourcePhrase &sourcePhrase, TargetPhrase &targetPhrase, const std::string &line, OnDiskWrapper &onDiskWrapper, int numScores, vector<float> &misc)
 {
   size_t scoreInd = 0;
 
@@ -118,9 +134,12 @@ void Tokenize(SourcePhrase &sourcePhrase, TargetPhrase &targetPhrase, char *line
    3 = align
    4 = count
    */
-  char *tok = strtok (line," ");
-  while (tok != NULL) {
-    if (0 == strcmp(tok, "|||")) {
+  // not strtok(), rules are tokenized by several builder threads
+  vector<string> toks;
+  Moses::Tokenize(toks, line, " ");
+  for (size_t tokInd = 0; tokInd < toks.size(); ++tokInd) {
+    const string &tok = toks[tokInd];
+    if (tok == "|||") {
       ++stage;
     } else {
       switch (stage) {
@@ -157,18 +176,15 @@ void Tokenize(SourcePhrase &sourcePhrase, TargetPhrase &targetPhrase, char *line
         break;
       }
     }
-
-    tok = strtok (NULL, " ");
-  } // while (tok != NULL)
+  } // for (tokInd)
 
   assert(scoreInd == numScores);
   targetPhrase.SortAlign();
 
 } // Tokenize()
 
-void Tokenize(OnDiskPt::Phrase &phrase
-              , const std::string &token, bool addSourceNonTerm, bool addTargetNonTerm
-              , OnDiskPt::OnDiskWrapper &onDiskWrapper)
+void SplitWords(std::vector<std::string> &words
+                , const std::string &token, bool addSourceNonTerm, bool addTargetNonTerm)
 {
 
   bool nonTerm = false;
@@ -187,29 +203,35 @@ void Tokenize(OnDiskPt::Phrase &phrase
 
     if (splitPos == string::npos) {
       // lhs - only 1 word
-      Word *word = new Word();
-      word->CreateFromString(wordStr, onDiskWrapper.GetVocab());
-      phrase.AddWord(word);
+      words.push_back(wordStr);
     } else {
       // source & target non-terms
       if (addSourceNonTerm) {
-        Word *word = new Word();
-        word->CreateFromString(wordStr, onDiskWrapper.GetVocab());
-        phrase.AddWord(word);
+        words.push_back(wordStr);
       }
 
       wordStr = token.substr(splitPos, tokSize - splitPos);
       if (addTargetNonTerm) {
-        Word *word = new Word();
-        word->CreateFromString(wordStr, onDiskWrapper.GetVocab());
-        phrase.AddWord(word);
+        words.push_back(wordStr);
       }
 
     }
   } else {
     // term
+    words.push_back(token);
+  }
+}
+
+void Tokenize(OnDiskPt::Phrase &phrase
+              , const std::string &token, bool addSourceNonTerm, bool addTargetNonTerm
+              , OnDiskPt::OnDiskWrapper &onDiskWrapper)
+{
+  vector<string> words;
+  SplitWords(words, token, addSourceNonTerm, addTargetNonTerm);
+
+  for (size_t ind = 0; ind < words.size(); ++ind) {
     Word *word = new Word();
-    word->CreateFromString(token, onDiskWrapper.GetVocab());
+    word->CreateFromString(words[ind], onDiskWrapper.GetVocab());
     phrase.AddWord(word);
   }
 }
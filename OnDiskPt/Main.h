@@ -25,11 +25,14 @@
 typedef std::pair<size_t, size_t>  AlignPair;
 typedef std::vector<AlignPair> AlignType;
 
+//! the words of a token of a rule, with the source or target part of a non-terminal pair
+void SplitWords(std::vector<std::string> &words
+                , const std::string &token, bool addSourceNonTerm, bool addTargetNonTerm);
 void Tokenize(OnDiskPt::Phrase &phrase
               , const std::string &token, bool addSourceNonTerm, bool addTargetNonTerm
               , OnDiskPt::OnDiskWrapper &onDiskWrapper);
 void Tokenize(OnDiskPt::SourcePhrase &sourcePhrase, OnDiskPt::TargetPhrase &targetPhrase
-              , char *line, OnDiskPt::OnDiskWrapper &onDiskWrapper
+              , const std::string &line, OnDiskPt::OnDiskWrapper &onDiskWrapper
               , int numScores
               , std::vector<float> &misc);
 
@@ -55,14 +55,9 @@ bool OnDiskWrapper::BeginLoad(const std::string &filePath)
 
 bool OnDiskWrapper::OpenForLoad(const std::string &filePath)
 {
-  m_fileSource.open((filePath + "/Source.dat").c_str(), ios::in | ios::binary);
-  CHECK(m_fileSource.is_open());
-
-  m_fileTargetInd.open((filePath + "/TargetInd.dat").c_str(), ios::in | ios::binary);
-  CHECK(m_fileTargetInd.is_open());
-
-  m_fileTargetColl.open((filePath + "/TargetColl.dat").c_str(), ios::in | ios::binary);
-  CHECK(m_fileTargetColl.is_open());
+  MapForLoad(filePath + "/Source.dat", m_fdSource, m_memSource);
+  MapForLoad(filePath + "/TargetInd.dat", m_fdTargetInd, m_memTargetInd);
+  MapForLoad(filePath + "/TargetColl.dat", m_fdTargetColl, m_memTargetColl);
 
   m_fileVocab.open((filePath + "/Vocab.dat").c_str(), ios::in);
   CHECK(m_fileVocab.is_open());
@@ -75,10 +70,25 @@ bool OnDiskWrapper::OpenForLoad(const std::string &filePath)
   m_numSourceFactors = GetMisc("NumSourceFactors");
   m_numTargetFactors = GetMisc("NumTargetFactors");
   m_numScores = GetMisc("NumScores");
+  m_version = GetMisc("Version");
+
+  if (IsCompact()) {
+    CHECK(m_quantizer.Load(filePath + "/Quant.dat"));
+    CHECK(m_quantizer.GetNumScores() == (size_t) m_numScores);
+  }
 
   return true;
 }
 
+void OnDiskWrapper::MapForLoad(const std::string &fileName, util::scoped_fd &fd, util::scoped_memory &mem)
+{
+  fd.reset(util::OpenReadOrThrow(fileName.c_str()));
+  const uint64_t size = util::SizeFile(fd.get());
+  // offset 0 is reserved, so every file has at least one byte
+  CHECK(size > 0);
+  util::MapRead(util::LAZY, fd.get(), 0, size, mem);
+}
+
 bool OnDiskWrapper::LoadMisc()
 {
   char line[100000];
@@ -100,7 +110,9 @@ bool OnDiskWrapper::BeginSave(const std::string &filePath
   m_numSourceFactors = numSourceFactors;
   m_numTargetFactors = numTargetFactors;
   m_numScores = numScores;
+  m_version = COMPACT_VERSION;
   m_filePath = filePath;
+  m_quantizer.Init(vector<size_t>(numScores, 0));
 
 #ifdef WIN32
   mkdir(filePath.c_str());
@@ -152,6 +164,7 @@ void OnDiskWrapper::EndSave()
   GetVocab().Save(*this);
 
   SaveMisc();
+  m_quantizer.Save(m_filePath + "/Quant.dat");
 
   m_fileMisc.close();
   m_fileVocab.close();
@@ -163,7 +176,7 @@ void OnDiskWrapper::EndSave()
 
 void OnDiskWrapper::SaveMisc()
 {
-  m_fileMisc << "Version 3" << endl;
+  m_fileMisc << "Version " << m_version << endl;
   m_fileMisc << "NumSourceFactors " << m_numSourceFactors << endl;
   m_fileMisc << "NumTargetFactors " << m_numTargetFactors << endl;
   m_fileMisc << "NumScores " << m_numScores << endl;
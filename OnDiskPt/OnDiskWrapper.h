@@ -22,20 +22,36 @@
 #include <fstream>
 #include "Vocab.h"
 #include "PhraseNode.h"
+#include "Quantizer.h"
 #include "../moses/src/Word.h"
+#include "util/file.hh"
+#include "util/mmap.hh"
 
 namespace OnDiskPt
 {
 const float DEFAULT_COUNT = 66666;
 
+// version 3 stores target words and scores at fixed width.  Version 4, the
+// one written, stores target phrases in the compact format of
+// TargetPhrase::WriteCompactToMemory()
+const UINT64 FIXED_WIDTH_VERSION = 3;
+const UINT64 COMPACT_VERSION = 4;
+
 class OnDiskWrapper
 {
 protected:
   Vocab m_vocab;
   std::string m_filePath;
   int m_numSourceFactors, m_numTargetFactors, m_numScores;
+  UINT64 m_version;
+  Quantizer m_quantizer;
   std::fstream m_fileMisc, m_fileVocab, m_fileSource, m_fileTarget, m_fileTargetInd, m_fileTargetColl;
 
+  // when loading, the node and target phrase files are mapped read-only
+  // rather than read through the fstreams, so lookups can run concurrently
+  util::scoped_fd m_fdSource, m_fdTargetInd, m_fdTargetColl;
+  util::scoped_memory m_memSource, m_memTargetInd, m_memTargetColl;
+
   size_t m_defaultNodeSize;
   PhraseNode *m_rootSourceNode;
 
@@ -43,6 +59,7 @@ protected:
 
   void SaveMisc();
   bool OpenForLoad(const std::string &filePath);
+  void MapForLoad(const std::string &fileName, util::scoped_fd &fd, util::scoped_memory &mem);
   bool LoadMisc();
 
 public:
@@ -75,6 +92,17 @@ public:
     return m_fileVocab;
   }
 
+  // views into the mapped files, only valid after BeginLoad()
+  const char *GetMemSource(UINT64 filePos) const {
+    return m_memSource.begin() + filePos;
+  }
+  const char *GetMemTargetInd(UINT64 filePos) const {
+    return m_memTargetInd.begin() + filePos;
+  }
+  const char *GetMemTargetColl(UINT64 filePos) const {
+    return m_memTargetColl.begin() + filePos;
+  }
+
   size_t GetNumSourceFactors() const {
     return m_numSourceFactors;
   }
@@ -85,6 +113,21 @@ public:
   size_t GetNumScores() const {
     return m_numScores;
   }
+
+  UINT64 GetVersion() const {
+    return m_version;
+  }
+  bool IsCompact() const {
+    return m_version >= COMPACT_VERSION;
+  }
+
+  //! score codes of the compact format. Set up before saving any phrase
+  Quantizer &GetQuantizer() {
+    return m_quantizer;
+  }
+  const Quantizer &GetQuantizer() const {
+    return m_quantizer;
+  }
   size_t GetNumCounts() const {
     return 1;
   }
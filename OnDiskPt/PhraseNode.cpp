@@ -17,6 +17,7 @@
  License along with this library; if not, write to the Free Software
  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  ***********************************************************************/
+#include <cstring>
 #include "util/check.hh"
 #include "PhraseNode.h"
 #include "OnDiskWrapper.h"
@@ -53,38 +54,24 @@ PhraseNode::PhraseNode(UINT64 filePos, OnDiskWrapper &onDiskWrapper)
 
   size_t countSize = onDiskWrapper.GetNumCounts();
 
-  std::fstream &file = onDiskWrapper.GetFileSource();
-  file.seekg(filePos);
-  CHECK(filePos == file.tellg());
-
-  file.read((char*) &m_numChildrenLoad, sizeof(UINT64));
-
-  size_t memAlloc = GetNodeSize(m_numChildrenLoad, onDiskWrapper.GetSourceWordSize(), countSize);
-  m_memLoad = (char*) malloc(memAlloc);
-
-  // go to start of node again
-  file.seekg(filePos);
-  CHECK(filePos == file.tellg());
+  m_memLoad = onDiskWrapper.GetMemSource(filePos);
+  memcpy(&m_numChildrenLoad, m_memLoad, sizeof(UINT64));
 
-  // read everything into memory
-  file.read(m_memLoad, memAlloc);
-  CHECK(filePos + memAlloc == file.tellg());
+  size_t nodeSize = GetNodeSize(m_numChildrenLoad, onDiskWrapper.GetSourceWordSize(), countSize);
 
   // get value
-  m_value = ((UINT64*)m_memLoad)[1];
+  memcpy(&m_value, m_memLoad + sizeof(UINT64), sizeof(UINT64));
 
   // get counts
-  float *memFloat = (float*) (m_memLoad + sizeof(UINT64) * 2);
-
   CHECK(countSize == 1);
-  m_counts[0] = memFloat[0];
+  memcpy(&m_counts[0], m_memLoad + sizeof(UINT64) * 2, sizeof(float));
 
-  m_memLoadLast = m_memLoad + memAlloc;
+  m_memLoadLast = m_memLoad + nodeSize;
 }
 
 PhraseNode::~PhraseNode()
 {
-  free(m_memLoad);
+  // m_memLoad points into the mapping owned by OnDiskWrapper
   //CHECK(m_saved);
 }
 
@@ -193,9 +180,33 @@ void PhraseNode::AddTargetPhrase(size_t pos, const SourcePhrase &sourcePhrase
   }
 }
 
+void PhraseNode::AddSavedNode(size_t pos, const SourcePhrase &sourcePhrase, UINT64 filePos)
+{
+  const Word &word = sourcePhrase.GetWord(pos);
+  PhraseNode &node = m_children[word];
+  CHECK(!node.Saved());
+
+  if (pos + 1 < sourcePhrase.GetSize()) {
+    node.SetPos(pos);
+    node.AddSavedNode(pos + 1, sourcePhrase, filePos);
+  } else {
+    // Save() writes the position of saved children without touching them
+    CHECK(node.GetSize() == 0);
+    node.m_filePos = filePos;
+    node.m_saved = true;
+  }
+}
+
 const PhraseNode *PhraseNode::GetChild(const Word &wordSought, OnDiskWrapper &onDiskWrapper) const
 {
-  const PhraseNode *ret = NULL;
+  UINT64 childFilePos = GetChildFilePos(wordSought, onDiskWrapper);
+  return childFilePos ? new PhraseNode(childFilePos, onDiskWrapper) : NULL;
+}
+
+UINT64 PhraseNode::GetChildFilePos(const Word &wordSought, const OnDiskWrapper &onDiskWrapper) const
+{
+  size_t wordSize = onDiskWrapper.GetSourceWordSize();
+  size_t numFactors = onDiskWrapper.GetNumSourceFactors();
 
   int l = 0;
   int r = m_numChildrenLoad - 1;
@@ -204,49 +215,35 @@ const PhraseNode *PhraseNode::GetChild(const Word &wordSought, OnDiskWrapper &on
   while (r >= l) {
     x = (l + r) / 2;
 
-    Word wordFound;
-    UINT64 childFilePos;
-    GetChild(wordFound, childFilePos, x, onDiskWrapper);
+    // compare against the mapped word without decoding it
+    const char *childMem = GetChildMem(x, onDiskWrapper);
+    int compare = wordSought.Compare(childMem, numFactors);
 
-    if (wordSought == wordFound) {
-      ret = new PhraseNode(childFilePos, onDiskWrapper);
-      break;
+    if (compare == 0) {
+      UINT64 childFilePos;
+      memcpy(&childFilePos, childMem + wordSize, sizeof(UINT64));
+      return childFilePos;
     }
-    if (wordSought < wordFound)
+    if (compare < 0)
       r = x - 1;
     else
       l = x + 1;
   }
 
-  return ret;
+  // offset 0 is reserved, so never a node
+  return 0;
 }
 
-void PhraseNode::GetChild(Word &wordFound, UINT64 &childFilePos, size_t ind, OnDiskWrapper &onDiskWrapper) const
+const char *PhraseNode::GetChildMem(size_t ind, const OnDiskWrapper &onDiskWrapper) const
 {
-
-  size_t wordSize = onDiskWrapper.GetSourceWordSize();
-  size_t childSize = wordSize + sizeof(UINT64);
-  size_t numFactors = onDiskWrapper.GetNumSourceFactors();
-
-  char *currMem = m_memLoad
-                  + sizeof(UINT64) * 2 // size & file pos of target phrase coll
-                  + sizeof(float) * onDiskWrapper.GetNumCounts() // count info
-                  + childSize * ind;
-
-  size_t memRead = ReadChild(wordFound, childFilePos, currMem, numFactors);
-  CHECK(memRead == childSize);
-}
-
-size_t PhraseNode::ReadChild(Word &wordFound, UINT64 &childFilePos, const char *mem, size_t numFactors) const
-{
-  size_t memRead = wordFound.ReadFromMemory(mem, numFactors);
-
-  const char *currMem = mem + memRead;
-  UINT64 *memArray = (UINT64*) (currMem);
-  childFilePos = memArray[0];
-
-  memRead += sizeof(UINT64);
-  return memRead;
+  size_t childSize = onDiskWrapper.GetSourceWordSize() + sizeof(UINT64);
+
+  const char *currMem = m_memLoad
+                        + sizeof(UINT64) * 2 // size & file pos of target phrase coll
+                        + sizeof(float) * onDiskWrapper.GetNumCounts() // count info
+                        + childSize * ind;
+  CHECK(currMem + childSize <= m_memLoadLast);
+  return currMem;
 }
 
 const TargetPhraseCollection *PhraseNode::GetTargetPhraseCollection(size_t tableLimit, OnDiskWrapper &onDiskWrapper) const
@@ -45,14 +45,11 @@ protected:
 
   TargetPhraseCollection m_targetPhraseColl;
 
-  char *m_memLoad, *m_memLoadLast;
+  // view of the node in the mapped source file, NULL if not loaded
+  const char *m_memLoad, *m_memLoadLast;
   UINT64 m_numChildrenLoad;
 
-  void AddTargetPhrase(size_t pos, const SourcePhrase &sourcePhrase
-                       , TargetPhrase *targetPhrase, OnDiskWrapper &onDiskWrapper
-                       , size_t tableLimit, const std::vector<float> &counts);
-  size_t ReadChild(Word &wordFound, UINT64 &childFilePos, const char *mem, size_t numFactors) const;
-  void GetChild(Word &wordFound, UINT64 &childFilePos, size_t ind, OnDiskWrapper &onDiskWrapper) const;
+  const char *GetChildMem(size_t ind, const OnDiskWrapper &onDiskWrapper) const;
 
 public:
   static size_t GetNodeSize(size_t numChildren, size_t wordSize, size_t countSize);
@@ -61,12 +58,17 @@ public:
   PhraseNode(UINT64 filePos, OnDiskWrapper &onDiskWrapper); // load saved node
   ~PhraseNode();
 
-  void Add(const Word &word, UINT64 nextFilePos, size_t wordSize);
   void Save(OnDiskWrapper &onDiskWrapper, size_t pos, size_t tableLimit);
 
   void AddTargetPhrase(const SourcePhrase &sourcePhrase, TargetPhrase *targetPhrase
                        , OnDiskWrapper &onDiskWrapper, size_t tableLimit
                        , const std::vector<float> &counts);
+  //! add below this node, which stands for the first pos words of sourcePhrase
+  void AddTargetPhrase(size_t pos, const SourcePhrase &sourcePhrase
+                       , TargetPhrase *targetPhrase, OnDiskWrapper &onDiskWrapper
+                       , size_t tableLimit, const std::vector<float> &counts);
+  //! link in a node for the words from pos on that has already been saved at filePos
+  void AddSavedNode(size_t pos, const SourcePhrase &sourcePhrase, UINT64 filePos);
 
   UINT64 GetFilePos() const {
     return m_filePos;
@@ -90,6 +92,8 @@ public:
   }
 
   const PhraseNode *GetChild(const Word &wordSought, OnDiskWrapper &onDiskWrapper) const;
+  //! file position of the child node for wordSought, 0 if there is none
+  UINT64 GetChildFilePos(const Word &wordSought, const OnDiskWrapper &onDiskWrapper) const;
   const TargetPhraseCollection *GetTargetPhraseCollection(size_t tableLimit, OnDiskWrapper &onDiskWrapper) const;
 
   void AddCounts(const std::vector<float> &counts) {
@@ -0,0 +1,194 @@
+/***********************************************************************
+ Moses - factored phrase-based, hierarchical and syntactic language decoder
+ Copyright (C) 2012 University of Edinburgh
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ ***********************************************************************/
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include "util/check.hh"
+#include "../moses/src/Util.h"
+#include "Quantizer.h"
+
+using namespace std;
+
+namespace OnDiskPt
+{
+
+namespace
+{
+
+float LogScore(float score)
+{
+  return Moses::FloorScore(Moses::TransformScore(score));
+}
+
+// upper bits of the float, mapped so that they sort like the floats do
+UINT32 HistogramKey(float score)
+{
+  UINT32 bits;
+  memcpy(&bits, &score, sizeof(bits));
+  bits = (bits & 0x80000000) ? ~bits : (bits | 0x80000000);
+  return bits >> 16;
+}
+
+}
+
+void Quantizer::Init(const std::vector<size_t> &bits)
+{
+  m_bits = bits;
+  m_centers.clear();
+  m_centers.resize(bits.size());
+  m_bounds.clear();
+  m_bounds.resize(bits.size());
+  m_histograms.clear();
+  m_histograms.resize(bits.size());
+  for (size_t ind = 0; ind < m_bits.size(); ++ind)
+    CHECK(m_bits[ind] <= MaxBits);
+}
+
+bool Quantizer::IsQuantized() const
+{
+  for (size_t ind = 0; ind < m_bits.size(); ++ind) {
+    if (m_bits[ind] > 0)
+      return true;
+  }
+  return false;
+}
+
+void Quantizer::AddScores(const std::vector<float> &scores)
+{
+  CHECK(scores.size() == m_bits.size());
+  for (size_t ind = 0; ind < scores.size(); ++ind) {
+    if (m_bits[ind] == 0)
+      continue;
+    float score = LogScore(scores[ind]);
+    Bucket &bucket = m_histograms[ind][HistogramKey(score)];
+    ++bucket.count;
+    bucket.sum += score;
+  }
+}
+
+void Quantizer::Train()
+{
+  for (size_t ind = 0; ind < m_bits.size(); ++ind) {
+    if (m_bits[ind] == 0)
+      continue;
+
+    const Histogram &histogram = m_histograms[ind];
+    size_t numBins = 1 << m_bits[ind];
+    std::vector<float> &centers = m_centers[ind];
+
+    size_t total = 0;
+    Histogram::const_iterator iter;
+    for (iter = histogram.begin(); iter != histogram.end(); ++iter)
+      total += iter->second.count;
+
+    // equal frequency bins, or one bin per bucket if there are few values
+    size_t binCount = 0, cumCount = 0;
+    double binSum = 0;
+    for (iter = histogram.begin(); iter != histogram.end(); ++iter) {
+      binCount += iter->second.count;
+      binSum += iter->second.sum;
+      cumCount += iter->second.count;
+      if (histogram.size() <= numBins
+          || (double) cumCount * numBins >= (double) total * (centers.size() + 1)) {
+        centers.push_back(binSum / binCount);
+        binCount = 0;
+        binSum = 0;
+      }
+    }
+    if (binCount > 0)
+      centers.push_back(binSum / binCount);
+    if (centers.empty())
+      centers.push_back(0);
+    CHECK(centers.size() <= numBins);
+
+    SetBounds(ind);
+    m_histograms[ind].clear();
+  }
+}
+
+void Quantizer::SetBounds(size_t ind)
+{
+  const std::vector<float> &centers = m_centers[ind];
+  std::vector<float> &bounds = m_bounds[ind];
+  bounds.clear();
+  for (size_t code = 1; code < centers.size(); ++code)
+    bounds.push_back((centers[code - 1] + centers[code]) / 2);
+}
+
+UINT32 Quantizer::Encode(size_t ind, float score) const
+{
+  UINT32 code;
+  if (m_bits[ind] == 0) {
+    memcpy(&code, &score, sizeof(code));
+  } else {
+    const std::vector<float> &bounds = m_bounds[ind];
+    code = std::upper_bound(bounds.begin(), bounds.end(), LogScore(score)) - bounds.begin();
+  }
+  return code;
+}
+
+float Quantizer::Decode(size_t ind, UINT32 code) const
+{
+  if (m_bits[ind] == 0) {
+    float score;
+    memcpy(&score, &code, sizeof(score));
+    return LogScore(score);
+  }
+  return m_centers[ind][code];
+}
+
+void Quantizer::Save(const std::string &filePath) const
+{
+  // per score: bits, number of centers, centers
+  std::fstream file(filePath.c_str(), ios::out | ios::binary | ios::trunc);
+  CHECK(file.is_open());
+  UINT64 numScores = m_bits.size();
+  file.write((const char*) &numScores, sizeof(UINT64));
+  for (size_t ind = 0; ind < m_bits.size(); ++ind) {
+    UINT64 bits = m_bits[ind], numCenters = m_centers[ind].size();
+    file.write((const char*) &bits, sizeof(UINT64));
+    file.write((const char*) &numCenters, sizeof(UINT64));
+    if (numCenters > 0)
+      file.write((const char*) &m_centers[ind][0], sizeof(float) * numCenters);
+  }
+}
+
+bool Quantizer::Load(const std::string &filePath)
+{
+  std::fstream file(filePath.c_str(), ios::in | ios::binary);
+  if (!file.is_open())
+    return false;
+
+  UINT64 numScores;
+  file.read((char*) &numScores, sizeof(UINT64));
+  Init(std::vector<size_t>(numScores, 0));
+  for (size_t ind = 0; ind < numScores; ++ind) {
+    UINT64 bits, numCenters;
+    file.read((char*) &bits, sizeof(UINT64));
+    file.read((char*) &numCenters, sizeof(UINT64));
+    m_bits[ind] = bits;
+    m_centers[ind].resize(numCenters);
+    if (numCenters > 0)
+      file.read((char*) &m_centers[ind][0], sizeof(float) * numCenters);
+    SetBounds(ind);
+  }
+  return file.good();
+}
+
+}
@@ -0,0 +1,80 @@
+#pragma once
+/***********************************************************************
+ Moses - factored phrase-based, hierarchical and syntactic language decoder
+ Copyright (C) 2012 University of Edinburgh
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ ***********************************************************************/
+#include <map>
+#include <string>
+#include <vector>
+#include "../moses/src/TypeDef.h"
+
+namespace OnDiskPt
+{
+
+/** Codes for the scores of the compact target phrase format.  Each score
+ * either keeps its 32 bit float or is quantized to a code of a few bits.
+ * Quantized scores are binned in the log domain the decoder uses, with bins
+ * of equal frequency over the scores of the whole table, and are decoded to
+ * the mean of their bin.
+ */
+class Quantizer
+{
+public:
+  //! the most bits per score, the training histograms cannot tell more values apart
+  static const size_t MaxBits = 16;
+
+  //! bits per score, 0 keeps the score as a float
+  void Init(const std::vector<size_t> &bits);
+  bool IsQuantized() const;
+
+  //! collect the raw scores of a rule before Train()
+  void AddScores(const std::vector<float> &scores);
+  void Train();
+
+  size_t GetNumScores() const {
+    return m_bits.size();
+  }
+  //! bits of the code of score ind
+  size_t GetCodeBits(size_t ind) const {
+    return m_bits[ind] ? m_bits[ind] : 32;
+  }
+
+  //! code of a raw score
+  UINT32 Encode(size_t ind, float score) const;
+  //! log score of a code, as TransformScore() and FloorScore() would give
+  float Decode(size_t ind, UINT32 code) const;
+
+  void Save(const std::string &filePath) const;
+  bool Load(const std::string &filePath);
+
+protected:
+  struct Bucket {
+    Bucket() : count(0), sum(0) {}
+    size_t count;
+    double sum;
+  };
+  typedef std::map<UINT32, Bucket> Histogram;
+
+  std::vector<size_t> m_bits;
+  std::vector<std::vector<float> > m_centers; // ascending
+  std::vector<std::vector<float> > m_bounds; // between consecutive centers
+  std::vector<Histogram> m_histograms;
+
+  void SetBounds(size_t ind);
+};
+
+}
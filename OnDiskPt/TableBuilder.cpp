@@ -0,0 +1,577 @@
+/***********************************************************************
+ Moses - factored phrase-based, hierarchical and syntactic language decoder
+ Copyright (C) 2012 University of Edinburgh
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ ***********************************************************************/
+#ifdef WIN32
+#include <direct.h>
+#else
+#include <unistd.h>
+#endif
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <queue>
+#include <boost/functional/hash.hpp>
+#include "util/check.hh"
+#include "../moses/src/InputFileStream.h"
+#include "../moses/src/ThreadPool.h"
+#include "../moses/src/Util.h"
+#include "OnDiskWrapper.h"
+#include "SourcePhrase.h"
+#include "TargetPhrase.h"
+#include "TableBuilder.h"
+#include "Main.h"
+
+using namespace std;
+
+namespace OnDiskPt
+{
+
+namespace
+{
+
+// shards per thread, so that a few large shards do not hold up the others
+const size_t ShardsPerThread = 4;
+
+// memory of a rule in a sort chunk besides its text
+const size_t RuleOverhead = 4 * sizeof(std::string) + sizeof(size_t);
+
+void MakeDir(const std::string &path)
+{
+#ifdef WIN32
+  mkdir(path.c_str());
+#else
+  mkdir(path.c_str(), 0777);
+#endif
+}
+
+void RemoveDir(const std::string &path)
+{
+#ifdef WIN32
+  _rmdir(path.c_str());
+#else
+  rmdir(path.c_str());
+#endif
+}
+
+void AddKeyWords(SourcePhrase &sourcePhrase, const std::string &key, Vocab &vocab)
+{
+  size_t begin = 0;
+  while (begin < key.size()) {
+    size_t end = key.find('\0', begin);
+    Word *word = new Word();
+    word->CreateFromString(key.substr(begin, end - begin), vocab);
+    sourcePhrase.AddWord(word);
+    begin = end + 1;
+  }
+}
+
+/** The rules of a shard in the order of their source words, and in input
+ * order among rules with the same source words.  A shard that fits in
+ * memory is sorted there, a larger one is sorted chunk by chunk into runs
+ * on disk that are merged as the rules are read.
+ */
+class SortedRules
+{
+public:
+  SortedRules(const std::string &shardPath, size_t maxBytes);
+  ~SortedRules();
+
+  bool Next(std::string &key, std::string &line);
+
+private:
+  struct Rule {
+    std::string m_key, m_line;
+  };
+
+  class RuleOrder
+  {
+    const std::vector<Rule> &m_rules;
+  public:
+    explicit RuleOrder(const std::vector<Rule> &rules)
+      :m_rules(rules)
+    {}
+    bool operator()(size_t a, size_t b) const {
+      return m_rules[a].m_key < m_rules[b].m_key;
+    }
+  };
+
+  // next rule of a run
+  struct Head {
+    std::string m_key, m_line;
+    size_t m_run;
+
+    // for a min-heap. Earlier runs hold earlier input, so they win ties
+    bool operator<(const Head &other) const {
+      int compare = m_key.compare(other.m_key);
+      return compare != 0 ? compare > 0 : m_run > other.m_run;
+    }
+  };
+
+  std::vector<Rule> m_rules;
+  std::vector<size_t> m_order;
+  size_t m_next;
+
+  std::vector<std::string> m_runPaths;
+  std::vector<std::ifstream*> m_runs;
+  std::priority_queue<Head> m_heads;
+
+  bool ReadChunk(std::istream &in, size_t maxBytes);
+  void SortChunk();
+  void ReadHead(size_t run);
+};
+
+SortedRules::SortedRules(const std::string &shardPath, size_t maxBytes)
+  :m_next(0)
+{
+  std::ifstream in(shardPath.c_str());
+  CHECK(in.is_open());
+
+  bool more = ReadChunk(in, maxBytes);
+  SortChunk();
+  if (!more)
+    return;
+
+  // external sort
+  while (!m_rules.empty()) {
+    std::string runPath = shardPath + ".run." + Moses::SPrint(m_runPaths.size());
+    std::ofstream run(runPath.c_str());
+    CHECK(run.is_open());
+    for (size_t ind = 0; ind < m_order.size(); ++ind)
+      run << m_rules[m_order[ind]].m_line << '\n';
+    run.close();
+    CHECK(!run.fail());
+    m_runPaths.push_back(runPath);
+
+    ReadChunk(in, maxBytes);
+    SortChunk();
+  }
+
+  for (size_t run = 0; run < m_runPaths.size(); ++run) {
+    m_runs.push_back(new std::ifstream(m_runPaths[run].c_str()));
+    CHECK(m_runs.back()->is_open());
+    ReadHead(run);
+  }
+}
+
+SortedRules::~SortedRules()
+{
+  Moses::RemoveAllInColl(m_runs);
+  for (size_t run = 0; run < m_runPaths.size(); ++run)
+    remove(m_runPaths[run].c_str());
+}
+
+bool SortedRules::ReadChunk(std::istream &in, size_t maxBytes)
+{
+  m_rules.clear();
+  size_t bytes = 0;
+  std::string line;
+  // at least one rule per chunk, however little memory there is
+  while (bytes < maxBytes || m_rules.empty()) {
+    if (!getline(in, line))
+      return false;
+    m_rules.push_back(Rule());
+    Rule &rule = m_rules.back();
+    rule.m_key = TableBuilder::GetSourceKey(line);
+    rule.m_line.swap(line);
+    bytes += rule.m_key.size() + rule.m_line.size() + RuleOverhead;
+  }
+  return true;
+}
+
+void SortedRules::SortChunk()
+{
+  m_order.resize(m_rules.size());
+  for (size_t ind = 0; ind < m_order.size(); ++ind)
+    m_order[ind] = ind;
+  std::stable_sort(m_order.begin(), m_order.end(), RuleOrder(m_rules));
+  m_next = 0;
+}
+
+void SortedRules::ReadHead(size_t run)
+{
+  Head head;
+  if (!getline(*m_runs[run], head.m_line))
+    return;
+  head.m_key = TableBuilder::GetSourceKey(head.m_line);
+  head.m_run = run;
+  m_heads.push(head);
+}
+
+bool SortedRules::Next(std::string &key, std::string &line)
+{
+  if (m_runs.empty()) {
+    if (m_next == m_order.size())
+      return false;
+    Rule &rule = m_rules[m_order[m_next++]];
+    key.swap(rule.m_key);
+    line.swap(rule.m_line);
+    return true;
+  }
+
+  if (m_heads.empty())
+    return false;
+  const Head &head = m_heads.top();
+  key = head.m_key;
+  line = head.m_line;
+  size_t run = head.m_run;
+  m_heads.pop();
+  ReadHead(run);
+  return true;
+}
+
+class BuildPartTask : public Moses::Task
+{
+public:
+  BuildPartTask(TableBuilder &builder, size_t shardInd)
+    :m_builder(builder)
+    ,m_shardInd(shardInd)
+  {}
+
+  void Run() {
+    m_builder.BuildPart(m_shardInd);
+  }
+
+private:
+  TableBuilder &m_builder;
+  size_t m_shardInd;
+};
+
+}
+
+TableBuilder::TableBuilder(OnDiskWrapper &onDiskWrapper, const std::string &tempPath
+                           , size_t numThreads, size_t maxBytes, size_t tableLimit)
+  :m_onDiskWrapper(onDiskWrapper)
+  ,m_tempPath(tempPath)
+  ,m_numThreads(std::max(numThreads, (size_t) 1))
+  ,m_tableLimit(tableLimit)
+{
+  m_maxBytes = maxBytes / m_numThreads;
+  m_numShards = m_numThreads * ShardsPerThread;
+  m_groups.resize(m_numShards);
+}
+
+std::string TableBuilder::GetShardPath(size_t shardInd) const
+{
+  return m_tempPath + "/shard." + Moses::SPrint(shardInd);
+}
+
+std::string TableBuilder::GetPartPath(size_t shardInd) const
+{
+  return m_tempPath + "/part." + Moses::SPrint(shardInd);
+}
+
+std::string TableBuilder::GetSourceKey(const std::string &line)
+{
+  std::string key;
+  std::vector<std::string> words;
+  size_t begin = 0;
+  while (begin < line.size()) {
+    size_t end = line.find(' ', begin);
+    if (end == std::string::npos)
+      end = line.size();
+    if (end > begin) {
+      std::string tok = line.substr(begin, end - begin);
+      if (tok == "|||")
+        break;
+      SplitWords(words, tok, true, true);
+    }
+    begin = end + 1;
+  }
+
+  for (size_t ind = 0; ind < words.size(); ++ind) {
+    key += words[ind];
+    key += '\0';
+  }
+  return key;
+}
+
+size_t TableBuilder::GetPrefixLength(const std::string &key, size_t numWords)
+{
+  size_t length = 0;
+  for (size_t ind = 0; ind < numWords && length < key.size(); ++ind)
+    length = key.find('\0', length) + 1;
+  return length;
+}
+
+void TableBuilder::Build(const std::string &filePath)
+{
+  MakeDir(m_tempPath);
+
+  WriteShards(filePath);
+  Moses::PrintUserTime("Wrote shards");
+
+  BuildParts();
+  Moses::PrintUserTime("Built parts");
+
+  MergeParts();
+  RemoveDir(m_tempPath);
+}
+
+void TableBuilder::WriteShards(const std::string &filePath)
+{
+  std::vector<std::ofstream*> shards(m_numShards);
+  for (size_t shardInd = 0; shardInd < m_numShards; ++shardInd) {
+    shards[shardInd] = new std::ofstream(GetShardPath(shardInd).c_str());
+    CHECK(shards[shardInd]->is_open());
+  }
+
+  Vocab &vocab = m_onDiskWrapper.GetVocab();
+  Quantizer &quantizer = m_onDiskWrapper.GetQuantizer();
+  bool quantize = quantizer.IsQuantized();
+  boost::hash<std::string> hasher;
+
+  Moses::InputFileStream inStream(filePath);
+  std::string line;
+  std::vector<std::string> toks, words;
+  std::vector<float> scores;
+  size_t lineNum = 0;
+  while (getline(inStream, line)) {
+    lineNum++;
+    if (lineNum%1000 == 0) cerr << "." << flush;
+    if (lineNum%10000 == 0) cerr << ":" << flush;
+    if (lineNum%100000 == 0) cerr << lineNum << flush;
+
+    // words get their ids in the order a sequential build would give them
+    toks.clear();
+    Moses::Tokenize(toks, line, " ");
+    std::string key;
+    size_t stage = 0, numSourceWords = 0;
+    for (size_t tokInd = 0; tokInd < toks.size() && stage < 3; ++tokInd) {
+      const std::string &tok = toks[tokInd];
+      if (tok == "|||") {
+        ++stage;
+        continue;
+      }
+
+      words.clear();
+      switch (stage) {
+      case 0:
+        SplitWords(words, tok, true, true);
+        for (size_t ind = 0; ind < words.size(); ++ind) {
+          vocab.AddVocabId(words[ind]);
+          if (numSourceWords++ < 2) {
+            key += words[ind];
+            key += '\0';
+          }
+        }
+        break;
+      case 1:
+        SplitWords(words, tok, false, true);
+        for (size_t ind = 0; ind < words.size(); ++ind)
+          vocab.AddVocabId(words[ind]);
+        break;
+      case 2:
+        if (quantize)
+          scores.push_back(Moses::Scan<float>(tok));
+        break;
+      }
+    }
+
+    if (numSourceWords < 2) {
+      cerr << endl << "Rule on line " << lineNum << " has less than 2 source words, left hand side included" << endl;
+      exit(1);
+    }
+    if (quantize) {
+      quantizer.AddScores(scores);
+      scores.clear();
+    }
+
+    std::ofstream &shard = *shards[hasher(key) % m_numShards];
+    shard << line << '\n';
+  }
+  cerr << endl;
+
+  for (size_t shardInd = 0; shardInd < m_numShards; ++shardInd) {
+    shards[shardInd]->close();
+    CHECK(!shards[shardInd]->fail());
+  }
+  Moses::RemoveAllInColl(shards);
+
+  if (quantize)
+    quantizer.Train();
+}
+
+void TableBuilder::BuildParts()
+{
+#ifdef WITH_THREADS
+  if (m_numThreads > 1) {
+    Moses::ThreadPool pool(m_numThreads);
+    for (size_t shardInd = 0; shardInd < m_numShards; ++shardInd)
+      pool.Submit(new BuildPartTask(*this, shardInd));
+    pool.Stop(true);
+    return;
+  }
+#endif
+  for (size_t shardInd = 0; shardInd < m_numShards; ++shardInd)
+    BuildPart(shardInd);
+}
+
+void TableBuilder::BuildPart(size_t shardInd)
+{
+  std::string shardPath = GetShardPath(shardInd);
+  std::vector<Group> &groups = m_groups[shardInd];
+  size_t numScores = m_onDiskWrapper.GetNumScores();
+
+  {
+    SortedRules rules(shardPath, m_maxBytes);
+
+    OnDiskWrapper part;
+    bool retDb = part.BeginSave(GetPartPath(shardInd), m_onDiskWrapper.GetNumSourceFactors()
+                                , m_onDiskWrapper.GetNumTargetFactors(), numScores);
+    CHECK(retDb);
+    part.GetQuantizer() = m_onDiskWrapper.GetQuantizer();
+
+    // one subtrie at a time, below the node of its first two words
+    PhraseNode *groupNode = NULL;
+    std::string key, line;
+    while (rules.Next(key, line)) {
+      key.resize(GetPrefixLength(key, 2));
+      if (groupNode && key != groups.back().m_key) {
+        groupNode->Save(part, 2, m_tableLimit);
+        groups.back().m_filePos = groupNode->GetFilePos();
+        delete groupNode;
+        groupNode = NULL;
+      }
+      if (groupNode == NULL) {
+        groupNode = new PhraseNode();
+        groups.push_back(Group());
+        groups.back().m_key = key;
+      }
+
+      // all words are in the vocab already, so looking them up is read-only
+      std::vector<float> misc(1);
+      SourcePhrase sourcePhrase;
+      TargetPhrase *targetPhrase = new TargetPhrase(numScores);
+      Tokenize(sourcePhrase, *targetPhrase, line, m_onDiskWrapper, numScores, misc);
+      CHECK(misc.size() == part.GetNumCounts());
+
+      groupNode->AddTargetPhrase(2, sourcePhrase, targetPhrase, part, m_tableLimit, misc);
+    }
+
+    if (groupNode) {
+      groupNode->Save(part, 2, m_tableLimit);
+      groups.back().m_filePos = groupNode->GetFilePos();
+      delete groupNode;
+    }
+  }
+
+  remove(shardPath.c_str());
+}
+
+void TableBuilder::MergeParts()
+{
+  PhraseNode &rootNode = m_onDiskWrapper.GetRootSourceNode();
+
+  for (size_t shardInd = 0; shardInd < m_numShards; ++shardInd) {
+    std::string partPath = GetPartPath(shardInd);
+    UINT64 collOffset = AppendTargetColl(partPath);
+    UINT64 sourceOffset = AppendSource(partPath, collOffset);
+    RemovePart(partPath);
+
+    const std::vector<Group> &groups = m_groups[shardInd];
+    for (size_t groupInd = 0; groupInd < groups.size(); ++groupInd) {
+      const Group &group = groups[groupInd];
+      SourcePhrase sourcePhrase;
+      AddKeyWords(sourcePhrase, group.m_key, m_onDiskWrapper.GetVocab());
+      rootNode.AddSavedNode(0, sourcePhrase, group.m_filePos + sourceOffset);
+    }
+    m_groups[shardInd].clear();
+  }
+
+  rootNode.Save(m_onDiskWrapper, 0, m_tableLimit);
+}
+
+UINT64 TableBuilder::AppendTargetColl(const std::string &partPath)
+{
+  std::fstream &file = m_onDiskWrapper.GetFileTargetColl();
+  file.seekp(0, ios::end);
+  // the part starts with its reserved byte too
+  UINT64 offset = (UINT64) file.tellp() - 1;
+
+  std::ifstream part((partPath + "/TargetColl.dat").c_str(), ios::in | ios::binary);
+  CHECK(part.is_open());
+  part.seekg(1);
+
+  // collections hold no file positions, so they are copied as they are
+  std::vector<char> buffer(1 << 20);
+  while (part) {
+    part.read(&buffer[0], buffer.size());
+    file.write(&buffer[0], part.gcount());
+  }
+  CHECK(!file.fail());
+  return offset;
+}
+
+UINT64 TableBuilder::AppendSource(const std::string &partPath, UINT64 collOffset)
+{
+  std::fstream &file = m_onDiskWrapper.GetFileSource();
+  file.seekp(0, ios::end);
+  UINT64 offset = (UINT64) file.tellp() - 1;
+
+  std::ifstream part((partPath + "/Source.dat").c_str(), ios::in | ios::binary);
+  CHECK(part.is_open());
+  part.seekg(1);
+
+  // nodes as written by PhraseNode::Save(), with the positions of their
+  // target phrases and children moved to where the part ends up
+  size_t wordSize = m_onDiskWrapper.GetSourceWordSize();
+  size_t numCounts = m_onDiskWrapper.GetNumCounts();
+  size_t headerSize = PhraseNode::GetNodeSize(0, wordSize, numCounts);
+  std::vector<char> mem;
+  UINT64 numChildren, value, childFilePos;
+  while (true) {
+    mem.resize(headerSize);
+    if (!part.read(&mem[0], headerSize))
+      break;
+    memcpy(&numChildren, &mem[0], sizeof(UINT64));
+    memcpy(&value, &mem[sizeof(UINT64)], sizeof(UINT64));
+    if (value)
+      value += collOffset;
+    memcpy(&mem[sizeof(UINT64)], &value, sizeof(UINT64));
+
+    mem.resize(PhraseNode::GetNodeSize(numChildren, wordSize, numCounts));
+    if (numChildren) {
+      CHECK(part.read(&mem[headerSize], mem.size() - headerSize));
+      for (size_t ind = 0; ind < numChildren; ++ind) {
+        char *childMem = &mem[headerSize + (wordSize + sizeof(UINT64)) * ind + wordSize];
+        memcpy(&childFilePos, childMem, sizeof(UINT64));
+        childFilePos += offset;
+        memcpy(childMem, &childFilePos, sizeof(UINT64));
+      }
+    }
+
+    file.write(&mem[0], mem.size());
+  }
+  CHECK(part.eof() && part.gcount() == 0);
+  CHECK(!file.fail());
+  return offset;
+}
+
+void TableBuilder::RemovePart(const std::string &partPath)
+{
+  const char *fileNames[] = { "Source.dat", "TargetInd.dat", "TargetColl.dat", "Vocab.dat", "Misc.dat" };
+  for (size_t ind = 0; ind < sizeof(fileNames) / sizeof(fileNames[0]); ++ind)
+    remove((partPath + "/" + fileNames[ind]).c_str());
+  RemoveDir(partPath);
+}
+
+}
@@ -0,0 +1,84 @@
+#pragma once
+/***********************************************************************
+ Moses - factored phrase-based, hierarchical and syntactic language decoder
+ Copyright (C) 2012 University of Edinburgh
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ ***********************************************************************/
+#include <string>
+#include <vector>
+#include "../moses/src/TypeDef.h"
+
+namespace OnDiskPt
+{
+
+class OnDiskWrapper;
+
+/** Builds an on-disk rule table from rules in any order.
+ *
+ * The rules are split into shards by their first two source words, so that
+ * every subtrie below depth 2 lies in one shard.  Each shard is sorted with
+ * bounded memory, spilling sorted runs to disk and merging them if it does
+ * not fit, and built into files of its own, several shards in parallel.  The
+ * part files are then appended to the table, with their file positions
+ * moved, and the nodes of depth 0 and 1 are written on top of them.
+ *
+ * The vocabulary and the score codes are set up in the single pass that
+ * writes the shards, so ids come out as in a sequential build and the
+ * workers only look words up.
+ */
+class TableBuilder
+{
+public:
+  //! onDiskWrapper after BeginSave(). maxBytes of rules are sorted in memory, over all threads
+  TableBuilder(OnDiskWrapper &onDiskWrapper, const std::string &tempPath
+               , size_t numThreads, size_t maxBytes, size_t tableLimit);
+
+  //! build the table from the rules in filePath. Call EndSave() afterwards
+  void Build(const std::string &filePath);
+
+  //! sort one shard and save its subtries into a part, run by the worker threads
+  void BuildPart(size_t shardInd);
+
+  //! source words of a rule, each followed by '\0', so that keys sort like word sequences
+  static std::string GetSourceKey(const std::string &line);
+  //! length of the prefix of key holding the first numWords words
+  static size_t GetPrefixLength(const std::string &key, size_t numWords);
+
+protected:
+  //! saved subtrie of the rules starting with the same two source words
+  struct Group {
+    std::string m_key; // the two words, as by GetSourceKey()
+    UINT64 m_filePos; // in the Source.dat of the part
+  };
+
+  OnDiskWrapper &m_onDiskWrapper;
+  std::string m_tempPath;
+  size_t m_numThreads, m_maxBytes, m_tableLimit, m_numShards;
+  std::vector<std::vector<Group> > m_groups; // by shard
+
+  std::string GetShardPath(size_t shardInd) const;
+  std::string GetPartPath(size_t shardInd) const;
+
+  void WriteShards(const std::string &filePath);
+  void BuildParts();
+  void MergeParts();
+
+  UINT64 AppendTargetColl(const std::string &partPath);
+  UINT64 AppendSource(const std::string &partPath, UINT64 collOffset);
+  void RemovePart(const std::string &partPath);
+};
+
+}
@@ -19,6 +19,7 @@
  ***********************************************************************/
 
 #include <algorithm>
+#include <cstring>
 #include <iostream>
 #include "../moses/src/Util.h"
 #include "../moses/src/TargetPhrase.h"
@@ -26,6 +27,7 @@
 #include "../moses/src/DummyScoreProducers.h"
 #include "TargetPhrase.h"
 #include "OnDiskWrapper.h"
+#include "CompactCoding.h"
 
 using namespace std;
 
@@ -34,6 +36,7 @@ namespace OnDiskPt
 
 TargetPhrase::TargetPhrase(size_t numScores)
   :m_scores(numScores)
+  ,m_filePos(0)
 {
 }
 
@@ -80,117 +83,33 @@ void TargetPhrase::SortAlign()
   std::sort(m_align.begin(), m_align.end(), AlignOrderer());
 }
 
-char *TargetPhrase::WriteToMemory(OnDiskWrapper &onDiskWrapper, size_t &memUsed) const
+void TargetPhrase::WriteCompactToMemory(std::string &out, const OnDiskWrapper &onDiskWrapper) const
 {
-  size_t phraseSize = GetSize();
-  size_t targetWordSize = onDiskWrapper.GetTargetWordSize();
-
-  size_t memNeeded = sizeof(UINT64)						// num of words
-                     + targetWordSize * phraseSize;	// actual words. lhs as last words
-  memUsed = 0;
-  UINT64 *mem = (UINT64*) malloc(memNeeded);
-
-  // write size
-  mem[0] = phraseSize;
-  memUsed += sizeof(UINT64);
-
-  // write each word
-  for (size_t pos = 0; pos < phraseSize; ++pos) {
-    const Word &word = GetWord(pos);
-    char *currPtr = (char*)mem + memUsed;
-    memUsed += word.WriteToMemory((char*) currPtr);
-  }
-
-  CHECK(memUsed == memNeeded);
-  return (char *) mem;
-}
-
-void TargetPhrase::Save(OnDiskWrapper &onDiskWrapper)
-{
-  // save in target ind
-  size_t memUsed;
-  char *mem = WriteToMemory(onDiskWrapper, memUsed);
-
-  std::fstream &file = onDiskWrapper.GetFileTargetInd();
-
-  UINT64 startPos = file.tellp();
-
-  file.seekp(0, ios::end);
-  file.write(mem, memUsed);
-
-  UINT64 endPos = file.tellp();
-  CHECK(startPos + memUsed == endPos);
-
-  m_filePos = startPos;
-  free(mem);
-}
-
-char *TargetPhrase::WriteOtherInfoToMemory(OnDiskWrapper &onDiskWrapper, size_t &memUsed) const
-{
-  // allocate mem
-  size_t numScores = onDiskWrapper.GetNumScores()
-                     ,numAlign = GetAlign().size();
-
-  size_t memNeeded = sizeof(UINT64); // file pos (phrase id)
-  memNeeded += sizeof(UINT64) + 2 * sizeof(UINT64) * numAlign; // align
-  memNeeded += sizeof(float) * numScores; // scores
-
-  char *mem = (char*) malloc(memNeeded);
-  //memset(mem, 0, memNeeded);
-
-  memUsed = 0;
-
-  // phrase id
-  memcpy(mem, &m_filePos, sizeof(UINT64));
-  memUsed += sizeof(UINT64);
-
-  // align
-  memUsed += WriteAlignToMemory(mem + memUsed);
-
-  // scores
-  memUsed += WriteScoresToMemory(mem + memUsed);
-
-  //DebugMem(mem, memNeeded);
-  CHECK(memNeeded == memUsed);
-  return mem;
-}
-
-size_t TargetPhrase::WriteAlignToMemory(char *mem) const
-{
-  size_t memUsed = 0;
-
-  // num of alignments
-  UINT64 numAlign = m_align.size();
-  memcpy(mem, &numAlign, sizeof(numAlign));
-  memUsed += sizeof(numAlign);
-
-  // actual alignments
+  // words. lhs as last word
+  WriteVarint(out, GetSize());
+  for (size_t pos = 0; pos < GetSize(); ++pos)
+    GetWord(pos).WriteCompactToMemory(out);
+
+  // align. sorted by source position, which is delta coded
+  WriteVarint(out, m_align.size());
+  UINT64 prevSourcePos = 0;
   AlignType::const_iterator iter;
   for (iter = m_align.begin(); iter != m_align.end(); ++iter) {
-    const AlignPair &alignPair = *iter;
-
-    memcpy(mem + memUsed, &alignPair.first, sizeof(alignPair.first));
-    memUsed += sizeof(alignPair.first);
-
-    memcpy(mem + memUsed, &alignPair.second, sizeof(alignPair.second));
-    memUsed += sizeof(alignPair.second);
+    CHECK(iter->first >= prevSourcePos);
+    WriteVarint(out, iter->first - prevSourcePos);
+    WriteVarint(out, iter->second);
+    prevSourcePos = iter->first;
   }
 
-  return memUsed;
-}
-
-size_t TargetPhrase::WriteScoresToMemory(char *mem) const
-{
-  float *scoreMem = (float*) mem;
-
+  // scores
+  const Quantizer &quantizer = onDiskWrapper.GetQuantizer();
+  CHECK(quantizer.GetNumScores() == m_scores.size());
+  BitWriter bitWriter(out);
   for (size_t ind = 0; ind < m_scores.size(); ++ind)
-    scoreMem[ind] = m_scores[ind];
-
-  size_t memUsed = sizeof(float) * m_scores.size();
-  return memUsed;
+    bitWriter.Write(quantizer.Encode(ind, m_scores[ind]), quantizer.GetCodeBits(ind));
+  bitWriter.Flush();
 }
 
-
 Moses::TargetPhrase *TargetPhrase::ConvertToMoses(const std::vector<Moses::FactorType> & /*inputFactors */
     , const std::vector<Moses::FactorType> &outputFactors
     , const Vocab &vocab
@@ -230,55 +149,82 @@ Moses::TargetPhrase *TargetPhrase::ConvertToMoses(const std::vector<Moses::Facto
   return ret;
 }
 
-UINT64 TargetPhrase::ReadOtherInfoFromFile(UINT64 filePos, std::fstream &fileTPColl)
+UINT64 TargetPhrase::ReadCompactFromMemory(const char *mem, const OnDiskWrapper &onDiskWrapper)
 {
-  CHECK(filePos == fileTPColl.tellg());
+  const char *currMem = mem;
+  size_t numFactors = onDiskWrapper.GetNumTargetFactors();
 
+  // words
+  UINT64 numWords = ReadVarint(currMem);
+  for (size_t ind = 0; ind < numWords; ++ind) {
+    Word *word = new Word();
+    currMem += word->ReadCompactFromMemory(currMem, numFactors);
+    AddWord(word);
+  }
+
+  // align
+  UINT64 numAlign = ReadVarint(currMem);
+  m_align.reserve(numAlign);
+  UINT64 sourcePos = 0;
+  for (size_t ind = 0; ind < numAlign; ++ind) {
+    sourcePos += ReadVarint(currMem);
+    UINT64 targetPos = ReadVarint(currMem);
+    m_align.push_back(AlignPair(sourcePos, targetPos));
+  }
+
+  // scores, already transformed and floored
+  const Quantizer &quantizer = onDiskWrapper.GetQuantizer();
+  BitReader bitReader(currMem);
+  for (size_t ind = 0; ind < m_scores.size(); ++ind)
+    m_scores[ind] = quantizer.Decode(ind, bitReader.Read(quantizer.GetCodeBits(ind)));
+  currMem += bitReader.GetBytesRead();
+
+  return currMem - mem;
+}
+
+UINT64 TargetPhrase::ReadOtherInfoFromMemory(const char *mem)
+{
   UINT64 memUsed = 0;
-  fileTPColl.read((char*) &m_filePos, sizeof(UINT64));
+  memcpy(&m_filePos, mem, sizeof(UINT64));
   memUsed += sizeof(UINT64);
   CHECK(m_filePos != 0);
 
-  memUsed += ReadAlignFromFile(fileTPColl);
-  CHECK((memUsed + filePos) == fileTPColl.tellg());
-
-  memUsed += ReadScoresFromFile(fileTPColl);
-  CHECK((memUsed + filePos) == fileTPColl.tellg());
+  memUsed += ReadAlignFromMemory(mem + memUsed);
+  memUsed += ReadScoresFromMemory(mem + memUsed);
 
   return memUsed;
 }
 
-UINT64 TargetPhrase::ReadFromFile(std::fstream &fileTP, size_t numFactors)
+UINT64 TargetPhrase::ReadFromMemory(const char *mem, size_t numFactors)
 {
   UINT64 bytesRead = 0;
 
-  fileTP.seekg(m_filePos);
-
   UINT64 numWords;
-  fileTP.read((char*) &numWords, sizeof(UINT64));
+  memcpy(&numWords, mem, sizeof(UINT64));
   bytesRead += sizeof(UINT64);
 
   for (size_t ind = 0; ind < numWords; ++ind) {
     Word *word = new Word();
-    bytesRead += word->ReadFromFile(fileTP, numFactors);
+    bytesRead += word->ReadFromMemory(mem + bytesRead, numFactors);
     AddWord(word);
   }
 
   return bytesRead;
 }
 
-UINT64 TargetPhrase::ReadAlignFromFile(std::fstream &fileTPColl)
+UINT64 TargetPhrase::ReadAlignFromMemory(const char *mem)
 {
   UINT64 bytesRead = 0;
 
   UINT64 numAlign;
-  fileTPColl.read((char*) &numAlign, sizeof(UINT64));
+  memcpy(&numAlign, mem, sizeof(UINT64));
   bytesRead += sizeof(UINT64);
 
+  m_align.reserve(numAlign);
   for (size_t ind = 0; ind < numAlign; ++ind) {
     AlignPair alignPair;
-    fileTPColl.read((char*) &alignPair.first, sizeof(UINT64));
-    fileTPColl.read((char*) &alignPair.second, sizeof(UINT64));
+    memcpy(&alignPair.first, mem + bytesRead, sizeof(UINT64));
+    memcpy(&alignPair.second, mem + bytesRead + sizeof(UINT64), sizeof(UINT64));
     m_align.push_back(alignPair);
 
     bytesRead += sizeof(UINT64) * 2;
@@ -287,17 +233,12 @@ UINT64 TargetPhrase::ReadAlignFromFile(std::fstream &fileTPColl)
   return bytesRead;
 }
 
-UINT64 TargetPhrase::ReadScoresFromFile(std::fstream &fileTPColl)
+UINT64 TargetPhrase::ReadScoresFromMemory(const char *mem)
 {
   CHECK(m_scores.size() > 0);
 
-  UINT64 bytesRead = 0;
-
-  for (size_t ind = 0; ind < m_scores.size(); ++ind) {
-    fileTPColl.read((char*) &m_scores[ind], sizeof(float));
-
-    bytesRead += sizeof(float);
-  }
+  UINT64 bytesRead = sizeof(float) * m_scores.size();
+  memcpy(&m_scores[0], mem, bytesRead);
 
   std::transform(m_scores.begin(),m_scores.end(),m_scores.begin(), Moses::TransformScore);
   std::transform(m_scores.begin(),m_scores.end(),m_scores.begin(), Moses::FloorScore);
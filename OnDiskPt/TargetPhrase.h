@@ -49,11 +49,8 @@ protected:
   std::vector<float>	m_scores;
   UINT64 m_filePos;
 
-  size_t WriteAlignToMemory(char *mem) const;
-  size_t WriteScoresToMemory(char *mem) const;
-
-  UINT64 ReadAlignFromFile(std::fstream &fileTPColl);
-  UINT64 ReadScoresFromFile(std::fstream &fileTPColl);
+  UINT64 ReadAlignFromMemory(const char *mem);
+  UINT64 ReadScoresFromMemory(const char *mem);
 
 public:
   TargetPhrase(size_t numScores);
@@ -70,9 +67,10 @@ public:
   }
   void SortAlign();
 
-  char *WriteToMemory(OnDiskWrapper &onDiskWrapper, size_t &memUsed) const;
-  char *WriteOtherInfoToMemory(OnDiskWrapper &onDiskWrapper, size_t &memUsed) const;
-  void Save(OnDiskWrapper &onDiskWrapper);
+  // compact (version 4) format: the words, alignments and score codes
+  // of a target phrase together in the collection file
+  void WriteCompactToMemory(std::string &out, const OnDiskWrapper &onDiskWrapper) const;
+  UINT64 ReadCompactFromMemory(const char *mem, const OnDiskWrapper &onDiskWrapper);
 
   UINT64 GetFilePos() const {
     return m_filePos;
@@ -88,8 +86,9 @@ public:
                                       , const std::vector<float> &weightT
                                       , const Moses::WordPenaltyProducer* wpProducer
                                       , const Moses::LMList &lmList) const;
-  UINT64 ReadOtherInfoFromFile(UINT64 filePos, std::fstream &fileTPColl);
-  UINT64 ReadFromFile(std::fstream &fileTP, size_t numFactors);
+  // fixed width (version 3) format: words in the target file, the rest in the collection file
+  UINT64 ReadOtherInfoFromMemory(const char *mem);
+  UINT64 ReadFromMemory(const char *mem, size_t numFactors);
 
 };
 
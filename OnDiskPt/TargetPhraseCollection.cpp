@@ -19,6 +19,7 @@
  ***********************************************************************/
 
 #include <algorithm>
+#include <cstring>
 #include <iostream>
 #include "../moses/src/Util.h"
 #include "../moses/src/TargetPhraseCollection.h"
@@ -26,6 +27,7 @@
 #include "TargetPhraseCollection.h"
 #include "Vocab.h"
 #include "OnDiskWrapper.h"
+#include "CompactCoding.h"
 
 using namespace std;
 
@@ -71,43 +73,24 @@ void TargetPhraseCollection::Save(OnDiskWrapper &onDiskWrapper)
 {
   std::fstream &file = onDiskWrapper.GetFileTargetColl();
 
-  size_t memUsed = sizeof(UINT64);
-  char *mem = (char*) malloc(memUsed);
+  std::string mem;
 
   // size of coll
-  UINT64 numPhrases = GetSize();
-  ((UINT64*)mem)[0] = numPhrases;
+  WriteVarint(mem, GetSize());
 
   // MAIN LOOP
   CollType::iterator iter;
   for (iter = m_coll.begin(); iter != m_coll.end(); ++iter) {
-    // save phrase
-    TargetPhrase &targetPhrase = **iter;
-    targetPhrase.Save(onDiskWrapper);
-
-    // save coll
-    size_t memUsedTPOtherInfo;
-    char *memTPOtherInfo = targetPhrase.WriteOtherInfoToMemory(onDiskWrapper, memUsedTPOtherInfo);
-
-    // expand existing mem
-    mem = (char*) realloc(mem, memUsed + memUsedTPOtherInfo);
-    memcpy(mem + memUsed, memTPOtherInfo, memUsedTPOtherInfo);
-    memUsed += memUsedTPOtherInfo;
-
-    free(memTPOtherInfo);
+    const TargetPhrase &targetPhrase = **iter;
+    targetPhrase.WriteCompactToMemory(mem, onDiskWrapper);
   }
 
-  // total number of bytes
-  //((UINT64*)mem)[0] = (UINT64) memUsed;
-
   UINT64 startPos = file.tellp();
   file.seekp(0, ios::end);
-  file.write((char*) mem, memUsed);
-
-  free(mem);
+  file.write(mem.data(), mem.size());
 
   UINT64 endPos = file.tellp();
-  CHECK(startPos + memUsed == endPos);
+  CHECK(startPos + mem.size() == endPos);
 
   m_filePos = startPos;
 
@@ -152,30 +135,33 @@ Moses::TargetPhraseCollection *TargetPhraseCollection::ConvertToMoses(const std:
 
 void TargetPhraseCollection::ReadFromFile(size_t tableLimit, UINT64 filePos, OnDiskWrapper &onDiskWrapper)
 {
-  fstream &fileTPColl = onDiskWrapper.GetFileTargetColl();
-  fstream &fileTP = onDiskWrapper.GetFileTargetInd();
+  const char *mem = onDiskWrapper.GetMemTargetColl(filePos);
 
   size_t numScores = onDiskWrapper.GetNumScores();
   size_t numTargetFactors = onDiskWrapper.GetNumTargetFactors();
+  bool compact = onDiskWrapper.IsCompact();
 
   UINT64 numPhrases;
-
-  UINT64 currFilePos = filePos;
-  fileTPColl.seekg(filePos);
-  fileTPColl.read((char*) &numPhrases, sizeof(UINT64));
+  if (compact) {
+    numPhrases = ReadVarint(mem);
+  } else {
+    memcpy(&numPhrases, mem, sizeof(UINT64));
+    mem += sizeof(UINT64);
+  }
 
   // table limit
   numPhrases = std::min(numPhrases, (UINT64) tableLimit);
 
-  currFilePos += sizeof(UINT64);
-
+  m_coll.reserve(numPhrases);
   for (size_t ind = 0; ind < numPhrases; ++ind) {
     TargetPhrase *tp = new TargetPhrase(numScores);
 
-    UINT64 sizeOtherInfo = tp->ReadOtherInfoFromFile(currFilePos, fileTPColl);
-    tp->ReadFromFile(fileTP, numTargetFactors);
-
-    currFilePos += sizeOtherInfo;
+    if (compact) {
+      mem += tp->ReadCompactFromMemory(mem, onDiskWrapper);
+    } else {
+      mem += tp->ReadOtherInfoFromMemory(mem);
+      tp->ReadFromMemory(onDiskWrapper.GetMemTargetInd(tp->GetFilePos()), numTargetFactors);
+    }
 
     m_coll.push_back(tp);
   }
@@ -32,26 +32,20 @@ bool Vocab::Load(OnDiskWrapper &onDiskWrapper)
 {
   fstream &file = onDiskWrapper.GetFileVocab();
 
+  // one "word id" line per word
   string line;
   while(getline(file, line)) {
-    vector<string> tokens;
-    Moses::Tokenize(tokens, line);
-    CHECK(tokens.size() == 2);
-    const string &key = tokens[0];
-    m_vocabColl[key] =  Moses::Scan<UINT64>(tokens[1]);
-  }
-
-  // create lookup
-  // assume contiguous vocab id
-  m_lookup.resize(m_vocabColl.size() + 1);
-
-  CollType::const_iterator iter;
-  for (iter = m_vocabColl.begin(); iter != m_vocabColl.end(); ++iter) {
-    UINT32 vocabId = iter->second;
-    const std::string &word = iter->first;
-
-    m_lookup[vocabId] = word;
+    size_t split = line.rfind(' ');
+    CHECK(split != string::npos && split > 0);
+    const string key = line.substr(0, split);
+    UINT64 vocabId = Moses::Scan<UINT64>(line.substr(split + 1));
+    m_vocabColl[key] = vocabId;
+
+    if (vocabId >= m_lookup.size())
+      m_lookup.resize(vocabId + 1);
+    m_lookup[vocabId] = key;
   }
+  m_nextId = m_lookup.size();
 
   return true;
 }
@@ -59,12 +53,8 @@ bool Vocab::Load(OnDiskWrapper &onDiskWrapper)
 void Vocab::Save(OnDiskWrapper &onDiskWrapper)
 {
   fstream &file = onDiskWrapper.GetFileVocab();
-  CollType::const_iterator iterVocab;
-  for (iterVocab = m_vocabColl.begin(); iterVocab != m_vocabColl.end(); ++iterVocab) {
-    const string &word = iterVocab->first;
-    UINT32 vocabId = iterVocab->second;
-
-    file << word << " " << vocabId << endl;
+  for (size_t vocabId = 1; vocabId < m_lookup.size(); ++vocabId) {
+    file << m_lookup[vocabId] << " " << vocabId << endl;
   }
 }
 
@@ -75,6 +65,7 @@ UINT64 Vocab::AddVocabId(const std::string &factorString)
   if (iter == m_vocabColl.end()) {
     // add new vocab entry
     m_vocabColl[factorString] = m_nextId;
+    m_lookup.push_back(factorString);
     return m_nextId++;
   } else {
     // return existing entry
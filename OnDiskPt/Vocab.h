@@ -19,7 +19,8 @@
  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  ***********************************************************************/
 #include <string>
-#include <map>
+#include <vector>
+#include <boost/unordered_map.hpp>
 #include "../moses/src/TypeDef.h"
 
 namespace Moses
@@ -35,10 +36,10 @@ class OnDiskWrapper;
 class Vocab
 {
 protected:
-  typedef std::map<std::string, UINT64> CollType;
+  typedef boost::unordered_map<std::string, UINT64> CollType;
   CollType m_vocabColl;
 
-  std::vector<std::string> m_lookup; // opposite of m_vocabColl
+  std::vector<std::string> m_lookup; // opposite of m_vocabColl, indexed by vocab id
   UINT64 m_nextId; // starts @ 1
 
   const std::string &GetString(UINT32 vocabId) const {
@@ -47,7 +48,8 @@ protected:
 
 public:
   Vocab()
-    :m_nextId(1)
+    :m_lookup(1)
+    ,m_nextId(1)
   {}
   UINT64 AddVocabId(const std::string &factorString);
   UINT64 GetVocabId(const std::string &factorString, bool &found) const;
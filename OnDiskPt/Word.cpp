@@ -18,9 +18,12 @@
  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  ***********************************************************************/
 
+#include <algorithm>
+#include <cstring>
 #include "../moses/src/Util.h"
 #include "../moses/src/Word.h"
 #include "Word.h"
+#include "CompactCoding.h"
 
 using namespace std;
 
@@ -86,19 +89,6 @@ size_t Word::ReadFromMemory(const char *mem, size_t numFactors)
   return memUsed;
 }
 
-size_t Word::ReadFromFile(std::fstream &file, size_t numFactors)
-{
-  size_t memAlloc = numFactors * sizeof(UINT64) + sizeof(char);
-  char *mem = (char*) malloc(memAlloc);
-  file.read(mem, memAlloc);
-
-  size_t memUsed = ReadFromMemory(mem, numFactors);
-  CHECK(memAlloc == memUsed);
-  free(mem);
-
-  return memUsed;
-}
-
 Moses::Word *Word::ConvertToMoses(Moses::FactorDirection direction
                                   , const std::vector<Moses::FactorType> &outputFactorsVec
                                   , const Vocab &vocab) const
@@ -116,6 +106,27 @@ Moses::Word *Word::ConvertToMoses(Moses::FactorDirection direction
 
 }
 
+void Word::WriteCompactToMemory(std::string &out) const
+{
+  WriteVarint(out, (m_factors[0] << 1) | (m_isNonTerminal ? 1 : 0));
+  for (size_t ind = 1; ind < m_factors.size(); ind++)
+    WriteVarint(out, m_factors[ind]);
+}
+
+size_t Word::ReadCompactFromMemory(const char *mem, size_t numFactors)
+{
+  const char *currMem = mem;
+  m_factors.resize(numFactors);
+
+  UINT64 first = ReadVarint(currMem);
+  m_isNonTerminal = first & 1;
+  m_factors[0] = first >> 1;
+  for (size_t ind = 1; ind < numFactors; ind++)
+    m_factors[ind] = ReadVarint(currMem);
+
+  return currMem - mem;
+}
+
 int Word::Compare(const Word &compare) const
 {
   int ret;
@@ -133,6 +144,28 @@ int Word::Compare(const Word &compare) const
   return ret;
 }
 
+int Word::Compare(const char *mem, size_t numFactors) const
+{
+  bool isNonTerminal = mem[sizeof(UINT64) * numFactors];
+  if (m_isNonTerminal != isNonTerminal)
+    return m_isNonTerminal ?-1 : 1;
+
+  // same ordering as comparing the factor vectors
+  size_t minSize = std::min(m_factors.size(), numFactors);
+  for (size_t ind = 0; ind < minSize; ++ind) {
+    UINT64 factor;
+    memcpy(&factor, mem + sizeof(UINT64) * ind, sizeof(UINT64));
+    if (m_factors[ind] < factor)
+      return -1;
+    else if (m_factors[ind] > factor)
+      return 1;
+  }
+
+  if (m_factors.size() == numFactors)
+    return 0;
+  return m_factors.size() < numFactors ? -1 : 1;
+}
+
 bool Word::operator<(const Word &compare) const
 {
   int ret = Compare(compare);
@@ -60,7 +60,9 @@ public:
 
   size_t WriteToMemory(char *mem) const;
   size_t ReadFromMemory(const char *mem, size_t numFactors);
-  size_t ReadFromFile(std::fstream &file, size_t numFactors);
+  // compact format: varint of the first factor and non-term flag, then the other factors
+  void WriteCompactToMemory(std::string &out) const;
+  size_t ReadCompactFromMemory(const char *mem, size_t numFactors);
 
   void SetVocabId(size_t ind, UINT32 vocabId) {
     m_factors[ind] = vocabId;
@@ -71,6 +73,8 @@ public:
                               , const Vocab &vocab) const;
 
   int Compare(const Word &compare) const;
+  // compare with a word as written by WriteToMemory(), without decoding it
+  int Compare(const char *mem, size_t numFactors) const;
   bool operator<(const Word &compare) const;
   bool operator==(const Word &compare) const;
 
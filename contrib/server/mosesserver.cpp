@@ -1,18 +1,25 @@
 #include "util/check.hh"
+#include <algorithm>
+#include <memory>
 #include <stdexcept>
 #include <iostream>
 
+#include <boost/date_time/posix_time/posix_time.hpp>
+
 #include <xmlrpc-c/base.hpp>
 #include <xmlrpc-c/registry.hpp>
 #include <xmlrpc-c/server_abyss.hpp>
 
 #include "ChartManager.h"
+#include "ClauseBoundaries.h"
 #include "Hypothesis.h"
 #include "Manager.h"
 #include "StaticData.h"
 #include "PhraseDictionaryDynSuffixArray.h"
 #include "TranslationSystem.h"
+#include "ThreadPool.h"
 #include "TreeInput.h"
+#include "Util.h"
 #include "LMList.h"
 #include "LM/ORLM.h"
 
@@ -52,6 +59,7 @@ public:
     const PhraseDictionaryFeature* pdf = system.GetPhraseDictionaries()[0];
     PhraseDictionaryDynSuffixArray* pdsa = (PhraseDictionaryDynSuffixArray*) pdf->GetDictionary();
     cerr << "Inserting into address " << pdsa << endl;
+    // queued; new sentences see it once the batch it is in has been applied
     pdsa->insertSnt(source_, target_, alignment_);
     if(add2ORLM_) {       
       updateORLM();
@@ -129,60 +137,65 @@ public:
   }
 };
 
-class Translator : public xmlrpc_c::method
+/** One sentence of a translate request.  Jobs of concurrent requests are
+ *  grouped into batches and decoded by the worker pool. */
+class TranslationJob
 {
 public:
-  Translator() {
-    // signature and help strings are documentation -- the client
-    // can query this information with a system.methodSignature and
-    // system.methodHelp RPC.
-    this->_signature = "S:S";
-    this->_help = "Does translation";
+  TranslationJob(const string &source, const string &clauseBounds,
+                 const TranslationSystem &system, const params_t &params)
+    : m_done(false), m_source(source), m_clauseBounds(clauseBounds), m_system(system) {
+    m_addAlignInfo = (params.find("align") != params.end());
+    m_addGraphInfo = (params.find("sg") != params.end());
+    m_addTopts = (params.find("topt") != params.end());
+    m_reportAllFactors = (params.find("report-all-factors") != params.end());
   }
 
-  void
-  execute(xmlrpc_c::paramList const& paramList,
-          xmlrpc_c::value *   const  retvalP) {
-
-    const params_t params = paramList.getStruct(0);
-    paramList.verifyEnd(1);
-    params_t::const_iterator si = params.find("text");
-    if (si == params.end()) {
-      throw xmlrpc_c::fault(
-        "Missing source text",
-        xmlrpc_c::fault::CODE_PARSE);
+  void Run() {
+    try {
+      Translate();
+    } catch (const std::exception &e) {
+      m_error = e.what();
     }
-    const string source(
-      (xmlrpc_c::value_string(si->second)));
-
-    cerr << "Input: " << source << endl;
-    si = params.find("align");
-    bool addAlignInfo = (si != params.end());
-    si = params.find("sg");
-    bool addGraphInfo = (si != params.end());
-    si = params.find("topt");
-    bool addTopts = (si != params.end());
-    si = params.find("report-all-factors");
-    bool reportAllFactors = (si != params.end());
+  }
 
-    const StaticData &staticData = StaticData::Instance();
+  const map<string, xmlrpc_c::value> &GetResult() const {
+    return m_retData;
+  }
+  const string &GetText() const {
+    return m_text;
+  }
+  const string &GetError() const {
+    return m_error;
+  }
 
-    if (addGraphInfo) {
-      (const_cast<StaticData&>(staticData)).SetOutputSearchGraph(true);
-    }
+  bool m_done; //! set by the worker, guarded by the batcher's mutex
 
-    const TranslationSystem& system = getTranslationSystem(params);
-    stringstream out, graphInfo, transCollOpts;
-    map<string, xmlrpc_c::value> retData;
+private:
+  void Translate() {
+    cerr << "Input: " << m_source << endl;
+    const StaticData &staticData = StaticData::Instance();
 
+    stringstream out;
     SearchAlgorithm searchAlgorithm = staticData.GetSearchAlgorithm();
     if (searchAlgorithm == ChartDecoding) {
-       TreeInput tinput; 
+        TreeInput tinput;
         const vector<FactorType> &inputFactorOrder =
           staticData.GetInputFactorOrder();
-        stringstream in(source + "\n");
+        stringstream in(m_source + "\n");
         tinput.Read(in,inputFactorOrder);
-        ChartManager manager(tinput, &system);
+
+        // min-span / clause-bounds decoding: the rule lookup expects boundaries
+        // on every input once the server was started with -clause-bounds
+        auto_ptr<ClauseBoundaries> clauseBoundaries;
+        if (staticData.GetParam("clause-bounds").size() == 1) {
+          clauseBoundaries.reset(new ClauseBoundaries());
+          stringstream bounds(m_clauseBounds + "\n");
+          clauseBoundaries->ReadClauseBoundaries(bounds);
+          tinput.SetClauseBoundaries(clauseBoundaries.get());
+        }
+
+        ChartManager manager(tinput, &m_system);
         manager.ProcessSentence();
         const ChartHypothesis *hypo = manager.GetBestHypothesis();
         outputChartHypo(out,hypo);
@@ -190,31 +203,32 @@ public:
         Sentence sentence;
         const vector<FactorType> &inputFactorOrder =
           staticData.GetInputFactorOrder();
-        stringstream in(source + "\n");
+        stringstream in(m_source + "\n");
         sentence.Read(in,inputFactorOrder);
-        Manager manager(sentence,staticData.GetSearchAlgorithm(), &system);
+        // the search graph is kept for this sentence only, as other jobs
+        // are decoded at the same time
+        Manager manager(sentence,staticData.GetSearchAlgorithm(), &m_system, m_addGraphInfo);
         manager.ProcessSentence();
         const Hypothesis* hypo = manager.GetBestHypothesis();
 
         vector<xmlrpc_c::value> alignInfo;
-        outputHypo(out,hypo,addAlignInfo,alignInfo,reportAllFactors);
-        if (addAlignInfo) {
-          retData.insert(pair<string, xmlrpc_c::value>("align", xmlrpc_c::value_array(alignInfo)));
+        outputHypo(out,hypo,m_addAlignInfo,alignInfo,m_reportAllFactors);
+        if (m_addAlignInfo) {
+          m_retData.insert(pair<string, xmlrpc_c::value>("align", xmlrpc_c::value_array(alignInfo)));
         }
 
-        if(addGraphInfo) {
-          insertGraphInfo(manager,retData);
-            (const_cast<StaticData&>(staticData)).SetOutputSearchGraph(false);
+        if(m_addGraphInfo) {
+          insertGraphInfo(manager,m_retData);
         }
-        if (addTopts) {
-          insertTranslationOptions(manager,retData);
+        if (m_addTopts) {
+          insertTranslationOptions(manager,m_retData);
         }
     }
+    m_text = out.str();
     pair<string, xmlrpc_c::value>
-    text("text", xmlrpc_c::value_string(out.str()));
-    retData.insert(text);
-    cerr << "Output: " << out.str() << endl;
-    *retvalP = xmlrpc_c::value_struct(retData);
+    text("text", xmlrpc_c::value_string(m_text));
+    m_retData.insert(text);
+    cerr << "Output: " << m_text << endl;
   }
 
   void outputHypo(ostream& out, const Hypothesis* hypo, bool addAlignmentInfo, vector<xmlrpc_c::value>& alignInfo, bool reportAllFactors = false) {
@@ -320,8 +334,337 @@ public:
     retData.insert(pair<string, xmlrpc_c::value>("topt", xmlrpc_c::value_array(toptsXml)));
   }
 
+  string m_source, m_clauseBounds;
+  const TranslationSystem &m_system;
+  bool m_addAlignInfo, m_addGraphInfo, m_addTopts, m_reportAllFactors;
+
+  map<string, xmlrpc_c::value> m_retData;
+  string m_text, m_error;
+};
+
+/** Latency of translate requests, reported by the stats method */
+class LatencyStats
+{
+public:
+  LatencyStats()
+    : m_requests(0), m_sentences(0), m_batches(0), m_batchedSentences(0)
+    , m_totalMs(0), m_maxMs(0) {
+    // bucket upper bounds in milliseconds; the last bucket is open
+    const int bounds[] = {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 30000};
+    m_bounds.assign(bounds, bounds + sizeof(bounds) / sizeof(bounds[0]));
+    m_counts.assign(m_bounds.size() + 1, 0);
+  }
+
+  void AddRequest(double ms, size_t sentences) {
+#ifdef WITH_THREADS
+    boost::mutex::scoped_lock lock(m_mutex);
+#endif
+    ++m_requests;
+    m_sentences += sentences;
+    m_totalMs += ms;
+    m_maxMs = std::max(m_maxMs, ms);
+    size_t bucket = std::upper_bound(m_bounds.begin(), m_bounds.end(), ms) - m_bounds.begin();
+    if (bucket > 0 && ms == m_bounds[bucket - 1]) --bucket;
+    ++m_counts[bucket];
+  }
+
+  void AddBatch(size_t sentences) {
+#ifdef WITH_THREADS
+    boost::mutex::scoped_lock lock(m_mutex);
+#endif
+    ++m_batches;
+    m_batchedSentences += sentences;
+  }
+
+  void GetStats(map<string, xmlrpc_c::value> &stats) const {
+#ifdef WITH_THREADS
+    boost::mutex::scoped_lock lock(m_mutex);
+#endif
+    stats["requests"] = xmlrpc_c::value_int(m_requests);
+    stats["sentences"] = xmlrpc_c::value_int(m_sentences);
+    stats["batches"] = xmlrpc_c::value_int(m_batches);
+    stats["mean-batch-size"] = xmlrpc_c::value_double(m_batches ? (double) m_batchedSentences / m_batches : 0);
+    stats["mean-latency-ms"] = xmlrpc_c::value_double(m_requests ? m_totalMs / m_requests : 0);
+    stats["max-latency-ms"] = xmlrpc_c::value_double(m_maxMs);
+
+    vector<xmlrpc_c::value> histogram;
+    for (size_t i = 0; i < m_counts.size(); ++i) {
+      map<string, xmlrpc_c::value> bucket;
+      if (i < m_bounds.size()) {
+        bucket["upper-ms"] = xmlrpc_c::value_int(m_bounds[i]);
+      }
+      bucket["count"] = xmlrpc_c::value_int(m_counts[i]);
+      histogram.push_back(xmlrpc_c::value_struct(bucket));
+    }
+    stats["latency-histogram"] = xmlrpc_c::value_array(histogram);
+  }
+
+private:
+  int m_requests, m_sentences, m_batches, m_batchedSentences;
+  double m_totalMs, m_maxMs;
+  vector<int> m_bounds, m_counts;
+#ifdef WITH_THREADS
+  mutable boost::mutex m_mutex;
+#endif
+};
+
+#ifdef WITH_THREADS
+
+class Batcher;
+
+/** Sentences from one or more concurrent requests, decoded in one worker */
+class RequestBatch : public Task
+{
+public:
+  RequestBatch(Batcher &batcher, const vector<TranslationJob*> &jobs)
+    : m_batcher(batcher), m_jobs(jobs) {}
+  void Run();
+
+private:
+  Batcher &m_batcher;
+  vector<TranslationJob*> m_jobs;
+};
+
+/** Collects the sentences of concurrent translate requests and submits them
+ *  to the worker pool as batches of up to batchSize sentences.  A partial batch
+ *  is submitted once its oldest sentence has waited batchWait milliseconds.
+ */
+class Batcher
+{
+public:
+  Batcher(size_t numThreads, size_t batchSize, long batchWait, LatencyStats &stats)
+    : m_pool(numThreads), m_batchSize(std::max<size_t>(1, batchSize))
+    , m_batchWait(boost::posix_time::milliseconds(batchWait)), m_stats(stats)
+    , m_stopping(false), m_flusher(boost::bind(&Batcher::FlushExpired, this)) {
+  }
+
+  //! decode the jobs still pending, then stop the flusher and the workers
+  ~Batcher() {
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      m_stopping = true;
+      Flush();
+      m_jobQueued.notify_all();
+    }
+    m_flusher.join();
+    // the workers call Done(), so they have to finish while the members exist
+    m_pool.Stop(true);
+  }
+
+  //! decode the jobs, blocking until all of them are done
+  void Translate(const vector<TranslationJob*> &jobs) {
+    boost::mutex::scoped_lock lock(m_mutex);
+    if (m_pending.empty()) {
+      m_oldestPending = boost::get_system_time();
+    }
+    m_pending.insert(m_pending.end(), jobs.begin(), jobs.end());
+    if (m_pending.size() >= m_batchSize || m_batchWait.total_milliseconds() == 0) {
+      Flush();
+    } else {
+      m_jobQueued.notify_all();
+    }
+
+    for (size_t i = 0; i < jobs.size(); ++i) {
+      while (!jobs[i]->m_done) {
+        m_jobDone.wait(lock);
+      }
+    }
+  }
+
+  void Done(TranslationJob *job) {
+    boost::mutex::scoped_lock lock(m_mutex);
+    job->m_done = true;
+    m_jobDone.notify_all();
+  }
+
+private:
+  //! submit all pending jobs; m_mutex must be held
+  void Flush() {
+    for (size_t start = 0; start < m_pending.size(); start += m_batchSize) {
+      size_t end = std::min(start + m_batchSize, m_pending.size());
+      vector<TranslationJob*> jobs(m_pending.begin() + start, m_pending.begin() + end);
+      m_stats.AddBatch(jobs.size());
+      m_pool.Submit(new RequestBatch(*this, jobs));
+    }
+    m_pending.clear();
+  }
+
+  //! flush partial batches which have waited long enough, until stopped
+  void FlushExpired() {
+    boost::mutex::scoped_lock lock(m_mutex);
+    while (!m_stopping) {
+      while (m_pending.empty() && !m_stopping) {
+        m_jobQueued.wait(lock);
+      }
+      // m_oldestPending moves on if the batch was flushed meanwhile
+      while (!m_pending.empty() && !m_stopping && boost::get_system_time() < m_oldestPending + m_batchWait) {
+        m_jobQueued.timed_wait(lock, m_oldestPending + m_batchWait);
+      }
+      if (!m_pending.empty()) {
+        Flush();
+      }
+    }
+  }
+
+  ThreadPool m_pool;
+  size_t m_batchSize;
+  boost::posix_time::time_duration m_batchWait;
+  LatencyStats &m_stats;
+
+  boost::mutex m_mutex;
+  boost::condition_variable m_jobQueued, m_jobDone;
+  vector<TranslationJob*> m_pending;
+  boost::system_time m_oldestPending;
+  bool m_stopping;
+  boost::thread m_flusher;
+};
 
+void RequestBatch::Run()
+{
+  for (size_t i = 0; i < m_jobs.size(); ++i) {
+    m_jobs[i]->Run();
+    m_batcher.Done(m_jobs[i]);
+  }
+}
+
+#endif //WITH_THREADS
+
+class Translator : public xmlrpc_c::method
+{
+public:
+#ifdef WITH_THREADS
+  Translator(Batcher *batcher, LatencyStats &stats) : m_batcher(batcher), m_stats(stats) {
+#else
+  Translator(LatencyStats &stats) : m_stats(stats) {
+#endif
+    // signature and help strings are documentation -- the client
+    // can query this information with a system.methodSignature and
+    // system.methodHelp RPC.
+    this->_signature = "S:S";
+    this->_help = "Does translation";
+  }
+
+  void
+  execute(xmlrpc_c::paramList const& paramList,
+          xmlrpc_c::value *   const  retvalP) {
+    boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+
+    const params_t params = paramList.getStruct(0);
+    paramList.verifyEnd(1);
+    params_t::const_iterator si = params.find("text");
+    if (si == params.end()) {
+      throw xmlrpc_c::fault(
+        "Missing source text",
+        xmlrpc_c::fault::CODE_PARSE);
+    }
+    const string source(
+      (xmlrpc_c::value_string(si->second)));
+
+    // clause boundaries, one line per sentence as in the -clause-bounds file
+    string clauseBounds;
+    si = params.find("clause-bounds");
+    if (si != params.end()) {
+      clauseBounds = xmlrpc_c::value_string(si->second);
+    }
+
+    // each line of the text is a sentence
+    const TranslationSystem& system = getTranslationSystem(params);
+    vector<string> sentences = TokenizeMultiCharSeparator(source, "\n");
+    if (!sentences.empty() && sentences.back().empty()) {
+      sentences.pop_back();
+    }
+    vector<string> bounds = TokenizeMultiCharSeparator(clauseBounds, "\n");
+    bounds.resize(sentences.size());
+
+    vector<TranslationJob*> jobs;
+    for (size_t i = 0; i < sentences.size(); ++i) {
+      jobs.push_back(new TranslationJob(sentences[i], bounds[i], system, params));
+    }
+
+#ifdef WITH_THREADS
+    m_batcher->Translate(jobs);
+#else
+    for (size_t i = 0; i < jobs.size(); ++i) {
+      jobs[i]->Run();
+    }
+#endif
 
+    string error;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+      if (!jobs[i]->GetError().empty()) {
+        error = jobs[i]->GetError();
+      }
+    }
+    if (!error.empty()) {
+      RemoveAllInColl(jobs);
+      throw xmlrpc_c::fault(error, xmlrpc_c::fault::CODE_INTERNAL);
+    }
+
+    if (jobs.size() == 1) {
+      *retvalP = xmlrpc_c::value_struct(jobs[0]->GetResult());
+    } else {
+      // several sentences: text holds one translation per line, the per
+      // sentence results are in the sentences array
+      map<string, xmlrpc_c::value> retData;
+      string text;
+      vector<xmlrpc_c::value> results;
+      for (size_t i = 0; i < jobs.size(); ++i) {
+        text += jobs[i]->GetText() + "\n";
+        results.push_back(xmlrpc_c::value_struct(jobs[i]->GetResult()));
+      }
+      retData["text"] = xmlrpc_c::value_string(text);
+      retData["sentences"] = xmlrpc_c::value_array(results);
+      *retvalP = xmlrpc_c::value_struct(retData);
+    }
+    RemoveAllInColl(jobs);
+
+    boost::posix_time::time_duration latency = boost::posix_time::microsec_clock::universal_time() - start;
+    m_stats.AddRequest(latency.total_microseconds() / 1000.0, sentences.size());
+  }
+
+private:
+#ifdef WITH_THREADS
+  Batcher *m_batcher;
+#endif
+  LatencyStats &m_stats;
+};
+
+class Stats : public xmlrpc_c::method
+{
+public:
+  Stats(const LatencyStats &stats) : m_stats(stats) {
+    this->_signature = "S:";
+    this->_help = "Returns request counts, batch sizes, a histogram of translate latencies and, "
+                  "for a suffix array phrase table, the rate and delay of updates";
+  }
+
+  void
+  execute(xmlrpc_c::paramList const& paramList,
+          xmlrpc_c::value *   const  retvalP) {
+    map<string, xmlrpc_c::value> stats;
+    m_stats.GetStats(stats);
+
+    const TranslationSystem &system = StaticData::Instance().GetTranslationSystem(TranslationSystem::DEFAULT);
+    const PhraseDictionaryDynSuffixArray* pdsa = NULL;
+    if (!system.GetPhraseDictionaries().empty()) {
+      pdsa = dynamic_cast<const PhraseDictionaryDynSuffixArray*>(system.GetPhraseDictionaries()[0]->GetDictionary());
+    }
+    if (pdsa != NULL) {
+      PhraseDictionaryDynSuffixArray::UpdateStats updateStats = pdsa->GetUpdateStats();
+      map<string, xmlrpc_c::value> updates;
+      updates["queued"] = xmlrpc_c::value_int(updateStats.queued);
+      updates["applied"] = xmlrpc_c::value_int(updateStats.applied);
+      updates["batches"] = xmlrpc_c::value_int(updateStats.batches);
+      updates["updates-per-second"] = xmlrpc_c::value_double(updateStats.applyMs > 0 ? updateStats.applied * 1000.0 / updateStats.applyMs : 0);
+      updates["mean-delay-ms"] = xmlrpc_c::value_double(updateStats.applied ? updateStats.totalDelayMs / updateStats.applied : 0);
+      updates["max-delay-ms"] = xmlrpc_c::value_double(updateStats.maxDelayMs);
+      stats["updates"] = xmlrpc_c::value_struct(updates);
+    }
+    *retvalP = xmlrpc_c::value_struct(stats);
+  }
+
+private:
+  const LatencyStats &m_stats;
 };
 
 
@@ -334,6 +677,9 @@ int main(int argc, char** argv)
   int port = 8080;
   const char* logfile = "/dev/null";
   bool isSerial = false;
+  int numThreads = 0;
+  size_t batchSize = 1;
+  long batchWait = 0;
 
   for (int i = 0; i < argc; ++i) {
     if (!strcmp(argv[i],"--server-port")) {
@@ -355,6 +701,30 @@ int main(int argc, char** argv)
     } else if (!strcmp(argv[i], "--serial")) {
       cerr << "Running single-threaded server" << endl;
       isSerial = true;
+    } else if (!strcmp(argv[i],"--workers")) {
+      ++i;
+      if (i >= argc) {
+        cerr << "Error: Missing argument to --workers" << endl;
+        exit(1);
+      } else {
+        numThreads = atoi(argv[i]);
+      }
+    } else if (!strcmp(argv[i],"--batch-size")) {
+      ++i;
+      if (i >= argc) {
+        cerr << "Error: Missing argument to --batch-size" << endl;
+        exit(1);
+      } else {
+        batchSize = atoi(argv[i]);
+      }
+    } else if (!strcmp(argv[i],"--batch-wait")) {
+      ++i;
+      if (i >= argc) {
+        cerr << "Error: Missing argument to --batch-wait" << endl;
+        exit(1);
+      } else {
+        batchWait = atol(argv[i]);
+      }
     } else {
       mosesargv[mosesargc] = new char[strlen(argv[i])+1];
       strcpy(mosesargv[mosesargc],argv[i]);
@@ -373,11 +743,25 @@ int main(int argc, char** argv)
 
   xmlrpc_c::registry myRegistry;
 
-  xmlrpc_c::methodPtr const translator(new Translator);
+  LatencyStats stats;
+#ifdef WITH_THREADS
+  // default to the decoder's -threads setting
+  if (numThreads <= 0) {
+    numThreads = StaticData::Instance().ThreadCount();
+  }
+  cerr << "Decoding with " << numThreads << " workers, batches of up to "
+       << batchSize << " sentences, waiting at most " << batchWait << " ms" << endl;
+  Batcher batcher(numThreads, batchSize, batchWait, stats);
+  xmlrpc_c::methodPtr const translator(new Translator(&batcher, stats));
+#else
+  xmlrpc_c::methodPtr const translator(new Translator(stats));
+#endif
   xmlrpc_c::methodPtr const updater(new Updater);
+  xmlrpc_c::methodPtr const statsMethod(new Stats(stats));
 
   myRegistry.addMethod("translate", translator);
   myRegistry.addMethod("updater", updater);
+  myRegistry.addMethod("stats", statsMethod);
 
   xmlrpc_c::serverAbyss myAbyssServer(
     myRegistry,
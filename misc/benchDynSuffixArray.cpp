@@ -0,0 +1,140 @@
+// Time the dynamic suffix array and its wavelet matrix on a synthetic corpus.
+// Sentences have 5 to 24 words drawn from a Zipf-like vocabulary.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <sys/time.h>
+
+#include "DynSuffixArray.h"
+#include "DynWaveletMatrix.h"
+
+using namespace Moses;
+
+namespace
+{
+
+const unsigned EOS = 1;
+
+void usage()
+{
+  std::cerr << "Usage: benchDynSuffixArray [-s sentences] [-i inserts] [-q queries] [-v vocabulary] [-r seed]" << std::endl;
+  exit(1);
+}
+
+double Now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+unsigned RandomWord(unsigned vocabSize)
+{
+  // the product of two uniform ids favours small ones
+  return 2 + (unsigned) ((unsigned long long) (rand() % vocabSize) * (rand() % vocabSize) / vocabSize);
+}
+
+void AddSentence(vuint_t &words, unsigned vocabSize)
+{
+  int length = 5 + rand() % 20;
+  for (int i = 0; i < length; ++i) {
+    words.push_back(RandomWord(vocabSize));
+  }
+  words.push_back(EOS);
+}
+
+void Report(const char *what, size_t count, double seconds)
+{
+  fprintf(stderr, "%-16s %10zu in %8.3fs = %12.1f/s\n", what, count, seconds, count / seconds);
+}
+
+}
+
+int main(int argc, char **argv)
+{
+  size_t numSentences = 100000, numInserts = 10, numQueries = 100000;
+  unsigned vocabSize = 5000, seed = 1;
+
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 == argc)
+      usage();
+    if (!strcmp(argv[i], "-s"))
+      numSentences = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-i"))
+      numInserts = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-q"))
+      numQueries = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-v"))
+      vocabSize = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-r"))
+      seed = atoi(argv[++i]);
+    else
+      usage();
+  }
+  if (vocabSize == 0 || numSentences == 0)
+    usage();
+
+  srand(seed);
+  vuint_t *corpus = new vuint_t();
+  for (size_t i = 0; i < numSentences; ++i) {
+    AddSentence(*corpus, vocabSize);
+  }
+  fprintf(stderr, "corpus: %zu sentences, %zu words\n", numSentences, corpus->size());
+
+  // rank over the corpus, as the LF mapping of the suffix array uses it
+  double start = Now();
+  DynWaveletMatrix matrix(*corpus);
+  Report("matrix build", corpus->size(), Now() - start);
+
+  unsigned long long checksum = 0;
+  start = Now();
+  for (size_t i = 0; i < numQueries; ++i) {
+    size_t pos = rand() % (corpus->size() + 1);
+    checksum += matrix.Rank(RandomWord(vocabSize), pos);
+  }
+  Report("matrix rank", numQueries, Now() - start);
+
+  start = Now();
+  for (size_t i = 0; i < numQueries; ++i) {
+    matrix.Insert(rand() % (matrix.GetSize() + 1), RandomWord(vocabSize));
+  }
+  Report("matrix insert", numQueries, Now() - start);
+
+  start = Now();
+  DynSuffixArray suffixArray(corpus);
+  Report("array build", corpus->size(), Now() - start);
+
+  // bigrams of the corpus as it is before the inserts
+  std::vector<vuint_t> phrases(numQueries);
+  for (size_t i = 0; i < numQueries; ++i) {
+    size_t pos = rand() % (corpus->size() - 1);
+    phrases[i].assign(corpus->begin() + pos, corpus->begin() + pos + 2);
+  }
+
+  // Insert stays O(n): SA, ISA and F are renumbered in linear passes
+  start = Now();
+  for (size_t i = 0; i < numInserts; ++i) {
+    vuint_t sentence;
+    AddSentence(sentence, vocabSize);
+    unsigned index = corpus->size();
+    corpus->insert(corpus->end(), sentence.begin(), sentence.end());
+    suffixArray.Insert(&sentence, index);
+  }
+  Report("array insert", numInserts, Now() - start);
+
+  start = Now();
+  vuint_t indices;
+  for (size_t i = 0; i < numQueries; ++i) {
+    suffixArray.GetCorpusIndex(&phrases[i], &indices);
+    checksum += indices.size();
+  }
+  Report("array lookup", numQueries, Now() - start);
+
+  // keeps the work from being optimised away, and tells runs apart
+  std::cout << checksum << std::endl;
+  delete corpus;
+  return 0;
+}
@@ -1,9 +1,11 @@
+#include <cstdlib>
 #include <iostream>
 #include <string>
 
 #include "Timer.h"
 #include "InputFileStream.h"
 #include "LexicalReorderingTable.h"
+#include "Util.h"
 
 using namespace Moses;
 
@@ -13,8 +15,11 @@ void printHelp()
 {
   std::cerr << "Usage:\n"
             "options: \n"
-            "\t-in  string -- input table file name\n"
+            "\t-in  string -- input table file name; with -compact also the\n"
+            "\t               prefix of a binary table (.binlexr.*) to convert\n"
             "\t-out string -- prefix of binary table files\n"
+            "\t-compact    -- write a single memory-mapped table (.minlexr)\n"
+            "\t-quantize n -- bits per score in the compact table (8 or 0 for exact scores, default 8)\n"
             "If -in is not specified reads from stdin\n"
             "\n";
 }
@@ -24,6 +29,8 @@ int main(int argc, char** argv)
   std::cerr << "processLexicalTable v0.1 by Konrad Rawlik\n";
   std::string inFilePath;
   std::string outFilePath("out");
+  bool compact = false;
+  size_t quantizationBits = 8;
   if(1 >= argc) {
     printHelp();
     return 1;
@@ -36,6 +43,11 @@ int main(int argc, char** argv)
     } else if("-out" == arg && i+1 < argc) {
       ++i;
       outFilePath = argv[i];
+    } else if("-compact" == arg) {
+      compact = true;
+    } else if("-quantize" == arg && i+1 < argc) {
+      ++i;
+      quantizationBits = atoi(argv[i]);
     } else {
       //somethings wrong... print help
       printHelp();
@@ -43,13 +55,22 @@ int main(int argc, char** argv)
     }
   }
 
-  if(inFilePath.empty()) {
+  if(compact && !inFilePath.empty() && FileExists(inFilePath + ".binlexr.idx")) {
+    std::cerr << "converting " << inFilePath << ".binlexr.* to " << outFilePath << ".minlexr\n";
+    bool success = LexicalReorderingTableCompact::ConvertTree(inFilePath, outFilePath, quantizationBits);
+    return (success ? 0 : 1);
+  } else if(inFilePath.empty()) {
     std::cerr << "processing stdin to " << outFilePath << ".*\n";
-    return LexicalReorderingTableTree::Create(std::cin, outFilePath);
+    bool success = compact
+                   ? LexicalReorderingTableCompact::Create(std::cin, outFilePath, quantizationBits)
+                   : LexicalReorderingTableTree::Create(std::cin, outFilePath);
+    return (success ? 0 : 1);
   } else {
     std::cerr << "processing " << inFilePath<< " to " << outFilePath << ".*\n";
     InputFileStream file(inFilePath);
-    bool success = LexicalReorderingTableTree::Create(file, outFilePath);
+    bool success = compact
+                   ? LexicalReorderingTableCompact::Create(file, outFilePath, quantizationBits)
+                   : LexicalReorderingTableTree::Create(file, outFilePath);
     return (success ? 0 : 1);
   }
 }
@@ -8,6 +8,7 @@
 #include <sys/stat.h>
 #include "TypeDef.h"
 #include "PhraseDictionaryTree.h"
+#include "PhraseDictionaryCompact.h"
 #include "ConfusionNet.h"
 #include "FactorCollection.h"
 #include "Phrase.h"
@@ -45,6 +46,8 @@ int main(int argc,char **argv)
   size_t noScoreComponent=5;
   int cn=0;
   bool aligninfo=false;
+  bool compact=false;
+  size_t quantizationBits=8;
   std::vector<std::pair<std::string,std::pair<char*,char*> > > ftts;
   int verb=0;
   for(int i=1; i<argc; ++i) {
@@ -59,6 +62,8 @@ int main(int argc,char **argv)
     else if(s=="-cn") cn=1;
     else if(s=="-irst") cn=2;
     else if(s=="-alignment-info") aligninfo=true;
+    else if(s=="-compact") compact=true;
+    else if(s=="-quantize") quantizationBits=atoi(argv[++i]);
     else if(s=="-v") verb=atoi(argv[++i]);
     else if(s=="-h") {
       std::cerr<<"usage "<<argv[0]<<" :\n\n"
@@ -67,6 +72,8 @@ int main(int argc,char **argv)
                "\t-out string      -- output file name prefix for binary ttable\n"
                "\t-nscores int     -- number of scores in ttable\n"
                "\t-alignment-info  -- include alignment info in the binary ttable (suffix \".wa\")\n"
+               "\t-compact         -- write a compact memory-mapped ttable (suffix \".minphr\") instead\n"
+               "\t-quantize int    -- bits per score in the compact ttable (8 or 0 for exact scores, default 8)\n"
                "\nfunctions:\n"
                "\t - convert ascii ttable in binary format\n"
                "\t - if ttable is not read from stdin:\n"
@@ -82,7 +89,14 @@ int main(int argc,char **argv)
 
   if(ftts.size()) {
 
-    if(ftts.size()==1) {
+    if(ftts.size()==1 && compact) {
+      if (ftts[0].first=="-") {
+        std::cerr<<"ERROR: the compact ttable can't be built from stdin\n";
+        return 1;
+      }
+      std::cerr<<"building compact ttable for "<<ftts[0].first<<"\n";
+      return PhraseDictionaryCompact::Create(ftts[0].first,fto,noScoreComponent,quantizationBits) ? 0 : 1;
+    } else if(ftts.size()==1) {
       std::cerr<<"processing ptree for ";
       PhraseDictionaryTree pdt(noScoreComponent);
 
@@ -0,0 +1,200 @@
+// Reference server for LanguageModelRemote: answers batched n-gram queries
+// with a KenLM model, speaking the protocol described in LM/RemoteProtocol.h.
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#ifdef WITH_THREADS
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#endif
+
+#include "lm/binary_format.hh"
+#include "lm/model.hh"
+#include "LM/RemoteProtocol.h"
+
+using namespace Moses::RemoteLMProtocol;
+
+namespace
+{
+
+// refuse requests that would make us allocate silly amounts of memory
+const uint32_t MAX_ITEMS = 1 << 20;
+const uint32_t MAX_STRING = 1 << 16;
+const uint32_t MAX_NGRAM = 256;
+
+template <class Model> bool Handshake(const Model &model, int sock)
+{
+  std::vector<uint32_t> buffer;
+  if (!ReadFields(sock, buffer, 2) || buffer[0] != MAGIC || buffer[1] != VERSION) {
+    return false;
+  }
+  buffer.clear();
+  Put(buffer, MAGIC);
+  Put(buffer, VERSION);
+  Put(buffer, model.Order());
+  Put(buffer, model.GetVocabulary().BeginSentence());
+  Put(buffer, model.GetVocabulary().EndSentence());
+  return WriteBuffer(sock, buffer);
+}
+
+template <class Model> bool AnswerVocab(const Model &model, int sock, uint32_t count, std::vector<uint32_t> &out)
+{
+  std::vector<uint32_t> field;
+  std::vector<char> str;
+  for (uint32_t i = 0; i < count; ++i) {
+    if (!ReadFields(sock, field, 1) || field[0] > MAX_STRING) {
+      return false;
+    }
+    str.resize((field[0] + 3) / 4 * 4);
+    if (!str.empty() && !ReadAll(sock, &str[0], str.size())) {
+      return false;
+    }
+    Put(out, model.GetVocabulary().Index(StringPiece(str.empty() ? "" : &str[0], field[0])));
+  }
+  return true;
+}
+
+template <class Model> bool AnswerScore(const Model &model, int sock, uint32_t count, std::vector<uint32_t> &out)
+{
+  const lm::WordIndex bound = model.GetVocabulary().Bound();
+  std::vector<uint32_t> ngram;
+  std::vector<lm::WordIndex> context;
+  typename Model::State state;
+  for (uint32_t i = 0; i < count; ++i) {
+    if (!ReadFields(sock, ngram, 1) || ngram[0] == 0 || ngram[0] > MAX_NGRAM) {
+      return false;
+    }
+    if (!ReadFields(sock, ngram, ngram[0])) {
+      return false;
+    }
+    for (size_t j = 0; j < ngram.size(); ++j) {
+      if (ngram[j] >= bound) ngram[j] = 0;
+    }
+
+    // context in reverse order, at most order - 1 words
+    context.clear();
+    for (size_t j = ngram.size() - 1; j > 0 && context.size() + 1 < model.Order(); --j) {
+      context.push_back(ngram[j - 1]);
+    }
+    const lm::WordIndex word = ngram.back();
+    lm::FullScoreReturn ret = context.empty()
+                              ? model.FullScore(model.NullContextState(), word, state)
+                              : model.FullScoreForgotState(&context[0], &context[0] + context.size(), word, state);
+    PutFloat(out, ret.prob);
+    Put(out, (static_cast<uint32_t>(state.Length()) << 1) | (word == 0 ? 1 : 0));
+  }
+  return true;
+}
+
+template <class Model> void Serve(const Model *model, int sock)
+{
+  std::vector<uint32_t> header, out;
+  if (Handshake(*model, sock)) {
+    while (ReadFields(sock, header, 2) && header[1] <= MAX_ITEMS) {
+      out.clear();
+      Put(out, header[0]);
+      Put(out, header[1]);
+      bool ok = false;
+      if (header[0] == REQUEST_VOCAB) {
+        ok = AnswerVocab(*model, sock, header[1], out);
+      } else if (header[0] == REQUEST_SCORE) {
+        ok = AnswerScore(*model, sock, header[1], out);
+      }
+      if (!ok || !WriteBuffer(sock, out)) {
+        break;
+      }
+    }
+  }
+  close(sock);
+}
+
+template <class Model> void Run(const char *file, int port)
+{
+  lm::ngram::Config config;
+  config.messages = &std::cerr;
+  Model model(file, config);
+
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  int flag = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+  if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(listener, 64) < 0) {
+    perror("Could not listen");
+    exit(1);
+  }
+  std::cerr << "Serving " << file << " on port " << port << std::endl;
+
+  while (true) {
+    int sock = accept(listener, NULL, NULL);
+    if (sock < 0) {
+      perror("accept");
+      continue;
+    }
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+#ifdef WITH_THREADS
+    // the model is read-only, so clients are served concurrently
+    boost::thread(boost::bind(&Serve<Model>, &model, sock)).detach();
+#else
+    Serve(&model, sock);
+#endif
+  }
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc != 3) {
+    std::cerr << "Usage: " << argv[0] << " lm_file port" << std::endl;
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN);
+  const char *file = argv[1];
+  int port = atoi(argv[2]);
+  try {
+    using namespace lm::ngram;
+    ModelType model_type;
+    if (RecognizeBinary(file, model_type)) {
+      switch(model_type) {
+      case HASH_PROBING:
+        Run<ProbingModel>(file, port);
+        break;
+      case TRIE_SORTED:
+        Run<TrieModel>(file, port);
+        break;
+      case QUANT_TRIE_SORTED:
+        Run<QuantTrieModel>(file, port);
+        break;
+      case ARRAY_TRIE_SORTED:
+        Run<ArrayTrieModel>(file, port);
+        break;
+      case QUANT_ARRAY_TRIE_SORTED:
+        Run<QuantArrayTrieModel>(file, port);
+        break;
+      default:
+        std::cerr << "Unrecognized kenlm model type " << model_type << std::endl;
+        return 1;
+      }
+    } else {
+      Run<ProbingModel>(file, port);
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -10,11 +10,16 @@
 #include "LatticeMBR.h"
 #include "StaticData.h"
 #include <algorithm>
+#include <climits>
 #include <set>
+#include "util/murmur_hash.hh"
+
+#ifdef WITH_THREADS
+#include "ThreadPool.h"
+#endif
 
 using namespace std;
 
-size_t bleu_order = 4;
 float UNKNGRAMLOGPROB = -20;
 void GetOutputWords(const TrellisPath &path, vector <Word> &translation)
 {
@@ -32,45 +37,74 @@ void GetOutputWords(const TrellisPath &path, vector <Word> &translation)
 }
 
 
-void extract_ngrams(const vector<Word >& sentence, map < Phrase, int >  & allngrams)
+size_t hash_value(const NgramKey& key)
 {
-  for (int k = 0; k < (int)bleu_order; k++) {
-    for(int i =0; i < max((int)sentence.size()-k,0); i++) {
-      Phrase ngram( k+1);
-      for ( int j = i; j<= i+k; j++) {
-        ngram.AddWord(sentence[j]);
-      }
-      ++allngrams[ngram];
-    }
+  return util::MurmurHash64A(key.m_words, sizeof(key.m_words));
+}
+
+namespace
+{
+
+void AddLogScore(NgramExpectations::Scores& scores, const NgramKey& ngram, float score)
+{
+  pair<NgramExpectations::Scores::iterator, bool> inserted = scores.insert(make_pair(ngram, score));
+  if (!inserted.second) {
+    inserted.first->second = log_sum(score, inserted.first->second);
   }
 }
 
+}
 
+unsigned int NgramExpectations::AddWord(const Word& word)
+{
+  pair<map<Word, unsigned int>::iterator, bool> inserted = m_vocab.insert(make_pair(word, m_words.size() + 1));
+  if (inserted.second) {
+    m_words.push_back(word);
+  }
+  return inserted.first->second;
+}
 
-void NgramScores::addScore(const Hypothesis* node, const Phrase& ngram, float score)
+void NgramExpectations::ExtractNgrams(const vector<Word>& sentence, NgramCounts& counts) const
 {
-  set<Phrase>::const_iterator ngramIter = m_ngrams.find(ngram);
-  if (ngramIter == m_ngrams.end()) {
-    ngramIter = m_ngrams.insert(ngram).first;
+  vector<unsigned int> ids(sentence.size());
+  map<Word, unsigned int> unknownWords;
+  for (size_t i = 0; i < sentence.size(); ++i) {
+    map<Word, unsigned int>::const_iterator known = m_vocab.find(sentence[i]);
+    if (known != m_vocab.end()) {
+      ids[i] = known->second;
+    } else {
+      ids[i] = unknownWords.insert(make_pair(sentence[i], m_words.size() + unknownWords.size() + 1)).first->second;
+    }
   }
-  map<const Phrase*,float>& ngramScores = m_scores[node];
-  map<const Phrase*,float>::iterator scoreIter = ngramScores.find(&(*ngramIter));
-  if (scoreIter == ngramScores.end()) {
-    ngramScores[&(*ngramIter)] = score;
-  } else {
-    ngramScores[&(*ngramIter)] = log_sum(score,scoreIter->second);
+
+  for (size_t k = 0; k < bleu_order; k++) {
+    for (size_t i = 0; i + k < ids.size(); i++) {
+      NgramKey ngram;
+      copy(ids.begin() + i, ids.begin() + i + k + 1, ngram.m_words);
+      ++counts[ngram];
+    }
   }
 }
 
-NgramScores::NodeScoreIterator NgramScores::nodeBegin(const Hypothesis* node)
+void NgramExpectations::AddScore(const NgramKey& ngram, float score)
 {
-  return m_scores[node].begin();
+  AddLogScore(m_scores, ngram, score);
 }
 
+void NgramExpectations::Normalise(float Z)
+{
+  for (Scores::iterator it = m_scores.begin(); it != m_scores.end(); ++it) {
+    it->second -= Z;
+  }
+}
 
-NgramScores::NodeScoreIterator NgramScores::nodeEnd(const Hypothesis* node)
+Phrase NgramExpectations::GetPhrase(const NgramKey& ngram) const
 {
-  return m_scores[node].end();
+  Phrase phrase(ngram.GetSize());
+  for (size_t i = 0; i < ngram.GetSize(); ++i) {
+    phrase.AddWord(m_words[ngram.m_words[i] - 1]);
+  }
+  return phrase;
 }
 
 LatticeMBRSolution::LatticeMBRSolution(const TrellisPath& path, bool isMap) :
@@ -94,22 +128,22 @@ LatticeMBRSolution::LatticeMBRSolution(const TrellisPath& path, bool isMap) :
 }
 
 
-void LatticeMBRSolution::CalcScore(map<Phrase, float>& finalNgramScores, const vector<float>& thetas, float mapWeight)
+void LatticeMBRSolution::CalcScore(const NgramExpectations& finalNgramScores, const vector<float>& thetas, float mapWeight)
 {
   m_ngramScores.assign(thetas.size()-1, -10000);
 
-  map < Phrase, int > counts;
-  extract_ngrams(m_words,counts);
+  NgramCounts counts;
+  finalNgramScores.ExtractNgrams(m_words,counts);
 
   //Now score this translation
   m_score = thetas[0] * m_words.size();
 
   //Calculate the ngramScores, working in log space at first
-  for (map < Phrase, int >::iterator ngrams = counts.begin(); ngrams != counts.end(); ++ngrams) {
+  for (NgramCounts::const_iterator ngrams = counts.begin(); ngrams != counts.end(); ++ngrams) {
     float ngramPosterior = UNKNGRAMLOGPROB;
-    map<Phrase,float>::const_iterator ngramPosteriorIt = finalNgramScores.find(ngrams->first);
-    if (ngramPosteriorIt != finalNgramScores.end()) {
-      ngramPosterior = ngramPosteriorIt->second;
+    const float* ngramPosteriorIt = finalNgramScores.Find(ngrams->first);
+    if (ngramPosteriorIt != NULL) {
+      ngramPosterior = *ngramPosteriorIt;
     }
     size_t ngramSize = ngrams->first.GetSize();
     m_ngramScores[ngramSize-1] = log_sum(log((float)ngrams->second) + ngramPosterior,m_ngramScores[ngramSize-1]);
@@ -127,7 +161,41 @@ void LatticeMBRSolution::CalcScore(map<Phrase, float>& finalNgramScores, const v
 }
 
 
-void pruneLatticeFB(Lattice & connectedHyp, map < const Hypothesis*, set <const Hypothesis* > > & outgoingHyps, map<const Hypothesis*, vector<Edge> >& incomingEdges,
+namespace
+{
+
+/** Set of hypotheses of one sentence, by id */
+class HypothesisIdSet
+{
+public:
+  explicit HypothesisIdSet(size_t maxId) : m_members(maxId + 1, false) {}
+
+  bool Contains(const Hypothesis* hypo) const {
+    if (hypo == NULL) return false;
+    size_t id = hypo->GetId();
+    return id < m_members.size() && m_members[id];
+  }
+
+  void Insert(const Hypothesis* hypo) {
+    m_members[hypo->GetId()] = true;
+  }
+
+private:
+  std::vector<bool> m_members;
+};
+
+size_t GetMaxId(const Lattice& hypos)
+{
+  size_t maxId = 0;
+  for (size_t i = 0; i < hypos.size(); ++i) {
+    maxId = max(maxId, (size_t) hypos[i]->GetId());
+  }
+  return maxId;
+}
+
+}
+
+void pruneLatticeFB(Lattice & connectedHyp, map < const Hypothesis*, set <const Hypothesis* > > & outgoingHyps, IncomingEdges& incomingEdges,
                     const vector< float> & estimatedScores, const Hypothesis* bestHypo, size_t edgeDensity, float scale)
 {
 
@@ -145,27 +213,33 @@ void pruneLatticeFB(Lattice & connectedHyp, map < const Hypothesis*, set <const
       outgoingHyps[emptyHyp].insert(connectedHyp[i]);
   }
 
-  //sort hyps based on estimated scores - do so by copying to multimap
-  multimap<float, const Hypothesis*> sortHypsByVal;
+  //sort hyps based on estimated scores, best first. Of hyps with equal
+  //scores, the one that comes later in connectedHyp goes first
+  vector<pair<float, size_t> > sortHypsByVal;
+  sortHypsByVal.reserve(connectedHyp.size());
   for (size_t i =0; i < estimatedScores.size(); ++i) {
-    sortHypsByVal.insert(make_pair(estimatedScores[i], connectedHyp[i]));
+    sortHypsByVal.push_back(make_pair(estimatedScores[i], i));
   }
 
-  multimap<float, const Hypothesis*>::const_iterator it = --sortHypsByVal.end();
-  float bestScore = it->first;
+  float bestScore = max_element(sortHypsByVal.begin(), sortHypsByVal.end())->first;
   //store best score as score of hyp 0
-  sortHypsByVal.insert(make_pair(bestScore, emptyHyp));
+  sortHypsByVal.push_back(make_pair(bestScore, connectedHyp.size() - 1));
+  sort(sortHypsByVal.begin(), sortHypsByVal.end(), greater<pair<float, size_t> >());
 
 
   IFVERBOSE(3) {
-    for (multimap<float, const Hypothesis*>::const_iterator it = --sortHypsByVal.end(); it != --sortHypsByVal.begin(); --it) {
-      const Hypothesis* currHyp =  it->second;
+    for (vector<pair<float, size_t> >::const_iterator it = sortHypsByVal.begin(); it != sortHypsByVal.end(); ++it) {
+      const Hypothesis* currHyp =  connectedHyp[it->second];
       cerr << "Hyp " << currHyp->GetId() << ", estimated score: " << it->first << endl;
     }
   }
 
 
-  set <const Hypothesis*> survivingHyps; //store hyps that make the cut in this
+  const size_t maxId = GetMaxId(connectedHyp);
+  HypothesisIdSet survivingHyps(maxId); //store hyps that make the cut in this
+  Lattice survivingList;
+  incomingEdges.clear();
+  incomingEdges.resize(maxId + 1);
 
   VERBOSE(2, "BEST HYPO TARGET LENGTH : " << bestHypo->GetSize() << endl)
   size_t numEdgesTotal = edgeDensity * bestHypo->GetSize(); //as per Shankar, aim for (density * target length of MAP solution) arcs
@@ -174,10 +248,10 @@ void pruneLatticeFB(Lattice & connectedHyp, map < const Hypothesis*, set <const
 
   float prevScore = -999999;
 
-  //now iterate over multimap
-  for (multimap<float, const Hypothesis*>::const_iterator it = --sortHypsByVal.end(); it != --sortHypsByVal.begin(); --it) {
+  //now iterate over sorted hyps
+  for (vector<pair<float, size_t> >::const_iterator it = sortHypsByVal.begin(); it != sortHypsByVal.end(); ++it) {
     float currEstimatedScore = it->first;
-    const Hypothesis* currHyp =  it->second;
+    const Hypothesis* currHyp =  connectedHyp[it->second];
 
     if (numEdgesCreated >= numEdgesTotal && prevScore > currEstimatedScore) //if this hyp has equal estimated score to previous, include its edges too
       break;
@@ -186,11 +260,14 @@ void pruneLatticeFB(Lattice & connectedHyp, map < const Hypothesis*, set <const
     VERBOSE(3, "Num edges created : "<< numEdgesCreated << ", numEdges wanted " << numEdgesTotal << endl)
     VERBOSE(3, "Considering hyp " << currHyp->GetId() << ", estimated score: " << it->first << endl)
 
-    survivingHyps.insert(currHyp); //CurrHyp made the cut
+    if (!survivingHyps.Contains(currHyp)) {
+      survivingHyps.Insert(currHyp); //CurrHyp made the cut
+      survivingList.push_back(currHyp);
+    }
 
     // is its best predecessor already included ?
-    if (survivingHyps.find(currHyp->GetPrevHypo()) != survivingHyps.end()) { //yes, then add an edge
-      vector <Edge>& edges = incomingEdges[currHyp];
+    if (survivingHyps.Contains(currHyp->GetPrevHypo())) { //yes, then add an edge
+      vector <Edge>& edges = incomingEdges[currHyp->GetId()];
       Edge winningEdge(currHyp->GetPrevHypo(),currHyp,scale*(currHyp->GetScore() - currHyp->GetPrevHypo()->GetScore()),currHyp->GetCurrTargetPhrase());
       edges.push_back(winningEdge);
       ++numEdgesCreated;
@@ -203,10 +280,10 @@ void pruneLatticeFB(Lattice & connectedHyp, map < const Hypothesis*, set <const
       for (iterArcList = arcList->begin() ; iterArcList != arcList->end() ; ++iterArcList) {
         const Hypothesis *loserHypo = *iterArcList;
         const Hypothesis* loserPrevHypo = loserHypo->GetPrevHypo();
-        if (survivingHyps.find(loserPrevHypo) != survivingHyps.end()) { //found it, add edge
+        if (survivingHyps.Contains(loserPrevHypo)) { //found it, add edge
           double arcScore = loserHypo->GetScore() - loserPrevHypo->GetScore();
           Edge losingEdge(loserPrevHypo, currHyp, arcScore*scale, loserHypo->GetCurrTargetPhrase());
-          vector <Edge>& edges = incomingEdges[currHyp];
+          vector <Edge>& edges = incomingEdges[currHyp->GetId()];
           edges.push_back(losingEdge);
           ++numEdgesCreated;
         }
@@ -221,15 +298,14 @@ void pruneLatticeFB(Lattice & connectedHyp, map < const Hypothesis*, set <const
       for (set<const Hypothesis*>::const_iterator outHypIts = outHyps.begin(); outHypIts != outHyps.end(); ++outHypIts) {
         const Hypothesis* succHyp = *outHypIts;
 
-        if (survivingHyps.find(succHyp) == survivingHyps.end()) //Have we encountered the successor yet?
+        if (!survivingHyps.Contains(succHyp)) //Have we encountered the successor yet?
           continue; //No, move on to next
 
         //Curr Hyp can be : a) the best predecessor  of succ b) or an arc attached to succ
         if (succHyp->GetPrevHypo() == currHyp) { //best predecessor
-          vector <Edge>& succEdges = incomingEdges[succHyp];
+          vector <Edge>& succEdges = incomingEdges[succHyp->GetId()];
           Edge succWinningEdge(currHyp, succHyp, scale*(succHyp->GetScore() - currHyp->GetScore()), succHyp->GetCurrTargetPhrase());
           succEdges.push_back(succWinningEdge);
-          survivingHyps.insert(succHyp);
           ++numEdgesCreated;
         }
 
@@ -242,7 +318,7 @@ void pruneLatticeFB(Lattice & connectedHyp, map < const Hypothesis*, set <const
             const Hypothesis *loserHypo = *iterArcList;
             const Hypothesis* loserPrevHypo = loserHypo->GetPrevHypo();
             if (loserPrevHypo == currHyp) { //found it
-              vector <Edge>& succEdges = incomingEdges[succHyp];
+              vector <Edge>& succEdges = incomingEdges[succHyp->GetId()];
               double arcScore = loserHypo->GetScore() - currHyp->GetScore();
               Edge losingEdge(currHyp, succHyp,scale* arcScore, loserHypo->GetCurrTargetPhrase());
               succEdges.push_back(losingEdge);
@@ -254,16 +330,13 @@ void pruneLatticeFB(Lattice & connectedHyp, map < const Hypothesis*, set <const
     }
   }
 
-  connectedHyp.clear();
-  for (set <const Hypothesis*>::iterator it =  survivingHyps.begin(); it != survivingHyps.end(); ++it) {
-    connectedHyp.push_back(*it);
-  }
+  connectedHyp.swap(survivingList);
 
   VERBOSE(2, "Done! Num edges created : "<< numEdgesCreated << ", numEdges wanted " << numEdgesTotal << endl)
 
   IFVERBOSE(3) {
     cerr << "Surviving hyps: " ;
-    for (set <const Hypothesis*>::iterator it =  survivingHyps.begin(); it != survivingHyps.end(); ++it) {
+    for (Lattice::const_iterator it =  connectedHyp.begin(); it != connectedHyp.end(); ++it) {
       cerr << (*it)->GetId() << " ";
     }
     cerr << endl;
@@ -272,203 +345,385 @@ void pruneLatticeFB(Lattice & connectedHyp, map < const Hypothesis*, set <const
 
 }
 
-void calcNgramExpectations(Lattice & connectedHyp, map<const Hypothesis*, vector<Edge> >& incomingEdges,
-                           map<Phrase, float>& finalNgramScores, bool posteriors)
+namespace
+{
+
+//! pads the path of an NgramPath with fewer edges than bleu_order
+const unsigned int NO_EDGE = UINT_MAX;
+
+/** An n-gram that ends on an edge, with the path of edges it spans */
+struct NgramPath {
+  NgramKey m_ngram;
+  unsigned int m_path[bleu_order]; //! edges from first to last, padded with NO_EDGE
+  float m_score; //! forward score of the tail of the first edge plus the scores of the edges
+  size_t m_count; //! times the n-gram occurs on the path
+
+  size_t GetPathSize() const {
+    return find(m_path, m_path + bleu_order, NO_EDGE) - m_path;
+  }
+
+  bool SamePath(const NgramPath& other) const {
+    return m_ngram == other.m_ngram && equal(m_path, m_path + bleu_order, other.m_path);
+  }
+
+  bool operator< (const NgramPath& compare) const {
+    if (m_ngram < compare.m_ngram)
+      return true;
+    if (compare.m_ngram < m_ngram)
+      return false;
+    return lexicographical_compare(m_path, m_path + bleu_order, compare.m_path, compare.m_path + bleu_order);
+  }
+};
+
+//! n-gram scores of a node, sorted by n-gram
+typedef vector<pair<NgramKey, float> > NodeScores;
+
+/** log_sum of a sequence of log scores */
+class LogScoreSum
+{
+public:
+  LogScoreSum() : m_empty(true), m_score(0) {}
+
+  void Add(float score) {
+    m_score = m_empty ? score : log_sum(score, m_score);
+    m_empty = false;
+  }
+
+  float Get() const {
+    return m_score;
+  }
+
+private:
+  bool m_empty;
+  float m_score;
+};
+
+/**
+* The pruned lattice laid out in arrays for the n-gram expectation
+* computation: nodes sorted by coverage, and the incoming edges of each node,
+* their word ids and n-gram histories stored by node and edge index.  All
+* nodes of one coverage only depend on nodes of lower coverage, so they are
+* processed in parallel.
+*/
+class ExpectationLattice
+{
+public:
+  ExpectationLattice(Lattice& connectedHyp, const IncomingEdges& incomingEdges, NgramExpectations& expectations, bool posteriors);
+
+  void ProcessNodes(size_t begin, size_t end) {
+    for (size_t node = begin; node < end; ++node) {
+      ProcessNode(node);
+    }
+  }
+
+  //! forward scores and n-gram scores of all nodes
+  void Process();
+
+  //! ngram scores summed over the complete nodes, normalised by the total score of the lattice
+  void Collect(NgramExpectations& expectations) const;
+
+private:
+  void ProcessNode(size_t node);
+  void CalcHistory(size_t edge);
+  const unsigned int* GetWordIds(size_t edge) const {
+    return m_wordIds.empty() ? NULL : &m_wordIds[0] + m_wordBegin[edge];
+  }
+
+  Lattice& m_nodes;
+  bool m_posteriors;
+  vector<size_t> m_levelBegin; //! first node of each coverage, and the number of nodes
+
+  vector<size_t> m_edgeBegin; //! first incoming edge of each node, and the number of edges
+  vector<const Edge*> m_edges;
+  vector<size_t> m_edgeTail;
+  vector<size_t> m_wordBegin; //! first word id of each edge, and the number of word ids
+  vector<unsigned int> m_wordIds;
+
+  vector<float> m_forwardScores;
+  vector<NodeScores> m_nodeScores;
+  vector<vector<NgramPath> > m_histories;
+};
+
+bool ascendingCoverageIdCmp(const Hypothesis* a, const Hypothesis* b)
+{
+  size_t aCovered = a->GetWordsBitmap().GetNumWordsCovered();
+  size_t bCovered = b->GetWordsBitmap().GetNumWordsCovered();
+  return aCovered < bCovered || (aCovered == bCovered && a->GetId() < b->GetId());
+}
+
+ExpectationLattice::ExpectationLattice(Lattice& connectedHyp, const IncomingEdges& incomingEdges, NgramExpectations& expectations, bool posteriors)
+  :m_nodes(connectedHyp)
+  ,m_posteriors(posteriors)
 {
+  sort(m_nodes.begin(),m_nodes.end(),ascendingCoverageIdCmp); //sort by increasing source word cov
 
-  sort(connectedHyp.begin(),connectedHyp.end(),ascendingCoverageCmp); //sort by increasing source word cov
+  vector<size_t> nodeIndex(GetMaxId(m_nodes) + 1, m_nodes.size());
+  for (size_t node = 0; node < m_nodes.size(); ++node) {
+    nodeIndex[m_nodes[node]->GetId()] = node;
+    if (node == 0 || ascendingCoverageCmp(m_nodes[node - 1], m_nodes[node])) {
+      m_levelBegin.push_back(node);
+    }
 
-  /*cerr << "Lattice:" << endl;
-  for (Lattice::const_iterator i = connectedHyp.begin(); i != connectedHyp.end(); ++i) {
-      const Hypothesis* h = *i;
-      cerr << *h << endl;
-      const vector<Edge>& edges = incomingEdges[h];
+    m_edgeBegin.push_back(m_edges.size());
+    size_t id = m_nodes[node]->GetId();
+    if (id < incomingEdges.size()) {
+      const vector<Edge>& edges = incomingEdges[id];
       for (size_t e = 0; e < edges.size(); ++e) {
-          cerr << edges[e];
+        m_edges.push_back(&edges[e]);
       }
-  }*/
+    }
+  }
+  m_levelBegin.push_back(m_nodes.size());
+  m_edgeBegin.push_back(m_edges.size());
+
+  m_edgeTail.resize(m_edges.size());
+  for (size_t e = 0; e < m_edges.size(); ++e) {
+    size_t tailId = m_edges[e]->GetTailNode()->GetId();
+    CHECK(tailId < nodeIndex.size() && nodeIndex[tailId] < m_nodes.size());
+    m_edgeTail[e] = nodeIndex[tailId];
+
+    m_wordBegin.push_back(m_wordIds.size());
+    const Phrase& words = m_edges[e]->GetWords();
+    for (size_t pos = 0; pos < words.GetSize(); ++pos) {
+      m_wordIds.push_back(expectations.AddWord(words.GetWord(pos)));
+    }
+  }
+  m_wordBegin.push_back(m_wordIds.size());
 
-  map<const Hypothesis*, float> forwardScore;
-  forwardScore[connectedHyp[0]] = 0.0f; //forward score of hyp 0 is 1 (or 0 in logprob space)
-  set< const Hypothesis *> finalHyps; //store completed hyps
+  m_forwardScores.resize(m_nodes.size(), 0.0f); //forward score of hyp 0 is 1 (or 0 in logprob space)
+  m_nodeScores.resize(m_nodes.size());
+  m_histories.resize(m_edges.size());
+}
 
-  NgramScores ngramScores;//ngram scores for each hyp
+#ifdef WITH_THREADS
+/** Processes a slice of the nodes of one coverage */
+class ProcessNodesTask : public Task
+{
+public:
+  ProcessNodesTask(ExpectationLattice& lattice, size_t begin, size_t end, TaskLatch& latch)
+    :m_lattice(lattice)
+    ,m_begin(begin)
+    ,m_end(end)
+    ,m_latch(latch) {
+  }
 
-  for (size_t i = 1; i < connectedHyp.size(); ++i) {
-    const Hypothesis* currHyp = connectedHyp[i];
-    if (currHyp->GetWordsBitmap().IsComplete()) {
-      finalHyps.insert(currHyp);
-    }
+  virtual void Run() {
+    m_lattice.ProcessNodes(m_begin, m_end);
+    m_latch.Done();
+  }
 
-    VERBOSE(3, "Processing hyp: " << currHyp->GetId() << ", num words cov= " << currHyp->GetWordsBitmap().GetNumWordsCovered() <<  endl)
+private:
+  ExpectationLattice& m_lattice;
+  size_t m_begin, m_end;
+  TaskLatch& m_latch;
+};
+#endif
 
-    vector <Edge> & edges = incomingEdges[currHyp];
-    for (size_t e = 0; e < edges.size(); ++e) {
-      const Edge& edge = edges[e];
-      if (forwardScore.find(currHyp) == forwardScore.end()) {
-        forwardScore[currHyp] = forwardScore[edge.GetTailNode()] + edge.GetScore();
-        VERBOSE(3, "Fwd score["<<currHyp->GetId()<<"] = fwdScore["<<edge.GetTailNode()->GetId() << "] + edge Score: " << edge.GetScore() << endl)
-      } else {
-        forwardScore[currHyp] = log_sum(forwardScore[currHyp], forwardScore[edge.GetTailNode()] + edge.GetScore());
-        VERBOSE(3, "Fwd score["<<currHyp->GetId()<<"] += fwdScore["<<edge.GetTailNode()->GetId() << "] + edge Score: " << edge.GetScore() << endl)
+void ExpectationLattice::Process()
+{
+#ifdef WITH_THREADS
+  const size_t numThreads = StaticData::Instance().GetSearchThreadCount();
+#endif
+
+  for (size_t level = 0; level + 1 < m_levelBegin.size(); ++level) {
+    const size_t begin = m_levelBegin[level];
+    const size_t end = m_levelBegin[level + 1];
+#ifdef WITH_THREADS
+    if (numThreads > 1 && end - begin > 1) {
+      // a few slices per thread, as nodes differ in the number of edges
+      const size_t numNodes = end - begin;
+      const size_t numTasks = min(numNodes, 4 * numThreads);
+      TaskLatch latch(numTasks);
+      for (size_t i = 0; i < numTasks; ++i) {
+        GetSearchThreadPool().Submit(new ProcessNodesTask(*this
+                                     , begin + numNodes * i / numTasks
+                                     , begin + numNodes * (i + 1) / numTasks
+                                     , latch));
       }
+      latch.Wait();
+      continue;
     }
+#endif
+    ProcessNodes(begin, end);
+  }
+}
+
+void ExpectationLattice::ProcessNode(size_t node)
+{
+  const size_t edgeBegin = m_edgeBegin[node];
+  const size_t edgeEnd = m_edgeBegin[node + 1];
+
+  VERBOSE(3, "Processing hyp: " << m_nodes[node]->GetId() << ", num words cov= " << m_nodes[node]->GetWordsBitmap().GetNumWordsCovered() <<  endl)
 
-    //Process ngrams now
-    for (size_t j =0 ; j < edges.size(); ++j) {
-      Edge& edge = edges[j];
-      const NgramHistory & incomingPhrases = edge.GetNgrams(incomingEdges);
+  float& forwardScore = m_forwardScores[node];
+  for (size_t e = edgeBegin; e < edgeEnd; ++e) {
+    float score = m_forwardScores[m_edgeTail[e]] + m_edges[e]->GetScore();
+    forwardScore = (e == edgeBegin) ? score : log_sum(forwardScore, score);
+  }
+
+  //Process ngrams now.  The scores of each edge are merged into those of
+  //the previous edges, keeping them sorted by n-gram
+  NodeScores ngramScores, merged;
+  for (size_t e = edgeBegin; e < edgeEnd; ++e) {
+    CalcHistory(e);
+    const vector<NgramPath>& history = m_histories[e];
+    const NodeScores& tailScores = m_nodeScores[m_edgeTail[e]];
+    const float edgeScore = m_edges[e]->GetScore();
+
+    merged.clear();
+    merged.reserve(ngramScores.size() + history.size() + tailScores.size());
+    NodeScores::const_iterator prev = ngramScores.begin();
+    vector<NgramPath>::const_iterator introduced = history.begin();
+    NodeScores::const_iterator propagated = tailScores.begin();
+    while (prev != ngramScores.end() || introduced != history.end() || propagated != tailScores.end()) {
+      NgramKey ngram;
+      bool first = true;
+      if (prev != ngramScores.end()) {
+        ngram = prev->first;
+        first = false;
+      }
+      if (introduced != history.end() && (first || introduced->m_ngram < ngram)) {
+        ngram = introduced->m_ngram;
+        first = false;
+      }
+      if (propagated != tailScores.end() && (first || propagated->first < ngram)) {
+        ngram = propagated->first;
+      }
+
+      LogScoreSum score;
+      if (prev != ngramScores.end() && prev->first == ngram) {
+        score.Add(prev->second);
+        ++prev;
+      }
 
       //let's first score ngrams introduced by this edge
-      for (NgramHistory::const_iterator it = incomingPhrases.begin(); it != incomingPhrases.end(); ++it) {
-        const Phrase& ngram = it->first;
-        const PathCounts& pathCounts = it->second;
-        VERBOSE(4, "Calculating score for: " << it->first << endl)
-
-        for (PathCounts::const_iterator pathCountIt = pathCounts.begin(); pathCountIt != pathCounts.end(); ++pathCountIt) {
-          //Score of an n-gram is forward score of head node of leftmost edge + all edge scores
-          const Path&  path = pathCountIt->first;
-          //cerr << "path count for " << ngram << " is " << pathCountIt->second << endl;
-          float score = forwardScore[path[0]->GetTailNode()];
-          for (size_t i = 0; i < path.size(); ++i) {
-            score += path[i]->GetScore();
-          }
-          //if we're doing expectations, then the number of times the ngram
-          //appears on the path is relevant.
-          size_t count = posteriors ? 1 : pathCountIt->second;
-          for (size_t k = 0; k < count; ++k) {
-            ngramScores.addScore(currHyp,ngram,score);
-          }
+      bool isIntroduced = false;
+      for (; introduced != history.end() && introduced->m_ngram == ngram; ++introduced) {
+        //if we're doing expectations, then the number of times the ngram
+        //appears on the path is relevant.
+        size_t count = m_posteriors ? 1 : introduced->m_count;
+        for (size_t k = 0; k < count; ++k) {
+          score.Add(introduced->m_score);
         }
+        isIntroduced = true;
       }
 
       //Now score ngrams that are just being propagated from the history
-      for (NgramScores::NodeScoreIterator it = ngramScores.nodeBegin(edge.GetTailNode());
-           it != ngramScores.nodeEnd(edge.GetTailNode()); ++it) {
-        const Phrase & currNgram = *(it->first);
-        float currNgramScore = it->second;
-        VERBOSE(4, "Calculating score for: " << currNgram << endl)
-
+      if (propagated != tailScores.end() && propagated->first == ngram) {
         // For posteriors, don't double count ngrams
-        if (!posteriors || incomingPhrases.find(currNgram) == incomingPhrases.end()) {
-          float score = edge.GetScore() + currNgramScore;
-          ngramScores.addScore(currHyp,currNgram,score);
+        if (!m_posteriors || !isIntroduced) {
+          score.Add(edgeScore + propagated->second);
         }
+        ++propagated;
       }
 
+      merged.push_back(make_pair(ngram, score.Get()));
     }
+    ngramScores.swap(merged);
   }
+  m_nodeScores[node].swap(ngramScores);
+}
 
-  float Z = 9999999; //the total score of the lattice
+/**
+* The n-grams ending on an edge: those local to the edge, and those straddling
+* an incoming edge of its tail and this edge
+*/
+void ExpectationLattice::CalcHistory(size_t edge)
+{
+  vector<NgramPath>& history = m_histories[edge];
+  const unsigned int* words = GetWordIds(edge);
+  const size_t size = m_wordBegin[edge + 1] - m_wordBegin[edge];
+  const size_t tail = m_edgeTail[edge];
+  const float edgeScore = m_edges[edge]->GetScore();
 
-  //Done - Print out ngram posteriors for final hyps
-  for (set< const Hypothesis *>::iterator finalHyp = finalHyps.begin(); finalHyp != finalHyps.end(); ++finalHyp) {
-    const Hypothesis* hyp = *finalHyp;
+  //Extract the n-grams local to this edge
+  NgramPath local;
+  fill(local.m_path, local.m_path + bleu_order, NO_EDGE);
+  local.m_path[0] = edge;
+  local.m_score = m_forwardScores[tail] + edgeScore;
+  local.m_count = 1;
+  for (size_t start = 0; start < size; ++start) {
+    for (size_t end = start; end < start + bleu_order && end < size; ++end) {
+      local.m_ngram.m_words[end - start] = words[end];
+      history.push_back(local);
+    }
+    fill(local.m_ngram.m_words, local.m_ngram.m_words + bleu_order, 0);
+  }
 
-    for (NgramScores::NodeScoreIterator it = ngramScores.nodeBegin(hyp); it != ngramScores.nodeEnd(hyp); ++it) {
-      const Phrase& ngram = *(it->first);
-      if (finalNgramScores.find(ngram) == finalNgramScores.end()) {
-        finalNgramScores[ngram] = it->second;
-      } else {
-        finalNgramScores[ngram] = log_sum(it->second,  finalNgramScores[ngram]);
+  //add the ngrams straddling prev and curr edge
+  for (size_t inEdge = m_edgeBegin[tail]; inEdge < m_edgeBegin[tail + 1]; ++inEdge) {
+    const vector<NgramPath>& inHistory = m_histories[inEdge];
+    const unsigned int* inWords = GetWordIds(inEdge);
+    const size_t inSize = m_wordBegin[inEdge + 1] - m_wordBegin[inEdge];
+
+    for (vector<NgramPath>::const_iterator in = inHistory.begin(); in != inHistory.end(); ++in) {
+      const size_t inNgramSize = in->m_ngram.GetSize();
+      const size_t back = min(inNgramSize, inSize);
+      //only extend n-grams that end like the previous edge
+      if (!equal(in->m_ngram.m_words + inNgramSize - back, in->m_ngram.m_words + inNgramSize, inWords + inSize - back)) {
+        continue;
       }
-    }
 
-    if (Z == 9999999) {
-      Z = forwardScore[hyp];
-    } else {
-      Z = log_sum(Z, forwardScore[hyp]);
+      NgramPath extended = *in;
+      extended.m_path[in->GetPathSize()] = edge;
+      extended.m_score = in->m_score + edgeScore;
+      for (size_t i = 0; i < size && i + inNgramSize < bleu_order; ++i) {
+        extended.m_ngram.m_words[inNgramSize + i] = words[i];
+        history.push_back(extended);
+      }
     }
   }
 
-  //Z *= scale;  //scale the score
-
-  for (map<Phrase, float>::iterator finalScoresIt = finalNgramScores.begin();  finalScoresIt != finalNgramScores.end(); ++finalScoresIt) {
-    finalScoresIt->second =  finalScoresIt->second - Z;
-    IFVERBOSE(2) {
-      VERBOSE(2,finalScoresIt->first << " [" << finalScoresIt->second << "]" << endl);
+  //the same n-gram on the same path is counted once, with its count
+  sort(history.begin(), history.end());
+  size_t merged = 0;
+  for (size_t i = 0; i < history.size(); ++i) {
+    if (merged > 0 && history[merged - 1].SamePath(history[i])) {
+      history[merged - 1].m_count += history[i].m_count;
+    } else {
+      history[merged++] = history[i];
     }
   }
-
+  history.resize(merged);
 }
 
-const NgramHistory& Edge::GetNgrams(map<const Hypothesis*, vector<Edge> > & incomingEdges)
+void ExpectationLattice::Collect(NgramExpectations& expectations) const
 {
+  float Z = 9999999; //the total score of the lattice
 
-  if (m_ngrams.size() > 0)
-    return m_ngrams;
-
-  const Phrase& currPhrase = GetWords();
-  //Extract the n-grams local to this edge
-  for (size_t start = 0; start < currPhrase.GetSize(); ++start) {
-    for (size_t end = start; end < start + bleu_order; ++end) {
-      if (end < currPhrase.GetSize()) {
-        Phrase edgeNgram(end-start+1);
-        for (size_t index = start; index <= end; ++index) {
-          edgeNgram.AddWord(currPhrase.GetWord(index));
-        }
-        //cout << "Inserting Phrase : " << edgeNgram << endl;
-        vector<const Edge*> edgeHistory;
-        edgeHistory.push_back(this);
-        storeNgramHistory(edgeNgram, edgeHistory);
-      } else {
-        break;
-      }
+  for (size_t node = 0; node < m_nodes.size(); ++node) {
+    if (!m_nodes[node]->GetWordsBitmap().IsComplete()) {
+      continue;
     }
-  }
-
-  map<const Hypothesis*, vector<Edge> >::iterator it = incomingEdges.find(m_tailNode);
-  if (it != incomingEdges.end()) { //node has incoming edges
-    vector<Edge> & inEdges = it->second;
-
-    for (vector<Edge>::iterator edge = inEdges.begin(); edge != inEdges.end(); ++edge) {//add the ngrams straddling prev and curr edge
-      const NgramHistory & edgeIncomingNgrams = edge->GetNgrams(incomingEdges);
-      for (NgramHistory::const_iterator edgeInNgramHist = edgeIncomingNgrams.begin(); edgeInNgramHist != edgeIncomingNgrams.end(); ++edgeInNgramHist) {
-        const Phrase& edgeIncomingNgram = edgeInNgramHist->first;
-        const PathCounts &  edgeIncomingNgramPaths = edgeInNgramHist->second;
-        size_t back = min(edgeIncomingNgram.GetSize(), edge->GetWordsSize());
-        const Phrase&  edgeWords = edge->GetWords();
-        IFVERBOSE(3) {
-          cerr << "Edge: "<< *edge <<endl;
-          cerr << "edgeWords: " << edgeWords << endl;
-          cerr << "edgeInNgram: " << edgeIncomingNgram << endl;
-        }
 
-        Phrase edgeSuffix(ARRAY_SIZE_INCR);
-        Phrase ngramSuffix(ARRAY_SIZE_INCR);
-        GetPhraseSuffix(edgeWords,back,edgeSuffix);
-        GetPhraseSuffix(edgeIncomingNgram,back,ngramSuffix);
-
-        if (ngramSuffix == edgeSuffix) { //we've got the suffix of previous edge
-          size_t  edgeInNgramSize =  edgeIncomingNgram.GetSize();
-
-          for (size_t i = 0; i < GetWordsSize() && i + edgeInNgramSize < bleu_order ; ++i) {
-            Phrase newNgram(edgeIncomingNgram);
-            for (size_t j = 0; j <= i ; ++j) {
-              newNgram.AddWord(GetWords().GetWord(j));
-            }
-            VERBOSE(3, "Inserting New Phrase : " << newNgram << endl)
+    const NodeScores& scores = m_nodeScores[node];
+    for (NodeScores::const_iterator it = scores.begin(); it != scores.end(); ++it) {
+      expectations.AddScore(it->first, it->second);
+    }
 
-            for (PathCounts::const_iterator pathIt = edgeIncomingNgramPaths.begin(); pathIt !=  edgeIncomingNgramPaths.end(); ++pathIt) {
-              Path newNgramPath = pathIt->first;
-              newNgramPath.push_back(this);
-              storeNgramHistory(newNgram, newNgramPath, pathIt->second);
-            }
-          }
-        }
-      }
+    if (Z == 9999999) {
+      Z = m_forwardScores[node];
+    } else {
+      Z = log_sum(Z, m_forwardScores[node]);
     }
   }
-  return m_ngrams;
+
+  expectations.Normalise(Z);
+}
+
 }
 
-//Add the last lastN words of origPhrase to targetPhrase
-void Edge::GetPhraseSuffix(const Phrase&  origPhrase, size_t lastN, Phrase& targetPhrase) const
+void calcNgramExpectations(Lattice & connectedHyp, const IncomingEdges& incomingEdges,
+                           NgramExpectations& finalNgramScores, bool posteriors)
 {
-  size_t origSize = origPhrase.GetSize();
-  size_t startIndex = origSize - lastN;
-  for (size_t index = startIndex; index < origPhrase.GetSize(); ++index) {
-    targetPhrase.AddWord(origPhrase.GetWord(index));
+  ExpectationLattice lattice(connectedHyp, incomingEdges, finalNgramScores, posteriors);
+  lattice.Process();
+  lattice.Collect(finalNgramScores);
+
+  IFVERBOSE(2) {
+    for (NgramExpectations::const_iterator it = finalNgramScores.begin(); it != finalNgramScores.end(); ++it) {
+      VERBOSE(2,finalNgramScores.GetPhrase(it->first) << " [" << it->second << "]" << endl);
+    }
   }
 }
 
@@ -487,7 +742,7 @@ bool Edge::operator< (const Edge& compare ) const
 
 ostream& operator<< (ostream& out, const Edge& edge)
 {
-  out << "Head: " << edge.m_headNode->GetId() << ", Tail: " << edge.m_tailNode->GetId() << ", Score: " << edge.m_score << ", Phrase: " << edge.m_targetPhrase << endl;
+  out << "Head: " << edge.m_headNode->GetId() << ", Tail: " << edge.m_tailNode->GetId() << ", Score: " << edge.m_score << ", Phrase: " << *edge.m_words << endl;
   return out;
 }
 
@@ -502,9 +757,9 @@ void getLatticeMBRNBest(Manager& manager, TrellisPathList& nBestList,
   const StaticData& staticData = StaticData::Instance();
   std::map < int, bool > connected;
   std::vector< const Hypothesis *> connectedList;
-  map<Phrase, float> ngramPosteriors;
+  NgramExpectations ngramPosteriors;
   std::map < const Hypothesis*, set <const Hypothesis*> > outgoingHyps;
-  map<const Hypothesis*, vector<Edge> > incomingEdges;
+  IncomingEdges incomingEdges;
   vector< float> estimatedScores;
   manager.GetForwardBackwardSearchGraph(&connected, &connectedList, &outgoingHyps, &estimatedScores);
   pruneLatticeFB(connectedList, outgoingHyps, incomingEdges, estimatedScores, manager.GetBestHypothesis(), staticData.GetLatticeMBRPruningFactor(),staticData.GetMBRScale());
@@ -560,9 +815,9 @@ const TrellisPath doConsensusDecoding(Manager& manager, TrellisPathList& nBestLi
   const StaticData& staticData = StaticData::Instance();
   std::map < int, bool > connected;
   std::vector< const Hypothesis *> connectedList;
-  map<Phrase, float> ngramExpectations;
+  NgramExpectations ngramExpectations;
   std::map < const Hypothesis*, set <const Hypothesis*> > outgoingHyps;
-  map<const Hypothesis*, vector<Edge> > incomingEdges;
+  IncomingEdges incomingEdges;
   vector< float> estimatedScores;
   manager.GetForwardBackwardSearchGraph(&connected, &connectedList, &outgoingHyps, &estimatedScores);
   pruneLatticeFB(connectedList, outgoingHyps, incomingEdges, estimatedScores, manager.GetBestHypothesis(), staticData.GetLatticeMBRPruningFactor(),staticData.GetMBRScale());
@@ -571,7 +826,7 @@ const TrellisPath doConsensusDecoding(Manager& manager, TrellisPathList& nBestLi
   //expected length is sum of expected unigram counts
   //cerr << "Thread " << pthread_self() <<  " Ngram expectations size: " << ngramExpectations.size() << endl;
   float ref_length = 0.0f;
-  for (map<Phrase,float>::const_iterator ref_iter = ngramExpectations.begin();
+  for (NgramExpectations::const_iterator ref_iter = ngramExpectations.begin();
        ref_iter != ngramExpectations.end(); ++ref_iter) {
     //cerr << "Ngram: " << ref_iter->first << " score: " <<
     //    ref_iter->second << endl;
@@ -591,14 +846,14 @@ const TrellisPath doConsensusDecoding(Manager& manager, TrellisPathList& nBestLi
   for (iter = nBestList.begin() ; iter != nBestList.end() ; ++iter) {
     const TrellisPath &path = **iter;
     vector<Word> words;
-    map<Phrase,int> ngrams;
+    NgramCounts ngrams;
     GetOutputWords(path,words);
     /*for (size_t i = 0; i < words.size(); ++i) {
         cerr << words[i].GetFactor(0)->GetString() << " ";
     }
     cerr << endl;
     */
-    extract_ngrams(words,ngrams);
+    ngramExpectations.ExtractNgrams(words,ngrams);
 
     vector<float> comps(2*BLEU_ORDER+1);
     float logbleu = 0.0;
@@ -609,11 +864,11 @@ const TrellisPath doConsensusDecoding(Manager& manager, TrellisPathList& nBestLi
       comps[2*i+1] = max(hyp_length-i,0);
     }
 
-    for (map<Phrase,int>::const_iterator hyp_iter = ngrams.begin();
+    for (NgramCounts::const_iterator hyp_iter = ngrams.begin();
          hyp_iter != ngrams.end(); ++hyp_iter) {
-      map<Phrase,float>::const_iterator ref_iter = ngramExpectations.find(hyp_iter->first);
-      if (ref_iter != ngramExpectations.end()) {
-        comps[2*(hyp_iter->first.GetSize()-1)] += min(exp(ref_iter->second), (float)(hyp_iter->second));
+      const float* ref_score = ngramExpectations.Find(hyp_iter->first);
+      if (ref_score != NULL) {
+        comps[2*(hyp_iter->first.GetSize()-1)] += min(exp(*ref_score), (float)(hyp_iter->second));
       }
 
     }
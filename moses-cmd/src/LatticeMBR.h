@@ -10,35 +10,36 @@
 #ifndef moses_cmd_LatticeMBR_h
 #define moses_cmd_LatticeMBR_h
 
+#include <algorithm>
 #include <map>
 #include <vector>
 #include <set>
+#include <boost/unordered_map.hpp>
 #include "Hypothesis.h"
 #include "Manager.h"
 #include "TrellisPathList.h"
 
 using namespace Moses;
 
-
+//! longest n-gram collected from the lattice
+const size_t bleu_order = 4;
 
 class Edge;
 
 typedef std::vector< const Hypothesis *> Lattice;
-typedef std::vector<const Edge*> Path;
-typedef std::map<Path, size_t> PathCounts;
-typedef std::map<Phrase, PathCounts > NgramHistory;
+
+/** Pruned lattice: the incoming edges of each node, indexed by hypothesis id */
+typedef std::vector<std::vector<Edge> > IncomingEdges;
 
 class Edge
 {
   const Hypothesis* m_tailNode;
   const Hypothesis* m_headNode;
   float m_score;
-  TargetPhrase m_targetPhrase;
-  NgramHistory m_ngrams;
+  const Phrase* m_words;
 
 public:
-  Edge(const Hypothesis* from, const Hypothesis* to, float score, const TargetPhrase& targetPhrase) : m_tailNode(from), m_headNode(to), m_score(score), m_targetPhrase(targetPhrase) {
-    //cout << "Creating new edge from Node " << from->GetId() << ", to Node : " << to->GetId() << ", score: " << score << " phrase: " << targetPhrase << endl;
+  Edge(const Hypothesis* from, const Hypothesis* to, float score, const Phrase& words) : m_tailNode(from), m_headNode(to), m_score(score), m_words(&words) {
   }
 
   const Hypothesis* GetHeadNode() const {
@@ -54,49 +55,88 @@ public:
   }
 
   size_t GetWordsSize() const {
-    return m_targetPhrase.GetSize();
+    return m_words->GetSize();
   }
 
   const Phrase& GetWords() const {
-    return m_targetPhrase;
+    return *m_words;
   }
 
   friend std::ostream& operator<< (std::ostream& out, const Edge& edge);
 
-  const NgramHistory&  GetNgrams(  std::map<const Hypothesis*, std::vector<Edge> > & incomingEdges) ;
-
   bool operator < (const Edge & compare) const;
+};
+
+/** An n-gram of word ids (see NgramExpectations), padded with 0 */
+struct NgramKey {
+  unsigned int m_words[bleu_order];
 
-  void GetPhraseSuffix(const Phrase& origPhrase, size_t lastN, Phrase& targetPhrase) const;
+  NgramKey() {
+    std::fill(m_words, m_words + bleu_order, 0);
+  }
 
-  void storeNgramHistory(const Phrase& phrase, Path & path, size_t count = 1) {
-    m_ngrams[phrase][path]+= count;
+  size_t GetSize() const {
+    size_t size = 0;
+    while (size < bleu_order && m_words[size] != 0) ++size;
+    return size;
   }
 
+  bool operator< (const NgramKey& compare) const {
+    return std::lexicographical_compare(m_words, m_words + bleu_order, compare.m_words, compare.m_words + bleu_order);
+  }
+  bool operator== (const NgramKey& compare) const {
+    return std::equal(m_words, m_words + bleu_order, compare.m_words);
+  }
 };
 
+size_t hash_value(const NgramKey& key);
+
+typedef boost::unordered_map<NgramKey, int> NgramCounts;
+
 /**
-* Data structure to hold the ngram scores as we traverse the lattice. Maps (hypo,ngram) to score
+* Log expected counts (or posteriors) of the n-grams of a lattice.  The words
+* of the lattice are numbered from 1, so that n-grams are hashed as small
+* fixed size keys rather than compared as phrases.
 */
-class NgramScores
+class NgramExpectations
 {
 public:
-  NgramScores() {}
+  typedef boost::unordered_map<NgramKey, float> Scores;
+  typedef Scores::const_iterator const_iterator;
+
+  //! id of word, numbering it if it is new
+  unsigned int AddWord(const Word& word);
+
+  //! n-grams of sentence with their counts.  Words the lattice doesn't contain get ids of their own
+  void ExtractNgrams(const std::vector<Word>& sentence, NgramCounts& counts) const;
 
   /** logsum this score to the existing score */
-  void addScore(const Hypothesis* node, const Phrase& ngram, float score);
+  void AddScore(const NgramKey& ngram, float score);
 
-  /** Iterate through ngrams for selected node */
-  typedef std::map<const Phrase*, float>::const_iterator NodeScoreIterator;
-  NodeScoreIterator nodeBegin(const Hypothesis* node);
-  NodeScoreIterator nodeEnd(const Hypothesis* node);
+  //! log score of ngram, or NULL if the lattice doesn't contain it
+  const float* Find(const NgramKey& ngram) const {
+    Scores::const_iterator it = m_scores.find(ngram);
+    return it == m_scores.end() ? NULL : &it->second;
+  }
+
+  const_iterator begin() const {
+    return m_scores.begin();
+  }
+  const_iterator end() const {
+    return m_scores.end();
+  }
+
+  /** Subtract the log total score of the lattice from all scores */
+  void Normalise(float Z);
+
+  Phrase GetPhrase(const NgramKey& ngram) const;
 
 private:
-  std::set<Phrase> m_ngrams;
-  std::map<const Hypothesis*, std::map<const Phrase*, float> > m_scores;
+  std::map<Word, unsigned int> m_vocab;
+  std::vector<Word> m_words; //! word of each id, less 1
+  Scores m_scores;
 };
 
-
 /** Holds a lattice mbr solution, and its scores */
 class LatticeMBRSolution
 {
@@ -117,7 +157,7 @@ public:
   }
 
   /** Initialise ngram scores */
-  void CalcScore(std::map<Phrase, float>& finalNgramScores, const std::vector<float>& thetas, float mapWeight);
+  void CalcScore(const NgramExpectations& finalNgramScores, const std::vector<float>& thetas, float mapWeight);
 
 private:
   std::vector<Word> m_words;
@@ -132,16 +172,15 @@ struct LatticeMBRSolutionComparator {
   }
 };
 
-void pruneLatticeFB(Lattice & connectedHyp, std::map < const Hypothesis*, std::set <const Hypothesis* > > & outgoingHyps, std::map<const Hypothesis*, std::vector<Edge> >& incomingEdges,
+void pruneLatticeFB(Lattice & connectedHyp, std::map < const Hypothesis*, std::set <const Hypothesis* > > & outgoingHyps, IncomingEdges& incomingEdges,
                     const std::vector< float> & estimatedScores, const Hypothesis*, size_t edgeDensity,float scale);
 
 //Use the ngram scores to rerank the nbest list, return at most n solutions
 void getLatticeMBRNBest(Manager& manager, TrellisPathList& nBestList, std::vector<LatticeMBRSolution>& solutions, size_t n);
 //calculate expectated ngram counts, clipping at 1 (ie calculating posteriors) if posteriors==true.
-void calcNgramExpectations(Lattice & connectedHyp, std::map<const Hypothesis*, std::vector<Edge> >& incomingEdges, std::map<Phrase,
-                           float>& finalNgramScores, bool posteriors);
+//Nodes of equal coverage are processed on the search threads.
+void calcNgramExpectations(Lattice & connectedHyp, const IncomingEdges& incomingEdges, NgramExpectations& finalNgramScores, bool posteriors);
 void GetOutputFactors(const TrellisPath &path, std::vector <Word> &translation);
-void extract_ngrams(const std::vector<Word >& sentence, std::map < Phrase, int >  & allngrams);
 bool ascendingCoverageCmp(const Hypothesis* a, const Hypothesis* b);
 std::vector<Word> doLatticeMBR(Manager& manager, TrellisPathList& nBestList);
 const TrellisPath doConsensusDecoding(Manager& manager, TrellisPathList& nBestList);
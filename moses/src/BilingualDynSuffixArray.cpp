@@ -5,13 +5,58 @@
 #include "TargetPhrase.h"
 #include <iomanip>
 
+#ifdef WITH_THREADS
+#include "ThreadPool.h"
+#endif
+
 using namespace std;
 
 namespace Moses {
 
+#ifdef WITH_THREADS
+//! fewer sampled sentences are not worth a task of their own
+const size_t MIN_SAMPLES_PER_TASK = 8;
+
+/** Extracts and scores the phrase pairs of a slice of the sampled sentences */
+class BilingualDynSuffixArray::ExtractTask : public Task
+{
+public:
+  ExtractTask(const BilingualDynSuffixArray &biSA, const std::vector<unsigned> &wrdIndices
+              , const std::vector<int> &sntIndexes, size_t sourceSize, const WordPairProbs &wordPairProbs
+              , size_t begin, size_t end
+              , std::vector<std::vector<ExtractedPhrase> > &extracted, TaskLatch &latch)
+    :m_biSA(biSA)
+    ,m_wrdIndices(wrdIndices)
+    ,m_sntIndexes(sntIndexes)
+    ,m_sourceSize(sourceSize)
+    ,m_wordPairProbs(wordPairProbs)
+    ,m_begin(begin)
+    ,m_end(end)
+    ,m_extracted(extracted)
+    ,m_latch(latch) {
+  }
+
+  virtual void Run() {
+    m_biSA.ExtractSamples(m_wrdIndices, m_sntIndexes, m_sourceSize, m_wordPairProbs, m_begin, m_end, m_extracted);
+    m_latch.Done();
+  }
+
+private:
+  const BilingualDynSuffixArray &m_biSA;
+  const std::vector<unsigned> &m_wrdIndices;
+  const std::vector<int> &m_sntIndexes;
+  size_t m_sourceSize;
+  const WordPairProbs &m_wordPairProbs;
+  size_t m_begin, m_end;
+  std::vector<std::vector<ExtractedPhrase> > &m_extracted;
+  TaskLatch &m_latch;
+};
+#endif
+
 BilingualDynSuffixArray::BilingualDynSuffixArray():
 	m_maxPhraseLength(StaticData::Instance().GetMaxPhraseLength()), 
-	m_maxSampleSize(20)
+	m_maxSampleSize(20),
+	m_maxCachedPhrases(10000)
 { 
 	m_srcSA = 0; 
 	m_trgSA = 0;
@@ -219,14 +264,13 @@ bool BilingualDynSuffixArray::GetLocalVocabIDs(const Phrase& src, SAPhrase &outp
 	return true;
 }
 
-pair<float, float> BilingualDynSuffixArray::GetLexicalWeight(const PhrasePair& phrasepair) const 
+pair<float, float> BilingualDynSuffixArray::GetLexicalWeight(const PhrasePair& phrasepair, const WordPairProbs& wordPairProbs) const 
 {
 	//return pair<float, float>(1, 1);
 	float srcLexWeight(1.0), trgLexWeight(1.0);
 	std::map<pair<wordID_t, wordID_t>, float> targetProbs; // collect sum of target probs given source words
 	//const SentenceAlignment& alignment = m_alignments[phrasepair.m_sntIndex];
 	const SentenceAlignment& alignment = GetSentenceAlignment(phrasepair.m_sntIndex);
-	std::map<pair<wordID_t, wordID_t>, pair<float, float> >::const_iterator itrCache; 
 	// for each source word
 	for(int srcIdx = phrasepair.m_startSource; srcIdx <= phrasepair.m_endSource; ++srcIdx) {
 		float srcSumPairProbs(0);
@@ -235,14 +279,10 @@ pair<float, float> BilingualDynSuffixArray::GetLexicalWeight(const PhrasePair& p
     // for each target word aligned to this source word in this alignment
 		if(srcWordAlignments.size() == 0) { // get p(NULL|src)
 			pair<wordID_t, wordID_t> wordpair = make_pair(srcWord, m_srcVocab->GetkOOVWordID());
-			itrCache = m_wordPairCache.find(wordpair);
-			if(itrCache == m_wordPairCache.end()) { // if not in cache
-				CacheWordProbs(srcWord);
-				itrCache = m_wordPairCache.find(wordpair); // search cache again
-			}
-			CHECK(itrCache != m_wordPairCache.end());
-			srcSumPairProbs += itrCache->second.first;
-			targetProbs[wordpair] = itrCache->second.second;
+			WordPairProbs::const_iterator itrProbs = wordPairProbs.find(wordpair);
+			CHECK(itrProbs != wordPairProbs.end());
+			srcSumPairProbs += itrProbs->second.first;
+			targetProbs[wordpair] = itrProbs->second.second;
 		}
 		else { // extract p(trg|src) 
 			for(size_t i = 0; i < srcWordAlignments.size(); ++i) { // for each aligned word
@@ -250,14 +290,10 @@ pair<float, float> BilingualDynSuffixArray::GetLexicalWeight(const PhrasePair& p
 				wordID_t trgWord = m_trgCorpus->at(trgIdx + m_trgSntBreaks[phrasepair.m_sntIndex]);
 				// get probability of this source->target word pair
 				pair<wordID_t, wordID_t> wordpair = make_pair(srcWord, trgWord);
-				itrCache = m_wordPairCache.find(wordpair);
-				if(itrCache == m_wordPairCache.end()) { // if not in cache
-          CacheWordProbs(srcWord);
-					itrCache = m_wordPairCache.find(wordpair); // search cache again
-				}
-				CHECK(itrCache != m_wordPairCache.end());
-				srcSumPairProbs += itrCache->second.first;
-				targetProbs[wordpair] = itrCache->second.second;	
+				WordPairProbs::const_iterator itrProbs = wordPairProbs.find(wordpair);
+				CHECK(itrProbs != wordPairProbs.end());
+				srcSumPairProbs += itrProbs->second.first;
+				targetProbs[wordpair] = itrProbs->second.second;	
 			} 
 		}
 		float srcNormalizer = srcWordAlignments.size() < 2 ? 1.0 : 1.0 / float(srcWordAlignments.size());
@@ -279,6 +315,31 @@ pair<float, float> BilingualDynSuffixArray::GetLexicalWeight(const PhrasePair& p
 	// TODO::Need to get p(NULL|trg)
 	return pair<float, float>(srcLexWeight, trgLexWeight);
 }
+void BilingualDynSuffixArray::GetWordPairProbs(const SAPhrase& phrase, WordPairProbs& wordPairProbs) const
+{
+  // copies the probabilities of the pairs of the words of phrase, which are
+  // all that its phrase pairs need, caching those of a word on the first miss
+  for(size_t i = 0; i < phrase.words.size(); ++i) {
+    wordID_t srcWord = phrase.words[i];
+    for(int attempt = 0; attempt < 2; ++attempt) {
+      {
+#ifdef WITH_THREADS
+        boost::shared_lock<boost::shared_mutex> lock(m_wordPairCacheLock);
+#endif
+        // all source words grouped
+        WordPairProbs::const_iterator first = m_wordPairCache.lower_bound(make_pair(srcWord, wordID_t(0)));
+        WordPairProbs::const_iterator last = m_wordPairCache.upper_bound(make_pair(srcWord, ~wordID_t(0)));
+        if(first != last) {
+          wordPairProbs.insert(first, last);
+          break;
+        }
+      }
+      CHECK(attempt == 0);
+      CacheWordProbs(srcWord);
+    }
+  }
+}
+
 void BilingualDynSuffixArray::CacheFreqWords() const {
   std::multimap<int, wordID_t> wordCnts;
   // for each source word in vocab
@@ -329,6 +390,9 @@ void BilingualDynSuffixArray::CacheWordProbs(wordID_t srcWord) const
 	}
 	// now we've gotten counts of all target words aligned to this source word
 	// get probs and cache all pairs
+#ifdef WITH_THREADS
+	boost::unique_lock<boost::shared_mutex> lock(m_wordPairCacheLock);
+#endif
 	for(std::map<wordID_t, int>::const_iterator itrCnt = counts.begin();
 			itrCnt != counts.end(); ++itrCnt) {
 		pair<wordID_t, wordID_t> wordPair = make_pair(srcWord, itrCnt->first);
@@ -369,40 +433,81 @@ void BilingualDynSuffixArray::GetTargetPhrasesByLexicalWeight(const Phrase& src,
 	size_t sourceSize = src.GetSize();
 	SAPhrase localIDs(sourceSize);
 	if(!GetLocalVocabIDs(src, localIDs)) return; 
+	ScoredPhrases scored;
+	bool cached;
+	{
+#ifdef WITH_THREADS
+		boost::shared_lock<boost::shared_mutex> lock(m_phraseCacheLock);
+#endif
+		std::map<SAPhrase, ScoredPhrases>::const_iterator itrCache = m_phraseCache.find(localIDs);
+		cached = (itrCache != m_phraseCache.end());
+		if(cached) scored = itrCache->second;
+	}
+	if(!cached) {
+		scored = ScorePhrases(localIDs);
+#ifdef WITH_THREADS
+		boost::unique_lock<boost::shared_mutex> lock(m_phraseCacheLock);
+#endif
+		if(m_phraseCache.size() >= m_maxCachedPhrases) m_phraseCache.clear();
+		m_phraseCache[localIDs] = scored;
+	}
+	// convert to moses phrase pairs
+	for(size_t i = 0; i < scored.size(); ++i) {
+		TargetPhrase *targetPhrase = GetMosesFactorIDs(scored[i].second);
+		target.push_back(make_pair(scored[i].first, targetPhrase));
+	}
+}
+
+BilingualDynSuffixArray::ScoredPhrases BilingualDynSuffixArray::ScorePhrases(const SAPhrase& localIDs) const
+{
+	ScoredPhrases scored;
+	size_t sourceSize = localIDs.words.size();
 	float totalTrgPhrases(0); 
 	std::map<SAPhrase, int> phraseCounts;
-  //std::map<SAPhrase, PhrasePair> phraseColl; // (one of) the word indexes this phrase was taken from 
 	std::map<SAPhrase, pair<float, float> > lexicalWeights;
 	std::map<SAPhrase, pair<float, float> >::iterator itrLexW;
 	std::vector<unsigned> wrdIndices;	
 	// extract sentence IDs from SA and return rightmost index of phrases
-	if(!m_srcSA->GetCorpusIndex(&(localIDs.words), &wrdIndices)) return;
+	if(!m_srcSA->GetCorpusIndex(&(localIDs.words), &wrdIndices)) return scored;
   SampleSelection(wrdIndices);
 	std::vector<int> sntIndexes = GetSntIndexes(wrdIndices, sourceSize, m_srcSntBreaks);	
-	// for each sentence with this phrase
-	for(size_t snt = 0; snt < sntIndexes.size(); ++snt) {
-		std::vector<PhrasePair*> phrasePairs; // to store all phrases possible from current sentence
-		int sntIndex = sntIndexes.at(snt); // get corpus index for sentence
-		if(sntIndex == -1) continue;	// bad flag set by GetSntIndexes()
-		ExtractPhrases(sntIndex, wrdIndices[snt], sourceSize, phrasePairs); 
-		//cerr << "extracted " << phrasePairs.size() << endl;
-		totalTrgPhrases += phrasePairs.size(); // keep track of count of each extracted phrase pair		
-		std::vector<PhrasePair*>::iterator iterPhrasePair;
-		for (iterPhrasePair = phrasePairs.begin(); iterPhrasePair != phrasePairs.end(); ++iterPhrasePair) {
-			SAPhrase phrase = TrgPhraseFromSntIdx(**iterPhrasePair);
+	// extract and score the phrase pairs of each sentence with this phrase
+	const size_t numSamples = sntIndexes.size();
+	std::vector<std::vector<ExtractedPhrase> > extracted(numSamples);
+	WordPairProbs wordPairProbs;
+	GetWordPairProbs(localIDs, wordPairProbs);
+#ifdef WITH_THREADS
+	const size_t numThreads = StaticData::Instance().GetSearchThreadCount();
+	if(numThreads > 1 && numSamples >= 2 * MIN_SAMPLES_PER_TASK) {
+		// a few slices per thread, as sentences differ in length
+		const size_t numTasks = std::min(numSamples / MIN_SAMPLES_PER_TASK, 4 * numThreads);
+		TaskLatch latch(numTasks);
+		for(size_t i = 0; i < numTasks; ++i) {
+			GetSearchThreadPool().Submit(new ExtractTask(*this, wrdIndices, sntIndexes, sourceSize, wordPairProbs
+			                             , numSamples * i / numTasks, numSamples * (i + 1) / numTasks
+			                             , extracted, latch));
+		}
+		latch.Wait();
+	} else {
+		ExtractSamples(wrdIndices, sntIndexes, sourceSize, wordPairProbs, 0, numSamples, extracted);
+	}
+#else
+	ExtractSamples(wrdIndices, sntIndexes, sourceSize, wordPairProbs, 0, numSamples, extracted);
+#endif
+	// count the phrases in the order of the samples
+	for(size_t snt = 0; snt < numSamples; ++snt) {
+		totalTrgPhrases += extracted[snt].size(); // keep track of count of each extracted phrase pair		
+		std::vector<ExtractedPhrase>::const_iterator iterPhrase;
+		for (iterPhrase = extracted[snt].begin(); iterPhrase != extracted[snt].end(); ++iterPhrase) {
+			const SAPhrase &phrase = iterPhrase->first;
+			const pair<float, float> &lexWeight = iterPhrase->second;
 			phraseCounts[phrase]++;	// count each unique phrase
-      // NOTE::Correct but slow to extract lexical weight here. could do 
-      // it later for only the top phrases chosen by phrase prob p(e|f)
-			pair<float, float> lexWeight = GetLexicalWeight(**iterPhrasePair);	// get lexical weighting for this phrase pair 
 			itrLexW = lexicalWeights.find(phrase); // check if phrase already has lexical weight attached
 			if((itrLexW != lexicalWeights.end()) && (itrLexW->second.first < lexWeight.first)) 
 				itrLexW->second = lexWeight;	// if this lex weight is greater save it
 			else lexicalWeights[phrase] = lexWeight; // else save 
 		}
-		// done with sentence. delete SA phrase pairs
-		RemoveAllInColl(phrasePairs);
 	} // done with all sentences
-	// convert to moses phrase pairs
 	std::map<SAPhrase, int>::const_iterator iterPhrases; 
 	std::multimap<Scores, const SAPhrase*, ScoresComp> phraseScores (*m_scoreCmp);
 	// get scores of all phrases
@@ -416,13 +521,35 @@ void BilingualDynSuffixArray::GetTargetPhrasesByLexicalWeight(const Phrase& src,
 		scoreVector[2] = 2.718; // exp(1); 
 		phraseScores.insert(make_pair(scoreVector, &iterPhrases->first));
 	}
-	// return top scoring phrases
+	// keep top scoring phrases
 	std::multimap<Scores, const SAPhrase*, ScoresComp>::reverse_iterator ritr;
 	for(ritr = phraseScores.rbegin(); ritr != phraseScores.rend(); ++ritr) {
-		Scores scoreVector = ritr->first;
-		TargetPhrase *targetPhrase = GetMosesFactorIDs(*ritr->second);
-		target.push_back(make_pair( scoreVector, targetPhrase));
-		if(target.size() == m_maxSampleSize) break;
+		scored.push_back(make_pair(ritr->first, *ritr->second));
+		if(scored.size() == m_maxSampleSize) break;
+	}
+	return scored;
+}
+
+void BilingualDynSuffixArray::ExtractSamples(const std::vector<unsigned>& wrdIndices,
+	const std::vector<int>& sntIndexes, size_t sourceSize, const WordPairProbs& wordPairProbs,
+	size_t begin, size_t end,
+	std::vector<std::vector<ExtractedPhrase> >& extracted) const
+{
+	// for each sentence with this phrase
+	for(size_t snt = begin; snt < end; ++snt) {
+		std::vector<PhrasePair*> phrasePairs; // to store all phrases possible from current sentence
+		int sntIndex = sntIndexes.at(snt); // get corpus index for sentence
+		if(sntIndex == -1) continue;	// bad flag set by GetSntIndexes()
+		ExtractPhrases(sntIndex, wrdIndices[snt], sourceSize, phrasePairs); 
+		std::vector<PhrasePair*>::iterator iterPhrasePair;
+		for (iterPhrasePair = phrasePairs.begin(); iterPhrasePair != phrasePairs.end(); ++iterPhrasePair) {
+      // NOTE::Correct but slow to extract lexical weight here. could do 
+      // it later for only the top phrases chosen by phrase prob p(e|f)
+			pair<float, float> lexWeight = GetLexicalWeight(**iterPhrasePair, wordPairProbs);	// get lexical weighting for this phrase pair 
+			extracted[snt].push_back(make_pair(TrgPhraseFromSntIdx(**iterPhrasePair), lexWeight));
+		}
+		// done with sentence. delete SA phrase pairs
+		RemoveAllInColl(phrasePairs);
 	}
 }
 
@@ -493,24 +620,35 @@ void BilingualDynSuffixArray::addSntPair(string& source, string& target, string&
   //m_trgSA->Insert(&trgFactor, oldTrgCrpSize);
   LoadRawAlignments(alignment);
   m_trgVocab->MakeClosed();
-  //for(size_t i=0; i < sphrase.GetSize(); ++i)
-    //ClearWordInCache(sIDs[i]);
-  
+  // the word probabilities of the new source words change, and so do the
+  // phrases containing them.  Other phrases keep their samples and weights
+  std::set<wordID_t> srcWords(srcFactor.begin(), srcFactor.end());
+  for(std::set<wordID_t>::const_iterator itr = srcWords.begin(); itr != srcWords.end(); ++itr)
+    ClearWordInCache(*itr);
+  ClearPhrasesInCache(srcWords);
 }
 void BilingualDynSuffixArray::ClearWordInCache(wordID_t srcWord) {
   if(m_freqWordsCached.find(srcWord) != m_freqWordsCached.end())
     return;
-	std::map<std::pair<wordID_t, wordID_t>, std::pair<float, float> >::iterator it,
-    first, last;
-  for(it = m_wordPairCache.begin(); it != m_wordPairCache.end(); ++it) {
-    if(it->first.first == srcWord) {  // all source words grouped 
-      first = it; // copy first entry of srcWord
-      last = it++;
-      while(it != m_wordPairCache.end() && (it->first.first == srcWord)) {
-        last = it++;
-      }
-    }
-    m_wordPairCache.erase(first, last);
+#ifdef WITH_THREADS
+  boost::unique_lock<boost::shared_mutex> lock(m_wordPairCacheLock);
+#endif
+  // all source words grouped
+  m_wordPairCache.erase(m_wordPairCache.lower_bound(make_pair(srcWord, wordID_t(0))),
+                        m_wordPairCache.upper_bound(make_pair(srcWord, ~wordID_t(0))));
+}
+void BilingualDynSuffixArray::ClearPhrasesInCache(const std::set<wordID_t>& srcWords) {
+#ifdef WITH_THREADS
+  boost::unique_lock<boost::shared_mutex> lock(m_phraseCacheLock);
+#endif
+  std::map<SAPhrase, ScoredPhrases>::iterator itr = m_phraseCache.begin();
+  while(itr != m_phraseCache.end()) {
+    const std::vector<wordID_t> &words = itr->first.words;
+    bool found = false;
+    for(size_t i = 0; i < words.size() && !found; ++i)
+      found = srcWords.find(words[i]) != srcWords.end();
+    if(found) m_phraseCache.erase(itr++);
+    else ++itr;
   }
 }
 SentenceAlignment::SentenceAlignment(int sntIndex, int sourceSize, int targetSize) 
@@ -9,6 +9,10 @@
 #include "InputFileStream.h"
 #include "FactorTypeSet.h"
 
+#ifdef WITH_THREADS
+#include <boost/thread/shared_mutex.hpp>
+#endif
+
 namespace Moses {
 
 class SAPhrase
@@ -77,6 +81,13 @@ private:
   const std::vector<float>& m_weights;
 };
 	
+/** Source and target corpus with suffix arrays, from which the phrase pairs
+ * of a source phrase are extracted and scored at lookup time.  The sampled
+ * sentences of a phrase are extracted in parallel on the search threads.
+ * Word translation probabilities and the scored target phrases of each
+ * source phrase are cached across sentences; addSntPair() drops the entries
+ * of the source words it adds.
+ */
 class BilingualDynSuffixArray {
 public: 
 	BilingualDynSuffixArray();
@@ -104,9 +115,21 @@ private:
 	std::vector<SentenceAlignment> m_alignments;
 	std::vector<std::vector<short> > m_rawAlignments;
 
-	mutable std::map<std::pair<wordID_t, wordID_t>, std::pair<float, float> > m_wordPairCache; 
+  //! target phrase of an extracted phrase pair with its lexical weights
+  typedef std::pair<SAPhrase, std::pair<float, float> > ExtractedPhrase;
+  //! the best target phrases of a source phrase with their scores
+  typedef std::vector<std::pair<Scores, SAPhrase> > ScoredPhrases;
+  //! p(trg|src) and p(src|trg) by source and target word
+  typedef std::map<std::pair<wordID_t, wordID_t>, std::pair<float, float> > WordPairProbs;
+  class ExtractTask;
+
+	mutable WordPairProbs m_wordPairCache; 
   mutable std::set<wordID_t> m_freqWordsCached;
-	const size_t m_maxPhraseLength, m_maxSampleSize;
+  mutable std::map<SAPhrase, ScoredPhrases> m_phraseCache; // by source phrase
+#ifdef WITH_THREADS
+  mutable boost::shared_mutex m_wordPairCacheLock, m_phraseCacheLock;
+#endif
+	const size_t m_maxPhraseLength, m_maxSampleSize, m_maxCachedPhrases;
 
 	int LoadCorpus(InputFileStream&, const std::vector<FactorType>& factors, 
 		std::vector<wordID_t>&, std::vector<wordID_t>&,
@@ -126,7 +149,12 @@ private:
 	void CacheWordProbs(wordID_t) const;
   void CacheFreqWords() const;
   void ClearWordInCache(wordID_t);
-	std::pair<float, float> GetLexicalWeight(const PhrasePair&) const;
+  void ClearPhrasesInCache(const std::set<wordID_t>&);
+  void GetWordPairProbs(const SAPhrase&, WordPairProbs&) const;
+	std::pair<float, float> GetLexicalWeight(const PhrasePair&, const WordPairProbs&) const;
+  void ExtractSamples(const std::vector<unsigned>&, const std::vector<int>&, size_t, const WordPairProbs&,
+                      size_t, size_t, std::vector<std::vector<ExtractedPhrase> >&) const;
+  ScoredPhrases ScorePhrases(const SAPhrase&) const;
 
 	int GetSourceSentenceSize(size_t sentenceId) const
 	{ 
@@ -28,7 +28,6 @@
 #include "StaticData.h"
 #include "NonTerminal.h"
 #include "ChartCellCollection.h"
-#include "ClauseBoundaries.h"
 #include "Util.h"
 
 
@@ -40,6 +39,7 @@ ChartRuleLookupManagerMinSpan::ChartRuleLookupManagerMinSpan(
   const ChartCellCollection &cellColl,
   const PhraseDictionaryMinSpan &ruleTable)
   : ChartRuleLookupManagerCYKPlus(src, cellColl)
+  , m_spanConstraints(src)
   , m_ruleTable(ruleTable)
 {
   assert(m_dottedRuleColls.size() == 0);
@@ -47,20 +47,6 @@ ChartRuleLookupManagerMinSpan::ChartRuleLookupManagerMinSpan(
   m_dottedRuleColls.resize(sourceSize);
 
 
- //MSPnew : if clause boundary option is on, set clause boundaries vector
-    //otherwise set to empty vector
-  const StaticData& staticData = StaticData::Instance();
-        //check if option is on
-    if (staticData.GetParam("clause-bounds").size() == 1)
-    {
-      m_clauseBounds = src.GetClauseBoundaries()->GetClauseBoundaries();
-    }
-    else
-    {
-        std::vector< std::vector<int> > empty_bounds;
-        m_clauseBounds = empty_bounds;
-    }
-
   const PhraseDictionaryNodeSCFG &rootNode = m_ruleTable.GetRootNode();
 
   for (size_t ind = 0; ind < m_dottedRuleColls.size(); ++ind) {
@@ -91,8 +77,10 @@ void ChartRuleLookupManagerMinSpan::GetChartRuleCollection(
   size_t relEndPos = range.GetEndPos() - range.GetStartPos();
   size_t absEndPos = range.GetEndPos();
 
-  //MSPnew : get start position of considered range
-  size_t startOfFirst = range.GetStartPos();
+  // no rule can cover this span or a longer one from the same start
+  if (!m_spanConstraints.AllowsExtension(range, minSpan)) {
+    return;
+  }
 
   // MAIN LOOP. create list of nodes of target phrases
 
@@ -172,110 +160,22 @@ void ChartRuleLookupManagerMinSpan::GetChartRuleCollection(
   // list of rules that that cover the entire span
   DottedRuleList &rules = dottedRuleCol.Get(relEndPos + 1);
 
-  // look up target sides for the rules
-  size_t rulesLimit = StaticData::Instance().GetRuleLimit();
-  DottedRuleList::const_iterator iterRule;
-  for (iterRule = rules.begin(); iterRule != rules.end(); ++iterRule) {
-    const DottedRuleInMemory &dottedRule = **iterRule;
-    //std::cout << "Dotted rule is : " << dottedRule << std::endl;
-
-    const PhraseDictionaryNodeSCFG &node = dottedRule.GetLastNode();
-    //std::cout << "Phrase dictionary node is : " << node << std::endl;
-
-    // look up target sides
-    const TargetPhraseCollection *targetPhraseCollection = node.GetTargetPhraseCollection();
-
-     //MSPnew : look at total covered span in order to determine if we are greater as the min span condition
-    int end = dottedRule.GetWordsRange().GetEndPos();
-
-    //MSPnew : determine start position : iterate over previous rule until first word is reached
-    //make a copy of covered chart span
-    DottedRule currentDottedRule = dottedRule;	
-
-    int span = end - startOfFirst + 1;
-    //std::cout << "Span is : " << span << std::endl;
-
-    //MSPnew : see if option clause-boundaries is on
-        //make instance of StaticData
-    const StaticData& staticData = StaticData::Instance();
-        //check if option is on
-    if (staticData.GetParam("clause-bounds").size() == 1)
-    {
-        //MSPnew : check if span crosses clause boundary
-            //get clause boundaries form InputType src
-        bool crosses = 0;
-
-        std::vector<std::vector<int> >::iterator iter_boundaries;
-
-        for(iter_boundaries = m_clauseBounds.begin(); iter_boundaries!=m_clauseBounds.end(); iter_boundaries++)
-        {
-                std::vector<int> boundaries = *iter_boundaries;
-                std::vector<int> :: iterator itr_bounds = boundaries.begin();
-
-                while(itr_bounds!=boundaries.end())
-                {
-                    int boundary1 = *itr_bounds;
-                    //MSPnew
-                    //std::cout << "First boundary : " << boundary1 << std::endl;
-                    itr_bounds++;
-                     //MSPnew : should be no problem to read boundary2 because there are always 2 boundaries in a clause
-                    int boundary2 = *itr_bounds;
-                    //std::cout << "Second boundary : " << boundary2 << std::endl;
-                    itr_bounds++;
-
-                    //MSPnew : terminals in rule can go up to boundary2 + 2
-                    bool isEndMatch = MatchesInterval(end, boundary2);
-
-		    bool isInsideStart = IsInside(startOfFirst, boundary1 + 1, boundary2 + 1);
-		    bool isInsideEnd = IsInside(end, boundary1 + 1, boundary2 + 1);
-
-		    if( (isInsideStart && !isInsideEnd) || (!isInsideStart && isInsideEnd) )
-		    {
-			crosses = 1;
-		    }	
-
-		    //MSPnew : only end of clause has to match
-                    if( isEndMatch == 1 )
-                    {
-                        if ((targetPhraseCollection != NULL) && (crosses == 0) && (span > minSpan))
-                        {
-                            	AddCompletedRule(dottedRule, *targetPhraseCollection, range, outColl);
-                        }
-                    }
-		   
-        	}
-    	}
-    }
-    else
-    {
-	//std::cout << "Not in clause boundary mode !" << std::endl;
-	
-        //MSPnew : do not look for clause boundaries
-        if(span > minSpan)
-        {
-            if (targetPhraseCollection != NULL)
-            {
-                  AddCompletedRule(dottedRule, *targetPhraseCollection, range, outColl);
-            }
-            else
-            {
-                //std::cout << "Target Phrase Collection is null ! " << std::endl;
-            }
-        }
-        else
-        {
-            //std::cout << "GCR : span : " << span << " too small." << endl;
-        }
+  // look up target sides for the rules, if a rule may cover this span
+  if (m_spanConstraints.Allows(range, minSpan)) {
+    DottedRuleList::const_iterator iterRule;
+    for (iterRule = rules.begin(); iterRule != rules.end(); ++iterRule) {
+      const DottedRuleInMemory &dottedRule = **iterRule;
+      const PhraseDictionaryNodeSCFG &node = dottedRule.GetLastNode();
+
+      // look up target sides
+      const TargetPhraseCollection *targetPhraseCollection = node.GetTargetPhraseCollection();
+      if (targetPhraseCollection != NULL) {
+        AddCompletedRule(dottedRule, *targetPhraseCollection, range, outColl);
+      }
     }
-
-    //MSPnew : removed here : do not give the complete target rule collection.
-    // add the fully expanded rule (with lexical target side)
-    //if (targetPhraseCollection != NULL) {
-    // outColl.Add(*targetPhraseCollection, dottedRule,
-    //              GetCellCollection(), adhereTableLimit, rulesLimit);
-   }
-    dottedRuleCol.Clear(relEndPos+1);
-    outColl.ShrinkToLimit();
+  }
+  dottedRuleCol.Clear(relEndPos+1);
+  outColl.ShrinkToLimit();
 }
 
 // Given a partial rule application ending at startPos-1 and given the sets of
@@ -31,15 +31,13 @@
 #endif
 
 #include "ChartRuleLookupManagerCYKPlus.h"
+#include "ChartSpanConstraints.h"
 #include "DotChart.h"
 #include "DotChartInMemory.h"
 #include "NonTerminal.h"
 #include "../RuleTable/PhraseDictionaryNodeSCFG.h"
 #include "../RuleTable/PhraseDictionaryMinSpan.h"
 
-//new : include ClauseBoundary class
-//#include "ClauseBoundaries.h"
-
 namespace Moses
 {
 
@@ -70,9 +68,7 @@ private:
     size_t stackInd,
     DottedRuleColl &dottedRuleColl);
 
-    //new : add clause boundaries vector as field of class ChartRuleLookupManagerMinSpan
-    std::vector< std::vector<int> > m_clauseBounds;
-
+    ChartSpanConstraints m_spanConstraints;
     std::vector<DottedRuleColl*> m_dottedRuleColls;
     const PhraseDictionaryMinSpan &m_ruleTable;
 #ifdef USE_BOOST_POOL
@@ -45,6 +45,8 @@ ChartRuleLookupManagerOnDisk::ChartRuleLookupManagerOnDisk(
   const std::string &filePath)
   : ChartRuleLookupManagerCYKPlus(sentence, cellColl)
   , m_dictionary(dictionary)
+  , m_spanConstraints(sentence)
+  , m_sharedCache(dictionary.GetCache())
   , m_dbWrapper(dbWrapper)
   , m_languageModels(languageModels)
   , m_wpProducer(wpProducer)
@@ -69,22 +71,73 @@ ChartRuleLookupManagerOnDisk::ChartRuleLookupManagerOnDisk(
 
 ChartRuleLookupManagerOnDisk::~ChartRuleLookupManagerOnDisk()
 {
-  std::map<UINT64, const TargetPhraseCollection*>::const_iterator iterCache;
-  for (iterCache = m_cache.begin(); iterCache != m_cache.end(); ++iterCache) {
-    delete iterCache->second;
+  RemoveAllInColl(m_expandableDottedRuleListVec);
+}
+
+const OnDiskPt::PhraseNode *ChartRuleLookupManagerOnDisk::GetChild(
+  const OnDiskPt::PhraseNode &node,
+  const OnDiskPt::Word &word)
+{
+  UINT64 childFilePos = node.GetChildFilePos(word, m_dbWrapper);
+  if (childFilePos == 0)
+    return NULL;
+
+  NodePtr child;
+  if (m_sharedCache)
+    child = m_sharedCache->GetNode(childFilePos);
+  if (!child) {
+    child.reset(new OnDiskPt::PhraseNode(childFilePos, m_dbWrapper));
+    if (m_sharedCache)
+      m_sharedCache->PutNode(childFilePos, child);
   }
-  m_cache.clear();
 
-  RemoveAllInColl(m_expandableDottedRuleListVec);
-  RemoveAllInColl(m_sourcePhraseNode);
+  // keep for the rest of the sentence
+  m_sourcePhraseNode.push_back(child);
+  return child.get();
+}
+
+const TargetPhraseCollection &ChartRuleLookupManagerOnDisk::GetTargetPhraseCollection(
+  const OnDiskPt::PhraseNode &node)
+{
+  UINT64 tpCollFilePos = node.GetValue();
+  TargetPhrasesPtr &targetPhrases = m_cache[tpCollFilePos];
+  if (targetPhrases)
+    return *targetPhrases;
+
+  if (m_sharedCache)
+    targetPhrases = m_sharedCache->GetTargetPhrases(tpCollFilePos);
+  if (!targetPhrases) {
+    const OnDiskPt::TargetPhraseCollection *tpcollBerkeleyDb = node.GetTargetPhraseCollection(m_dictionary.GetTableLimit(), m_dbWrapper);
+
+    targetPhrases.reset(tpcollBerkeleyDb->ConvertToMoses(m_inputFactorsVec
+                        ,m_outputFactorsVec
+                        ,m_dictionary
+                        ,m_weight
+                        ,m_wpProducer
+                        ,*m_languageModels
+                        ,m_filePath
+                        , m_dbWrapper.GetVocab()));
+
+    delete tpcollBerkeleyDb;
+    if (m_sharedCache)
+      m_sharedCache->PutTargetPhrases(tpCollFilePos, targetPhrases);
+  }
+
+  return *targetPhrases;
 }
 
- //MSPnew : optional minSpan argument set to 0
 void ChartRuleLookupManagerOnDisk::GetChartRuleCollection(
   const WordsRange &range,
   ChartTranslationOptionList &outColl,
   size_t minSpan)
 {
+  // the min-span model. Partial rules that can't be completed are not
+  // extended, and target phrases are only read for spans rules may cover
+  bool constrained = minSpan > 0;
+  if (constrained && !m_spanConstraints.AllowsExtension(range, minSpan))
+    return;
+  bool complete = !constrained || m_spanConstraints.Allows(range, minSpan);
+
   size_t relEndPos = range.GetEndPos() - range.GetStartPos();
   size_t absEndPos = range.GetEndPos();
 
@@ -111,16 +164,13 @@ void ChartRuleLookupManagerOnDisk::GetChartRuleCollection(
       OnDiskPt::Word *sourceWordBerkeleyDb = m_dbWrapper.ConvertFromMoses(Input, m_inputFactorsVec, sourceWordLabel.GetLabel());
 
       if (sourceWordBerkeleyDb != NULL) {
-        const OnDiskPt::PhraseNode *node = prevNode.GetChild(*sourceWordBerkeleyDb, m_dbWrapper);
+        const OnDiskPt::PhraseNode *node = GetChild(prevNode, *sourceWordBerkeleyDb);
         if (node != NULL) {
           // TODO figure out why source word is needed from node, not from sentence
           // prob to do with factors or non-term
           //const Word &sourceWord = node->GetSourceWord();
           DottedRuleOnDisk *dottedRule = new DottedRuleOnDisk(*node, sourceWordLabel, prevDottedRule);
           expandableDottedRuleList.Add(relEndPos+1, dottedRule);
-
-          // cache for cleanup
-          m_sourcePhraseNode.push_back(node);
         }
 
         delete sourceWordBerkeleyDb;
@@ -163,7 +213,7 @@ void ChartRuleLookupManagerOnDisk::GetChartRuleCollection(
         continue; // vocab not in pt. node definately won't be in there
       }
 
-      const OnDiskPt::PhraseNode *sourceNode = prevNode.GetChild(*sourceLHSBerkeleyDb, m_dbWrapper);
+      const OnDiskPt::PhraseNode *sourceNode = GetChild(prevNode, *sourceLHSBerkeleyDb);
       delete sourceLHSBerkeleyDb;
 
       if (sourceNode == NULL)
@@ -187,7 +237,7 @@ void ChartRuleLookupManagerOnDisk::GetChartRuleCollection(
           if (chartNonTermBerkeleyDb == NULL)
             continue;
 
-          const OnDiskPt::PhraseNode *node = sourceNode->GetChild(*chartNonTermBerkeleyDb, m_dbWrapper);
+          const OnDiskPt::PhraseNode *node = GetChild(*sourceNode, *chartNonTermBerkeleyDb);
           delete chartNonTermBerkeleyDb;
 
           if (node == NULL)
@@ -197,15 +247,14 @@ void ChartRuleLookupManagerOnDisk::GetChartRuleCollection(
           //const Word &sourceWord = node->GetSourceWord();
           DottedRuleOnDisk *dottedRule = new DottedRuleOnDisk(*node, cellLabel, prevDottedRule);
           expandableDottedRuleList.Add(stackInd, dottedRule);
-
-          m_sourcePhraseNode.push_back(node);
         }
       } // for (iterChartNonTerm
 
-      delete sourceNode;
-
     } // for (iterLabelListf
 
+    if (!complete)
+      continue;
+
     // return list of target phrases
     DottedRuleCollOnDisk &nodes = expandableDottedRuleList.Get(relEndPos + 1);
 
@@ -230,41 +279,16 @@ void ChartRuleLookupManagerOnDisk::GetChartRuleCollection(
         if (sourceLHSBerkeleyDb == NULL)
           continue;
 
-        const TargetPhraseCollection *targetPhraseCollection = NULL;
-        const OnDiskPt::PhraseNode *node = prevNode.GetChild(*sourceLHSBerkeleyDb, m_dbWrapper);
+        const OnDiskPt::PhraseNode *node = GetChild(prevNode, *sourceLHSBerkeleyDb);
         if (node) {
-          UINT64 tpCollFilePos = node->GetValue();
-          std::map<UINT64, const TargetPhraseCollection*>::const_iterator iterCache = m_cache.find(tpCollFilePos);
-          if (iterCache == m_cache.end()) {
-
-            const OnDiskPt::TargetPhraseCollection *tpcollBerkeleyDb = node->GetTargetPhraseCollection(m_dictionary.GetTableLimit(), m_dbWrapper);
-
-            targetPhraseCollection
-            = tpcollBerkeleyDb->ConvertToMoses(m_inputFactorsVec
-                                               ,m_outputFactorsVec
-                                               ,m_dictionary
-                                               ,m_weight
-                                               ,m_wpProducer
-                                               ,*m_languageModels
-                                               ,m_filePath
-                                               , m_dbWrapper.GetVocab());
-
-            delete tpcollBerkeleyDb;
-            m_cache[tpCollFilePos] = targetPhraseCollection;
-          } else {
-            // just get out of cache
-            targetPhraseCollection = iterCache->second;
-          }
-
-          CHECK(targetPhraseCollection);
-          if (!targetPhraseCollection->IsEmpty()) {
-            AddCompletedRule(prevDottedRule, *targetPhraseCollection,
+          const TargetPhraseCollection &targetPhraseCollection = GetTargetPhraseCollection(*node);
+          if (!targetPhraseCollection.IsEmpty()) {
+            AddCompletedRule(prevDottedRule, targetPhraseCollection,
                              range, outColl);
           }
 
         } // if (node)
 
-        delete node;
         delete sourceLHSBerkeleyDb;
       }
     }
@@ -24,10 +24,12 @@
 #include "../../../OnDiskPt/OnDiskWrapper.h"
 
 #include "ChartRuleLookupManagerCYKPlus.h"
+#include "ChartSpanConstraints.h"
 #include "ChartTranslationOptionList.h"
 #include "DotChartOnDisk.h"
 #include "InputType.h"
 #include "RuleTable/PhraseDictionaryOnDisk.h"
+#include "RuleTable/PhraseDictionaryOnDiskCache.h"
 
 namespace Moses
 {
@@ -49,13 +51,23 @@ class ChartRuleLookupManagerOnDisk : public ChartRuleLookupManagerCYKPlus
 
   ~ChartRuleLookupManagerOnDisk();
 
-  //MSPnew : optional minSpan argument set to 0
+  // minSpan > 0 for the min-span model, whose spans are constrained
   virtual void GetChartRuleCollection(const WordsRange &range,
                                       ChartTranslationOptionList &outColl,
                                       size_t minSpan = 0);
 
  private:
+  typedef PhraseDictionaryOnDiskCache::NodePtr NodePtr;
+  typedef PhraseDictionaryOnDiskCache::TargetPhrasesPtr TargetPhrasesPtr;
+
+  // look up a child node or the target phrases of a node, in the shared
+  // cache if there is one.  The results stay valid until the end of the sentence
+  const OnDiskPt::PhraseNode *GetChild(const OnDiskPt::PhraseNode &node, const OnDiskPt::Word &word);
+  const TargetPhraseCollection &GetTargetPhraseCollection(const OnDiskPt::PhraseNode &node);
+
   const PhraseDictionaryOnDisk &m_dictionary;
+  ChartSpanConstraints m_spanConstraints;
+  PhraseDictionaryOnDiskCache *m_sharedCache;
   OnDiskPt::OnDiskWrapper &m_dbWrapper;
   const LMList *m_languageModels;
   const WordPenaltyProducer *m_wpProducer;
@@ -64,8 +76,8 @@ class ChartRuleLookupManagerOnDisk : public ChartRuleLookupManagerCYKPlus
   const std::vector<float> &m_weight;
   const std::string &m_filePath;
   std::vector<DottedRuleStackOnDisk*> m_expandableDottedRuleListVec;
-  std::map<UINT64, const TargetPhraseCollection*> m_cache;
-  std::list<const OnDiskPt::PhraseNode*> m_sourcePhraseNode;
+  std::map<UINT64, TargetPhrasesPtr> m_cache;
+  std::vector<NodePtr> m_sourcePhraseNode;
 };
 
 }  // namespace Moses
@@ -0,0 +1,337 @@
+// vim:tabstop=2
+/***********************************************************************
+ Moses - factored phrase-based language decoder
+ Copyright (C) 2010 Hieu Hoang
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ ***********************************************************************/
+
+#include <algorithm>
+#include "ChartClauseCache.h"
+#include "ChartCell.h"
+#include "ChartCellCollection.h"
+#include "ChartHypothesis.h"
+#include "ChartManager.h"
+#include "ClauseBoundaries.h"
+#include "InputType.h"
+#include "StaticData.h"
+#include "TargetPhrase.h"
+#include "Util.h"
+
+using namespace std;
+
+namespace Moses
+{
+
+ClauseCacheKey::ClauseCacheKey(const InputType &source, const WordsRange &clause,
+                               const std::string &systemId)
+  :m_systemId(systemId)
+  ,m_words(clause.GetNumWordsCovered())
+{
+  const int start = clause.GetStartPos();
+  const int end = clause.GetEndPos();
+
+  for (int pos = start; pos <= end; ++pos) {
+    m_words.AddWord(source.GetWord(pos));
+  }
+
+  // clause boundaries that can influence rule application inside the clause.
+  // Boundaries are given in source word positions, the chart is offset by <s>
+  const ClauseBoundaries *clauseBoundaries = source.GetClauseBoundaries();
+  if (clauseBoundaries != NULL) {
+    const vector<vector<int> > &bounds = clauseBoundaries->m_clauseBoundaries;
+    for (size_t i = 0; i < bounds.size(); ++i) {
+      const vector<int> &boundaries = bounds[i];
+      for (size_t j = 0; j + 1 < boundaries.size(); j += 2) {
+        int lower = boundaries[j] + 1;
+        int upper = boundaries[j + 1] + 1;
+        bool intersects = lower <= end && upper >= start;
+        bool endInside = boundaries[j + 1] >= start && boundaries[j + 1] <= end;
+        if (!intersects && !endInside) {
+          continue;
+        }
+        m_boundaries.push_back(intersects ? std::max(lower, start) - start : -1);
+        m_boundaries.push_back(intersects ? std::min(upper, end) - start : -1);
+        m_boundaries.push_back(endInside ? boundaries[j + 1] - start : -1);
+      }
+    }
+  }
+
+  // source labels of all spans inside the clause
+  for (int startPos = start; startPos <= end; ++startPos) {
+    for (int endPos = startPos; endPos <= end; ++endPos) {
+      const NonTerminalSet &labelSet = source.GetLabelSet(startPos, endPos);
+      size_t first = m_labels.size();
+      NonTerminalSet::const_iterator iter;
+      for (iter = labelSet.begin(); iter != labelSet.end(); ++iter) {
+        m_labels.push_back((*iter)[0]);
+      }
+      std::sort(m_labels.begin() + first, m_labels.end());
+      m_labels.push_back(NULL);
+    }
+  }
+}
+
+bool ClauseCacheKey::operator<(const ClauseCacheKey &other) const
+{
+  if (m_systemId != other.m_systemId) {
+    return m_systemId < other.m_systemId;
+  }
+  int ret = m_words.Compare(other.m_words);
+  if (ret != 0) {
+    return ret < 0;
+  }
+  if (m_boundaries != other.m_boundaries) {
+    return m_boundaries < other.m_boundaries;
+  }
+  return m_labels < other.m_labels;
+}
+
+/** Record the hypotheses of all cells inside the clause, bottom-up */
+ClauseSubChart::ClauseSubChart(const ChartCellCollection &cells, const WordsRange &clause)
+  :m_cells(clause.GetNumWordsCovered())
+  ,m_numHypotheses(0)
+{
+  const size_t size = clause.GetNumWordsCovered();
+  for (size_t relStart = 0; relStart < size; ++relStart) {
+    m_cells[relStart].resize(size - relStart);
+  }
+
+  map<const ChartHypothesis*, ChildRef> index;
+  map<const TargetPhrase*, const TargetPhrase*> copies;
+
+  for (size_t width = 1; width <= size; ++width) {
+    for (size_t relStart = 0; relStart <= size - width; ++relStart) {
+      size_t startPos = clause.GetStartPos() + relStart;
+      WordsRange range(startPos, startPos + width - 1);
+      const ChartCell &cell = cells.Get(range);
+      CellType &entries = m_cells[relStart][width - 1];
+
+      const ChartCellLabelSet &labelSet = cell.GetTargetLabelSet();
+      ChartCellLabelSet::const_iterator iterLabel;
+      for (iterLabel = labelSet.begin(); iterLabel != labelSet.end(); ++iterLabel) {
+        const HypoList *stack = iterLabel->second.GetStack();
+        if (stack == NULL) {
+          continue;
+        }
+
+        HypoList::const_iterator iterHypo;
+        for (iterHypo = stack->begin(); iterHypo != stack->end(); ++iterHypo) {
+          const ChartHypothesis *hypo = *iterHypo;
+
+          Entry entry;
+          entry.targetPhrase = CopyTargetPhrase(hypo->GetCurrTargetPhrase(), copies);
+
+          const vector<const ChartHypothesis*> &prevHypos = hypo->GetPrevHypos();
+          entry.children.reserve(prevHypos.size());
+          vector<const ChartHypothesis*>::const_iterator iterPrev;
+          for (iterPrev = prevHypos.begin(); iterPrev != prevHypos.end(); ++iterPrev) {
+            map<const ChartHypothesis*, ChildRef>::const_iterator child = index.find(*iterPrev);
+            CHECK(child != index.end());
+            entry.children.push_back(child->second);
+          }
+
+          index.insert(make_pair(hypo, ChildRef(relStart, width - 1, entries.size())));
+          entries.push_back(entry);
+          ++m_numHypotheses;
+        }
+      }
+    }
+  }
+}
+
+ClauseSubChart::~ClauseSubChart()
+{
+  RemoveAllInColl(m_targetPhrases);
+  RemoveAllInColl(m_sourcePhrases);
+}
+
+const TargetPhrase *ClauseSubChart::CopyTargetPhrase(const TargetPhrase &targetPhrase,
+    map<const TargetPhrase*, const TargetPhrase*> &copies)
+{
+  map<const TargetPhrase*, const TargetPhrase*>::const_iterator iter = copies.find(&targetPhrase);
+  if (iter != copies.end()) {
+    return iter->second;
+  }
+
+  TargetPhrase *copy = new TargetPhrase(targetPhrase);
+  m_targetPhrases.push_back(copy);
+  if (targetPhrase.GetSourcePhrase() != NULL) {
+    Phrase *sourcePhrase = new Phrase(*targetPhrase.GetSourcePhrase());
+    m_sourcePhrases.push_back(sourcePhrase);
+    copy->SetSourcePhrase(sourcePhrase);
+  }
+
+  copies[&targetPhrase] = copy;
+  return copy;
+}
+
+ClauseSplice::ClauseSplice(const WordsRange &clause, boost::shared_ptr<const ClauseSubChart> subChart)
+  :m_clause(clause)
+  ,m_subChart(subChart)
+  ,m_hypos(clause.GetNumWordsCovered())
+{
+  const size_t size = clause.GetNumWordsCovered();
+  CHECK(m_subChart->GetSize() == size);
+  for (size_t relStart = 0; relStart < size; ++relStart) {
+    m_hypos[relStart].resize(size - relStart);
+  }
+}
+
+/** Re-create the cached hypotheses of one cell.  Must be called bottom-up so
+ *  that the children of each hypothesis have already been spliced.
+ */
+void ClauseSplice::Splice(const WordsRange &range, ChartCell &cell, ChartManager &manager)
+{
+  size_t relStart = range.GetStartPos() - m_clause.GetStartPos();
+  size_t relWidth = range.GetEndPos() - range.GetStartPos();
+  const ClauseSubChart::CellType &entries = m_subChart->GetCell(relStart, relWidth);
+
+  m_added.clear();
+  for (size_t ind = 0; ind < entries.size(); ++ind) {
+    const ClauseSubChart::Entry &entry = entries[ind];
+
+    vector<const ChartHypothesis*> prevHypos;
+    prevHypos.reserve(entry.children.size());
+    vector<ClauseSubChart::ChildRef>::const_iterator iterChild;
+    for (iterChild = entry.children.begin(); iterChild != entry.children.end(); ++iterChild) {
+      const ChartHypothesis *prevHypo = m_hypos[iterChild->relStart][iterChild->relWidth][iterChild->index];
+      if (prevHypo == NULL) {
+        break;
+      }
+      prevHypos.push_back(prevHypo);
+    }
+    if (prevHypos.size() != entry.children.size()) {
+      // a child did not survive in this chart
+      continue;
+    }
+
+    ChartHypothesis *hypo = new ChartHypothesis(*entry.targetPhrase, range, prevHypos, manager);
+    hypo->CalcScore();
+    // a hypothesis deleted on recombination may leave its address to a later
+    // one, so the last entry for an address is the one that holds
+    m_added[hypo] = ind;
+    cell.AddHypothesis(hypo);
+  }
+}
+
+/** Link the cached entries of one cell to the hypotheses that survived
+ *  recombination and pruning.  Called once the cell is sorted.
+ */
+void ClauseSplice::Record(const WordsRange &range, const ChartCell &cell)
+{
+  size_t relStart = range.GetStartPos() - m_clause.GetStartPos();
+  size_t relWidth = range.GetEndPos() - range.GetStartPos();
+
+  vector<const ChartHypothesis*> &created = m_hypos[relStart][relWidth];
+  created.assign(m_subChart->GetCell(relStart, relWidth).size(), NULL);
+
+  const ChartCellLabelSet &labelSet = cell.GetTargetLabelSet();
+  ChartCellLabelSet::const_iterator iterLabel;
+  for (iterLabel = labelSet.begin(); iterLabel != labelSet.end(); ++iterLabel) {
+    const HypoList *stack = iterLabel->second.GetStack();
+    if (stack == NULL) {
+      continue;
+    }
+
+    HypoList::const_iterator iterHypo;
+    for (iterHypo = stack->begin(); iterHypo != stack->end(); ++iterHypo) {
+      map<const ChartHypothesis*, size_t>::const_iterator added = m_added.find(*iterHypo);
+      if (added != m_added.end()) {
+        created[added->second] = *iterHypo;
+      }
+    }
+  }
+  m_added.clear();
+}
+
+ChartClauseCache::ChartClauseCache(size_t maxSize)
+  :m_maxSize(maxSize)
+  ,m_lastUsed(0)
+  ,m_hits(0)
+  ,m_misses(0)
+  ,m_evictions(0)
+{
+}
+
+boost::shared_ptr<const ClauseSubChart> ChartClauseCache::Find(const ClauseCacheKey &key)
+{
+#ifdef WITH_THREADS
+  boost::mutex::scoped_lock lock(m_mutex);
+#endif
+  MapType::iterator iter = m_cache.find(key);
+  if (iter == m_cache.end()) {
+    ++m_misses;
+    return boost::shared_ptr<const ClauseSubChart>();
+  }
+  ++m_hits;
+  iter->second.second = ++m_lastUsed; // update last used time
+  return iter->second.first;
+}
+
+void ChartClauseCache::Add(const ClauseCacheKey &key, boost::shared_ptr<const ClauseSubChart> subChart)
+{
+  if (m_maxSize == 0) return;
+#ifdef WITH_THREADS
+  boost::mutex::scoped_lock lock(m_mutex);
+#endif
+  m_cache[key] = make_pair(subChart, ++m_lastUsed);
+  Reduce();
+}
+
+void ChartClauseCache::Reduce()
+{
+  if (m_cache.size() <= m_maxSize) return; // not full
+
+  // find cutoff for last used time
+  vector<size_t> lastUsedTimes;
+  lastUsedTimes.reserve(m_cache.size());
+  MapType::iterator iter;
+  for (iter = m_cache.begin(); iter != m_cache.end(); ++iter) {
+    lastUsedTimes.push_back(iter->second.second);
+  }
+  size_t keep = std::max<size_t>(1, m_maxSize / 2);
+  vector<size_t>::iterator cutoff = lastUsedTimes.end() - keep;
+  std::nth_element(lastUsedTimes.begin(), cutoff, lastUsedTimes.end());
+  size_t cutoffLastUsed = *cutoff;
+
+  // remove all old entries.  Sentences still splicing an entry keep it alive
+  iter = m_cache.begin();
+  while (iter != m_cache.end()) {
+    if (iter->second.second < cutoffLastUsed) {
+      m_cache.erase(iter++);
+      ++m_evictions;
+    } else {
+      ++iter;
+    }
+  }
+  VERBOSE(2,"Reduced clause cache to " << m_cache.size() << " clauses" << endl);
+}
+
+std::ostream& operator<<(std::ostream &out, const ChartClauseCache &cache)
+{
+#ifdef WITH_THREADS
+  boost::mutex::scoped_lock lock(cache.m_mutex);
+#endif
+  size_t lookups = cache.m_hits + cache.m_misses;
+  out << "clause cache size=" << cache.m_cache.size() << "/" << cache.m_maxSize
+      << " hits=" << cache.m_hits
+      << " misses=" << cache.m_misses
+      << " hit-rate=" << (lookups ? (100 * cache.m_hits / lookups) : 0) << "%"
+      << " evictions=" << cache.m_evictions;
+  return out;
+}
+
+}
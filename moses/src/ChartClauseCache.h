@@ -0,0 +1,175 @@
+// vim:tabstop=2
+/***********************************************************************
+ Moses - factored phrase-based language decoder
+ Copyright (C) 2010 Hieu Hoang
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ ***********************************************************************/
+
+#pragma once
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#ifdef WITH_THREADS
+#include <boost/thread/mutex.hpp>
+#endif
+
+#include "Phrase.h"
+#include "WordsRange.h"
+
+namespace Moses
+{
+
+class ChartCell;
+class ChartCellCollection;
+class ChartHypothesis;
+class ChartManager;
+class Factor;
+class InputType;
+class TargetPhrase;
+
+/** Identifies a clause independently of the sentence it occurs in: the
+ *  clause's source words, the clause boundaries that fall inside it (relative
+ *  to the clause start), the source labels of its spans and the translation
+ *  system.  Two clauses with equal keys produce identical sub-charts.
+ */
+class ClauseCacheKey
+{
+public:
+  ClauseCacheKey(const InputType &source, const WordsRange &clause,
+                 const std::string &systemId);
+
+  bool operator<(const ClauseCacheKey &other) const;
+
+private:
+  std::string m_systemId;
+  Phrase m_words;
+  std::vector<int> m_boundaries;
+  std::vector<const Factor*> m_labels;
+};
+
+/** Pruned content of a completed clause sub-chart.  For each cell we store
+ *  the derivation of every surviving hypothesis (rule and child hypotheses);
+ *  scores and LM boundary states are recomputed when the cell is spliced into
+ *  a new chart since feature function states are bound to their hypothesis.
+ *  Target phrases are copied so that the entry outlives per-sentence rules
+ *  such as unknown word translations.
+ */
+class ClauseSubChart
+{
+public:
+  struct ChildRef {
+    ChildRef(size_t start, size_t width, size_t ind)
+      : relStart(start), relWidth(width), index(ind) {}
+    size_t relStart, relWidth, index;
+  };
+
+  struct Entry {
+    const TargetPhrase *targetPhrase;
+    std::vector<ChildRef> children;
+  };
+
+  typedef std::vector<Entry> CellType;
+
+  ClauseSubChart(const ChartCellCollection &cells, const WordsRange &clause);
+  ~ClauseSubChart();
+
+  size_t GetSize() const {
+    return m_cells.size();
+  }
+  size_t GetNumHypotheses() const {
+    return m_numHypotheses;
+  }
+  const CellType &GetCell(size_t relStart, size_t relWidth) const {
+    return m_cells[relStart][relWidth];
+  }
+
+private:
+  // Non-copyable: copy constructor and assignment operator not implemented.
+  ClauseSubChart(const ClauseSubChart &);
+  ClauseSubChart &operator=(const ClauseSubChart &);
+
+  const TargetPhrase *CopyTargetPhrase(const TargetPhrase &targetPhrase,
+                                       std::map<const TargetPhrase*, const TargetPhrase*> &copies);
+
+  std::vector<std::vector<CellType> > m_cells;
+  std::vector<TargetPhrase*> m_targetPhrases;
+  std::vector<Phrase*> m_sourcePhrases;
+  size_t m_numHypotheses;
+};
+
+/** A cached sub-chart being spliced into the chart of the current sentence.
+ *  Keeps track of the hypotheses that survive for each cached entry so that
+ *  hypotheses of larger cells can be linked to their children.
+ */
+class ClauseSplice
+{
+public:
+  ClauseSplice(const WordsRange &clause, boost::shared_ptr<const ClauseSubChart> subChart);
+
+  const WordsRange &GetClause() const {
+    return m_clause;
+  }
+
+  void Splice(const WordsRange &range, ChartCell &cell, ChartManager &manager);
+  void Record(const WordsRange &range, const ChartCell &cell);
+
+private:
+  WordsRange m_clause;
+  boost::shared_ptr<const ClauseSubChart> m_subChart;
+  std::vector<std::vector<std::vector<const ChartHypothesis*> > > m_hypos; /**< surviving hypothesis of each entry, or NULL */
+  std::map<const ChartHypothesis*, size_t> m_added; /**< entry of each hypothesis added to the current cell */
+};
+
+/** Bounded cache of clause sub-charts shared by all sentences.  When the
+ *  cache is full, the least recently used half is evicted.
+ */
+class ChartClauseCache
+{
+  friend std::ostream& operator<<(std::ostream&, const ChartClauseCache&);
+
+public:
+  ChartClauseCache(size_t maxSize);
+
+  boost::shared_ptr<const ClauseSubChart> Find(const ClauseCacheKey &key);
+  void Add(const ClauseCacheKey &key, boost::shared_ptr<const ClauseSubChart> subChart);
+
+  size_t GetMaxSize() const {
+    return m_maxSize;
+  }
+
+private:
+  typedef std::pair<boost::shared_ptr<const ClauseSubChart>, size_t> EntryType;
+  typedef std::map<ClauseCacheKey, EntryType> MapType;
+
+  void Reduce();
+
+  MapType m_cache;
+  size_t m_maxSize;
+  size_t m_lastUsed; /**< counter used as last used time */
+  size_t m_hits, m_misses, m_evictions;
+#ifdef WITH_THREADS
+  mutable boost::mutex m_mutex;
+#endif
+};
+
+std::ostream& operator<<(std::ostream&, const ChartClauseCache&);
+
+}
@@ -61,6 +61,24 @@ ChartHypothesis::ChartHypothesis(const ChartTranslationOption &transOpt,
   }
 }
 
+/** Create a hypothesis from a rule and its already chosen child hypotheses.
+ *  Used to splice cached clause sub-charts into a chart
+ */
+ChartHypothesis::ChartHypothesis(const TargetPhrase &targetPhrase,
+                                 const WordsRange &range,
+                                 const std::vector<const ChartHypothesis*> &prevHypos,
+                                 ChartManager &manager)
+  :m_targetPhrase(targetPhrase)
+  ,m_currSourceWordsRange(range)
+  ,m_ffStates(manager.GetTranslationSystem()->GetStatefulFeatureFunctions().size())
+  ,m_arcList(NULL)
+  ,m_winningHypo(NULL)
+  ,m_prevHypos(prevHypos)
+  ,m_manager(manager)
+  ,m_id(manager.GetNextHypoId())
+{
+}
+
 ChartHypothesis::~ChartHypothesis()
 {
 	// delete feature function states
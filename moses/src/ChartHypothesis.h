@@ -86,6 +86,10 @@ public:
   ChartHypothesis(const ChartTranslationOption &, const RuleCubeItem &item,
                   ChartManager &manager);
 
+  ChartHypothesis(const TargetPhrase &targetPhrase, const WordsRange &range,
+                  const std::vector<const ChartHypothesis*> &prevHypos,
+                  ChartManager &manager);
+
   ~ChartHypothesis();
 
   unsigned GetId() const { return m_id; }
@@ -20,6 +20,8 @@
  ***********************************************************************/
 
 #include <stdio.h>
+#include <algorithm>
+#include <functional>
 #include "ChartManager.h"
 #include "ChartCell.h"
 #include "ChartHypothesis.h"
@@ -30,6 +32,8 @@
 #include "StaticData.h"
 #include "DecodeStep.h"
 #include "TreeInput.h"
+#include "ChartClauseCache.h"
+#include "ClauseBoundaries.h"
 
 using namespace std;
 using namespace Moses;
@@ -81,6 +85,7 @@ void ChartManager::ProcessSentence()
   //ChartHypothesis::ResetHypoCount();
 
   AddXmlChartOptions();
+  InitClauseCache();
 
   // MAIN LOOP
   size_t size = m_source.GetSize();
@@ -89,18 +94,31 @@ void ChartManager::ProcessSentence()
       size_t endPos = startPos + width - 1;
       WordsRange range(startPos, endPos);
 
-      // create trans opt
+      // create trans opt.  Also done for spliced cells since rule lookup for
+      // spans that start inside a clause but end outside of it continues the
+      // dotted rules of this range
       m_transOptColl.CreateTranslationOptionsForRange(range);
 
       // decode
       ChartCell &cell = m_hypoStackColl.Get(range);
 
-      cell.ProcessSentence(m_transOptColl.GetTranslationOptionList()
-                           ,m_hypoStackColl);
+      ClauseSplice *splice = FindClauseSplice(range);
+      if (splice) {
+        splice->Splice(range, cell, *this);
+      } else {
+        cell.ProcessSentence(m_transOptColl.GetTranslationOptionList()
+                             ,m_hypoStackColl);
+      }
       m_transOptColl.Clear();
       cell.PruneToSize();
       cell.CleanupArcList();
       cell.SortHypotheses();
+      if (splice) {
+        // only now do we know which spliced hypotheses survive
+        splice->Record(range, cell);
+      }
+
+      AddClauseToCache(range);
     }
   }
 
@@ -147,6 +165,105 @@ void ChartManager::AddXmlChartOptions() {
   }
 }
 
+/** Look up the clauses of the sentence in the clause cache.  Cached clauses
+ *  are spliced into the chart, the others are added to the cache once their
+ *  cells are complete.  Only nested or disjoint clauses are spliced so that
+ *  every cell is taken from at most one cached sub-chart.
+ */
+void ChartManager::InitClauseCache()
+{
+  const StaticData &staticData = StaticData::Instance();
+  ChartClauseCache *cache = staticData.GetClauseCache();
+  const ClauseBoundaries *clauseBoundaries = m_source.GetClauseBoundaries();
+  if (cache == NULL || clauseBoundaries == NULL) {
+    return;
+  }
+
+  // spliced cells don't contain recombined hypotheses
+  if (staticData.IsNBestEnabled()) {
+    return;
+  }
+
+  // xml options are specific to the sentence
+  TreeInput const &source = dynamic_cast<TreeInput const&>(m_source);
+  if (!source.GetXmlChartTranslationOptions().empty()) {
+    return;
+  }
+
+  // clause ranges, largest first
+  std::vector<std::pair<size_t, WordsRange> > clauses;
+  const std::vector<std::vector<int> > &bounds = clauseBoundaries->m_clauseBoundaries;
+  for (size_t i = 0; i < bounds.size(); ++i) {
+    const std::vector<int> &boundaries = bounds[i];
+    for (size_t j = 0; j + 1 < boundaries.size(); j += 2) {
+      int startPos = boundaries[j] + 1;
+      int endPos = boundaries[j + 1] + 1;
+      if (startPos < 1 || endPos < startPos || endPos >= (int) m_source.GetSize()) {
+        continue;
+      }
+      WordsRange range(startPos, endPos);
+      clauses.push_back(std::make_pair(range.GetNumWordsCovered(), range));
+    }
+  }
+  std::sort(clauses.begin(), clauses.end(), std::greater<std::pair<size_t, WordsRange> >());
+  clauses.erase(std::unique(clauses.begin(), clauses.end()), clauses.end());
+
+  const std::string &systemId = m_system->GetId();
+  for (size_t i = 0; i < clauses.size(); ++i) {
+    const WordsRange &clause = clauses[i].second;
+
+    bool nested = false, overlaps = false;
+    std::vector<boost::shared_ptr<ClauseSplice> >::const_iterator iter;
+    for (iter = m_clauseSplices.begin(); iter != m_clauseSplices.end(); ++iter) {
+      const WordsRange &spliced = (*iter)->GetClause();
+      if (spliced.GetStartPos() <= clause.GetStartPos() && clause.GetEndPos() <= spliced.GetEndPos()) {
+        nested = true;
+      } else if (spliced.Overlap(clause)) {
+        overlaps = true;
+      }
+    }
+    if (nested) {
+      continue;
+    }
+
+    ClauseCacheKey key(m_source, clause, systemId);
+    boost::shared_ptr<const ClauseSubChart> subChart = cache->Find(key);
+    if (subChart && !overlaps) {
+      m_clauseSplices.push_back(boost::shared_ptr<ClauseSplice>(new ClauseSplice(clause, subChart)));
+    } else if (!subChart) {
+      m_clausesToCache.push_back(clause);
+    }
+  }
+}
+
+/** Return the cached sub-chart that provides the cell for this range, if any */
+ClauseSplice *ChartManager::FindClauseSplice(const WordsRange &range) const
+{
+  std::vector<boost::shared_ptr<ClauseSplice> >::const_iterator iter;
+  for (iter = m_clauseSplices.begin(); iter != m_clauseSplices.end(); ++iter) {
+    const WordsRange &clause = (*iter)->GetClause();
+    if (clause.GetStartPos() <= range.GetStartPos() && range.GetEndPos() <= clause.GetEndPos()) {
+      return iter->get();
+    }
+  }
+  return NULL;
+}
+
+/** Once the top cell of a clause is complete, store its sub-chart */
+void ChartManager::AddClauseToCache(const WordsRange &range)
+{
+  std::vector<WordsRange>::const_iterator iter;
+  for (iter = m_clausesToCache.begin(); iter != m_clausesToCache.end(); ++iter) {
+    if (*iter == range) {
+      ChartClauseCache *cache = StaticData::Instance().GetClauseCache();
+      ClauseCacheKey key(m_source, range, m_system->GetId());
+      boost::shared_ptr<const ClauseSubChart> subChart(new ClauseSubChart(m_hypoStackColl, range));
+      cache->Add(key, subChart);
+      return;
+    }
+  }
+}
+
 const ChartHypothesis *ChartManager::GetBestHypothesis() const
 {
   size_t size = m_source.GetSize();
@@ -244,6 +361,12 @@ void ChartManager::CalcNBest(size_t count, ChartTrellisPathList &ret,bool onlyDi
 
 void ChartManager::CalcDecoderStatistics() const
 {
+  const ChartClauseCache *cache = StaticData::Instance().GetClauseCache();
+  if (cache != NULL) {
+    VERBOSE(1, "Clauses spliced from cache: " << m_clauseSplices.size()
+            << ", added to cache: " << m_clausesToCache.size()
+            << ", " << *cache << endl);
+  }
 }
 
 void ChartManager::GetSearchGraph(long translationId, std::ostream &outputSearchGraphStream) const
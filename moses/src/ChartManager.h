@@ -37,6 +37,7 @@ namespace Moses
 {
 
 class ChartHypothesis;
+class ClauseSplice;
 class ChartTrellisDetourQueue;
 class ChartTrellisNode;
 class ChartTrellisPath;
@@ -52,7 +53,13 @@ private:
                                  const ChartTrellisNode &,
                                  ChartTrellisDetourQueue &);
 
+  void InitClauseCache();
+  ClauseSplice *FindClauseSplice(const WordsRange &range) const;
+  void AddClauseToCache(const WordsRange &range);
+
   InputType const& m_source; /**< source sentence to be translated */
+  std::vector<boost::shared_ptr<ClauseSplice> > m_clauseSplices; /**< cached clauses spliced into this chart */
+  std::vector<WordsRange> m_clausesToCache; /**< clauses to add to the clause cache once decoded */
   ChartCellCollection m_hypoStackColl;
   ChartTranslationOptionCollection m_transOptColl; /**< pre-computed list of translation options for the phrases in this sentence */
   std::auto_ptr<SentenceStats> m_sentenceStats;
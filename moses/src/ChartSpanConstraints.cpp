@@ -0,0 +1,86 @@
+/***********************************************************************
+  Moses - factored phrase-based language decoder
+  Copyright (C) 2012 University of Edinburgh
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ ***********************************************************************/
+
+#include "ChartSpanConstraints.h"
+
+#include "ClauseBoundaries.h"
+#include "InputType.h"
+#include "StaticData.h"
+#include "Util.h"
+#include "WordsRange.h"
+
+namespace Moses
+{
+
+ChartSpanConstraints::ChartSpanConstraints(const InputType &sentence)
+  : m_useClauses(false)
+{
+  const int size = sentence.GetSize();
+  m_lastEnd.resize(size, size - 1);
+
+  const ClauseBoundaries *clauseBoundaries = sentence.GetClauseBoundaries();
+  if (StaticData::Instance().GetParam("clause-bounds").size() != 1 || clauseBoundaries == NULL) {
+    return;
+  }
+  m_useClauses = true;
+
+  // the clause test of the min-span rule lookup.  A span is allowed at the
+  // first clause it ends, if it crosses none of the clauses listed up to there
+  const std::vector<std::vector<int> > &bounds = clauseBoundaries->m_clauseBoundaries;
+  m_clauseAllows.resize(size);
+  for (int start = 0; start < size; ++start) {
+    m_clauseAllows[start].resize(size, false);
+    m_lastEnd[start] = -1;
+    for (int end = start; end < size; ++end) {
+      bool crosses = false, allows = false;
+      for (size_t i = 0; i < bounds.size() && !allows; ++i) {
+        const std::vector<int> &boundaries = bounds[i];
+        for (size_t j = 0; j + 1 < boundaries.size() && !allows; j += 2) {
+          int boundary1 = boundaries[j], boundary2 = boundaries[j + 1];
+          bool isInsideStart = IsInside(start, boundary1 + 1, boundary2 + 1);
+          bool isInsideEnd = IsInside(end, boundary1 + 1, boundary2 + 1);
+          crosses = crosses || isInsideStart != isInsideEnd;
+          allows = MatchesInterval(end, boundary2) && !crosses;
+        }
+      }
+      m_clauseAllows[start][end] = allows;
+      if (allows) {
+        m_lastEnd[start] = end;
+      }
+    }
+  }
+}
+
+bool ChartSpanConstraints::Allows(const WordsRange &range, size_t minSpan) const
+{
+  if (range.GetNumWordsCovered() <= minSpan) {
+    return false;
+  }
+  return !m_useClauses || m_clauseAllows[range.GetStartPos()][range.GetEndPos()];
+}
+
+bool ChartSpanConstraints::AllowsExtension(const WordsRange &range, size_t minSpan) const
+{
+  // the allowed span ending last is the longest
+  int lastEnd = m_lastEnd[range.GetStartPos()];
+  return lastEnd >= (int) range.GetEndPos()
+         && (size_t) (lastEnd - range.GetStartPos() + 1) > minSpan;
+}
+
+}  // namespace Moses
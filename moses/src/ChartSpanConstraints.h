@@ -0,0 +1,60 @@
+/***********************************************************************
+  Moses - factored phrase-based language decoder
+  Copyright (C) 2012 University of Edinburgh
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ ***********************************************************************/
+
+#pragma once
+#ifndef moses_ChartSpanConstraints_h
+#define moses_ChartSpanConstraints_h
+
+#include <cstddef>
+#include <vector>
+
+namespace Moses
+{
+
+class InputType;
+class WordsRange;
+
+/** Spans of a sentence that the rules of the min-span model may cover.  A
+ *  rule must cover more than the min span of its decode graph and, if
+ *  clause boundaries are given (clause-bounds), its span must end at the end
+ *  of a clause without crossing the clauses checked before that one.
+ *  Whether a span is allowed by the clause boundaries is worked out once per
+ *  sentence, so rule lookup can skip spans no rule may cover.
+ */
+class ChartSpanConstraints
+{
+public:
+  explicit ChartSpanConstraints(const InputType &sentence);
+
+  //! whether a rule may cover range
+  bool Allows(const WordsRange &range, size_t minSpan) const;
+
+  //! whether a rule may cover a span with the start of range that ends at or
+  //! after the end of range.  Partial rules of range are useless otherwise
+  bool AllowsExtension(const WordsRange &range, size_t minSpan) const;
+
+private:
+  bool m_useClauses;
+  std::vector<std::vector<bool> > m_clauseAllows; // by start, end
+  std::vector<int> m_lastEnd; // by start, -1 if no span is allowed
+};
+
+}  // namespace Moses
+
+#endif
@@ -21,6 +21,9 @@ struct DistortionState_traditional : public FFState {
     if (range.GetEndPos() > o.range.GetEndPos()) return 1;
     return 0;
   }
+  size_t hash() const {
+    return range.GetEndPos();
+  }
 };
 
 const FFState* DistortionScoreProducer::EmptyHypothesisState(const InputType &input) const
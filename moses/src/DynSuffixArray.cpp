@@ -11,7 +11,7 @@ DynSuffixArray::DynSuffixArray()
   m_SA = new vuint_t();
   m_ISA = new vuint_t();
   m_F = new vuint_t();
-  m_L = new vuint_t();
+  m_L = new DynWaveletMatrix();
   std::cerr << "DYNAMIC SUFFIX ARRAY CLASS INSTANTIATED" << std::endl;
 }
 
@@ -47,24 +47,21 @@ void DynSuffixArray::BuildAuxArrays()
   int size = m_SA->size();
   m_ISA = new vuint_t(size);
   m_F = new vuint_t(size);
-  m_L = new vuint_t(size);
+  vuint_t L(size);
 
   for(int i=0; i < size; ++i) {
     m_ISA->at(m_SA->at(i)) = i;
     //(*m_ISA)[(*m_SA)[i]] = i;
     (*m_F)[i] = (*m_corpus)[m_SA->at(i)];
-    (*m_L)[i] = (*m_corpus)[(m_SA->at(i) == 0 ? size-1 : m_SA->at(i)-1)];
+    L[i] = (*m_corpus)[(m_SA->at(i) == 0 ? size-1 : m_SA->at(i)-1)];
   }
+  m_L = new DynWaveletMatrix(L);
 }
 
 int DynSuffixArray::Rank(unsigned word, unsigned idx)
 {
-  /* use Gerlach's code to make rank faster */
   // the number of words in L[0..i] (minus 1 which is why 'i < idx', not '<=')
-  int r(0);
-  for(unsigned i=0; i < idx; ++i)
-    if(m_L->at(i) == word) ++r;
-  return r;
+  return m_L->Rank(word, idx);
 }
 
 /* count function should be implemented
@@ -93,7 +90,7 @@ int DynSuffixArray::LastFirstFunc(unsigned L_idx)
 {
   int fIdx(-1);
   //cerr << "in LastFirstFcn() with L_idx = " << L_idx << endl;
-  unsigned word = m_L->at(L_idx);
+  unsigned word = m_L->Get(L_idx);
   if((fIdx = F_firstIdx(word)) != -1) {
     //cerr << "fidx + Rank(" << word << "," << L_idx << ") = " << fIdx << "+" << Rank(word, L_idx) << endl;
     fIdx += Rank(word, L_idx);
@@ -113,8 +110,8 @@ void DynSuffixArray::Insert(vuint_t* newSent, unsigned newIndex)
   int k(-1), kprime(-1);
   k = (newIndex < m_SA->size() ? m_ISA->at(newIndex) : m_ISA->at(0)); // k is now index of the cycle that starts at newindex
   int true_pos = LastFirstFunc(k); // track cycle shift (newIndex - 1)
-  int Ltmp = m_L->at(k);
-  m_L->at(k) = newSent->at(newSent->size()-1);  // cycle k now ends with correct word
+  int Ltmp = m_L->Get(k);
+  m_L->Set(k, newSent->at(newSent->size()-1));  // cycle k now ends with correct word
   for(int j = newSent->size()-1; j > -1; --j) {
     kprime = LastFirstFunc(k);  // find cycle that starts with (newindex - 1)
     //kprime += ((m_L[k] == Ltmp) && (k > isa[k]) ? 1 : 0); // yada yada
@@ -125,7 +122,7 @@ void DynSuffixArray::Insert(vuint_t* newSent, unsigned newIndex)
     m_F->insert(m_F->begin() + kprime, newSent->at(j));
     int theLWord = (j == 0 ? Ltmp : newSent->at(j-1));
 
-    m_L->insert(m_L->begin() + kprime, theLWord);
+    m_L->Insert(kprime, theLWord);
     for (vuint_t::iterator itr = m_SA->begin(); itr != m_SA->end(); ++itr) {
       if(*itr >= newIndex) ++(*itr);
     }
@@ -163,8 +160,8 @@ void DynSuffixArray::Reorder(unsigned j, unsigned jprime)
     int new_j = LastFirstFunc(j);
     CHECK(j <= jprime);
     // for SA and L, the element at pos j is moved to pos j'
-    m_L->insert(m_L->begin() + jprime + 1, m_L->at(j)); 
-    m_L->erase(m_L->begin() + j);
+    m_L->Insert(jprime + 1, m_L->Get(j));
+    m_L->Erase(j);
     m_SA->insert(m_SA->begin() + jprime + 1, m_SA->at(j)); 
     m_SA->erase(m_SA->begin() + j);
     // all ISA values between (j...j'] decremented
@@ -184,14 +181,14 @@ void DynSuffixArray::Reorder(unsigned j, unsigned jprime)
 
 void DynSuffixArray::Delete(unsigned index, unsigned num2del)
 {
-  int ltmp = m_L->at(m_ISA->at(index));
+  int ltmp = m_L->Get(m_ISA->at(index));
   int true_pos = LastFirstFunc(m_ISA->at(index)); // track cycle shift (newIndex - 1)
   for(size_t q = 0; q < num2del; ++q) {
     int row = m_ISA->at(index); // gives the position of index in SA and m_F
     //std::cerr << "row = " << row << std::endl;
     //std::cerr << "SA[r]/index = " << m_SA->at(row) << "/" << index << std::endl;
     true_pos -= (row <= true_pos ? 1 : 0); // track changes
-    m_L->erase(m_L->begin() + row);
+    m_L->Erase(row);
     m_F->erase(m_F->begin() + row);
 
     m_ISA->erase(m_ISA->begin() + index);  // order is important
@@ -204,7 +201,7 @@ void DynSuffixArray::Delete(unsigned index, unsigned num2del)
       if(*itr > index) --(*itr);
     }
   }
-  m_L->at(m_ISA->at(index))= ltmp;
+  m_L->Set(m_ISA->at(index), ltmp);
   Reorder(LastFirstFunc(m_ISA->at(index)), true_pos);
   //PrintAuxArrays();
 }
@@ -8,12 +8,21 @@
 #include "Util.h"
 #include "File.h"
 #include "DynSAInclude/types.h"
+#include "DynWaveletMatrix.h"
 
 namespace Moses
 {
 
 typedef std::vector<unsigned> vuint_t;
 
+/** Suffix array of a corpus that sentences can be inserted into and deleted
+ * from.  Only rank on the BWT column m_L is sublinear, O(log |V| log n),
+ * which makes the LF mapping cheap.  Insert and Delete are still O(n) per
+ * word: m_SA, m_ISA and m_F are plain vectors, and every word inserted or
+ * deleted renumbers all of m_SA and m_ISA.  Sublinear updates would need
+ * dynamic forms of these arrays as well, e.g. a sampled suffix array that
+ * is located through the LF mapping, at the cost of slower lookups.
+ */
 class DynSuffixArray
 {
 
@@ -32,7 +41,7 @@ private:
   vuint_t* m_SA;
   vuint_t* m_ISA;
   vuint_t* m_F;
-  vuint_t* m_L;
+  DynWaveletMatrix* m_L; // with rank in O(log |V| log n)
   vuint_t* m_corpus;
   void BuildAuxArrays();
   void Qsort(int* array, int begin, int end);
@@ -44,7 +53,7 @@ private:
   void PrintAuxArrays() {
     std::cerr << "SA\tISA\tF\tL\n";
     for(size_t i=0; i < m_SA->size(); ++i)
-      std::cerr << m_SA->at(i) << "\t" << m_ISA->at(i) << "\t" << m_F->at(i) << "\t" << m_L->at(i) << std::endl;
+      std::cerr << m_SA->at(i) << "\t" << m_ISA->at(i) << "\t" << m_F->at(i) << "\t" << m_L->Get(i) << std::endl;
   }
 };
 
@@ -0,0 +1,316 @@
+#include "DynWaveletMatrix.h"
+#include "util/check.hh"
+
+namespace Moses
+{
+
+namespace
+{
+
+inline size_t PopCount(UINT64 word)
+{
+  return __builtin_popcountll(word);
+}
+
+// bits below offset
+inline UINT64 LowMask(size_t offset)
+{
+  return offset == 0 ? 0 : (~UINT64(0) >> (64 - offset));
+}
+
+// largest power of 2 not above num
+inline size_t TopStep(size_t num)
+{
+  size_t step = 1;
+  while (step * 2 <= num)
+    step *= 2;
+  return step;
+}
+
+}
+
+DynBitVector::DynBitVector()
+  : m_size(0)
+{
+}
+
+size_t DynBitVector::FindBlock(size_t &pos) const
+{
+  const size_t numBlocks = m_blocks.size();
+  size_t blockInd = 0;
+  for (size_t step = TopStep(numBlocks); step > 0; step >>= 1) {
+    if (blockInd + step <= numBlocks && m_sizeTree[blockInd + step] <= pos) {
+      blockInd += step;
+      pos -= m_sizeTree[blockInd];
+    }
+  }
+  return blockInd;
+}
+
+size_t DynBitVector::FindInsertBlock(size_t &pos) const
+{
+  if (pos == m_size) {
+    pos = m_blocks.back().m_size;
+    return m_blocks.size() - 1;
+  }
+  return FindBlock(pos);
+}
+
+size_t DynBitVector::PrefixOnes(size_t blockInd) const
+{
+  size_t ones = 0;
+  for (size_t i = blockInd; i > 0; i -= i & (~i + 1))
+    ones += m_onesTree[i];
+  return ones;
+}
+
+void DynBitVector::Update(size_t blockInd, int sizeDiff, int onesDiff)
+{
+  for (size_t i = blockInd + 1; i <= m_blocks.size(); i += i & (~i + 1)) {
+    m_sizeTree[i] += sizeDiff;
+    m_onesTree[i] += onesDiff;
+  }
+}
+
+void DynBitVector::BuildTrees()
+{
+  const size_t numBlocks = m_blocks.size();
+  m_sizeTree.assign(numBlocks + 1, 0);
+  m_onesTree.assign(numBlocks + 1, 0);
+  for (size_t i = 1; i <= numBlocks; ++i) {
+    m_sizeTree[i] += m_blocks[i - 1].m_size;
+    m_onesTree[i] += m_blocks[i - 1].m_ones;
+    size_t parent = i + (i & (~i + 1));
+    if (parent <= numBlocks) {
+      m_sizeTree[parent] += m_sizeTree[i];
+      m_onesTree[parent] += m_onesTree[i];
+    }
+  }
+}
+
+bool DynBitVector::Get(size_t pos) const
+{
+  CHECK(pos < m_size);
+  const Block &block = m_blocks[FindBlock(pos)];
+  return (block.m_words[pos / 64] >> (pos % 64)) & 1;
+}
+
+size_t DynBitVector::Rank1(size_t pos) const
+{
+  CHECK(pos <= m_size);
+  if (pos == m_size)
+    return PrefixOnes(m_blocks.size());
+
+  size_t blockInd = FindBlock(pos);
+  const Block &block = m_blocks[blockInd];
+  size_t ones = PrefixOnes(blockInd);
+  size_t word = pos / 64;
+  for (size_t i = 0; i < word; ++i)
+    ones += PopCount(block.m_words[i]);
+  return ones + PopCount(block.m_words[word] & LowMask(pos % 64));
+}
+
+void DynBitVector::SplitBlock(size_t blockInd)
+{
+  // the upper half moves to a new block after this one
+  Block upper;
+  Block &lower = m_blocks[blockInd];
+  const size_t half = BlockWords / 2;
+  for (size_t i = 0; i < half; ++i) {
+    upper.m_words[i] = lower.m_words[half + i];
+    upper.m_ones += PopCount(upper.m_words[i]);
+    lower.m_words[half + i] = 0;
+  }
+  upper.m_size = lower.m_size - half * 64;
+  lower.m_size = half * 64;
+  lower.m_ones -= upper.m_ones;
+
+  m_blocks.insert(m_blocks.begin() + blockInd + 1, upper);
+  BuildTrees();
+}
+
+void DynBitVector::Insert(size_t pos, bool bit)
+{
+  CHECK(pos <= m_size);
+  if (m_blocks.empty()) {
+    m_blocks.push_back(Block());
+    BuildTrees();
+  }
+
+  size_t blockInd = FindInsertBlock(pos);
+  if (m_blocks[blockInd].m_size == BlockBits) {
+    SplitBlock(blockInd);
+    if (pos >= m_blocks[blockInd].m_size) {
+      pos -= m_blocks[blockInd].m_size;
+      ++blockInd;
+    }
+  }
+
+  // shift the bits from pos up by one
+  Block &block = m_blocks[blockInd];
+  UINT64 *words = block.m_words;
+  size_t word = pos / 64, offset = pos % 64;
+  for (size_t i = block.m_size / 64; i > word; --i)
+    words[i] = (words[i] << 1) | (words[i - 1] >> 63);
+  UINT64 low = words[word] & LowMask(offset);
+  words[word] = low | ((words[word] & ~LowMask(offset)) << 1) | (UINT64(bit) << offset);
+
+  ++block.m_size;
+  block.m_ones += bit;
+  ++m_size;
+  Update(blockInd, 1, bit);
+}
+
+void DynBitVector::Erase(size_t pos)
+{
+  CHECK(pos < m_size);
+  size_t blockInd = FindBlock(pos);
+  Block &block = m_blocks[blockInd];
+  UINT64 *words = block.m_words;
+  size_t word = pos / 64, offset = pos % 64;
+  bool bit = (words[word] >> offset) & 1;
+
+  // shift the bits above pos down by one
+  UINT64 low = words[word] & LowMask(offset);
+  words[word] = low | ((words[word] >> 1) & ~LowMask(offset));
+  for (size_t i = word; i < (block.m_size - 1) / 64; ++i) {
+    words[i] |= (words[i + 1] & 1) << 63;
+    words[i + 1] >>= 1;
+  }
+
+  --block.m_size;
+  block.m_ones -= bit;
+  --m_size;
+  if (block.m_size == 0 && m_blocks.size() > 1) {
+    m_blocks.erase(m_blocks.begin() + blockInd);
+    BuildTrees();
+  } else {
+    Update(blockInd, -1, -(int) bit);
+  }
+}
+
+void DynBitVector::Assign(const std::vector<bool> &bits)
+{
+  m_blocks.clear();
+  m_blocks.resize((bits.size() + BlockBits - 1) / BlockBits);
+  for (size_t pos = 0; pos < bits.size(); ++pos) {
+    Block &block = m_blocks[pos / BlockBits];
+    size_t offset = pos % BlockBits;
+    if (bits[pos]) {
+      block.m_words[offset / 64] |= UINT64(1) << (offset % 64);
+      ++block.m_ones;
+    }
+    ++block.m_size;
+  }
+  m_size = bits.size();
+  BuildTrees();
+}
+
+DynWaveletMatrix::DynWaveletMatrix(const std::vector<unsigned> &symbols)
+{
+  unsigned maxSymbol = 0;
+  for (size_t i = 0; i < symbols.size(); ++i)
+    maxSymbol = std::max(maxSymbol, symbols[i]);
+  size_t numLevels = 1;
+  while (numLevels < 32 && (maxSymbol >> numLevels) != 0)
+    ++numLevels;
+  m_levels.resize(numLevels);
+  m_zeros.resize(numLevels);
+
+  // each level in the order of the bits above, 0 first
+  std::vector<unsigned> order(symbols), next(symbols.size());
+  std::vector<bool> bits(symbols.size());
+  for (size_t level = 0; level < numLevels; ++level) {
+    const size_t shift = numLevels - 1 - level;
+    size_t zeros = 0;
+    for (size_t i = 0; i < order.size(); ++i) {
+      bits[i] = (order[i] >> shift) & 1;
+      zeros += !bits[i];
+    }
+    m_levels[level].Assign(bits);
+    m_zeros[level] = zeros;
+
+    size_t zeroPos = 0, onePos = zeros;
+    for (size_t i = 0; i < order.size(); ++i)
+      next[bits[i] ? onePos++ : zeroPos++] = order[i];
+    order.swap(next);
+  }
+}
+
+void DynWaveletMatrix::Widen(unsigned symbol)
+{
+  const size_t size = GetSize();
+  while (m_levels.empty() || !Fits(symbol)) {
+    DynBitVector top;
+    top.Assign(std::vector<bool>(size, false));
+    m_levels.insert(m_levels.begin(), top);
+    m_zeros.insert(m_zeros.begin(), size);
+  }
+}
+
+unsigned DynWaveletMatrix::Get(size_t pos) const
+{
+  unsigned symbol = 0;
+  for (size_t level = 0; level < m_levels.size(); ++level) {
+    const DynBitVector &bits = m_levels[level];
+    bool bit = bits.Get(pos);
+    pos = bit ? m_zeros[level] + bits.Rank1(pos) : bits.Rank0(pos);
+    symbol = (symbol << 1) | bit;
+  }
+  return symbol;
+}
+
+size_t DynWaveletMatrix::Rank(unsigned symbol, size_t pos) const
+{
+  if (m_levels.empty() || !Fits(symbol))
+    return 0;
+
+  // range of the positions before pos holding symbols with the bits so far
+  size_t begin = 0, end = pos;
+  const size_t numLevels = m_levels.size();
+  for (size_t level = 0; level < numLevels; ++level) {
+    const DynBitVector &bits = m_levels[level];
+    if ((symbol >> (numLevels - 1 - level)) & 1) {
+      begin = m_zeros[level] + bits.Rank1(begin);
+      end = m_zeros[level] + bits.Rank1(end);
+    } else {
+      begin = bits.Rank0(begin);
+      end = bits.Rank0(end);
+    }
+  }
+  return end - begin;
+}
+
+void DynWaveletMatrix::Insert(size_t pos, unsigned symbol)
+{
+  CHECK(pos <= GetSize());
+  Widen(symbol);
+  const size_t numLevels = m_levels.size();
+  for (size_t level = 0; level < numLevels; ++level) {
+    DynBitVector &bits = m_levels[level];
+    bool bit = (symbol >> (numLevels - 1 - level)) & 1;
+    bits.Insert(pos, bit);
+    if (bit) {
+      pos = m_zeros[level] + bits.Rank1(pos);
+    } else {
+      ++m_zeros[level];
+      pos = bits.Rank0(pos);
+    }
+  }
+}
+
+void DynWaveletMatrix::Erase(size_t pos)
+{
+  CHECK(pos < GetSize());
+  for (size_t level = 0; level < m_levels.size(); ++level) {
+    DynBitVector &bits = m_levels[level];
+    bool bit = bits.Get(pos);
+    size_t next = bit ? m_zeros[level] + bits.Rank1(pos) : bits.Rank0(pos);
+    bits.Erase(pos);
+    if (!bit)
+      --m_zeros[level];
+    pos = next;
+  }
+}
+
+} // end namespace
@@ -0,0 +1,107 @@
+#ifndef moses_DynWaveletMatrix_h
+#define moses_DynWaveletMatrix_h
+
+#include <algorithm>
+#include <vector>
+#include <cstddef>
+#include "TypeDef.h"
+
+namespace Moses
+{
+
+/** Bit sequence that supports inserting and erasing bits as well as access
+ * and rank in O(log n).  The bits are held in blocks of at most BlockBits,
+ * and the lengths and numbers of ones of the blocks are summed up in Fenwick
+ * trees, so that a position is found without scanning the blocks before it.
+ * A full block is split in two; an empty block is dropped.
+ */
+class DynBitVector
+{
+public:
+  DynBitVector();
+
+  size_t GetSize() const {
+    return m_size;
+  }
+  bool Get(size_t pos) const;
+  //! number of ones in [0, pos)
+  size_t Rank1(size_t pos) const;
+  //! number of zeros in [0, pos)
+  size_t Rank0(size_t pos) const {
+    return pos - Rank1(pos);
+  }
+  void Insert(size_t pos, bool bit);
+  void Erase(size_t pos);
+
+  //! replace the contents by bits
+  void Assign(const std::vector<bool> &bits);
+
+protected:
+  static const size_t BlockWords = 32;
+  static const size_t BlockBits = BlockWords * 64;
+
+  struct Block {
+    UINT64 m_words[BlockWords]; // bits past m_size are kept 0
+    size_t m_size, m_ones;
+    Block() : m_size(0), m_ones(0) {
+      std::fill(m_words, m_words + BlockWords, 0);
+    }
+  };
+
+  std::vector<Block> m_blocks;
+  std::vector<size_t> m_sizeTree, m_onesTree; // Fenwick trees over the blocks, 1-based
+  size_t m_size;
+
+  //! block holding pos, which is made the offset within it. pos < m_size
+  size_t FindBlock(size_t &pos) const;
+  //! block to insert at pos, which is made the offset within it. pos <= m_size
+  size_t FindInsertBlock(size_t &pos) const;
+  size_t PrefixOnes(size_t blockInd) const;
+  void Update(size_t blockInd, int sizeDiff, int onesDiff);
+  void SplitBlock(size_t blockInd);
+  void BuildTrees();
+};
+
+/** Dynamic sequence of unsigned symbols with access and rank in
+ * O(log sigma * log n), log sigma being the number of bits of the largest
+ * symbol, and inserts and erases at any position in the same time.
+ *
+ * This is a wavelet matrix: level 0 holds the top bit of every symbol, and
+ * each further level the next bit, with the symbols stably sorted by the bits
+ * above, those with a 0 bit first.  A symbol needing more bits than there
+ * are levels adds a new top level of zeros, which leaves the order below
+ * unchanged.
+ */
+class DynWaveletMatrix
+{
+public:
+  DynWaveletMatrix() {}
+  explicit DynWaveletMatrix(const std::vector<unsigned> &symbols);
+
+  size_t GetSize() const {
+    return m_levels.empty() ? 0 : m_levels[0].GetSize();
+  }
+  unsigned Get(size_t pos) const;
+  //! number of occurrences of symbol in [0, pos)
+  size_t Rank(unsigned symbol, size_t pos) const;
+
+  void Insert(size_t pos, unsigned symbol);
+  void Erase(size_t pos);
+  void Set(size_t pos, unsigned symbol) {
+    Erase(pos);
+    Insert(pos, symbol);
+  }
+
+protected:
+  std::vector<DynBitVector> m_levels; // top bit first
+  std::vector<size_t> m_zeros; // number of zeros of each level
+
+  bool Fits(unsigned symbol) const {
+    return m_levels.size() >= 32 || (symbol >> m_levels.size()) == 0;
+  }
+  void Widen(unsigned symbol);
+};
+
+} // end namespace
+
+#endif
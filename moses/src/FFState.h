@@ -2,6 +2,7 @@
 #define moses_FFState_h
 
 #include "util/check.hh"
+#include <cstddef>
 #include <vector>
 
 
@@ -13,6 +14,12 @@ class FFState
 public:
   virtual ~FFState();
   virtual int Compare(const FFState& other) const = 0;
+  /** hash consistent with Compare(): states that compare equal must hash
+   * equally.  Used to recombine hypotheses in hash tables.  The default
+   * puts all states of a feature into one bucket */
+  virtual size_t hash() const {
+    return 0;
+  }
 };
 
 }
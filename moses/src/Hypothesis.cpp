@@ -39,6 +39,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include "Manager.h"
 #include "hash.h"
 
+#include <boost/functional/hash.hpp>
+
 using namespace std;
 
 namespace Moses
@@ -252,6 +254,15 @@ int Hypothesis::RecombineCompare(const Hypothesis &compare) const
   return 0;
 }
 
+size_t Hypothesis::GetRecombinationHash() const
+{
+  size_t seed = m_sourceCompleted.hash();
+  for (unsigned i = 0; i < m_ffStates.size(); ++i) {
+    boost::hash_combine(seed, m_ffStates[i] ? m_ffStates[i]->hash() : 0);
+  }
+  return seed;
+}
+
 void Hypothesis::ResetScore()
 {
   m_scoreBreakdown.ZeroAll();
@@ -416,7 +427,7 @@ void Hypothesis::CleanupArcList()
    */
   const StaticData &staticData = StaticData::Instance();
   size_t nBestSize = staticData.GetNBestSize();
-  bool distinctNBest = staticData.GetDistinctNBest() || staticData.UseMBR() || staticData.GetOutputSearchGraph() || staticData.UseLatticeMBR() ;
+  bool distinctNBest = staticData.GetDistinctNBest() || staticData.UseMBR() || m_manager.GetOutputSearchGraph() || staticData.UseLatticeMBR() ;
 
   if (!distinctNBest && m_arcList->size() > nBestSize * 5) {
     // prune arc list only if there too many arcs
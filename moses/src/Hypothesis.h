@@ -203,6 +203,8 @@ public:
   }
 
   int RecombineCompare(const Hypothesis &compare) const;
+  //! hash over everything RecombineCompare() looks at
+  size_t GetRecombinationHash() const;
 
   void ToStream(std::ostream& out) const {
     if (m_prevHypo != NULL) {
@@ -255,9 +257,19 @@ public:
 std::ostream& operator<<(std::ostream& out, const Hypothesis& hypothesis);
 
 // sorting helper
+//! best first, ties broken by creation order so that sorting is deterministic
 struct CompareHypothesisTotalScore {
   bool operator()(const Hypothesis* hypo1, const Hypothesis* hypo2) const {
-    return hypo1->GetTotalScore() > hypo2->GetTotalScore();
+    if (hypo1->GetTotalScore() != hypo2->GetTotalScore())
+      return hypo1->GetTotalScore() > hypo2->GetTotalScore();
+    return hypo1->GetId() < hypo2->GetId();
+  }
+};
+
+//! creation order
+struct CompareHypothesisId {
+  bool operator()(const Hypothesis* hypo1, const Hypothesis* hypo2) const {
+    return hypo1->GetId() < hypo2->GetId();
   }
 };
 
@@ -290,5 +302,22 @@ public:
   }
 };
 
+//! hash and equality of hypotheses that can be recombined, for hash tables
+class HypothesisRecombinationHasher
+{
+public:
+  size_t operator()(const Hypothesis* hypo) const {
+    return hypo->GetRecombinationHash();
+  }
+};
+
+class HypothesisRecombinationComparer
+{
+public:
+  bool operator()(const Hypothesis* hypoA, const Hypothesis* hypoB) const {
+    return hypoA->RecombineCompare(*hypoB) == 0;
+  }
+};
+
 }
 #endif
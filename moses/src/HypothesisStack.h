@@ -2,7 +2,7 @@
 #define moses_HypothesisStack_h
 
 #include <vector>
-#include <set>
+#include <boost/unordered_set.hpp>
 #include "Hypothesis.h"
 #include "WordsBitmap.h"
 
@@ -15,7 +15,7 @@ class HypothesisStack
 {
 
 protected:
-  typedef std::set< Hypothesis*, HypothesisRecombinationOrderer > _HCType;
+  typedef boost::unordered_set< Hypothesis*, HypothesisRecombinationHasher, HypothesisRecombinationComparer > _HCType;
   _HCType m_hypos; /**< contains hypotheses */
   Manager& m_manager;
 
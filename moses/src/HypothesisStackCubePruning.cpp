@@ -35,7 +35,7 @@ namespace Moses
 HypothesisStackCubePruning::HypothesisStackCubePruning(Manager& manager) :
   HypothesisStack(manager)
 {
-  m_nBestIsEnabled = StaticData::Instance().IsNBestEnabled();
+  m_nBestIsEnabled = StaticData::Instance().IsNBestEnabled() || manager.GetOutputSearchGraph();
   m_bestScore = -std::numeric_limits<float>::infinity();
   m_worstScore = -std::numeric_limits<float>::infinity();
 }
@@ -206,7 +206,7 @@ const Hypothesis *HypothesisStackCubePruning::GetBestHypothesis() const
     Hypothesis *bestHypo = *iter;
     while (++iter != m_hypos.end()) {
       Hypothesis *hypo = *iter;
-      if (hypo->GetTotalScore() > bestHypo->GetTotalScore())
+      if (CompareHypothesisTotalScore()(hypo, bestHypo))
         bestHypo = hypo;
     }
     return bestHypo;
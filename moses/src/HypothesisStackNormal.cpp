@@ -35,7 +35,7 @@ namespace Moses
 HypothesisStackNormal::HypothesisStackNormal(Manager& manager) :
   HypothesisStack(manager)
 {
-  m_nBestIsEnabled = StaticData::Instance().IsNBestEnabled();
+  m_nBestIsEnabled = StaticData::Instance().IsNBestEnabled() || manager.GetOutputSearchGraph();
   m_bestScore = -std::numeric_limits<float>::infinity();
   m_worstScore = -std::numeric_limits<float>::infinity();
 }
@@ -48,12 +48,87 @@ void HypothesisStackNormal::RemoveAll()
   }
 }
 
+void HypothesisStackNormal::Detach(const HypothesisStack::iterator &iter)
+{
+  HeapErase(*iter);
+  HypothesisStack::Detach(iter);
+}
+
+void HypothesisStackNormal::HeapSiftUp(size_t pos)
+{
+  Hypothesis *hypo = m_heap[pos];
+  while (pos > 0) {
+    size_t parent = (pos - 1) / 2;
+    if (!IsWorse(hypo, m_heap[parent])) break;
+    HeapSet(pos, m_heap[parent]);
+    pos = parent;
+  }
+  HeapSet(pos, hypo);
+}
+
+void HypothesisStackNormal::HeapSiftDown(size_t pos)
+{
+  Hypothesis *hypo = m_heap[pos];
+  for (;;) {
+    size_t child = 2 * pos + 1;
+    if (child >= m_heap.size()) break;
+    if (child + 1 < m_heap.size() && IsWorse(m_heap[child + 1], m_heap[child]))
+      ++child;
+    if (!IsWorse(m_heap[child], hypo)) break;
+    HeapSet(pos, m_heap[child]);
+    pos = child;
+  }
+  HeapSet(pos, hypo);
+}
+
+void HypothesisStackNormal::HeapInsert(Hypothesis *hypo)
+{
+  m_heap.push_back(hypo);
+  HeapSiftUp(m_heap.size() - 1);
+}
+
+void HypothesisStackNormal::HeapErase(const Hypothesis *hypo)
+{
+  boost::unordered_map<const Hypothesis*, size_t>::iterator iter = m_heapIndex.find(hypo);
+  CHECK(iter != m_heapIndex.end());
+  size_t pos = iter->second;
+  m_heapIndex.erase(iter);
+
+  Hypothesis *last = m_heap.back();
+  m_heap.pop_back();
+  if (pos < m_heap.size()) {
+    HeapSet(pos, last);
+    if (pos > 0 && IsWorse(last, m_heap[(pos - 1) / 2])) {
+      HeapSiftUp(pos);
+    } else {
+      HeapSiftDown(pos);
+    }
+  }
+}
+
+void HypothesisStackNormal::RebuildHeap()
+{
+  m_heap.clear();
+  m_heapIndex.clear();
+  for (iterator iter = m_hypos.begin(); iter != m_hypos.end(); ++iter) {
+    HeapInsert(*iter);
+  }
+}
+
+void HypothesisStackNormal::RemoveWorst()
+{
+  Hypothesis *worst = m_heap.front();
+  Remove(m_hypos.find(worst));
+  m_manager.GetSentenceStats().AddPruning();
+}
+
 pair<HypothesisStackNormal::iterator, bool> HypothesisStackNormal::Add(Hypothesis *hypo)
 {
   std::pair<iterator, bool> ret = m_hypos.insert(hypo);
   if (ret.second) {
     // equiv hypo doesn't exists
     VERBOSE(3,"added hyp to stack");
+    HeapInsert(hypo);
 
     // Update best score, if this hypothesis is new best
     if (hypo->GetTotalScore() > m_bestScore) {
@@ -71,13 +146,27 @@ pair<HypothesisStackNormal::iterator, bool> HypothesisStackNormal::Add(Hypothesi
 
     VERBOSE(3,", now size " << m_hypos.size());
 
-    // prune only if stack is twice as big as needed (lazy pruning)
-    size_t toleratedSize = 2*m_maxHypoStackSize-1;
-    // add in room for stack diversity
-    if (m_minHypoStackDiversity)
+    if (m_minHypoStackDiversity) {
+      // prune only if stack is twice as big as needed (lazy pruning)
+      size_t toleratedSize = 2*m_maxHypoStackSize-1;
+      // add in room for stack diversity
       toleratedSize += m_minHypoStackDiversity << StaticData::Instance().GetMaxDistortion();
-    if (m_hypos.size() > toleratedSize) {
-      PruneToSize(m_maxHypoStackSize);
+      if (m_hypos.size() > toleratedSize) {
+        PruneToSize(m_maxHypoStackSize);
+        // the stack was rebuilt, and this hypothesis may be gone. The heap
+        // index is keyed by address, so a deleted one is not looked into
+        ret.first = (m_heapIndex.find(hypo) == m_heapIndex.end()) ? m_hypos.end() : m_hypos.find(hypo);
+      } else {
+        VERBOSE(3,std::endl);
+      }
+    } else if (m_maxHypoStackSize > 0 && m_hypos.size() > m_maxHypoStackSize) {
+      // stack is full: drop the worst hypothesis, which may be this one.
+      // Only hypotheses better than the new worst can enter from now on
+      if (m_heap.front() == hypo) ret.first = m_hypos.end();
+      RemoveWorst();
+      if (m_heap.front()->GetTotalScore() > m_worstScore)
+        m_worstScore = m_heap.front()->GetTotalScore();
+      VERBOSE(3,", evicted worst" << std::endl);
     } else {
       VERBOSE(3,std::endl);
     }
@@ -102,8 +191,8 @@ bool HypothesisStackNormal::AddPrune(Hypothesis *hypo)
   // over threshold, try to add to collection
   std::pair<iterator, bool> addRet = Add(hypo);
   if (addRet.second) {
-    // nothing found. add to collection
-    return true;
+    // nothing found. added to collection, unless pruned again at once
+    return addRet.first != m_hypos.end();
   }
 
   // equiv hypo exists, recombine with other hypo
@@ -145,6 +234,24 @@ bool HypothesisStackNormal::AddPrune(Hypothesis *hypo)
 }
 
 void HypothesisStackNormal::PruneToSize(size_t newSize)
+{
+  if (m_minHypoStackDiversity > 0) {
+    PruneToSizeWithDiversity(newSize);
+    return;
+  }
+  if ( size() <= newSize ) return; // ok, if not over the limit
+
+  while (!m_heap.empty()
+         && (size() > newSize || m_heap.front()->GetTotalScore() <= m_bestScore + m_beamWidth)) {
+    RemoveWorst();
+  }
+  if (size() == newSize && !m_heap.empty() && m_heap.front()->GetTotalScore() > m_worstScore)
+    m_worstScore = m_heap.front()->GetTotalScore();
+
+  VERBOSE(3,", pruned to size " << size() << endl);
+}
+
+void HypothesisStackNormal::PruneToSizeWithDiversity(size_t newSize)
 {
   if ( size() <= newSize ) return; // ok, if not over the limit
 
@@ -154,10 +261,7 @@ void HypothesisStackNormal::PruneToSize(size_t newSize)
   for(size_t i=0; i<hypos.size(); i++) included[i] = false;
 
   // clear out original set
-  for( iterator iter = m_hypos.begin(); iter != m_hypos.end(); ) {
-    iterator removeHyp = iter++;
-    Detach(removeHyp);
-  }
+  m_hypos.clear();
 
   // add best hyps for each coverage according to minStackDiversity
   if ( m_minHypoStackDiversity > 0 ) {
@@ -202,6 +306,7 @@ void HypothesisStackNormal::PruneToSize(size_t newSize)
     }
   }
   free(included);
+  RebuildHeap();
 
   // some reporting....
   VERBOSE(3,", pruned to size " << size() << endl);
@@ -222,7 +327,7 @@ const Hypothesis *HypothesisStackNormal::GetBestHypothesis() const
     Hypothesis *bestHypo = *iter;
     while (++iter != m_hypos.end()) {
       Hypothesis *hypo = *iter;
-      if (hypo->GetTotalScore() > bestHypo->GetTotalScore())
+      if (CompareHypothesisTotalScore()(hypo, bestHypo))
         bestHypo = hypo;
     }
     return bestHypo;
@@ -250,6 +355,16 @@ vector<Hypothesis*> HypothesisStackNormal::GetSortedListNOTCONST()
   return ret;
 }
 
+vector<const Hypothesis*> HypothesisStackNormal::GetListByCreation() const
+{
+  vector<const Hypothesis*> ret;
+  ret.reserve(m_hypos.size());
+  std::copy(m_hypos.begin(), m_hypos.end(), std::inserter(ret, ret.end()));
+  sort(ret.begin(), ret.end(), CompareHypothesisId());
+
+  return ret;
+}
+
 void HypothesisStackNormal::CleanupArcList()
 {
   // only necessary if n-best calculations are enabled
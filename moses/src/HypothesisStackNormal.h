@@ -24,6 +24,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include <limits>
 #include <set>
+#include <boost/unordered_map.hpp>
 #include "Hypothesis.h"
 #include "HypothesisStack.h"
 #include "WordsBitmap.h"
@@ -33,7 +34,11 @@ namespace Moses
 // class WordsBitmap;
 // typedef size_t WordsBitmapID;
 
-/** Stack for instances of Hypothesis, includes functions for pruning. */
+/** Stack for instances of Hypothesis, includes functions for pruning.
+ * Hypotheses are recombined through a hash table.  A min-heap on the total
+ * score keeps the worst hypothesis on top, so a full stack evicts it as soon
+ * as a better one arrives instead of growing and being pruned in bulk.
+ */
 class HypothesisStackNormal: public HypothesisStack
 {
 public:
@@ -48,8 +53,34 @@ protected:
   size_t m_minHypoStackDiversity; /**< minimum number of hypothesis with different source word coverage */
   bool m_nBestIsEnabled; /**< flag to determine whether to keep track of old arcs */
 
+  std::vector<Hypothesis*> m_heap; /**< all hypotheses in the stack, worst on top */
+  boost::unordered_map<const Hypothesis*, size_t> m_heapIndex; /**< position of each hypothesis in m_heap */
+
+  //! whether hypoA should be evicted before hypoB
+  static bool IsWorse(const Hypothesis *hypoA, const Hypothesis *hypoB) {
+    if (hypoA->GetTotalScore() != hypoB->GetTotalScore())
+      return hypoA->GetTotalScore() < hypoB->GetTotalScore();
+    return hypoA->GetId() > hypoB->GetId();
+  }
+  void HeapSet(size_t pos, Hypothesis *hypo) {
+    m_heap[pos] = hypo;
+    m_heapIndex[hypo] = pos;
+  }
+  void HeapSiftUp(size_t pos);
+  void HeapSiftDown(size_t pos);
+  void HeapInsert(Hypothesis *hypo);
+  void HeapErase(const Hypothesis *hypo);
+  void RebuildHeap();
+
+  //! delete the worst hypothesis in the stack
+  void RemoveWorst();
+
+  //! pruning with minimum stack diversity, see PruneToSize()
+  void PruneToSizeWithDiversity(size_t newSize);
+
   /** add hypothesis to stack. Prune if necessary.
-   * Returns false if equiv hypo exists in collection, otherwise returns true
+   * Returns false if equiv hypo exists in collection, otherwise returns true;
+   * the iterator is end() if the hypothesis was pruned and deleted right away
    */
   std::pair<HypothesisStackNormal::iterator, bool> Add(Hypothesis *hypothesis);
 
@@ -75,6 +106,7 @@ public:
   /** adds the hypo, but only if within thresholds (beamThr, stackSize).
   *	This function will recombine hypotheses silently!  There is no record
   * (could affect n-best list generation...TODO)
+  * Returns true if the hypo is in the stack afterwards as a new entry
   * Call stack for adding hypothesis is
   		AddPrune()
   			Add()
@@ -108,10 +140,10 @@ public:
   }
 
   /** pruning, if too large.
-   * Pruning algorithm: find a threshold and delete all hypothesis below it.
-   * The threshold is chosen so that exactly newSize top items remain on the
-   * stack in fact, in situations where some of the hypothesis fell below
-   * m_beamWidth, the stack will contain less items.
+   * Pruning algorithm: delete the worst hypotheses until at most newSize
+   * remain and all of them are within m_beamWidth of the best one.
+   * With a minimum stack diversity, the best hypotheses of each coverage are
+   * kept first, and the stack is only pruned if it is too large.
    * \param newSize maximum size */
   void PruneToSize(size_t newSize);
 
@@ -120,6 +152,11 @@ public:
   //! return all hypothesis, sorted by descending score. Used in creation of N best list
   std::vector<const Hypothesis*> GetSortedList() const;
   std::vector<Hypothesis*> GetSortedListNOTCONST();
+  /** return all hypotheses in the order they were created, which unlike the
+   * hash order does not depend on addresses of LM states */
+  std::vector<const Hypothesis*> GetListByCreation() const;
+
+  virtual void Detach(const HypothesisStack::iterator &iter);
 
   /** make all arcs in point to the equiv hypothesis that contains them.
   * Ie update doubly linked list be hypo & arcs
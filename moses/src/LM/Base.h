@@ -66,6 +66,12 @@ public:
 
   virtual void InitializeBeforeSentenceProcessing() {}
 
+  //! false if each thread gets its own states for the same context, so that
+  //! hypotheses of a sentence have to be scored on one thread to recombine
+  virtual bool SharesStatesAcrossThreads() const {
+    return true;
+  }
+
   virtual void CleanUpAfterSentenceProcessing() {}
 
   virtual const FFState* EmptyHypothesisState(const InputType &input) const = 0;
@@ -66,10 +66,11 @@ LanguageModel* CreateLanguageModel(LMImplementation lmImplementation
                                    , size_t nGramOrder
                                    , const std::string &languageModelFile
                                    , ScoreIndexManager &scoreIndexManager
-                                   , int dub )
+                                   , int dub
+                                   , const std::string &kenImageFile )
 {
   if (lmImplementation == Ken || lmImplementation == LazyKen) {
-    return ConstructKenLM(languageModelFile, scoreIndexManager, factorTypes[0], lmImplementation == LazyKen);
+    return ConstructKenLM(languageModelFile, scoreIndexManager, factorTypes[0], lmImplementation == LazyKen, kenImageFile);
   }
   LanguageModelImplementation *lm = NULL;
   switch (lmImplementation) {
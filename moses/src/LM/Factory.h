@@ -25,7 +25,8 @@ LanguageModel* CreateLanguageModel(LMImplementation lmImplementation
                                    , size_t nGramOrder
                                    , const std::string &languageModelFile
                                    , ScoreIndexManager &scoreIndexManager
-                                   , int dub);
+                                   , int dub
+                                   , const std::string &kenImageFile = "");
 
 };
 
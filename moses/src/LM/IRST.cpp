@@ -253,6 +253,8 @@ bool LMCacheCleanup(size_t sentences_done, size_t m_lmcache_cleanup_threshold)
 
 void LanguageModelIRST::CleanUpAfterSentenceProcessing()
 {
+  LanguageModelPointerState::CleanUpAfterSentenceProcessing();
+
   const StaticData &staticData = StaticData::Instance();
   static int sentenceCount = 0;
   sentenceCount++;
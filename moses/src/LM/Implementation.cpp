@@ -68,6 +68,53 @@ void LanguageModelImplementation::GetState(
   GetValueForgotState(contextFactor, state);
 }
 
+// Collect the n-grams CalcScore() will query
+void LanguageModelImplementation::PrefetchPhrase(const Phrase &phrase) const
+{
+  vector<vector<const Word*> > ngrams;
+  vector<const Word*> contextFactor;
+  contextFactor.reserve(GetNGramOrder());
+  for (size_t currPos = 0; currPos < phrase.GetSize(); ++currPos) {
+    const Word &word = phrase.GetWord(currPos);
+    if (word.IsNonTerminal()) {
+      contextFactor.clear();
+    } else {
+      ShiftOrPush(contextFactor, word);
+      if (!(word == GetSentenceStartArray())) {
+        ngrams.push_back(contextFactor);
+      }
+    }
+  }
+  Prefetch(ngrams);
+}
+
+// Collect the n-grams across the phrase boundary that Evaluate() will query
+void LanguageModelImplementation::PrefetchBoundary(const Hypothesis &hypo) const
+{
+  const size_t startPos = hypo.GetCurrTargetWordsRange().GetStartPos();
+  const size_t endPos = std::min(startPos + GetNGramOrder() - 2
+                                 , hypo.GetCurrTargetWordsRange().GetEndPos());
+  vector<vector<const Word*> > ngrams;
+  vector<const Word*> contextFactor(GetNGramOrder());
+  for (size_t currPos = startPos; currPos <= endPos; ++currPos) {
+    for (size_t i = 0; i < GetNGramOrder(); ++i) {
+      int pos = (int) currPos - (int) GetNGramOrder() + 1 + (int) i;
+      contextFactor[i] = (pos >= 0) ? &hypo.GetWord(pos) : &GetSentenceStartArray();
+    }
+    ngrams.push_back(contextFactor);
+  }
+  if (hypo.IsSourceCompleted()) {
+    const size_t size = hypo.GetSize();
+    for (size_t i = 0 ; i < GetNGramOrder() - 1 ; i ++) {
+      int currPos = (int)(size - GetNGramOrder() + i + 1);
+      contextFactor[i] = (currPos < 0) ? &GetSentenceStartArray() : &hypo.GetWord((size_t)currPos);
+    }
+    contextFactor.back() = &GetSentenceEndArray();
+    ngrams.push_back(contextFactor);
+  }
+  Prefetch(ngrams);
+}
+
 // Calculate score of a phrase.  
 void LanguageModelImplementation::CalcScore(const Phrase &phrase, float &fullScore, float &ngramScore, size_t &oovCount) const {
   fullScore  = 0;
@@ -78,6 +125,10 @@ void LanguageModelImplementation::CalcScore(const Phrase &phrase, float &fullSco
   size_t phraseSize = phrase.GetSize();
   if (!phraseSize) return;
 
+  if (WantsPrefetch()) {
+    PrefetchPhrase(phrase);
+  }
+
   vector<const Word*> contextFactor;
   contextFactor.reserve(GetNGramOrder());
   std::auto_ptr<FFState> state(NewState((phrase.GetWord(0) == GetSentenceStartArray()) ?
@@ -138,6 +189,10 @@ FFState *LanguageModelImplementation::Evaluate(const Hypothesis &hypo, const FFS
   const size_t currEndPos = hypo.GetCurrTargetWordsRange().GetEndPos();
   const size_t startPos = hypo.GetCurrTargetWordsRange().GetStartPos();
 
+  if (WantsPrefetch()) {
+    PrefetchBoundary(hypo);
+  }
+
   // 1st n-gram
   vector<const Word*> contextFactor(GetNGramOrder());
   size_t index = 0;
@@ -211,109 +266,118 @@ namespace {
 
 // This is the FFState used by LanguageModelImplementation::EvaluateChart.  
 // Though svn blame goes back to heafield, don't blame me.  I just moved this from LanguageModelChartState.cpp and ChartHypothesis.cpp.  
+// The boundary words are kept in fixed-size arrays of pointers into the
+// target phrases of the chart, which live as long as the hypotheses do, so
+// building a state doesn't allocate anything besides the backend's right
+// context state.  Prefix and suffix are built from those of the underlying
+// hypotheses rather than by walking down the whole derivation.
 class LanguageModelChartState : public FFState
 {
+public:
+  typedef const Word *ContextType[MAX_NGRAM_SIZE - 1];
+
 private:
   float m_prefixScore;
   FFState* m_lmRightContext;
 
-  Phrase m_contextPrefix, m_contextSuffix;
+  ContextType m_contextPrefix, m_contextSuffix;
+  size_t m_prefixSize, m_suffixSize;
 
   size_t m_numTargetTerminals; // This isn't really correct except for the surviving hypothesis
 
   const ChartHypothesis &m_hypo;
 
-  /** Construct the prefix string of up to specified size 
-   * \param ret prefix string
-   * \param size maximum size (typically max lm context window)
-   */
-  size_t CalcPrefix(const ChartHypothesis &hypo, int featureID, Phrase &ret, size_t size) const
+  static const LanguageModelChartState *GetPrevState(const ChartHypothesis &hypo, size_t pos, int featureID) {
+    const AlignmentInfo::NonTermIndexMap &nonTermIndexMap =
+      hypo.GetCurrTargetPhrase().GetAlignmentInfo().GetNonTermIndexMap();
+    const ChartHypothesis *prevHypo = hypo.GetPrevHypo(nonTermIndexMap[pos]);
+    return static_cast<const LanguageModelChartState*>(prevHypo->GetFFState(featureID));
+  }
+
+  /** Construct the prefix of up to specified size (typically max lm context window) */
+  void CalcPrefix(const ChartHypothesis &hypo, int featureID, size_t size)
   {
     const TargetPhrase &target = hypo.GetCurrTargetPhrase();
-    const AlignmentInfo::NonTermIndexMap &nonTermIndexMap =
-      target.GetAlignmentInfo().GetNonTermIndexMap();
 
-    // loop over the rule that is being applied
-    for (size_t pos = 0; pos < target.GetSize(); ++pos) {
+    // loop over the rule that is being applied, finish when maximum length reached
+    for (size_t pos = 0; pos < target.GetSize() && m_prefixSize < size; ++pos) {
       const Word &word = target.GetWord(pos);
 
-      // for non-terminals, retrieve it from underlying hypothesis
+      // for non-terminals, take the prefix of the underlying hypothesis
       if (word.IsNonTerminal()) {
-        size_t nonTermInd = nonTermIndexMap[pos];
-        const ChartHypothesis *prevHypo = hypo.GetPrevHypo(nonTermInd);
-        size = static_cast<const LanguageModelChartState*>(prevHypo->GetFFState(featureID))->CalcPrefix(*prevHypo, featureID, ret, size);
+        const LanguageModelChartState *prevState = GetPrevState(hypo, pos, featureID);
+        for (size_t i = 0; i < prevState->GetPrefixSize() && m_prefixSize < size; ++i) {
+          m_contextPrefix[m_prefixSize++] = &prevState->GetPrefixWord(i);
+        }
       }
       // for words, add word
       else {
-        ret.AddWord(target.GetWord(pos));
-        size--;
+        m_contextPrefix[m_prefixSize++] = &word;
       }
-
-      // finish when maximum length reached
-      if (size==0)
-        break;
     }
-
-    return size;
   }
 
-  /** Construct the suffix phrase of up to specified size 
-   * will always be called after the construction of prefix phrase
-   * \param ret suffix phrase
-   * \param size maximum size of suffix
+  /** Construct the suffix of up to specified size, in reverse order.
+   * Will always be called after the construction of prefix
    */
-  size_t CalcSuffix(const ChartHypothesis &hypo, int featureID, Phrase &ret, size_t size) const
+  void CalcSuffix(const ChartHypothesis &hypo, int featureID, size_t size)
   {
-    CHECK(m_contextPrefix.GetSize() <= m_numTargetTerminals);
+    CHECK(m_prefixSize <= m_numTargetTerminals);
+
+    ContextType reversed;
+    size_t count = 0;
 
     // special handling for small hypotheses
     // does the prefix match the entire hypothesis string? -> just copy prefix
-    if (m_contextPrefix.GetSize() == m_numTargetTerminals) {
-      size_t maxCount = std::min(m_contextPrefix.GetSize(), size);
-      size_t pos= m_contextPrefix.GetSize() - 1;
-
-      for (size_t ind = 0; ind < maxCount; ++ind) {
-        const Word &word = m_contextPrefix.GetWord(pos);
-        ret.PrependWord(word);
-        --pos;
+    if (m_prefixSize == m_numTargetTerminals) {
+      for (size_t pos = m_prefixSize; pos > 0 && count < size; --pos) {
+        reversed[count++] = m_contextPrefix[pos - 1];
       }
-
-      size -= maxCount;
-      return size;
     }
     // construct suffix analogous to prefix
     else {
-      const AlignmentInfo::NonTermIndexMap &nonTermIndexMap =
-        hypo.GetCurrTargetPhrase().GetAlignmentInfo().GetNonTermIndexMap();
-      for (int pos = (int) hypo.GetCurrTargetPhrase().GetSize() - 1; pos >= 0 ; --pos) {
-        const Word &word = hypo.GetCurrTargetPhrase().GetWord(pos);
+      const TargetPhrase &target = hypo.GetCurrTargetPhrase();
+      for (size_t pos = target.GetSize(); pos > 0 && count < size; --pos) {
+        const Word &word = target.GetWord(pos - 1);
 
         if (word.IsNonTerminal()) {
-          size_t nonTermInd = nonTermIndexMap[pos];
-          const ChartHypothesis *prevHypo = hypo.GetPrevHypo(nonTermInd);
-          size = static_cast<const LanguageModelChartState*>(prevHypo->GetFFState(featureID))->CalcSuffix(*prevHypo, featureID, ret, size);
+          const LanguageModelChartState *prevState = GetPrevState(hypo, pos - 1, featureID);
+          for (size_t i = prevState->GetSuffixSize(); i > 0 && count < size; --i) {
+            reversed[count++] = &prevState->GetSuffixWord(i - 1);
+          }
         }
         else {
-          ret.PrependWord(hypo.GetCurrTargetPhrase().GetWord(pos));
-          size--;
+          reversed[count++] = &word;
         }
-
-        if (size==0)
-          break;
       }
+    }
 
-      return size;
+    m_suffixSize = count;
+    for (size_t i = 0; i < count; ++i) {
+      m_contextSuffix[i] = reversed[count - 1 - i];
     }
   }
 
+  static int CompareContext(const ContextType &a, size_t sizeA, const ContextType &b, size_t sizeB) {
+    if (sizeA != sizeB) {
+      return (sizeA < sizeB) ? -1 : 1;
+    }
+    for (size_t pos = 0; pos < sizeA; ++pos) {
+      int ret = Word::Compare(*a[pos], *b[pos]);
+      if (ret != 0)
+        return ret;
+    }
+    return 0;
+  }
 
 public:
   LanguageModelChartState(const ChartHypothesis &hypo, int featureID, size_t order)
       :m_lmRightContext(NULL)
-      ,m_contextPrefix(order - 1)
-      ,m_contextSuffix( order - 1)
+      ,m_prefixSize(0)
+      ,m_suffixSize(0)
       ,m_hypo(hypo)
   {
+    CHECK(order <= MAX_NGRAM_SIZE);
     m_numTargetTerminals = hypo.GetCurrTargetPhrase().GetNumTerminals();
 
     for (std::vector<const ChartHypothesis*>::const_iterator i = hypo.GetPrevHypos().begin(); i != hypo.GetPrevHypos().end(); ++i) {
@@ -321,8 +385,8 @@ public:
       m_numTargetTerminals += static_cast<const LanguageModelChartState*>((*i)->GetFFState(featureID))->GetNumTargetTerminals();
     }
 
-    CalcPrefix(hypo, featureID, m_contextPrefix, order - 1);
-    CalcSuffix(hypo, featureID, m_contextSuffix, order - 1);
+    CalcPrefix(hypo, featureID, order - 1);
+    CalcSuffix(hypo, featureID, order - 1);
   }
 
   ~LanguageModelChartState() {
@@ -341,21 +405,27 @@ public:
     return m_numTargetTerminals;
   }
 
-  const Phrase &GetPrefix() const {
-    return m_contextPrefix;
+  size_t GetPrefixSize() const {
+    return m_prefixSize;
   }
-  const Phrase &GetSuffix() const {
-    return m_contextSuffix;
+  const Word &GetPrefixWord(size_t pos) const {
+    return *m_contextPrefix[pos];
+  }
+  size_t GetSuffixSize() const {
+    return m_suffixSize;
+  }
+  const Word &GetSuffixWord(size_t pos) const {
+    return *m_contextSuffix[pos];
   }
 
   int Compare(const FFState& o) const {
     const LanguageModelChartState &other =
-      dynamic_cast<const LanguageModelChartState &>( o );
+      static_cast<const LanguageModelChartState &>( o );
 
     // prefix
     if (m_hypo.GetCurrSourceRange().GetStartPos() > 0) // not for "<s> ..."
     {
-      int ret = GetPrefix().Compare(other.GetPrefix());
+      int ret = CompareContext(m_contextPrefix, m_prefixSize, other.m_contextPrefix, other.m_prefixSize);
       if (ret != 0)
         return ret;
     }
@@ -380,8 +450,9 @@ FFState* LanguageModelImplementation::EvaluateChart(const ChartHypothesis& hypo,
   vector<const Word*> contextFactor;
   contextFactor.reserve(GetNGramOrder());
 
-  // initialize language model context state
-  FFState *lmState = NewState( GetNullContextState() );
+  // language model context state, created when first needed: rules starting
+  // with <s> or a non-terminal take it from elsewhere
+  FFState *lmState = NULL;
 
   // initial language model scores
   float prefixScore = 0.0;    // not yet final for initial words (lack context)
@@ -414,6 +485,7 @@ FFState* LanguageModelImplementation::EvaluateChart(const ChartHypothesis& hypo,
       // score a regular word added by the rule
       else
       {
+        if (lmState == NULL) lmState = NewState( GetNullContextState() );
         updateChartScore( &prefixScore, &finalizedScore, UntransformLMScore(GetValueGivenState(contextFactor, *lmState).score), ++wordPos );
       }
     }
@@ -442,11 +514,11 @@ FFState* LanguageModelImplementation::EvaluateChart(const ChartHypothesis& hypo,
         lmState = NewState( prevState->GetRightContext() );
 
         // push suffix
-        int suffixPos = prevState->GetSuffix().GetSize() - (GetNGramOrder()-1);
+        int suffixPos = prevState->GetSuffixSize() - (GetNGramOrder()-1);
         if (suffixPos < 0) suffixPos = 0; // push all words if less than order
-        for(;(size_t)suffixPos < prevState->GetSuffix().GetSize(); suffixPos++)
+        for(;(size_t)suffixPos < prevState->GetSuffixSize(); suffixPos++)
         {
-          const Word &word = prevState->GetSuffix().GetWord(suffixPos);
+          const Word &word = prevState->GetSuffixWord(suffixPos);
           ShiftOrPush(contextFactor, word);
           wordPos++;
         }
@@ -461,8 +533,9 @@ FFState* LanguageModelImplementation::EvaluateChart(const ChartHypothesis& hypo,
               && prefixPos < subPhraseLength; // up to length
             prefixPos++)
         {
-          const Word &word = prevState->GetPrefix().GetWord(prefixPos);
+          const Word &word = prevState->GetPrefixWord(prefixPos);
           ShiftOrPush(contextFactor, word);
+          if (lmState == NULL) lmState = NewState( GetNullContextState() );
           updateChartScore( &prefixScore, &finalizedScore, UntransformLMScore(GetValueGivenState(contextFactor, *lmState).score), ++wordPos );
         }
 
@@ -484,10 +557,10 @@ FFState* LanguageModelImplementation::EvaluateChart(const ChartHypothesis& hypo,
             // only what is needed for the history window
             remainingWords = GetNGramOrder()-1;
           }
-          for(size_t suffixPos = prevState->GetSuffix().GetSize() - remainingWords;
-              suffixPos < prevState->GetSuffix().GetSize();
+          for(size_t suffixPos = prevState->GetSuffixSize() - remainingWords;
+              suffixPos < prevState->GetSuffixSize();
               suffixPos++) {
-            const Word &word = prevState->GetSuffix().GetWord(suffixPos);
+            const Word &word = prevState->GetSuffixWord(suffixPos);
             ShiftOrPush(contextFactor, word);
           }
           wordPos += subPhraseLength;
@@ -499,6 +572,8 @@ FFState* LanguageModelImplementation::EvaluateChart(const ChartHypothesis& hypo,
   // assign combined score to score breakdown
   out->Assign(scorer, prefixScore + finalizedScore);
 
+  if (lmState == NULL) lmState = NewState( GetNullContextState() );
+
   ret->Set(prefixScore, lmState);
   return ret;
 }
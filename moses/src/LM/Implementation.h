@@ -56,6 +56,9 @@ class LanguageModelImplementation
 
   void ShiftOrPush(std::vector<const Word*> &contextFactor, const Word &word) const;
 
+  void PrefetchPhrase(const Phrase &phrase) const;
+  void PrefetchBoundary(const Hypothesis &hypo) const;
+
 protected:
   std::string	m_filePath; //! for debugging purposes
   size_t			m_nGramOrder; //! max n-gram length contained in this LM
@@ -92,6 +95,15 @@ public:
   virtual const FFState *GetBeginSentenceState() const = 0;
   virtual FFState *NewState(const FFState *from = NULL) const = 0;
 
+  /* backends with a high latency per query return true and fetch all n-grams
+   * passed to Prefetch() at once, before they are queried one by one.
+   * Called from CalcScore() and Evaluate()
+   */
+  virtual bool WantsPrefetch() const {
+    return false;
+  }
+  virtual void Prefetch(const std::vector<std::vector<const Word*> > &/*ngrams*/) const {}
+
   void CalcScore(const Phrase &phrase, float &fullScore, float &ngramScore, size_t &oovCount) const;
 
   FFState *Evaluate(const Hypothesis &hypo, const FFState *ps, ScoreComponentCollection *out, const LanguageModel *feature) const;
@@ -124,6 +136,11 @@ public:
   //! overrideable funtions for IRST LM to cleanup. Maybe something to do with on demand/cache loading/unloading
   virtual void InitializeBeforeSentenceProcessing() {};
   virtual void CleanUpAfterSentenceProcessing() {};
+
+  //! see LanguageModel::SharesStatesAcrossThreads()
+  virtual bool SharesStatesAcrossThreads() const {
+    return true;
+  }
 };
 
 class LMRefCount : public LanguageModel {
@@ -144,6 +161,10 @@ class LMRefCount : public LanguageModel {
       m_impl->CleanUpAfterSentenceProcessing();
     }
 
+    bool SharesStatesAcrossThreads() const {
+      return m_impl->SharesStatesAcrossThreads();
+    }
+
     const FFState* EmptyHypothesisState(const InputType &/*input*/) const {
       return m_impl->NewState(m_impl->GetBeginSentenceState());
     }
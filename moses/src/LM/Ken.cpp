@@ -30,6 +30,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "LM/Ken.h"
 #include "LM/Base.h"
+#include "LM/QueryCache.h"
 #include "FFState.h"
 #include "TypeDef.h"
 #include "Util.h"
@@ -40,6 +41,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include "ChartHypothesis.h"
 
 #include <boost/shared_ptr.hpp>
+#ifdef WITH_THREADS
+#include <boost/thread/tss.hpp>
+#endif
 
 using namespace std;
 
@@ -54,6 +58,68 @@ struct KenLMState : public FFState {
     if (state.length > other.state.length) return 1;
     return std::memcmp(state.words, other.state.words, sizeof(lm::WordIndex) * state.length);
   }
+  size_t hash() const {
+    return util::MurmurHashNative(state.words, sizeof(lm::WordIndex) * state.length, state.length);
+  }
+};
+
+// Cached result of FullScore(in, word, out).  Only the words of the input
+// state matter: its backoffs are determined by them.
+struct KenLMCacheEntry {
+  bool Matches(const lm::ngram::State &inState, lm::WordIndex newWord) const {
+    return in.length == inState.length && word == newWord &&
+      !std::memcmp(in.words, inState.words, sizeof(lm::WordIndex) * inState.length);
+  }
+
+  lm::ngram::State in;
+  lm::WordIndex word;
+  lm::FullScoreReturn ret;
+  lm::ngram::State out;
+};
+
+typedef LMQueryCache<KenLMCacheEntry> KenLMCache;
+
+/*
+ * Puts the query cache in front of a kenlm model.  Provides the part of the
+ * model interface used by lm::ngram::RuleScore.
+ */
+template <class Model> class CachedModel {
+  public:
+    typedef typename Model::State State;
+
+    CachedModel(const Model &model, KenLMCache *cache) : m_model(model), m_cache(cache) {}
+
+    const State &BeginSentenceState() const { return m_model.BeginSentenceState(); }
+
+    unsigned char Order() const { return m_model.Order(); }
+
+    lm::FullScoreReturn FullScore(const State &in, const lm::WordIndex word, State &out) const {
+      if (!m_cache) return m_model.FullScore(in, word, out);
+
+      uint64_t hash = util::MurmurHashNative(in.words, sizeof(lm::WordIndex) * in.length, word);
+      const KenLMCacheEntry *found = m_cache->Lookup(hash);
+      if (found && found->Matches(in, word)) {
+        m_cache->Hit();
+        out = found->out;
+        return found->ret;
+      }
+      m_cache->Miss();
+      lm::FullScoreReturn ret = m_model.FullScore(in, word, out);
+      KenLMCacheEntry &entry = m_cache->Insert(hash);
+      entry.in = in;
+      entry.word = word;
+      entry.ret = ret;
+      entry.out = out;
+      return ret;
+    }
+
+    lm::FullScoreReturn ExtendLeft(const lm::WordIndex *add_rbegin, const lm::WordIndex *add_rend, const float *backoff_in, uint64_t extend_pointer, unsigned char extend_length, float *backoff_out, unsigned char &next_use) const {
+      return m_model.ExtendLeft(add_rbegin, add_rend, backoff_in, extend_pointer, extend_length, backoff_out, next_use);
+    }
+
+  private:
+    const Model &m_model;
+    KenLMCache *m_cache;
 };
 
 /*
@@ -61,7 +127,7 @@ struct KenLMState : public FFState {
  */
 template <class Model> class LanguageModelKen : public LanguageModel {
   public:
-    LanguageModelKen(const std::string &file, ScoreIndexManager &manager, FactorType factorType, bool lazy);
+    LanguageModelKen(const std::string &file, ScoreIndexManager &manager, FactorType factorType, bool lazy, const std::string &writeImage);
 
     LanguageModel *Duplicate(ScoreIndexManager &scoreIndexManager) const;
 
@@ -87,9 +153,21 @@ template <class Model> class LanguageModelKen : public LanguageModel {
 
     FFState *EvaluateChart(const ChartHypothesis& cur_hypo, int featureID, ScoreComponentCollection *accumulator) const;
 
+    void CleanUpAfterSentenceProcessing();
+
   private:
     LanguageModelKen(ScoreIndexManager &manager, const LanguageModelKen<Model> &copy_from);
 
+    // query cache of the calling thread, created on first use.  NULL if disabled
+    KenLMCache *GetCache() const {
+      size_t size = StaticData::Instance().GetLMCacheSize();
+      if (size == 0) return NULL;
+      if (m_cache.get() == NULL) {
+        m_cache.reset(new KenLMCache(size));
+      }
+      return m_cache.get();
+    }
+
     lm::WordIndex TranslateID(const Word &word) const {
       std::size_t factor = word.GetFactor(m_factorType)->GetId();
       return (factor >= m_lmIdLookup.size() ? 0 : m_lmIdLookup[factor]);
@@ -117,6 +195,12 @@ template <class Model> class LanguageModelKen : public LanguageModel {
     FactorType m_factorType;
 
     const Factor *m_beginSentenceFactor;
+
+#ifdef WITH_THREADS
+    mutable boost::thread_specific_ptr<KenLMCache> m_cache;
+#else
+    mutable std::auto_ptr<KenLMCache> m_cache;
+#endif
 };
 
 class MappingBuilder : public lm::EnumerateVocab {
@@ -138,7 +222,7 @@ private:
   std::vector<lm::WordIndex> &m_mapping;
 };
 
-template <class Model> LanguageModelKen<Model>::LanguageModelKen(const std::string &file, ScoreIndexManager &manager, FactorType factorType, bool lazy) : m_factorType(factorType) {
+template <class Model> LanguageModelKen<Model>::LanguageModelKen(const std::string &file, ScoreIndexManager &manager, FactorType factorType, bool lazy, const std::string &writeImage) : m_factorType(factorType) {
   lm::ngram::Config config;
   IFVERBOSE(1) {
     config.messages = &std::cerr;
@@ -149,6 +233,9 @@ template <class Model> LanguageModelKen<Model>::LanguageModelKen(const std::stri
   MappingBuilder builder(collection, m_lmIdLookup);
   config.enumerate_vocab = &builder;
   config.load_method = lazy ? util::LAZY : util::POPULATE_OR_READ;
+  if (!writeImage.empty()) {
+    config.write_mmap = writeImage.c_str();
+  }
 
   m_ngram.reset(new Model(file.c_str(), config));
 
@@ -188,6 +275,7 @@ template <class Model> void LanguageModelKen<Model>::CalcScore(const Phrase &phr
   }
   
   size_t ngramBoundary = m_ngram->Order() - 1;
+  CachedModel<Model> model(*m_ngram, GetCache());
 
   for (; position < phrase.GetSize(); ++position) {
     const Word &word = phrase.GetWord(position);
@@ -201,7 +289,7 @@ template <class Model> void LanguageModelKen<Model>::CalcScore(const Phrase &phr
         std::cerr << "Either your data contains <s> in a position other than the first word or your language model is missing <s>.  Did you build your ARPA using IRSTLM and forget to run add-start-end.sh?" << std::endl;
         abort();
       }
-      float score = TransformLMScore(m_ngram->Score(*state0, index, *state1));
+      float score = TransformLMScore(model.FullScore(*state0, index, *state1).prob);
       std::swap(state0, state1);
       if (position >= ngramBoundary) ngramScore += score;
       fullScore += score;
@@ -285,7 +373,8 @@ class LanguageModelChartStateKenLM : public FFState {
 
 template <class Model> FFState *LanguageModelKen<Model>::EvaluateChart(const ChartHypothesis& hypo, int featureID, ScoreComponentCollection *accumulator) const {
   LanguageModelChartStateKenLM *newState = new LanguageModelChartStateKenLM();
-  lm::ngram::RuleScore<Model> ruleScore(*m_ngram, newState->GetChartState());
+  CachedModel<Model> model(*m_ngram, GetCache());
+  lm::ngram::RuleScore<CachedModel<Model> > ruleScore(model, newState->GetChartState());
   const AlignmentInfo::NonTermIndexMap &nonTermIndexMap = hypo.GetCurrTargetPhrase().GetAlignmentInfo().GetNonTermIndexMap();
 
   const size_t size = hypo.GetCurrTargetPhrase().GetSize();
@@ -321,29 +410,41 @@ template <class Model> FFState *LanguageModelKen<Model>::EvaluateChart(const Cha
   return newState;
 }
 
+template <class Model> void LanguageModelKen<Model>::CleanUpAfterSentenceProcessing() {
+  if (m_cache.get() == NULL) return;
+  VERBOSE(2, GetScoreProducerDescription(0) << " query cache: " << m_cache->GetHits() << " hits, "
+          << m_cache->GetMisses() << " misses, hit rate " << m_cache->GetHitRate() << endl);
+  m_cache->ResetCounts();
+}
+
 } // namespace
 
-LanguageModel *ConstructKenLM(const std::string &file, ScoreIndexManager &manager, FactorType factorType, bool lazy) {
+bool IsKenLMBinary(const std::string &file) {
+  lm::ngram::ModelType model_type;
+  return lm::ngram::RecognizeBinary(file.c_str(), model_type);
+}
+
+LanguageModel *ConstructKenLM(const std::string &file, ScoreIndexManager &manager, FactorType factorType, bool lazy, const std::string &writeImage) {
   try {
     lm::ngram::ModelType model_type;
     if (lm::ngram::RecognizeBinary(file.c_str(), model_type)) {
       switch(model_type) {
         case lm::ngram::HASH_PROBING:
-          return new LanguageModelKen<lm::ngram::ProbingModel>(file, manager, factorType, lazy);
+          return new LanguageModelKen<lm::ngram::ProbingModel>(file, manager, factorType, lazy, "");
         case lm::ngram::TRIE_SORTED:
-          return new LanguageModelKen<lm::ngram::TrieModel>(file, manager, factorType, lazy);
+          return new LanguageModelKen<lm::ngram::TrieModel>(file, manager, factorType, lazy, "");
         case lm::ngram::QUANT_TRIE_SORTED:
-          return new LanguageModelKen<lm::ngram::QuantTrieModel>(file, manager, factorType, lazy);
+          return new LanguageModelKen<lm::ngram::QuantTrieModel>(file, manager, factorType, lazy, "");
         case lm::ngram::ARRAY_TRIE_SORTED:
-          return new LanguageModelKen<lm::ngram::ArrayTrieModel>(file, manager, factorType, lazy);
+          return new LanguageModelKen<lm::ngram::ArrayTrieModel>(file, manager, factorType, lazy, "");
         case lm::ngram::QUANT_ARRAY_TRIE_SORTED:
-          return new LanguageModelKen<lm::ngram::QuantArrayTrieModel>(file, manager, factorType, lazy);
+          return new LanguageModelKen<lm::ngram::QuantArrayTrieModel>(file, manager, factorType, lazy, "");
         default:
           std::cerr << "Unrecognized kenlm model type " << model_type << std::endl;
           abort();
       }
     } else {
-      return new LanguageModelKen<lm::ngram::ProbingModel>(file, manager, factorType, lazy);
+      return new LanguageModelKen<lm::ngram::ProbingModel>(file, manager, factorType, lazy, writeImage);
     }
   } catch (std::exception &e) {
     std::cerr << e.what() << std::endl;
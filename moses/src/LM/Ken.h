@@ -31,8 +31,12 @@ namespace Moses {
 class ScoreIndexManager;
 class LanguageModel;
 
-// This will also load.  
-LanguageModel *ConstructKenLM(const std::string &file, ScoreIndexManager &manager, FactorType factorType, bool lazy);
+// This will also load.  If writeImage is given and file is an ARPA file, a
+// binary image of the model is written there while loading.
+LanguageModel *ConstructKenLM(const std::string &file, ScoreIndexManager &manager, FactorType factorType, bool lazy, const std::string &writeImage = "");
+
+// True if file is already in kenlm's binary (mmap-able) format.
+bool IsKenLMBinary(const std::string &file);
 
 } // namespace Moses
 
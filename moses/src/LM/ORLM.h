@@ -30,13 +30,19 @@ public:
     fout.close();
     delete m_lm;
   }
-  void CleanUpAfterSentenceProcessing() {m_lm->clearCache();} // clear caches
+  void CleanUpAfterSentenceProcessing() {
+    LanguageModelPointerState::CleanUpAfterSentenceProcessing();
+    m_lm->clearCache(); // clear caches
+  }
   void InitializeBeforeSentenceProcessing() { // nothing to do
     //m_lm->initThreadSpecificData(); // Creates thread specific data iff
                                     // compiled with multithreading.
   }
   bool UpdateORLM(const std::vector<string>& ngram, const int value);
  protected:
+  // probabilities change with UpdateORLM
+  bool IsQueryCacheable() const { return false; }
+
   OnlineRLM<T>* m_lm;
   //MultiOnlineRLM<T>* m_lm;
   wordID_t m_oov_id;
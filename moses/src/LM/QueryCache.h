@@ -0,0 +1,111 @@
+// $Id$
+
+/***********************************************************************
+Moses - factored phrase-based language decoder
+Copyright (C) 2012 University of Edinburgh
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+***********************************************************************/
+
+#ifndef moses_LMQueryCache_h
+#define moses_LMQueryCache_h
+
+#include <algorithm>
+#include <vector>
+
+#include <stdint.h>
+
+namespace Moses
+{
+
+/** Small direct-mapped cache of language model queries.  Every query hashes
+ * to exactly one slot and replaces whatever was stored there, so old entries
+ * age out without any bookkeeping.  Clear() invalidates all slots in constant
+ * time.  Not thread-safe: each decoding thread keeps its own cache (see
+ * LanguageModelKen and LanguageModelPointerState).
+ */
+template <class Entry> class LMQueryCache
+{
+  struct Slot {
+    Slot() : generation(0) {}
+    unsigned int generation;
+    Entry entry;
+  };
+
+public:
+  //! size is rounded up to a power of 2
+  explicit LMQueryCache(size_t size)
+    :m_generation(1)
+    ,m_hits(0)
+    ,m_misses(0) {
+    size_t slots = 1;
+    while (slots < size) slots <<= 1;
+    m_slots.resize(slots);
+    m_mask = slots - 1;
+  }
+
+  //! entry stored for hash since the last Clear(), or NULL.  The caller compares keys
+  const Entry *Lookup(uint64_t hash) const {
+    const Slot &slot = m_slots[hash & m_mask];
+    return (slot.generation == m_generation) ? &slot.entry : NULL;
+  }
+
+  //! entry for hash, to be overwritten by the caller
+  Entry &Insert(uint64_t hash) {
+    Slot &slot = m_slots[hash & m_mask];
+    slot.generation = m_generation;
+    return slot.entry;
+  }
+
+  void Hit() {
+    ++m_hits;
+  }
+  void Miss() {
+    ++m_misses;
+  }
+
+  size_t GetHits() const {
+    return m_hits;
+  }
+  size_t GetMisses() const {
+    return m_misses;
+  }
+  float GetHitRate() const {
+    size_t lookups = m_hits + m_misses;
+    return lookups ? (float) m_hits / lookups : 0;
+  }
+
+  void ResetCounts() {
+    m_hits = m_misses = 0;
+  }
+
+  void Clear() {
+    if (++m_generation == 0) {
+      // wrapped around: old slots could look current again
+      std::fill(m_slots.begin(), m_slots.end(), Slot());
+      m_generation = 1;
+    }
+  }
+
+private:
+  std::vector<Slot> m_slots;
+  size_t m_mask;
+  unsigned int m_generation;
+  size_t m_hits, m_misses;
+};
+
+}
+
+#endif
@@ -53,12 +53,18 @@ public:
     delete m_lm;
   }
   void CleanUpAfterSentenceProcessing() {
+    // the query cache holds states that clearCaches() frees
+    LanguageModelPointerState::CleanUpAfterSentenceProcessing();
     m_lm->clearCaches(); // clear caches
   }
   void InitializeBeforeSentenceProcessing() {
     m_lm->initThreadSpecificData(); // Creates thread specific data iff
                                     // compiled with multithreading.
   }
+  // states point into the caches of the thread that queried them
+  bool SharesStatesAcrossThreads() const {
+    return false;
+  }
 protected:
   std::vector<randlm::WordID> m_randlm_ids_vec;
   randlm::RandLM* m_lm;
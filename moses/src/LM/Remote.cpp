@@ -4,16 +4,315 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+
 #include "LM/Remote.h"
+#include "LM/RemoteProtocol.h"
 #include "Factor.h"
+#include "FactorCollection.h"
+#include "StaticData.h"
+#include "UserMessage.h"
+
+using namespace std;
 
 namespace Moses
 {
 
-const Factor* LanguageModelRemote::BOS = NULL;
-const Factor* LanguageModelRemote::EOS = (LanguageModelRemote::BOS + 1);
+namespace
+{
+//! results kept across sentences before the connection's cache is emptied
+const size_t MAX_CACHED_NGRAMS = 1 << 22;
+//! interned LM states kept before the map is emptied
+const size_t MAX_CACHED_STATES = 1 << 22;
+}
+
+/** Connection of one thread to the LM server, with the word ids negotiated on
+ * it and the results received so far */
+class RemoteLMConnection
+{
+public:
+  typedef vector<const Factor*> Key;
+
+  struct Result {
+    LMResult result;
+    const void *state;
+  };
+
+  RemoteLMConnection(const LanguageModelRemote &lm, const string &host, int port);
+  ~RemoteLMConnection();
+
+  bool Connect();
+
+  //! make sure results for all of keys are available
+  void Fetch(const vector<Key> &keys);
+
+  const Result *Find(const Key &key) const {
+    ResultMap::const_iterator iter = m_results.find(key);
+    return (iter == m_results.end()) ? NULL : &iter->second;
+  }
+
+  void ReportAndReduce();
+
+private:
+  typedef boost::unordered_map<Key, Result> ResultMap;
+
+  const LanguageModelRemote &m_lm;
+  string m_host;
+  int m_port;
+  int m_sock;
+  size_t m_serverOrder;
+  unsigned int m_bosId, m_eosId;
+  boost::unordered_map<const Factor*, unsigned int> m_vocab;
+  ResultMap m_results;
+  size_t m_roundTrips, m_ngramsFetched;
+
+  void Close();
+  bool FetchVocab(const vector<Key> &keys);
+  bool FetchScores(const vector<Key> &keys);
+  unsigned int GetId(const Key &key, size_t pos) const;
+};
+
+RemoteLMConnection::RemoteLMConnection(const LanguageModelRemote &lm, const string &host, int port)
+  :m_lm(lm)
+  ,m_host(host)
+  ,m_port(port)
+  ,m_sock(-1)
+  ,m_serverOrder(0)
+  ,m_bosId(0)
+  ,m_eosId(0)
+  ,m_roundTrips(0)
+  ,m_ngramsFetched(0)
+{
+}
+
+RemoteLMConnection::~RemoteLMConnection()
+{
+  Close();
+}
+
+void RemoteLMConnection::Close()
+{
+  if (m_sock >= 0) {
+    close(m_sock);
+    m_sock = -1;
+  }
+}
+
+bool RemoteLMConnection::Connect()
+{
+  using namespace RemoteLMProtocol;
+  Close();
+  m_vocab.clear();
+
+  struct addrinfo hints, *addresses;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  int ret = getaddrinfo(m_host.c_str(), SPrint(m_port).c_str(), &hints, &addresses);
+  if (ret != 0) {
+    UserMessage::Add("Could not resolve LM server " + m_host + ": " + gai_strerror(ret));
+    return false;
+  }
+
+  int errors = 0;
+  while (m_sock < 0) {
+    for (struct addrinfo *addr = addresses; addr != NULL && m_sock < 0; addr = addr->ai_next) {
+      m_sock = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+      if (m_sock >= 0 && connect(m_sock, addr->ai_addr, addr->ai_addrlen) < 0) {
+        Close();
+      }
+    }
+    if (m_sock < 0) {
+      if (++errors > 5) break;
+      sleep(1);
+    }
+  }
+  freeaddrinfo(addresses);
+  if (m_sock < 0) {
+    return false;
+  }
+
+  // queries are small and latency bound
+  int flag = 1;
+  setsockopt(m_sock, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+  vector<uint32_t> buffer;
+  Put(buffer, MAGIC);
+  Put(buffer, VERSION);
+  if (!WriteBuffer(m_sock, buffer) || !ReadFields(m_sock, buffer, 5)
+      || buffer[0] != MAGIC || buffer[1] != VERSION) {
+    UserMessage::Add("LM server on " + m_host + ":" + SPrint(m_port) + " does not speak protocol version " + SPrint(VERSION));
+    Close();
+    return false;
+  }
+  m_serverOrder = buffer[2];
+  m_bosId = buffer[3];
+  m_eosId = buffer[4];
+  if (m_serverOrder < m_lm.GetNGramOrder()) {
+    VERBOSE(1, "LM server on " << m_host << ":" << m_port << " has order " << m_serverOrder
+            << ", less than the configured order " << m_lm.GetNGramOrder() << endl);
+  }
+  return true;
+}
+
+unsigned int RemoteLMConnection::GetId(const Key &key, size_t pos) const
+{
+  if (key[pos] == NULL) {
+    return (pos + 1 == key.size()) ? m_eosId : m_bosId;
+  }
+  return m_vocab.find(key[pos])->second;
+}
+
+bool RemoteLMConnection::FetchVocab(const vector<Key> &keys)
+{
+  using namespace RemoteLMProtocol;
+
+  vector<const Factor*> words;
+  boost::unordered_set<const Factor*> seen;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    for (size_t j = 0; j < keys[i].size(); ++j) {
+      const Factor *factor = keys[i][j];
+      if (factor != NULL && m_vocab.find(factor) == m_vocab.end() && seen.insert(factor).second) {
+        words.push_back(factor);
+      }
+    }
+  }
+  if (words.empty()) {
+    return true;
+  }
+
+  vector<uint32_t> buffer;
+  Put(buffer, REQUEST_VOCAB);
+  Put(buffer, words.size());
+  for (size_t i = 0; i < words.size(); ++i) {
+    PutString(buffer, words[i]->GetString());
+  }
+  if (!WriteBuffer(m_sock, buffer) || !ReadFields(m_sock, buffer, 2)
+      || buffer[0] != REQUEST_VOCAB || buffer[1] != words.size()
+      || !ReadFields(m_sock, buffer, words.size())) {
+    return false;
+  }
+  ++m_roundTrips;
+  for (size_t i = 0; i < words.size(); ++i) {
+    m_vocab[words[i]] = buffer[i];
+  }
+  return true;
+}
+
+bool RemoteLMConnection::FetchScores(const vector<Key> &keys)
+{
+  using namespace RemoteLMProtocol;
+
+  const size_t numRequests = (keys.size() + MAX_BATCH_SIZE - 1) / MAX_BATCH_SIZE;
+  size_t sent = 0;
+  vector<uint32_t> buffer;
+  for (size_t received = 0; received < numRequests; ++received) {
+    // keep up to PIPELINE_DEPTH requests in flight
+    for (; sent < numRequests && sent < received + PIPELINE_DEPTH; ++sent) {
+      size_t begin = sent * MAX_BATCH_SIZE;
+      size_t end = std::min(keys.size(), begin + MAX_BATCH_SIZE);
+      buffer.clear();
+      Put(buffer, REQUEST_SCORE);
+      Put(buffer, end - begin);
+      for (size_t i = begin; i < end; ++i) {
+        Put(buffer, keys[i].size());
+        for (size_t pos = 0; pos < keys[i].size(); ++pos) {
+          Put(buffer, GetId(keys[i], pos));
+        }
+      }
+      if (!WriteBuffer(m_sock, buffer)) {
+        return false;
+      }
+    }
+
+    size_t begin = received * MAX_BATCH_SIZE;
+    size_t end = std::min(keys.size(), begin + MAX_BATCH_SIZE);
+    if (!ReadFields(m_sock, buffer, 2) || buffer[0] != REQUEST_SCORE || buffer[1] != end - begin) {
+      return false;
+    }
+    // read the raw fields: the probabilities are converted by GetFloat()
+    buffer.resize(2 * (end - begin));
+    if (!ReadAll(m_sock, &buffer[0], buffer.size() * sizeof(uint32_t))) {
+      return false;
+    }
+    ++m_roundTrips;
+
+    vector<unsigned int> context;
+    for (size_t i = begin; i < end; ++i) {
+      const Key &key = keys[i];
+      uint32_t flags = ntohl(buffer[2 * (i - begin) + 1]);
+      size_t stateLength = std::min<size_t>(flags >> 1, key.size());
+
+      context.clear();
+      for (size_t pos = key.size() - stateLength; pos < key.size(); ++pos) {
+        context.push_back(GetId(key, pos));
+      }
+
+      Result &result = m_results[key];
+      result.result.score = FloorScore(TransformLMScore(GetFloat(buffer[2 * (i - begin)])));
+      result.result.unknown = flags & 1;
+      result.state = m_lm.InternState(context);
+    }
+  }
+  m_ngramsFetched += keys.size();
+  return true;
+}
+
+void RemoteLMConnection::Fetch(const vector<Key> &keys)
+{
+  vector<Key> missing;
+  boost::unordered_set<Key> seen;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (m_results.find(keys[i]) == m_results.end() && seen.insert(keys[i]).second) {
+      missing.push_back(keys[i]);
+    }
+  }
+  if (missing.empty()) {
+    return;
+  }
+
+  // on failure, reconnect once in case the server was restarted
+  for (size_t attempt = 0; attempt < 2; ++attempt) {
+    if (m_sock >= 0 && FetchVocab(missing) && FetchScores(missing)) {
+      return;
+    }
+    if (!Connect()) {
+      break;
+    }
+  }
+  const string msg("Lost connection to LM server on " + m_host + ":" + SPrint(m_port));
+  UserMessage::Add(msg);
+  throw runtime_error(msg);
+}
+
+void RemoteLMConnection::ReportAndReduce()
+{
+  VERBOSE(2, "Remote LM: " << m_ngramsFetched << " n-grams in " << m_roundTrips << " round trips" << endl);
+  m_ngramsFetched = m_roundTrips = 0;
+  if (m_results.size() > MAX_CACHED_NGRAMS) {
+    m_results.clear();
+  }
+}
+
+LanguageModelRemote::LanguageModelRemote()
+  :m_port(0)
+  ,m_nextStateId(1)
+{
+}
+
+LanguageModelRemote::~LanguageModelRemote()
+{
+}
 
 bool LanguageModelRemote::Load(const std::string &filePath
                                , FactorType factorType
@@ -22,123 +321,105 @@ bool LanguageModelRemote::Load(const std::string &filePath
   m_factorType    = factorType;
   m_nGramOrder    = nGramOrder;
 
-  int cutAt = filePath.find(':',0);
-  std::string host = filePath.substr(0,cutAt);
-  //std::cerr << "port string = '" << filePath.substr(cutAt+1,filePath.size()-cutAt) << "'\n";
-  int port = atoi(filePath.substr(cutAt+1,filePath.size()-cutAt).c_str());
-  bool good = start(host,port);
+  FactorCollection &factorCollection = FactorCollection::Instance();
+  m_sentenceStart = factorCollection.AddFactor(Output, m_factorType, BOS_);
+  m_sentenceStartArray[m_factorType] = m_sentenceStart;
+  m_sentenceEnd = factorCollection.AddFactor(Output, m_factorType, EOS_);
+  m_sentenceEndArray[m_factorType] = m_sentenceEnd;
+
+  size_t cutAt = filePath.rfind(':');
+  if (cutAt == string::npos) {
+    UserMessage::Add("Remote LM must be given as host:port, not " + filePath);
+    return false;
+  }
+  m_host = filePath.substr(0, cutAt);
+  m_port = Scan<int>(filePath.substr(cutAt + 1));
+
+  m_connection.reset(new RemoteLMConnection(*this, m_host, m_port));
+  bool good = m_connection->Connect();
   if (!good) {
-    std::cerr << "failed to connect to lm server on " << host << " on port " << port << std::endl;
+    std::cerr << "failed to connect to lm server on " << m_host << " on port " << m_port << std::endl;
   }
-  ClearSentenceCache();
   return good;
 }
 
-
-bool LanguageModelRemote::start(const std::string& host, int port)
+RemoteLMConnection &LanguageModelRemote::GetConnection() const
 {
-  //std::cerr << "host = " << host << ", port = " << port << "\n";
-  sock = socket(AF_INET, SOCK_STREAM, 0);
-  hp = gethostbyname(host.c_str());
-  if (hp==NULL) {
-    herror("gethostbyname failed");
-    exit(1);
+  if (m_connection.get() == NULL) {
+    m_connection.reset(new RemoteLMConnection(*this, m_host, m_port));
+    if (!m_connection->Connect()) {
+      const string msg("Could not connect to LM server on " + m_host + ":" + SPrint(m_port));
+      m_connection.reset();
+      UserMessage::Add(msg);
+      throw runtime_error(msg);
+    }
   }
+  return *m_connection;
+}
 
-  bzero((char *)&server, sizeof(server));
-  bcopy(hp->h_addr, (char *)&server.sin_addr, hp->h_length);
-  server.sin_family = hp->h_addrtype;
-  server.sin_port = htons(port);
+const void *LanguageModelRemote::InternState(const std::vector<unsigned int> &context) const
+{
+#ifdef WITH_THREADS
+  boost::mutex::scoped_lock lock(m_statesMutex);
+#endif
+  if (m_states.size() >= MAX_CACHED_STATES) {
+    m_states.clear();
+  }
+  // id 0 would be the NULL state
+  StateMap::iterator state = m_states.insert(StateMap::value_type(context, m_nextStateId)).first;
+  if (state->second == m_nextStateId) {
+    ++m_nextStateId;
+  }
+  return reinterpret_cast<const void*>(state->second);
+}
 
-  int errors = 0;
-  while (connect(sock, (struct sockaddr *)&server, sizeof(server)) < 0) {
-    //std::cerr << "Error: connect()\n";
-    sleep(1);
-    errors++;
-    if (errors > 5) return false;
+void LanguageModelRemote::Prefetch(const std::vector<std::vector<const Word*> > &ngrams) const
+{
+  vector<RemoteLMConnection::Key> keys(ngrams.size());
+  for (size_t i = 0; i < ngrams.size(); ++i) {
+    const vector<const Word*> &ngram = ngrams[i];
+    size_t begin = ngram.size() - std::min(ngram.size(), GetNGramOrder());
+    for (size_t pos = begin; pos < ngram.size(); ++pos) {
+      keys[i].push_back(ngram[pos]->GetFactor(m_factorType));
+    }
   }
-  return true;
+  GetConnection().Fetch(keys);
 }
 
 LMResult LanguageModelRemote::GetValue(const std::vector<const Word*> &contextFactor, State* finalState) const
 {
-  LMResult ret;
-  ret.unknown = false;
   size_t count = contextFactor.size();
   if (count == 0) {
-    if (finalState) *finalState = NULL;
+    LMResult ret;
+    ret.unknown = false;
     ret.score = 0.0;
+    if (finalState) *finalState = NULL;
     return ret;
   }
-  //std::cerr << "contextFactor.size() = " << count << "\n";
-  size_t max = m_nGramOrder;
-  const FactorType factor = GetFactorType();
-  if (max > count) max = count;
-
-  Cache* cur = &m_cache;
-  int pc = static_cast<int>(count) - 1;
-  for (int i = 0; i < pc; ++i) {
-    const Factor* f = contextFactor[i]->GetFactor(factor);
-    cur = &cur->tree[f ? f : BOS];
-  }
-  const Factor* event_word = contextFactor[pc]->GetFactor(factor);
-  cur = &cur->tree[event_word ? event_word : EOS];
-  if (cur->prob) {
-    if (finalState) *finalState = cur->boState;
-    ret.score = cur->prob;
-    return ret;
-  }
-  cur->boState = *reinterpret_cast<const State*>(&m_curId);
-  ++m_curId;
-
-  std::ostringstream os;
-  os << "prob ";
-  if (event_word == NULL) {
-    os << "</s>";
-  } else {
-    os << event_word->GetString();
-  }
-  for (size_t i=1; i<max; i++) {
-    const Factor* f = contextFactor[count-1-i]->GetFactor(factor);
-    if (f == NULL) {
-      os << " <s>";
-    } else {
-      os << ' ' << f->GetString();
-    }
+
+  RemoteLMConnection::Key key;
+  for (size_t pos = count - std::min(count, GetNGramOrder()); pos < count; ++pos) {
+    key.push_back(contextFactor[pos]->GetFactor(m_factorType));
   }
-  os << std::endl;
-  std::string out = os.str();
-  write(sock, out.c_str(), out.size());
-  char res[6];
-  int r = read(sock, res, 6);
-  int errors = 0;
-  int cnt = 0;
-  while (1) {
-    if (r < 0) {
-      errors++;
-      sleep(1);
-      //std::cerr << "Error: read()\n";
-      if (errors > 5) exit(1);
-    } else if (r==0 || res[cnt] == '\n') {
-      break;
-    } else {
-      cnt += r;
-      if (cnt==6) break;
-      read(sock, &res[cnt], 6-cnt);
-    }
+
+  RemoteLMConnection &connection = GetConnection();
+  const RemoteLMConnection::Result *found = connection.Find(key);
+  if (found == NULL) {
+    connection.Fetch(vector<RemoteLMConnection::Key>(1, key));
+    found = connection.Find(key);
   }
-  cur->prob = FloorScore(TransformLMScore(*reinterpret_cast<float*>(res)));
   if (finalState) {
-    *finalState = cur->boState;
+    *finalState = found->state;
   }
-  ret.score = cur->prob;
-  return ret;
+  return found->result;
 }
 
-LanguageModelRemote::~LanguageModelRemote()
+void LanguageModelRemote::CleanUpAfterSentenceProcessing()
 {
-  // Step 8 When finished send all lingering transmissions and close the connection
-  close(sock);
+  LanguageModelPointerState::CleanUpAfterSentenceProcessing();
+  if (m_connection.get() != NULL) {
+    m_connection->ReportAndReduce();
+  }
 }
 
 }
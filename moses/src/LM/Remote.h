@@ -1,44 +1,74 @@
 #ifndef moses_LanguageModelRemote_h
 #define moses_LanguageModelRemote_h
 
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+
+#ifdef WITH_THREADS
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+#endif
+
 #include "LM/SingleFactor.h"
 #include "TypeDef.h"
 #include "Factor.h"
-#include <sys/socket.h>
-#include <sys/types.h>
-#include <netinet/in.h>
 
 namespace Moses
 {
 
+class RemoteLMConnection;
+
+/** Language model queried over TCP from a server such as misc/remoteLMServer,
+ * using the batched binary protocol of LM/RemoteProtocol.h.  Each decoding
+ * thread has its own connection.  N-grams announced through Prefetch() are
+ * sent in batches and pipelined, so a phrase or hypothesis costs one round
+ * trip rather than one per n-gram.  Results are kept across sentences, until
+ * a connection holds more than MAX_CACHED_NGRAMS of them.  Losing the
+ * connection to the server throws std::runtime_error.
+ */
 class LanguageModelRemote : public LanguageModelPointerState
 {
 private:
-  struct Cache {
-    std::map<const Factor*, Cache> tree;
-    float prob;
-    State boState;
-    Cache() : prob(0) {}
-  };
-
-  int sock, port;
-  struct hostent *hp;
-  struct sockaddr_in server;
-  mutable size_t m_curId;
-  mutable Cache m_cache;
-  bool start(const std::string& host, int port);
-  static const Factor* BOS;
-  static const Factor* EOS;
+  std::string m_host;
+  int m_port;
+
+  // LM states are ids of the context words the server reports, interned so
+  // that equal contexts of different threads share the same id.  Ids are
+  // never reused, so the map can be emptied when it grows too large: the
+  // only cost is that hypotheses scored before and after do not recombine
+  typedef boost::unordered_map<std::vector<unsigned int>, size_t> StateMap;
+  mutable StateMap m_states;
+  mutable size_t m_nextStateId;
+#ifdef WITH_THREADS
+  mutable boost::mutex m_statesMutex;
+  mutable boost::thread_specific_ptr<RemoteLMConnection> m_connection;
+#else
+  mutable std::auto_ptr<RemoteLMConnection> m_connection;
+#endif
+
+  RemoteLMConnection &GetConnection() const;
+
 public:
+  LanguageModelRemote();
   ~LanguageModelRemote();
-  void ClearSentenceCache() {
-    m_cache.tree.clear();
-    m_curId = 1000;
-  }
+
+  const void *InternState(const std::vector<unsigned int> &context) const;
+
   virtual LMResult GetValue(const std::vector<const Word*> &contextFactor, State* finalState = 0) const;
+
+  virtual bool WantsPrefetch() const {
+    return true;
+  }
+  virtual void Prefetch(const std::vector<std::vector<const Word*> > &ngrams) const;
+
   bool Load(const std::string &filePath
             , FactorType factorType
             , size_t nGramOrder);
+
+  virtual void CleanUpAfterSentenceProcessing();
 };
 
 }
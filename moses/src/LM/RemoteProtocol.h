@@ -0,0 +1,148 @@
+/***********************************************************************
+Moses - factored phrase-based language decoder
+Copyright (C) 2012 University of Edinburgh
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+***********************************************************************/
+
+#ifndef moses_LM_RemoteProtocol_h
+#define moses_LM_RemoteProtocol_h
+
+/** Wire format shared by LanguageModelRemote and misc/remoteLMServer.
+ *
+ * All fields are 32 bit unsigned integers in network byte order, floats are
+ * sent as their bit pattern.  After connecting, the client sends
+ *   MAGIC VERSION
+ * and the server answers
+ *   MAGIC VERSION order bos-id eos-id
+ * Each request starts with a header
+ *   type count
+ * followed by count items.  The server answers every request, in order, with
+ * a header of the same type and count followed by count results, so a client
+ * may send several requests before reading the first answer.
+ *
+ * REQUEST_VOCAB  item: length bytes...     result: word id (0 = unknown)
+ * REQUEST_SCORE  item: n id_1 ... id_n     result: log10-prob flags
+ *   The n-gram is given oldest word first; id_n is the word being scored.
+ *   flags = (state length << 1) | unknown, where the state length is the
+ *   number of trailing words of the n-gram the model needs as context for
+ *   the next word.
+ */
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+namespace Moses
+{
+namespace RemoteLMProtocol
+{
+
+const uint32_t MAGIC = 0x4d4c4d31; // "MLM1"
+const uint32_t VERSION = 1;
+
+const uint32_t REQUEST_VOCAB = 1;
+const uint32_t REQUEST_SCORE = 2;
+
+//! n-grams per score request, and requests in flight before reading answers
+const size_t MAX_BATCH_SIZE = 512;
+const size_t PIPELINE_DEPTH = 8;
+
+inline void Put(std::vector<uint32_t> &buffer, uint32_t value)
+{
+  buffer.push_back(htonl(value));
+}
+
+inline void PutFloat(std::vector<uint32_t> &buffer, float value)
+{
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  Put(buffer, bits);
+}
+
+inline float GetFloat(uint32_t raw)
+{
+  uint32_t bits = ntohl(raw);
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+//! append a string, padded to a multiple of 4 bytes
+inline void PutString(std::vector<uint32_t> &buffer, const std::string &str)
+{
+  Put(buffer, str.size());
+  size_t offset = buffer.size();
+  buffer.resize(offset + (str.size() + 3) / 4, 0);
+  if (!str.empty()) {
+    std::memcpy(&buffer[offset], str.data(), str.size());
+  }
+}
+
+//! write all of data; false on error or closed connection
+inline bool WriteAll(int fd, const void *data, size_t size)
+{
+  const char *from = static_cast<const char*>(data);
+  while (size) {
+    ssize_t ret = write(fd, from, size);
+    if (ret < 0 && errno == EINTR) continue;
+    if (ret <= 0) return false;
+    from += ret;
+    size -= ret;
+  }
+  return true;
+}
+
+//! read exactly size bytes; false on error or closed connection
+inline bool ReadAll(int fd, void *data, size_t size)
+{
+  char *to = static_cast<char*>(data);
+  while (size) {
+    ssize_t ret = read(fd, to, size);
+    if (ret < 0 && errno == EINTR) continue;
+    if (ret <= 0) return false;
+    to += ret;
+    size -= ret;
+  }
+  return true;
+}
+
+inline bool WriteBuffer(int fd, const std::vector<uint32_t> &buffer)
+{
+  return buffer.empty() || WriteAll(fd, &buffer[0], buffer.size() * sizeof(uint32_t));
+}
+
+//! read count fields into buffer, converted to host byte order
+inline bool ReadFields(int fd, std::vector<uint32_t> &buffer, size_t count)
+{
+  buffer.resize(count);
+  if (count && !ReadAll(fd, &buffer[0], count * sizeof(uint32_t))) {
+    return false;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    buffer[i] = ntohl(buffer[i]);
+  }
+  return true;
+}
+
+}
+}
+
+#endif
@@ -19,10 +19,13 @@ License along with this library; if not, write to the Free Software
 Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 ***********************************************************************/
 
+#include <algorithm>
 #include <limits>
 #include <iostream>
 #include <sstream>
 
+#include "util/murmur_hash.hh"
+
 #include "LM/SingleFactor.h"
 #include "TypeDef.h"
 #include "Util.h"
@@ -58,6 +61,9 @@ struct PointerState : public FFState {
     else if (other.lmstate < lmstate) return -1;
     return 0;
   }
+  size_t hash() const {
+    return reinterpret_cast<size_t>(lmstate);
+  }
 };
 
 LanguageModelPointerState::LanguageModelPointerState()
@@ -83,9 +89,56 @@ FFState *LanguageModelPointerState::NewState(const FFState *from) const
   return new PointerState(from ? static_cast<const PointerState*>(from)->lmstate : NULL);
 }
 
+LanguageModelPointerState::Cache *LanguageModelPointerState::GetCache() const
+{
+  size_t size = StaticData::Instance().GetLMCacheSize();
+  if (size == 0 || !IsQueryCacheable()) return NULL;
+  if (m_cache.get() == NULL) {
+    m_cache.reset(new Cache(size));
+  }
+  return m_cache.get();
+}
+
 LMResult LanguageModelPointerState::GetValueForgotState(const std::vector<const Word*> &contextFactor, FFState &outState) const
 {
-  return GetValue(contextFactor, &static_cast<PointerState&>(outState).lmstate);
+  State &finalState = static_cast<PointerState&>(outState).lmstate;
+  Cache *cache = GetCache();
+  const size_t size = contextFactor.size();
+  if (cache == NULL || size > MAX_NGRAM_SIZE) {
+    return GetValue(contextFactor, &finalState);
+  }
+
+  const Factor *ngram[MAX_NGRAM_SIZE];
+  for (size_t i = 0; i < size; ++i) {
+    ngram[i] = contextFactor[i]->GetFactor(m_factorType);
+  }
+  uint64_t hash = util::MurmurHashNative(ngram, sizeof(const Factor*) * size);
+
+  const PointerStateCacheEntry *found = cache->Lookup(hash);
+  if (found && found->size == size && std::equal(ngram, ngram + size, found->ngram)) {
+    cache->Hit();
+    finalState = found->state;
+    return found->result;
+  }
+
+  cache->Miss();
+  LMResult result = GetValue(contextFactor, &finalState);
+  PointerStateCacheEntry &entry = cache->Insert(hash);
+  std::copy(ngram, ngram + size, entry.ngram);
+  entry.size = size;
+  entry.result = result;
+  entry.state = finalState;
+  return result;
+}
+
+void LanguageModelPointerState::CleanUpAfterSentenceProcessing()
+{
+  if (m_cache.get() == NULL) return;
+  VERBOSE(2, GetScoreProducerDescription(0) << " query cache: " << m_cache->GetHits() << " hits, "
+          << m_cache->GetMisses() << " misses, hit rate " << m_cache->GetHitRate() << endl);
+  m_cache->ResetCounts();
+  // backends may free their context states between sentences
+  m_cache->Clear();
 }
 
 }
@@ -22,7 +22,14 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #ifndef moses_LanguageModelSingleFactor_h
 #define moses_LanguageModelSingleFactor_h
 
+#include <memory>
+
+#ifdef WITH_THREADS
+#include <boost/thread/tss.hpp>
+#endif
+
 #include "LM/Implementation.h"
+#include "LM/QueryCache.h"
 #include "Phrase.h"
 
 namespace Moses
@@ -64,12 +71,31 @@ public:
   std::string GetScoreProducerDescription(unsigned) const;
 };
 
+// Cached result of GetValue() for one n-gram
+struct PointerStateCacheEntry {
+  const Factor *ngram[MAX_NGRAM_SIZE];
+  size_t size;
+  LMResult result;
+  const void *state;
+};
+
 // Single factor LM that uses a null pointer state.
 class LanguageModelPointerState : public LanguageModelSingleFactor
 {
 private:
+  typedef LMQueryCache<PointerStateCacheEntry> Cache;
+
   FFState *m_nullContextState;
   FFState *m_beginSentenceState;
+
+#ifdef WITH_THREADS
+  mutable boost::thread_specific_ptr<Cache> m_cache;
+#else
+  mutable std::auto_ptr<Cache> m_cache;
+#endif
+
+  Cache *GetCache() const;
+
 protected:
   typedef const void *State;
 
@@ -84,6 +110,15 @@ protected:
   virtual LMResult GetValueForgotState(const std::vector<const Word*> &contextFactor, FFState &outState) const;
 
   virtual LMResult GetValue(const std::vector<const Word*> &contextFactor, State* finalState = NULL) const = 0;
+
+  //! false for models whose probabilities change while decoding
+  virtual bool IsQueryCacheable() const {
+    return true;
+  }
+
+public:
+  //! clears the query cache; backends that override it must call it
+  virtual void CleanUpAfterSentenceProcessing();
 };
 
 
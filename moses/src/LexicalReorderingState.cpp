@@ -3,6 +3,8 @@
 #include <string>
 #include "util/check.hh"
 
+#include <boost/functional/hash.hpp>
+
 #include "FFState.h"
 #include "Hypothesis.h"
 #include "WordsRange.h"
@@ -196,6 +198,13 @@ int PhraseBasedReorderingState::Compare(const FFState& o) const
   return 1;
 }
 
+size_t PhraseBasedReorderingState::hash() const
+{
+  size_t seed = m_prevRange.GetStartPos();
+  boost::hash_combine(seed, m_prevRange.GetEndPos());
+  return seed;
+}
+
 LexicalReorderingState* PhraseBasedReorderingState::Expand(const TranslationOption& topt, Scores& scores) const
 {
   ReorderingType reoType;
@@ -293,6 +302,13 @@ int BidirectionalReorderingState::Compare(const FFState& o) const
     return m_forward->Compare(*other.m_forward);
 }
 
+size_t BidirectionalReorderingState::hash() const
+{
+  size_t seed = m_backward->hash();
+  boost::hash_combine(seed, m_forward->hash());
+  return seed;
+}
+
 LexicalReorderingState* BidirectionalReorderingState::Expand(const TranslationOption& topt, Scores& scores) const
 {
   LexicalReorderingState *newbwd = m_backward->Expand(topt, scores);
@@ -317,6 +333,11 @@ int HierarchicalReorderingBackwardState::Compare(const FFState& o) const
   return m_reoStack.Compare(other.m_reoStack);
 }
 
+size_t HierarchicalReorderingBackwardState::hash() const
+{
+  return m_reoStack.hash();
+}
+
 LexicalReorderingState* HierarchicalReorderingBackwardState::Expand(const TranslationOption& topt, Scores& scores) const
 {
 
@@ -409,6 +430,13 @@ int HierarchicalReorderingForwardState::Compare(const FFState& o) const
   return 1;
 }
 
+size_t HierarchicalReorderingForwardState::hash() const
+{
+  size_t seed = m_prevRange.GetStartPos();
+  boost::hash_combine(seed, m_prevRange.GetEndPos());
+  return seed;
+}
+
 // For compatibility with the phrase-based reordering model, scoring is one step delayed.
 // The forward model takes determines orientations heuristically as follows:
 //  mono:   if the next phrase comes after the conditioning phrase and
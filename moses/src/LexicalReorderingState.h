@@ -123,6 +123,7 @@ public:
   }
 
   virtual int Compare(const FFState& o) const;
+  virtual size_t hash() const;
   virtual LexicalReorderingState* Expand(const TranslationOption& topt, Scores& scores) const;
 };
 
@@ -138,6 +139,7 @@ public:
   PhraseBasedReorderingState(const PhraseBasedReorderingState *prev, const TranslationOption &topt);
 
   virtual int Compare(const FFState& o) const;
+  virtual size_t hash() const;
   virtual LexicalReorderingState* Expand(const TranslationOption& topt, Scores& scores) const;
 
   ReorderingType GetOrientationTypeMSD(WordsRange currRange) const;
@@ -159,6 +161,7 @@ public:
                                       const TranslationOption &topt, ReorderingStack reoStack);
 
   virtual int Compare(const FFState& o) const;
+  virtual size_t hash() const;
   virtual LexicalReorderingState* Expand(const TranslationOption& hypo, Scores& scores) const;
 
 private:
@@ -182,6 +185,7 @@ public:
   HierarchicalReorderingForwardState(const HierarchicalReorderingForwardState *prev, const TranslationOption &topt);
 
   virtual int Compare(const FFState& o) const;
+  virtual size_t hash() const;
   virtual LexicalReorderingState* Expand(const TranslationOption& hypo, Scores& scores) const;
 
 private:
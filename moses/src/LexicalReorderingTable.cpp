@@ -1,6 +1,12 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
 #include "LexicalReorderingTable.h"
 #include "InputFileStream.h"
 //#include "LVoc.h" //need IPhrase
+#include "ScoreCodebook.h"
+#include "util/murmur_hash.hh"
 
 #include "StaticData.h"
 #include "PhraseDictionary.h"
@@ -47,8 +53,11 @@ void auxAppend(IPhrase& head, const IPhrase& tail)
 
 LexicalReorderingTable* LexicalReorderingTable::LoadAvailable(const std::string& filePath, const FactorList& f_factors, const FactorList& e_factors, const FactorList& c_factors)
 {
-  //decide use Tree or Memory table
-  if(FileExists(filePath+".binlexr.idx")) {
+  //decide use Compact, Tree or Memory table
+  if(FileExists(filePath+".minlexr")) {
+    //there exists a compact version use that
+    return new LexicalReorderingTableCompact(filePath, f_factors, e_factors, c_factors);
+  } else if(FileExists(filePath+".binlexr.idx")) {
     //there exists a binary version use that
     return new LexicalReorderingTableTree(filePath, f_factors, e_factors, c_factors);
   } else {
@@ -57,6 +66,46 @@ LexicalReorderingTable* LexicalReorderingTable::LoadAvailable(const std::string&
   }
 }
 
+uint64_t LexicalReorderingTable::CombineFingerprints(uint64_t seed, uint64_t value)
+{
+  uint64_t both[2] = { seed, value };
+  return util::MurmurHash64A(both, sizeof(both));
+}
+
+uint64_t LexicalReorderingTable::MakeFingerprint(const Phrase& phrase, const FactorList& factors)
+{
+  uint64_t key = phrase.GetSize();
+  for(size_t pos = 0; pos < phrase.GetSize(); ++pos) {
+    const Word& word = phrase.GetWord(pos);
+    uint64_t wordKey = 0;
+    for(size_t i = 0; i < factors.size(); ++i) {
+      const Factor* factor = word[factors[i]];
+      if(factor != NULL) {
+        const std::string& str = factor->GetString();
+        wordKey = CombineFingerprints(wordKey, util::MurmurHash64A(str.data(), str.size()));
+      }
+    }
+    key = CombineFingerprints(key, wordKey);
+  }
+  return key;
+}
+
+uint64_t LexicalReorderingTable::MakeFingerprint(const std::string& phrase)
+{
+  const std::string& factorDelimiter = StaticData::Instance().GetFactorDelimiter();
+  std::vector<std::string> words = Tokenize(phrase);
+  uint64_t key = words.size();
+  for(size_t pos = 0; pos < words.size(); ++pos) {
+    std::vector<std::string> factors = TokenizeMultiCharSeparator(words[pos], factorDelimiter);
+    uint64_t wordKey = 0;
+    for(size_t i = 0; i < factors.size(); ++i) {
+      wordKey = CombineFingerprints(wordKey, util::MurmurHash64A(factors[i].data(), factors[i].size()));
+    }
+    key = CombineFingerprints(key, wordKey);
+  }
+  return key;
+}
+
 /*
  * functions for LexicalReorderingTableMemory
  */
@@ -81,7 +130,7 @@ std::vector<float>  LexicalReorderingTableMemory::GetScore(const Phrase& f,
   //rather complicated because of const can't use []... as [] might enter new things into std::map
   //also can't have to be careful with words range if c is empty can't use c.GetSize()-1 will underflow and be large
   TableType::const_iterator r;
-  std::string key;
+  uint64_t key;
   if(0 == c.GetSize()) {
     key = MakeKey(f,e,c);
     r = m_Table.find(key);
@@ -106,7 +155,7 @@ void LexicalReorderingTableMemory::DbgDump(std::ostream* out) const
 {
   TableType::const_iterator i;
   for(i = m_Table.begin(); i != m_Table.end(); ++i) {
-    *out << " key: '" << i->first << "' score: ";
+    *out << " key: " << i->first << " score: ";
     *out << "(num scores: " << (i->second).size() << ")";
     for(size_t j = 0; j < (i->second).size(); ++j) {
       *out << (i->second)[j] << " ";
@@ -115,46 +164,36 @@ void LexicalReorderingTableMemory::DbgDump(std::ostream* out) const
   }
 };
 
-std::string  LexicalReorderingTableMemory::MakeKey(const Phrase& f,
+uint64_t LexicalReorderingTableMemory::MakeKey(const Phrase& f,
     const Phrase& e,
     const Phrase& c) const
 {
-  /*
-  std::string key;
-  if(!m_FactorsF.empty()){
-    key += f.GetStringRep(m_FactorsF);
+  uint64_t key = 0;
+  if(!m_FactorsF.empty()) {
+    key = CombineFingerprints(key, MakeFingerprint(f, m_FactorsF));
   }
-  if(!m_FactorsE.empty()){
-    if(!key.empty()){
-      key += " ||| ";
-    }
-    key += e.GetStringRep(m_FactorsE);
+  if(!m_FactorsE.empty()) {
+    key = CombineFingerprints(key, MakeFingerprint(e, m_FactorsE));
   }
-  */
-  return MakeKey(auxClearString(f.GetStringRep(m_FactorsF)),
-                 auxClearString(e.GetStringRep(m_FactorsE)),
-                 auxClearString(c.GetStringRep(m_FactorsC)));
+  if(!m_FactorsC.empty()) {
+    key = CombineFingerprints(key, MakeFingerprint(c, m_FactorsC));
+  }
+  return key;
 }
 
-std::string  LexicalReorderingTableMemory::MakeKey(const std::string& f,
+uint64_t LexicalReorderingTableMemory::MakeKey(const std::string& f,
     const std::string& e,
     const std::string& c) const
 {
-  std::string key;
-  if(!f.empty()) {
-    key += f;
+  uint64_t key = 0;
+  if(!m_FactorsF.empty()) {
+    key = CombineFingerprints(key, MakeFingerprint(f));
   }
   if(!m_FactorsE.empty()) {
-    if(!key.empty()) {
-      key += "|||";
-    }
-    key += e;
+    key = CombineFingerprints(key, MakeFingerprint(e));
   }
   if(!m_FactorsC.empty()) {
-    if(!key.empty()) {
-      key += "|||";
-    }
-    key += c;
+    key = CombineFingerprints(key, MakeFingerprint(c));
   }
   return key;
 }
@@ -207,6 +246,286 @@ void  LexicalReorderingTableMemory::LoadFromFile(const std::string& filePath)
   std::cerr << "done.\n";
 }
 
+/*
+ * functions for LexicalReorderingTableCompact
+ */
+LexicalReorderingTableCompact::LexicalReorderingTableCompact(
+  const std::string& filePath,
+  const std::vector<FactorType>& f_factors,
+  const std::vector<FactorType>& e_factors,
+  const std::vector<FactorType>& c_factors)
+  : LexicalReorderingTable(f_factors, e_factors, c_factors)
+  , m_File(util::OpenReadOrThrow((filePath+".minlexr").c_str()))
+{
+  // pages are only read when lookups touch them
+  const uint64_t size = util::SizeFile(m_File.get());
+  if(size < sizeof(Header)) {
+    TRACE_ERR("ERROR: " << filePath << ".minlexr is not a compact reordering table\n");
+    exit(1);
+  }
+  util::MapRead(util::LAZY, m_File.get(), 0, size, m_Memory);
+  m_Header = reinterpret_cast<const Header*>(m_Memory.begin());
+  const size_t recordSize = m_Header->numScores * (m_Header->quantizationBits ? 1 : sizeof(float));
+  const size_t codebookSize = m_Header->quantizationBits ? m_Header->numScores * ScoreCodebookSize : 0;
+  if(m_Header->magic != Magic || m_Header->version != Version
+     || size != sizeof(Header) + codebookSize * sizeof(float) + m_Header->numBuckets * sizeof(Entry) + m_Header->numEntries * recordSize) {
+    TRACE_ERR("ERROR: " << filePath << ".minlexr is not a compact reordering table of version " << Version << " or is truncated\n");
+    exit(1);
+  }
+  m_Codebook = reinterpret_cast<const float*>(m_Memory.begin() + sizeof(Header));
+  m_Entries = reinterpret_cast<const Entry*>(m_Codebook + codebookSize);
+  m_Records = reinterpret_cast<const char*>(m_Entries + m_Header->numBuckets);
+}
+
+Scores LexicalReorderingTableCompact::GetScore(const Phrase& f, const Phrase& e, const Phrase& c)
+{
+  Scores scores;
+  uint64_t key = CombineFingerprints(0, MakeFingerprint(f, m_FactorsF));
+  if(m_Header->numKeyPhrases >= 2) {
+    key = CombineFingerprints(key, MakeFingerprint(e, m_FactorsE));
+  }
+  if(m_Header->numKeyPhrases < 3) {
+    Find(key, scores);
+    return scores;
+  }
+  //try from large to smaller context
+  for(size_t i = 0; i <= c.GetSize(); ++i) {
+    Phrase sub_c(ARRAY_SIZE_INCR);
+    if(i < c.GetSize()) {
+      sub_c = c.GetSubString(WordsRange(i, c.GetSize()-1));
+    }
+    if(Find(CombineFingerprints(key, MakeFingerprint(sub_c, m_FactorsC)), scores)) {
+      break;
+    }
+  }
+  return scores;
+}
+
+bool LexicalReorderingTableCompact::Find(uint64_t key, Scores& scores) const
+{
+  if(0 == key) {
+    key = 1; //0 marks empty buckets
+  }
+  const uint64_t numBuckets = m_Header->numBuckets;
+  for(uint64_t bucket = key % numBuckets; ; bucket = (bucket + 1 == numBuckets) ? 0 : bucket + 1) {
+    const Entry& entry = m_Entries[bucket];
+    if(entry.key == key) {
+      const size_t numScores = m_Header->numScores;
+      scores.resize(numScores);
+      if(m_Header->quantizationBits) {
+        const unsigned char* codes = reinterpret_cast<const unsigned char*>(m_Records) + entry.record * numScores;
+        for(size_t i = 0; i < numScores; ++i) {
+          scores[i] = m_Codebook[i * ScoreCodebookSize + codes[i]];
+        }
+      } else {
+        std::memcpy(&scores[0], m_Records + entry.record * numScores * sizeof(float), numScores * sizeof(float));
+      }
+      return true;
+    }
+    if(0 == entry.key) {
+      return false;
+    }
+  }
+}
+
+void LexicalReorderingTableCompact::DbgDump(std::ostream* out) const
+{
+  *out << "compact reordering table: " << m_Header->numEntries << " entries in "
+       << m_Header->numBuckets << " buckets, " << m_Header->numScores << " scores, "
+       << m_Header->numKeyPhrases << " key phrases, "
+       << m_Header->quantizationBits << " bit quantization\n";
+}
+
+bool LexicalReorderingTableCompact::Create(std::istream& inFile,
+    const std::string& outFileName,
+    size_t quantizationBits)
+{
+  if(quantizationBits != 0 && quantizationBits != 8) {
+    TRACE_ERR("ERROR: scores can only be quantized to 8 bits\n");
+    return false;
+  }
+  std::vector<uint64_t> keys;
+  std::vector<float> scores;
+  size_t numTokens = 0, numScores = 0, lnc = 0;
+  std::string line;
+  while(getline(inFile, line)) {
+    ++lnc;
+    if(0 == lnc % 100000) {
+      TRACE_ERR(".");
+    }
+    std::vector<std::string> tokens = TokenizeMultiCharSeparator(line, "|||");
+    if(1 == lnc) {
+      numTokens = tokens.size();
+      if(numTokens < 2 || numTokens > 4) {
+        TRACE_ERR("ERROR: expected f [||| e [||| c]] ||| scores in line 1\n");
+        return false;
+      }
+    } else if(tokens.size() != numTokens) {
+      TRACE_ERR("ERROR: inconsistent number of fields in line " << lnc << ": '" << line << "'\n");
+      return false;
+    }
+    uint64_t key = 0;
+    for(size_t t = 0; t + 1 < numTokens; ++t) {
+      key = CombineFingerprints(key, MakeFingerprint(tokens[t]));
+    }
+    keys.push_back(key ? key : 1);
+
+    std::vector<float> p = Scan<float>(Tokenize(tokens.back()));
+    if(1 == lnc) {
+      numScores = p.size();
+    } else if(p.size() != numScores) {
+      TRACE_ERR("ERROR: found " << p.size() << " scores in line " << lnc << ", expected " << numScores << "\n");
+      return false;
+    }
+    std::transform(p.begin(),p.end(),p.begin(),TransformScore);
+    std::transform(p.begin(),p.end(),p.begin(),FloorScore);
+    scores.insert(scores.end(), p.begin(), p.end());
+  }
+  return Write(keys, scores, numScores, numTokens - 1, outFileName, quantizationBits);
+}
+
+//collects the keys and scores of a binary table, see ConvertTree()
+struct LexicalReorderingTableCompact::TreeConverter {
+  explicit TreeConverter(const PrefixTreeMap& table)
+    : m_Table(table), m_NumScores(0), m_NumKeyPhrases(0), m_Ok(true) {}
+
+  //key is f, or f ||| e, and each candidate adds c if the table has contexts
+  void operator()(const IPhrase& key, const Candidates& cands) {
+    uint64_t keyFingerprint = 0;
+    size_t numKeyPhrases = 1;
+    std::string phrase;
+    for(size_t i = 0; i < key.size(); ++i) {
+      if(key[i] == PrefixTreeMap::MagicWord) {
+        keyFingerprint = CombineFingerprints(keyFingerprint, MakeFingerprint(phrase));
+        phrase.clear();
+        ++numKeyPhrases;
+      } else {
+        phrase += (phrase.empty() ? "" : " ") + m_Table.ConvertWord(key[i], numKeyPhrases == 1 ? 0 : 1);
+      }
+    }
+    keyFingerprint = CombineFingerprints(keyFingerprint, MakeFingerprint(phrase));
+
+    for(size_t i = 0; i < cands.size(); ++i) {
+      const GenericCandidate& cand = cands[i];
+      uint64_t fingerprint = keyFingerprint;
+      for(size_t j = 0; j < cand.NumPhrases(); ++j) {
+        std::string context;
+        const IPhrase& contextPhrase = cand.GetPhrase(j);
+        for(size_t k = 0; k < contextPhrase.size(); ++k) {
+          context += (k ? " " : "") + m_Table.ConvertWord(contextPhrase[k], 1);
+        }
+        fingerprint = CombineFingerprints(fingerprint, MakeFingerprint(context));
+      }
+      const std::vector<float>& scores = cand.GetScore(0);
+      if(m_Keys.empty()) {
+        m_NumScores = scores.size();
+        m_NumKeyPhrases = numKeyPhrases + cand.NumPhrases();
+      } else if(scores.size() != m_NumScores || numKeyPhrases + cand.NumPhrases() != m_NumKeyPhrases) {
+        if(m_Ok) {
+          TRACE_ERR("ERROR: inconsistent number of phrases or scores in binary table\n");
+        }
+        m_Ok = false;
+      }
+      m_Keys.push_back(fingerprint ? fingerprint : 1);
+      m_Scores.insert(m_Scores.end(), scores.begin(), scores.end());
+    }
+  }
+
+  const PrefixTreeMap& m_Table;
+  std::vector<uint64_t> m_Keys;
+  std::vector<float> m_Scores;
+  size_t m_NumScores, m_NumKeyPhrases;
+  bool m_Ok;
+};
+
+bool LexicalReorderingTableCompact::ConvertTree(const std::string& filePath,
+    const std::string& outFileName,
+    size_t quantizationBits)
+{
+  if(quantizationBits != 0 && quantizationBits != 8) {
+    TRACE_ERR("ERROR: scores can only be quantized to 8 bits\n");
+    return false;
+  }
+  if(!FileExists(filePath+".binlexr.idx")) {
+    TRACE_ERR("ERROR: " << filePath << ".binlexr.idx not found\n");
+    return false;
+  }
+  //binary tables hold scores that are already transformed
+  PrefixTreeMap table;
+  table.Read(filePath+".binlexr");
+  TreeConverter converter(table);
+  table.ForEachKey(converter);
+  if(!converter.m_Ok) {
+    return false;
+  }
+  return Write(converter.m_Keys, converter.m_Scores, converter.m_NumScores,
+               converter.m_NumKeyPhrases, outFileName, quantizationBits);
+}
+
+bool LexicalReorderingTableCompact::Write(const std::vector<uint64_t>& keys,
+    const std::vector<float>& scores,
+    size_t numScores, size_t numKeyPhrases,
+    const std::string& outFileName,
+    size_t quantizationBits)
+{
+  if(keys.empty()) {
+    TRACE_ERR("ERROR: empty reordering table\n");
+    return false;
+  }
+
+  //hash table at most two thirds full.  Later lines win over earlier ones with the same key
+  Header header;
+  std::memset(&header, 0, sizeof(header));
+  header.magic = Magic;
+  header.version = Version;
+  header.numScores = numScores;
+  header.numKeyPhrases = numKeyPhrases;
+  header.quantizationBits = quantizationBits;
+  header.numEntries = keys.size();
+  header.numBuckets = keys.size() + keys.size() / 2 + 1;
+  std::vector<Entry> table(header.numBuckets);
+  std::memset(&table[0], 0, table.size() * sizeof(Entry));
+  for(size_t i = 0; i < keys.size(); ++i) {
+    uint64_t bucket = keys[i] % header.numBuckets;
+    while(table[bucket].key != 0 && table[bucket].key != keys[i]) {
+      bucket = (bucket + 1 == header.numBuckets) ? 0 : bucket + 1;
+    }
+    table[bucket].key = keys[i];
+    table[bucket].record = i;
+  }
+
+  std::ofstream out((outFileName+".minlexr").c_str(), std::ios::out | std::ios::binary);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  if(quantizationBits) {
+    std::vector<std::vector<float> > codebooks(numScores);
+    std::vector<float> column(keys.size());
+    for(size_t s = 0; s < numScores; ++s) {
+      for(size_t i = 0; i < keys.size(); ++i) {
+        column[i] = scores[i * numScores + s];
+      }
+      codebooks[s] = MakeScoreCodebook(column);
+      std::vector<float> padded(codebooks[s]);
+      padded.resize(ScoreCodebookSize, padded.back());
+      out.write(reinterpret_cast<const char*>(&padded[0]), ScoreCodebookSize * sizeof(float));
+    }
+    out.write(reinterpret_cast<const char*>(&table[0]), table.size() * sizeof(Entry));
+    std::vector<unsigned char> codes(scores.size());
+    for(size_t i = 0; i < scores.size(); ++i) {
+      codes[i] = QuantizeScore(codebooks[i % numScores], scores[i]);
+    }
+    out.write(reinterpret_cast<const char*>(&codes[0]), codes.size());
+  } else {
+    out.write(reinterpret_cast<const char*>(&table[0]), table.size() * sizeof(Entry));
+    out.write(reinterpret_cast<const char*>(&scores[0]), scores.size() * sizeof(float));
+  }
+  out.close();
+  if(!out) {
+    TRACE_ERR("ERROR: could not write " << outFileName << ".minlexr\n");
+    return false;
+  }
+  return true;
+}
+
 /*
  * functions for LexicalReorderingTableTree
  */
@@ -8,6 +8,10 @@
 #include <string>
 #include <iostream>
 
+#include <stdint.h>
+
+#include <boost/unordered_map.hpp>
+
 #ifdef WITH_THREADS
 #include <boost/thread/tss.hpp>
 #endif
@@ -19,6 +23,8 @@
 #include "ConfusionNet.h"
 #include "Sentence.h"
 #include "PrefixTreeMap.h"
+#include "util/file.hh"
+#include "util/mmap.hh"
 
 namespace Moses
 {
@@ -67,6 +73,14 @@ protected:
   FactorList m_FactorsF;
   FactorList m_FactorsE;
   FactorList m_FactorsC;
+
+  /** 64 bit keys of phrases, used in place of their string representation.
+   * Both versions give the same key for a phrase and its text form, in which
+   * words are separated by blanks and factors by the factor delimiter.
+   */
+  static uint64_t MakeFingerprint(const Phrase& phrase, const FactorList& factors);
+  static uint64_t MakeFingerprint(const std::string& phrase);
+  static uint64_t CombineFingerprints(uint64_t seed, uint64_t value);
 };
 
 class LexicalReorderingTableMemory : public LexicalReorderingTable
@@ -83,15 +97,67 @@ public:
   virtual std::vector<float> GetScore(const Phrase& f, const Phrase& e, const Phrase& c);
   void DbgDump(std::ostream* out) const;
 private:
-  std::string MakeKey(const Phrase& f, const Phrase& e, const Phrase& c) const;
-  std::string MakeKey(const std::string& f, const std::string& e, const std::string& c) const;
+  uint64_t MakeKey(const Phrase& f, const Phrase& e, const Phrase& c) const;
+  uint64_t MakeKey(const std::string& f, const std::string& e, const std::string& c) const;
 
   void LoadFromFile(const std::string& filePath);
 private:
-  typedef std::map< std::string, std::vector<float> > TableType;
+  typedef boost::unordered_map< uint64_t, std::vector<float> > TableType;
   TableType m_Table;
 };
 
+class LexicalReorderingTableCompact : public LexicalReorderingTable
+{
+  //implements LexicalReorderingTable as an open addressing hash table from
+  //phrase pair fingerprints to scores, mapped read-only from a single file.
+  //Scores are optionally quantized to one byte each.  Lookups don't change
+  //anything, so all threads share the table and no caching is needed
+public:
+  LexicalReorderingTableCompact(const std::string& filePath,
+                                const std::vector<FactorType>& f_factors,
+                                const std::vector<FactorType>& e_factors,
+                                const std::vector<FactorType>& c_factors);
+public:
+  virtual std::vector<float> GetScore(const Phrase& f, const Phrase& e, const Phrase& c);
+  void DbgDump(std::ostream* out) const;
+public:
+  /** convert a text table (f ||| e ||| scores, with optional context) into
+   * outFileName + ".minlexr".  quantizationBits is 8, or 0 to keep floats */
+  static bool Create(std::istream& inFile, const std::string& outFileName, size_t quantizationBits);
+  /** convert the binary table filePath + ".binlexr.*" in the same way */
+  static bool ConvertTree(const std::string& filePath, const std::string& outFileName, size_t quantizationBits);
+private:
+  struct TreeConverter;
+  struct Header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t numScores;
+    uint32_t numKeyPhrases; // f, e, c present in the key
+    uint32_t quantizationBits;
+    uint64_t numEntries;
+    uint64_t numBuckets;
+  };
+  struct Entry {
+    uint64_t key; // 0 for empty buckets
+    uint64_t record;
+  };
+  static const uint64_t Magic = 0x3130305258454c4dULL; // "MLEXR001"
+  static const uint32_t Version = 1;
+
+  bool Find(uint64_t key, Scores& scores) const;
+  //! scores holds numScores transformed scores for each key
+  static bool Write(const std::vector<uint64_t>& keys, const std::vector<float>& scores,
+                    size_t numScores, size_t numKeyPhrases,
+                    const std::string& outFileName, size_t quantizationBits);
+
+  util::scoped_fd m_File;
+  util::scoped_memory m_Memory;
+  const Header* m_Header;
+  const float* m_Codebook;
+  const Entry* m_Entries;
+  const char* m_Records;
+};
+
 class LexicalReorderingTableTree : public LexicalReorderingTable
 {
   //implements LexicalReorderingTable using the crafty PDT code...
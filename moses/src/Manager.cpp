@@ -48,8 +48,9 @@ using namespace std;
 
 namespace Moses
 {
-Manager::Manager(InputType const& source, SearchAlgorithm searchAlgorithm, const TranslationSystem* system)
+Manager::Manager(InputType const& source, SearchAlgorithm searchAlgorithm, const TranslationSystem* system, bool outputSearchGraph)
   :m_system(system)
+  ,m_outputSearchGraph(outputSearchGraph || StaticData::Instance().GetOutputSearchGraph())
   ,m_transOptColl(source.CreateTranslationOptionCollection(system))
   ,m_search(Search::CreateSearch(*this, source, searchAlgorithm, *m_transOptColl))
   ,m_start(clock())
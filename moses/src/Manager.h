@@ -94,6 +94,7 @@ class Manager
   Manager(Manager const&);
   void operator=(Manager const&);
   const TranslationSystem* m_system;
+  bool m_outputSearchGraph; /**< keep the arcs GetSearchGraph() needs, set before m_search is created */
 protected:
   // data
 //	InputType const& m_source; /**< source sentence to be translated */
@@ -116,7 +117,9 @@ protected:
 
 public:
   InputType const& m_source; /**< source sentence to be translated */
-  Manager(InputType const& source, SearchAlgorithm searchAlgorithm, const TranslationSystem* system);
+  /** outputSearchGraph asks for the search graph of this sentence only,
+   * whether or not it is output for all sentences (output-search-graph) */
+  Manager(InputType const& source, SearchAlgorithm searchAlgorithm, const TranslationSystem* system, bool outputSearchGraph = false);
   ~Manager();
   const  TranslationOptionCollection* getSntTranslationOptions();
   const TranslationSystem* GetTranslationSystem() {
@@ -137,6 +140,9 @@ public:
   void SerializeSearchGraphPB(long translationId, std::ostream& outputStream) const;
 #endif
 
+  bool GetOutputSearchGraph() const {
+    return m_outputSearchGraph;
+  }
   void OutputSearchGraph(long translationId, std::ostream &outputSearchGraphStream) const;
   void GetSearchGraph(std::vector<SearchGraphNode>& searchGraph) const;
   const InputType& GetSource() const {
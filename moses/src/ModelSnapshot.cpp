@@ -0,0 +1,206 @@
+// $Id$
+
+/***********************************************************************
+Moses - factored phrase-based language decoder
+Copyright (C) 2012 University of Edinburgh
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+***********************************************************************/
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "util/murmur_hash.hh"
+
+#include "ModelSnapshot.h"
+#include "Parameter.h"
+#include "UserMessage.h"
+#include "Util.h"
+
+using namespace std;
+
+namespace Moses
+{
+
+namespace
+{
+
+uint64_t HashString(const string &str, uint64_t seed)
+{
+  return util::MurmurHash64A(str.data(), str.size(), seed);
+}
+
+/** checksum over all settings and the files they refer to.  Model files are
+ * identified by size and modification time rather than content, so checking
+ * a snapshot doesn't cost a full read of multi-gigabyte models */
+string ComputeChecksum(const Parameter &parameter)
+{
+  uint64_t hash = 0;
+  const PARAM_MAP &settings = parameter.GetParams();
+  PARAM_MAP::const_iterator iterParam;
+  for (iterParam = settings.begin(); iterParam != settings.end(); ++iterParam) {
+    const string &paramName = iterParam->first;
+    if (paramName == "verbose" || paramName == "snapshot-dir") {
+      continue;
+    }
+    hash = HashString(paramName, hash);
+
+    const PARAM_VEC &values = iterParam->second;
+    for (size_t i = 0; i < values.size(); ++i) {
+      hash = HashString(values[i], hash);
+
+      const vector<string> tokens = Tokenize(values[i]);
+      for (size_t j = 0; j < tokens.size(); ++j) {
+        struct stat info;
+        if (stat(tokens[j].c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+          continue;
+        }
+        uint64_t fileInfo[2];
+        fileInfo[0] = static_cast<uint64_t>(info.st_size);
+        fileInfo[1] = static_cast<uint64_t>(info.st_mtime);
+        hash = util::MurmurHash64A(fileInfo, sizeof(fileInfo), hash);
+      }
+    }
+  }
+
+  stringstream strme;
+  strme << hex << hash;
+  return strme.str();
+}
+
+}
+
+ModelSnapshot::ModelSnapshot(const string &directory, const Parameter &parameter)
+  :m_directory(directory)
+  ,m_checksum(ComputeChecksum(parameter))
+  ,m_valid(false)
+{
+  m_valid = Load();
+  if (!m_valid) {
+    m_lmImages.clear();
+  }
+}
+
+bool ModelSnapshot::CreateDirectory() const
+{
+  if (mkdir(m_directory.c_str(), 0755) == 0) {
+    return true;
+  }
+  int error = errno;
+  struct stat info;
+  if (error == EEXIST) {
+    if (stat(m_directory.c_str(), &info) == 0 && S_ISDIR(info.st_mode)) {
+      return true;
+    }
+    error = ENOTDIR;
+  }
+  UserMessage::Add("Could not create snapshot directory " + m_directory + ": " + strerror(error));
+  return false;
+}
+
+string ModelSnapshot::GetManifestPath() const
+{
+  return m_directory + "/manifest";
+}
+
+bool ModelSnapshot::Load()
+{
+  ifstream manifest(GetManifestPath().c_str());
+  if (!manifest.good()) {
+    return false;
+  }
+
+  string line;
+  if (!getline(manifest, line) || line != "checksum " + m_checksum) {
+    return false;
+  }
+
+  while (getline(manifest, line)) {
+    // lm <image> <original file, may contain spaces>
+    vector<string> tokens = Tokenize(line);
+    if (tokens.size() < 3 || tokens[0] != "lm") {
+      return false;
+    }
+    size_t pos = tokens[0].size() + tokens[1].size() + 2;
+    if (!FileExists(m_directory + "/" + tokens[1])) {
+      return false;
+    }
+    m_lmImages[line.substr(pos)] = tokens[1];
+  }
+  return true;
+}
+
+string ModelSnapshot::GetLanguageModelFile(const string &languageModelFile) const
+{
+  map<string, string>::const_iterator iter = m_lmImages.find(languageModelFile);
+  return (iter == m_lmImages.end()) ? languageModelFile : m_directory + "/" + iter->second;
+}
+
+string ModelSnapshot::GetTemporarySuffix() const
+{
+  return "." + SPrint(getpid()) + ".tmp";
+}
+
+string ModelSnapshot::AddLanguageModelImage(const string &languageModelFile)
+{
+  // named after the checksum, so that a rebuild for other settings never
+  // replaces an image that a running decoder has mapped
+  string image = "lm." + SPrint(m_lmImages.size()) + "." + m_checksum + ".mmap";
+  m_lmImages[languageModelFile] = image;
+  return m_directory + "/" + image + GetTemporarySuffix();
+}
+
+bool ModelSnapshot::Save() const
+{
+  // images and manifest are written to temporary files of this process and
+  // renamed into place, so that concurrent readers never see partial files
+  // and concurrent writers don't write to the same file
+  map<string, string>::const_iterator iterImage;
+  for (iterImage = m_lmImages.begin(); iterImage != m_lmImages.end(); ++iterImage) {
+    const string imagePath = m_directory + "/" + iterImage->second;
+    if (rename((imagePath + GetTemporarySuffix()).c_str(), imagePath.c_str()) != 0) {
+      UserMessage::Add("Could not write snapshot image " + imagePath + ": " + strerror(errno));
+      return false;
+    }
+  }
+
+  const string manifestPath = GetManifestPath();
+  const string tmpPath = manifestPath + GetTemporarySuffix();
+  {
+    ofstream manifest(tmpPath.c_str());
+    manifest << "checksum " << m_checksum << endl;
+    map<string, string>::const_iterator iter;
+    for (iter = m_lmImages.begin(); iter != m_lmImages.end(); ++iter) {
+      manifest << "lm " << iter->second << " " << iter->first << endl;
+    }
+    if (!manifest.good()) {
+      UserMessage::Add("Could not write snapshot manifest " + tmpPath);
+      return false;
+    }
+  }
+  if (rename(tmpPath.c_str(), manifestPath.c_str()) != 0) {
+    UserMessage::Add("Could not write snapshot manifest " + manifestPath);
+    return false;
+  }
+  return true;
+}
+
+}
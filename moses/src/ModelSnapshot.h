@@ -0,0 +1,80 @@
+// $Id$
+
+/***********************************************************************
+Moses - factored phrase-based language decoder
+Copyright (C) 2012 University of Edinburgh
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+***********************************************************************/
+
+#ifndef moses_ModelSnapshot_h
+#define moses_ModelSnapshot_h
+
+#include <map>
+#include <string>
+
+namespace Moses
+{
+
+class Parameter;
+
+/** Directory holding mmap-able images of the models loaded by a previous
+ * decoder run, so that a later process maps them instead of parsing the text
+ * files again.  The manifest records a checksum of the effective settings
+ * (moses.ini plus switches) and of the size and modification time of every
+ * model file they name; a snapshot whose checksum does not match is ignored
+ * and rebuilt during loading.  Images are named after the checksum, so
+ * those of earlier settings stay until they are removed by hand.
+ */
+class ModelSnapshot
+{
+public:
+  ModelSnapshot(const std::string &directory, const Parameter &parameter);
+
+  //! true if the manifest exists and matches the current settings and models
+  bool IsValid() const {
+    return m_valid;
+  }
+
+  //! create the directory the images are written to, if it does not exist yet
+  bool CreateDirectory() const;
+
+  /** path of the image to load in place of the given LM file, or the
+   * file itself if the snapshot doesn't hold an image of it */
+  std::string GetLanguageModelFile(const std::string &languageModelFile) const;
+
+  /** path to which an image of the given LM file should be written while it
+   * is loaded.  Only called when the snapshot is not valid; Save() moves the
+   * image into place */
+  std::string AddLanguageModelImage(const std::string &languageModelFile);
+
+  //! write the manifest once all models are loaded and their images are complete
+  bool Save() const;
+
+protected:
+  std::string m_directory;
+  std::string m_checksum;
+  bool m_valid;
+  std::map<std::string, std::string> m_lmImages; //! original LM file -> image file name in m_directory
+
+  std::string GetManifestPath() const;
+  //! of the files this process writes before renaming them into place
+  std::string GetTemporarySuffix() const;
+  bool Load();
+};
+
+}
+
+#endif
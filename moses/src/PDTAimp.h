@@ -6,6 +6,7 @@
 
 #include "StaticData.h"  // needed for factor splitter
 #include "PhraseDictionaryTree.h"
+#include "PhraseDictionaryTreeCache.h"
 #include "UniqueObject.h"
 #include "InputFileStream.h"
 #include "PhraseDictionaryTreeAdaptor.h"
@@ -33,7 +34,7 @@ class PDTAimp
 protected:
   PDTAimp(PhraseDictionaryTreeAdaptor *p,unsigned nis)
     : m_languageModels(0),m_weightWP(0.0),m_dict(0),
-      m_obj(p),useCache(1),m_numInputScores(nis),totalE(0),distinctE(0) {}
+      m_obj(p),useCache(1),m_sharedCache(0),m_numInputScores(nis),totalE(0),distinctE(0) {}
 
 public:
   std::vector<float> m_weights;
@@ -49,6 +50,11 @@ public:
   PhraseDictionaryTreeAdaptor *m_obj;
   int useCache;
 
+  // target phrases decoded by any thread in any sentence, and the entries of
+  // it used in the current sentence, which must outlive their eviction
+  PhraseDictionaryTreeCache *m_sharedCache;
+  mutable std::vector<PhraseDictionaryTreeCache::EntryPtr> m_sharedEntries;
+
   std::vector<vTPC> m_rangeCache;
   unsigned m_numInputScores;
 
@@ -64,6 +70,13 @@ public:
 
     if (StaticData::Instance().GetVerboseLevel() >= 2) {
 
+      if(m_sharedCache) {
+        size_t hits=m_sharedCache->GetHits(),misses=m_sharedCache->GetMisses();
+        TRACE_ERR("shared ttable cache: hits="<<hits<<";  misses="<<misses
+                  <<";  hit rate="<<(hits+misses ? 100.0*hits/(hits+misses) : 0.0)
+                  <<"%\n");
+      }
+
       TRACE_ERR("tgt candidates stats:  total="<<totalE<<";  distinct="
                 <<distinctE<<" ("<<distinctE/(0.01*totalE)<<");  duplicates="
                 <<totalE-distinctE<<" ("<<(totalE-distinctE)/(0.01*totalE)
@@ -105,6 +118,7 @@ public:
     for(size_t i=0; i<m_tgtColls.size(); ++i) delete m_tgtColls[i];
     m_tgtColls.clear();
     m_cache.clear();
+    m_sharedEntries.clear();
     m_rangeCache.clear();
     uniqSrcPhr.clear();
   }
@@ -130,6 +144,10 @@ public:
       Factors2String(src.GetWord(i),srcString[i]);
     }
 
+    if(useCache && m_sharedCache) {
+      return GetSharedTargetPhraseCollection(src,srcString,piter.first->second);
+    }
+
     // get target phrases in string representation
     std::vector<StringTgtCand> cands;
     std::vector<std::string> wacands;
@@ -138,6 +156,56 @@ public:
       return 0;
     }
 
+    TargetPhraseCollection *rv=CreateTargetPhraseCollection(cands,wacands,&src);
+    if(rv->IsEmpty()) {
+      delete rv;
+      return 0;
+    } else {
+      if(useCache) piter.first->second=rv;
+      m_tgtColls.push_back(rv);
+      return rv;
+    }
+
+  }
+
+
+
+  // look up src in the shared cache, decoding and adding it on a miss
+  TargetPhraseCollection const*
+  GetSharedTargetPhraseCollection(Phrase const &src,
+                                  std::vector<std::string> const &srcString,
+                                  TargetPhraseCollection const* &cacheSlot) const {
+    std::string key;
+    for(size_t i=0; i<srcString.size(); ++i) {
+      if(i) key+=' ';
+      key+=srcString[i];
+    }
+
+    PhraseDictionaryTreeCache::EntryPtr entry=m_sharedCache->Get(key);
+    if(!entry) {
+      PhraseDictionaryTreeCache::Entry *newEntry=new PhraseDictionaryTreeCache::Entry(src);
+      entry.reset(newEntry);
+
+      std::vector<StringTgtCand> cands;
+      std::vector<std::string> wacands;
+      m_dict->GetTargetCandidates(srcString,cands,wacands);
+      if(!cands.empty()) {
+        TargetPhraseCollection *rv=CreateTargetPhraseCollection(cands,wacands,&newEntry->m_source);
+        if(rv->IsEmpty()) delete rv;
+        else newEntry->m_targetPhrases=rv;
+      }
+      m_sharedCache->Put(key,entry);
+    }
+    m_sharedEntries.push_back(entry);
+    cacheSlot=entry->m_targetPhrases;
+    return entry->m_targetPhrases;
+  }
+
+  // convert, score and prune the candidates of a source phrase
+  TargetPhraseCollection*
+  CreateTargetPhraseCollection(std::vector<StringTgtCand> const &cands,
+                               std::vector<std::string> const &wacands,
+                               Phrase const *srcPtr) const {
     std::vector<TargetPhrase> tCands;
     tCands.reserve(cands.size());
     std::vector<std::pair<float,size_t> > costs;
@@ -155,27 +223,14 @@ public:
                      TransformScore);
       std::transform(scoreVector.begin(),scoreVector.end(),scoreVector.begin(),
                      FloorScore);
-      //CreateTargetPhrase(targetPhrase,factorStrings,scoreVector,&src);
-      CreateTargetPhrase(targetPhrase,factorStrings,scoreVector,wacands[i],&src);
+      CreateTargetPhrase(targetPhrase,factorStrings,scoreVector,wacands[i],srcPtr);
       costs.push_back(std::make_pair(-targetPhrase.GetFutureScore(),tCands.size()));
       tCands.push_back(targetPhrase);
     }
 
-    TargetPhraseCollection *rv;
-    rv=PruneTargetCandidates(tCands,costs);
-    if(rv->IsEmpty()) {
-      delete rv;
-      return 0;
-    } else {
-      if(useCache) piter.first->second=rv;
-      m_tgtColls.push_back(rv);
-      return rv;
-    }
-
+    return PruneTargetCandidates(tCands,costs);
   }
 
-
-
   void Create(const std::vector<FactorType> &input
               , const std::vector<FactorType> &output
               , const std::string &filePath
@@ -194,6 +249,10 @@ public:
 
     const StaticData &staticData = StaticData::Instance();
     m_dict->UseWordAlignment(staticData.UseAlignmentInfo());
+    if(staticData.GetTTableCacheSize()) {
+      m_sharedCache=&PhraseDictionaryTreeCache::GetShared(m_obj->GetFeature(),&languageModels,
+                    staticData.GetTTableCacheSize());
+    }
 
     std::string binFname=filePath+".binphr.idx";
     if(!FileExists(binFname.c_str())) {
@@ -40,9 +40,12 @@ Parameter::Parameter()
   AddParam("beam-threshold", "b", "threshold for threshold pruning");
   //MSPnew :add parameter for clause boundaries
   AddParam("clause-bounds", "cb", "location of the clause boundaries of input sentences");
+  AddParam("use-clause-cache", "(chart decoding with clause boundaries only) reuse the sub-charts of clauses across sentences (default false)");
+  AddParam("clause-cache-size", "maximum number of clause sub-charts in the clause cache (default 1,000)");
   //MSPnew : add parameter for min span
   AddParam("min-chart-span", "minSp", "minimum num of source words chart rules must consume");
   AddParam("config", "f", "location of the configuration file");
+  AddParam("snapshot-dir", "directory holding binary images of the models; created on first use and mapped on later runs with the same configuration");
   AddParam("continue-partial-translation", "cpt", "start from nonempty hypothesis");
   AddParam("decoding-graph-backoff", "dpb", "only use subsequent decoding paths for unknown spans of given length");
   AddParam("drop-unknown", "du", "drop unknown words instead of copying them");
@@ -80,6 +83,7 @@ Parameter::Parameter()
   AddParam("stack", "s", "maximum stack size for histogram pruning");
   AddParam("stack-diversity", "sd", "minimum number of hypothesis of each coverage in stack (default 0)");
   AddParam("threads","th", "number of threads to use in decoding (defaults to single-threaded)");
+  AddParam("search-threads", "number of threads working on one sentence: scoring the expansions of a hypothesis stack in phrase-based search, lattice MBR / consensus decoding, and extracting the phrase pairs of a suffix array phrase table (default 1)");
   AddParam("translation-details", "T", "for each best hypothesis, report translation details to the given file");
   AddParam("ttable-file", "location and properties of the translation tables");
   AddParam("ttable-limit", "ttl", "maximum number of translation table entries per input phrase");
@@ -116,7 +120,10 @@ Parameter::Parameter()
   AddParam("lmbr-map-weight", "weight given to map solution when doing lattice MBR (default 0)");
   AddParam("lattice-hypo-set", "to use lattice as hypo set during lattice MBR");
   AddParam("clean-lm-cache", "clean language model caches after N translations (default N=1)");
+  AddParam("lmodel-cache-size", "number of entries in the per-thread language model query cache, 0 to disable (default 65536)");
   AddParam("use-persistent-cache", "cache translation options across sentences (default true)");
+  AddParam("ttable-cache-size", "number of source phrases whose target phrases are kept across sentences and threads for binary phrase tables, 0 to disable (default 100,000)");
+  AddParam("ondisk-cache-size", "megabytes of rules from on-disk rule tables kept across sentences and threads, 0 to disable (default 256)");
   AddParam("persistent-cache-size", "maximum size of cache for translation options (default 10,000 input phrases)");
   AddParam("recover-input-path", "r", "(conf net/word lattice only) - recover input path corresponding to the best translation");
   AddParam("output-word-graph", "owg", "Output stack info as word graph. Takes filename, 0=only hypos in stack, 1=stack + nbest hypos");
@@ -69,6 +69,10 @@ public:
   const PARAM_VEC &GetParam(const std::string &paramName) {
     return m_setting[paramName];
   }
+  /** all parameters set in either moses.ini or as switch */
+  const PARAM_MAP &GetParams() const {
+    return m_setting;
+  }
   /** check if parameter is defined (either in moses.ini or as switch) */
   bool isParamSpecified(const std::string &paramName) {
     return  m_setting.find( paramName ) != m_setting.end();
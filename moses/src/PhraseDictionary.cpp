@@ -21,6 +21,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "PhraseDictionary.h"
 #include "PhraseDictionaryTreeAdaptor.h"
+#include "PhraseDictionaryCompact.h"
 #include "RuleTable/PhraseDictionarySCFG.h"
 #include "RuleTable/PhraseDictionaryOnDisk.h"
 #include "RuleTable/PhraseDictionaryALSuffixArray.h"
@@ -71,7 +72,9 @@ PhraseDictionaryFeature::PhraseDictionaryFeature
   const StaticData& staticData = StaticData::Instance();
   const_cast<ScoreIndexManager&>(staticData.GetScoreIndexManager()).AddScoreProducer(this);
   //MSPnew : register SCFG_MIN_SPAN as thread safe dictionary
-  if (implementation == Memory || implementation == SCFG || implementation == SuffixArray || implementation == SCFG_MIN_SPAN) {
+  // on-disk rule tables are read through a shared mapping and keep sentence state in their lookup managers
+  if (implementation == Memory || implementation == SCFG || implementation == SuffixArray || implementation == SCFG_MIN_SPAN
+      || implementation == OnDisk) {
     m_useThreadSafePhraseDictionary = true;
   } else {
     m_useThreadSafePhraseDictionary = false;
@@ -113,6 +116,22 @@ PhraseDictionary* PhraseDictionaryFeature::LoadPhraseTable(const TranslationSyst
                , system->GetWeightWordPenalty());
     CHECK(ret);
     return pdta;
+  } else if (m_implementation == Compact) {
+    // memory-mapped, but lookups keep per-sentence state, so one per thread
+    if (staticData.GetInputType() != SentenceInput) {
+      UserMessage::Add("The compact phrase table supports sentence input only");
+      CHECK(false);
+    }
+    PhraseDictionaryCompact* pdc = new PhraseDictionaryCompact(m_numScoreComponent, this);
+    bool ret = pdc->Load(GetInput()
+                         , GetOutput()
+                         , m_filePath
+                         , m_weight
+                         , m_tableLimit
+                         , system->GetLanguageModels()
+                         , system->GetWeightWordPenalty());
+    CHECK(ret);
+    return pdc;
   } else if (m_implementation == SCFG || m_implementation == Hiero) {
     // memory phrase table
     if (m_implementation == Hiero) {
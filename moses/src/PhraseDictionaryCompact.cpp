@@ -0,0 +1,561 @@
+// $Id$
+
+/***********************************************************************
+Moses - factored phrase-based language decoder
+Copyright (C) 2012 University of Edinburgh
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+***********************************************************************/
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <sstream>
+
+#include "PhraseDictionaryCompact.h"
+#include "FactorCollection.h"
+#include "ScoreCodebook.h"
+#include "StaticData.h"
+#include "TargetPhrase.h"
+#include "TargetPhraseCollection.h"
+#include "UserMessage.h"
+#include "Util.h"
+#include "util/file_piece.hh"
+#include "util/murmur_hash.hh"
+#include "util/tokenize_piece.hh"
+
+namespace Moses
+{
+
+namespace
+{
+
+//! scores per column used to build the codebooks
+const size_t ScoreSampleSize = 1 << 18;
+
+void WriteVarint(std::string &out, uint64_t value)
+{
+  while (value >= 0x80) {
+    out += static_cast<char>((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  out += static_cast<char>(value);
+}
+
+uint64_t ReadVarint(const char *&data)
+{
+  uint64_t value = 0;
+  for (unsigned shift = 0; ; shift += 7) {
+    unsigned char byte = *data++;
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return value;
+    }
+  }
+}
+
+void WritePadding(std::ofstream &out)
+{
+  static const char zeros[8] = {0};
+  out.write(zeros, (8 - out.tellp() % 8) % 8);
+}
+
+//! one line of a text phrase table
+struct CompactLine {
+  std::string source; //! words separated by single blanks
+  std::vector<std::string> target;
+  std::vector<float> scores;
+  bool hasAlignment;
+  std::string alignment;
+};
+
+bool ParseLine(const StringPiece &line, size_t numScores, CompactLine &out)
+{
+  util::TokenIter<util::MultiCharacter> pipes(line, util::MultiCharacter("|||"));
+  StringPiece fields[3];
+  for (size_t i = 0; i < 3; ++i, ++pipes) {
+    if (!pipes) {
+      return false;
+    }
+    fields[i] = *pipes;
+  }
+
+  out.source.clear();
+  for (util::TokenIter<util::AnyCharacter, true> word(fields[0], util::AnyCharacter(" \t")); word; ++word) {
+    if (!out.source.empty()) {
+      out.source += ' ';
+    }
+    out.source.append(word->data(), word->size());
+  }
+  out.target.clear();
+  for (util::TokenIter<util::AnyCharacter, true> word(fields[1], util::AnyCharacter(" \t")); word; ++word) {
+    out.target.push_back(word->as_string());
+  }
+  out.scores.clear();
+  for (util::TokenIter<util::AnyCharacter, true> token(fields[2], util::AnyCharacter(" \t")); token; ++token) {
+    char *end;
+    out.scores.push_back(FloorScore(TransformScore(static_cast<float>(strtod(token->data(), &end)))));
+    if (end == token->data()) {
+      return false;
+    }
+  }
+
+  out.hasAlignment = pipes;
+  if (pipes) {
+    out.alignment = pipes->as_string();
+    ++pipes;
+  }
+  return !pipes && out.scores.size() == numScores;
+}
+
+}
+
+PhraseDictionaryCompact::~PhraseDictionaryCompact()
+{
+  CleanUp();
+}
+
+void PhraseDictionaryCompact::CleanUp()
+{
+  for (std::map<Phrase, TargetPhraseCollection*>::iterator iter = m_cache.begin(); iter != m_cache.end(); ++iter) {
+    delete iter->second;
+  }
+  m_cache.clear();
+}
+
+uint64_t PhraseDictionaryCompact::MakeFingerprint(const std::string &source)
+{
+  return util::MurmurHash64A(source.data(), source.size());
+}
+
+uint64_t PhraseDictionaryCompact::GetSlot(uint64_t fingerprint, uint32_t displacement, uint64_t numSources)
+{
+  return util::MurmurHash64A(&fingerprint, sizeof(fingerprint), displacement) % numSources;
+}
+
+bool PhraseDictionaryCompact::Load(const std::vector<FactorType> &input
+                                   , const std::vector<FactorType> &output
+                                   , const std::string &filePath
+                                   , const std::vector<float> &weight
+                                   , size_t tableLimit
+                                   , const LMList &languageModels
+                                   , float weightWP)
+{
+  m_input = input;
+  m_output = output;
+  m_weight = weight;
+  m_tableLimit = tableLimit;
+  m_languageModels = &languageModels;
+  m_weightWP = weightWP;
+
+  const std::string fileName = filePath + ".minphr";
+  if (!FileExists(fileName)) {
+    UserMessage::Add("compact phrase table " + fileName + " does not exist");
+    return false;
+  }
+  m_file.reset(util::OpenReadOrThrow(fileName.c_str()));
+  const uint64_t size = util::SizeFile(m_file.get());
+  if (size < sizeof(Header)) {
+    UserMessage::Add(fileName + " is not a compact phrase table");
+    return false;
+  }
+  // pages are only read when lookups touch them
+  util::MapRead(util::LAZY, m_file.get(), 0, size, m_memory);
+  const char *base = static_cast<const char*>(m_memory.begin());
+  m_header = reinterpret_cast<const Header*>(base);
+  if (m_header->magic != Magic || m_header->version != Version || m_header->fileSize != size) {
+    std::stringstream strme;
+    strme << fileName << " is not a compact phrase table of version " << Version << " or is truncated";
+    UserMessage::Add(strme.str());
+    return false;
+  }
+  if (m_header->numScores != m_numScoreComponent) {
+    std::stringstream strme;
+    strme << "Size of scoreVector != number (" << m_header->numScores << "!=" << m_numScoreComponent
+          << ") of score components in " << fileName;
+    UserMessage::Add(strme.str());
+    return false;
+  }
+  m_codebook = reinterpret_cast<const float*>(base + sizeof(Header));
+  m_buckets = reinterpret_cast<const uint32_t*>(base + m_header->bucketsOffset);
+  m_entries = reinterpret_cast<const Entry*>(base + m_header->entriesOffset);
+  m_vocabOffsets = reinterpret_cast<const uint64_t*>(base + m_header->vocabOffset);
+  m_data = base + m_header->dataOffset;
+
+  VERBOSE(1, "compact phrase table " << fileName << ": " << m_header->numSources << " source phrases, "
+          << m_header->numWords << " target words" << std::endl);
+  return true;
+}
+
+const PhraseDictionaryCompact::Entry *PhraseDictionaryCompact::Find(uint64_t fingerprint) const
+{
+  const uint32_t displacement = m_buckets[fingerprint % m_header->numBuckets];
+  const uint64_t slot = (displacement & DirectSlot)
+                        ? (displacement & ~DirectSlot)
+                        : GetSlot(fingerprint, displacement, m_header->numSources);
+  // the perfect hash maps unknown phrases to some slot too
+  const Entry &entry = m_entries[slot];
+  return (entry.fingerprint == fingerprint) ? &entry : NULL;
+}
+
+const Word &PhraseDictionaryCompact::GetTargetWord(uint64_t id) const
+{
+  boost::unordered_map<uint64_t, Word>::iterator iter = m_words.find(id);
+  if (iter != m_words.end()) {
+    return iter->second;
+  }
+
+  const char *base = reinterpret_cast<const char*>(m_vocabOffsets + m_header->numWords + 1);
+  const std::string str(base + m_vocabOffsets[id], base + m_vocabOffsets[id + 1]);
+  std::vector<std::string> factors = TokenizeMultiCharSeparator(str, StaticData::Instance().GetFactorDelimiter());
+  CHECK(factors.size() == m_output.size());
+
+  FactorCollection &factorCollection = FactorCollection::Instance();
+  Word &word = m_words[id];
+  for (size_t i = 0; i < m_output.size(); ++i) {
+    word[m_output[i]] = factorCollection.AddFactor(Output, m_output[i], factors[i]);
+  }
+  return word;
+}
+
+TargetPhraseCollection *PhraseDictionaryCompact::Decode(const Entry &entry, const Phrase &source) const
+{
+  const char *data = m_data + entry.offset;
+  const size_t numScores = m_header->numScores;
+  std::vector<float> scores(numScores);
+
+  TargetPhraseCollection *ret = new TargetPhraseCollection();
+  for (uint64_t numTargets = ReadVarint(data); numTargets; --numTargets) {
+    TargetPhrase *targetPhrase = new TargetPhrase(Output);
+    for (uint64_t numWords = ReadVarint(data); numWords; --numWords) {
+      targetPhrase->AddWord(GetTargetWord(ReadVarint(data)));
+    }
+
+    if (m_header->quantizationBits) {
+      for (size_t i = 0; i < numScores; ++i) {
+        scores[i] = m_codebook[i * ScoreCodebookSize + static_cast<unsigned char>(*data++)];
+      }
+    } else {
+      std::memcpy(&scores[0], data, numScores * sizeof(float));
+      data += numScores * sizeof(float);
+    }
+    targetPhrase->SetScore(m_feature, scores, m_weight, m_weightWP, *m_languageModels);
+
+    if (m_header->hasAlignment) {
+      const uint64_t length = ReadVarint(data);
+      targetPhrase->SetAlignmentInfo(StringPiece(data, length));
+      data += length;
+    }
+    targetPhrase->SetSourcePhrase(&source);
+    ret->Add(targetPhrase);
+  }
+  ret->Sort(m_tableLimit > 0, m_tableLimit);
+  return ret;
+}
+
+const TargetPhraseCollection *PhraseDictionaryCompact::GetTargetPhraseCollection(const Phrase &source) const
+{
+  if (source.GetSize() == 0) {
+    return NULL;
+  }
+  std::pair<std::map<Phrase, TargetPhraseCollection*>::iterator, bool> cached =
+    m_cache.insert(std::make_pair(source, static_cast<TargetPhraseCollection*>(NULL)));
+  if (!cached.second) {
+    return cached.first->second;
+  }
+
+  std::string key;
+  for (size_t pos = 0; pos < source.GetSize(); ++pos) {
+    if (pos) {
+      key += ' ';
+    }
+    key += source.GetWord(pos).GetString(m_input, false);
+  }
+  const Entry *entry = Find(MakeFingerprint(key));
+  if (entry) {
+    TargetPhraseCollection *ret = Decode(*entry, cached.first->first);
+    if (ret->IsEmpty()) {
+      delete ret;
+    } else {
+      cached.first->second = ret;
+    }
+  }
+  return cached.first->second;
+}
+
+void PhraseDictionaryCompact::InitializeForInput(InputType const&)
+{
+  CleanUp();
+}
+
+bool PhraseDictionaryCompact::Create(const std::string &inFileName
+                                     , const std::string &outFileName
+                                     , size_t numScoreComponent
+                                     , size_t quantizationBits)
+{
+  if (quantizationBits != 0 && quantizationBits != 8) {
+    TRACE_ERR("ERROR: scores can only be quantized to 8 bits\n");
+    return false;
+  }
+
+  // first pass: source phrases, target word frequencies and score samples
+  std::vector<uint64_t> fingerprints;
+  boost::unordered_map<std::string, uint64_t> words;
+  std::vector<std::vector<float> > samples(numScoreComponent);
+  uint64_t numLines = 0, random = 1;
+  bool hasAlignment = false;
+  {
+    util::FilePiece in(inFileName.c_str(), &std::cerr);
+    CompactLine parsed;
+    std::string previousSource;
+    while (true) {
+      StringPiece line;
+      try {
+        line = in.ReadLine();
+      } catch (util::EndOfFileException &e) {
+        break;
+      }
+      ++numLines;
+      if (!ParseLine(line, numScoreComponent, parsed)) {
+        TRACE_ERR("ERROR: " << inFileName << ":" << numLines << ": expected source ||| target ||| "
+                  << numScoreComponent << " scores [||| alignment]\n");
+        return false;
+      }
+      if (1 == numLines) {
+        hasAlignment = parsed.hasAlignment;
+      } else if (parsed.hasAlignment != hasAlignment) {
+        TRACE_ERR("ERROR: " << inFileName << ":" << numLines << ": alignment given on some lines only\n");
+        return false;
+      }
+      if (parsed.source.empty()) {
+        continue;
+      }
+      if (fingerprints.empty() || parsed.source != previousSource) {
+        fingerprints.push_back(MakeFingerprint(parsed.source));
+        previousSource = parsed.source;
+      }
+      for (size_t i = 0; i < parsed.target.size(); ++i) {
+        ++words[parsed.target[i]];
+      }
+      // reservoir sample of every score column
+      for (size_t i = 0; i < numScoreComponent; ++i) {
+        random = random * 6364136223846793005ULL + 1442695040888963407ULL;
+        if (samples[i].size() < ScoreSampleSize) {
+          samples[i].push_back(parsed.scores[i]);
+        } else if ((random >> 16) % numLines < ScoreSampleSize) {
+          samples[i][(random >> 16) % ScoreSampleSize] = parsed.scores[i];
+        }
+      }
+    }
+  }
+  const uint64_t numSources = fingerprints.size();
+  if (0 == numSources || numSources >= DirectSlot) {
+    TRACE_ERR("ERROR: " << inFileName << " has " << numSources << " source phrases\n");
+    return false;
+  }
+  {
+    std::vector<uint64_t> sorted(fingerprints);
+    std::sort(sorted.begin(), sorted.end());
+    if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end()) {
+      TRACE_ERR("ERROR: the target phrases of a source phrase must be on consecutive lines, sort "
+                << inFileName << " first\n");
+      return false;
+    }
+  }
+
+  // target words by decreasing frequency, so frequent words get short codes
+  std::vector<std::pair<uint64_t, std::string> > vocab;
+  vocab.reserve(words.size());
+  for (boost::unordered_map<std::string, uint64_t>::const_iterator iter = words.begin(); iter != words.end(); ++iter) {
+    vocab.push_back(std::make_pair(~iter->second, iter->first));
+  }
+  std::sort(vocab.begin(), vocab.end());
+  for (size_t i = 0; i < vocab.size(); ++i) {
+    words[vocab[i].second] = i;
+  }
+
+  // minimal perfect hash: buckets of about 4 sources, largest first, each
+  // get the first displacement that moves all their sources to free slots.
+  // Single sources then take the remaining slots directly
+  Header header;
+  std::memset(&header, 0, sizeof(header));
+  header.numSources = numSources;
+  header.numBuckets = numSources / 4 + 1;
+  std::vector<std::pair<uint64_t, uint64_t> > byBucket(numSources);
+  for (uint64_t i = 0; i < numSources; ++i) {
+    byBucket[i] = std::make_pair(fingerprints[i] % header.numBuckets, i);
+  }
+  std::sort(byBucket.begin(), byBucket.end());
+  std::vector<std::pair<uint64_t, uint64_t> > bucketRanges; // size, begin in byBucket
+  for (uint64_t begin = 0, end; begin < numSources; begin = end) {
+    for (end = begin + 1; end < numSources && byBucket[end].first == byBucket[begin].first; ++end) {}
+    bucketRanges.push_back(std::make_pair(end - begin, begin));
+  }
+  std::sort(bucketRanges.begin(), bucketRanges.end(), std::greater<std::pair<uint64_t, uint64_t> >());
+
+  std::vector<uint32_t> displacements(header.numBuckets, 0);
+  std::vector<uint64_t> slots(numSources);
+  std::vector<bool> taken(numSources, false);
+  std::vector<uint64_t> candidates;
+  uint64_t nextFree = 0;
+  for (size_t b = 0; b < bucketRanges.size(); ++b) {
+    const uint64_t size = bucketRanges[b].first, begin = bucketRanges[b].second;
+    const uint64_t bucket = byBucket[begin].first;
+    if (1 == size) {
+      while (taken[nextFree]) {
+        ++nextFree;
+      }
+      taken[nextFree] = true;
+      slots[byBucket[begin].second] = nextFree;
+      displacements[bucket] = DirectSlot | nextFree;
+      continue;
+    }
+    for (uint32_t displacement = 0; ; ++displacement) {
+      if (displacement == DirectSlot) {
+        TRACE_ERR("ERROR: could not build the perfect hash\n");
+        return false;
+      }
+      candidates.clear();
+      for (uint64_t i = begin; i < begin + size; ++i) {
+        const uint64_t slot = GetSlot(fingerprints[byBucket[i].second], displacement, numSources);
+        if (taken[slot] || std::find(candidates.begin(), candidates.end(), slot) != candidates.end()) {
+          break;
+        }
+        candidates.push_back(slot);
+      }
+      if (candidates.size() == size) {
+        for (uint64_t i = 0; i < size; ++i) {
+          taken[candidates[i]] = true;
+          slots[byBucket[begin + i].second] = candidates[i];
+        }
+        displacements[bucket] = displacement;
+        break;
+      }
+    }
+  }
+  std::vector<std::pair<uint64_t, uint64_t> >().swap(byBucket);
+
+  std::vector<std::vector<float> > codebooks(numScoreComponent);
+  if (quantizationBits) {
+    for (size_t i = 0; i < numScoreComponent; ++i) {
+      codebooks[i] = MakeScoreCodebook(samples[i]);
+    }
+  }
+  std::vector<std::vector<float> >().swap(samples);
+
+  // header, codebooks, buckets, vocabulary, target phrases, index
+  const std::string outPath = outFileName + ".minphr";
+  std::ofstream out(outPath.c_str(), std::ios::out | std::ios::binary);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  for (size_t i = 0; i < codebooks.size() && quantizationBits; ++i) {
+    std::vector<float> padded(codebooks[i]);
+    padded.resize(ScoreCodebookSize, padded.back());
+    out.write(reinterpret_cast<const char*>(&padded[0]), ScoreCodebookSize * sizeof(float));
+  }
+  WritePadding(out);
+  header.bucketsOffset = out.tellp();
+  out.write(reinterpret_cast<const char*>(&displacements[0]), displacements.size() * sizeof(uint32_t));
+  WritePadding(out);
+  header.vocabOffset = out.tellp();
+  header.numWords = vocab.size();
+  std::vector<uint64_t> vocabOffsets(1, 0);
+  for (size_t i = 0; i < vocab.size(); ++i) {
+    vocabOffsets.push_back(vocabOffsets.back() + vocab[i].second.size());
+  }
+  out.write(reinterpret_cast<const char*>(&vocabOffsets[0]), vocabOffsets.size() * sizeof(uint64_t));
+  for (size_t i = 0; i < vocab.size(); ++i) {
+    out.write(vocab[i].second.data(), vocab[i].second.size());
+  }
+  WritePadding(out);
+  header.dataOffset = out.tellp();
+
+  // second pass: target phrases, grouped by source phrase
+  std::vector<Entry> entries(numSources);
+  {
+    util::FilePiece in(inFileName.c_str(), &std::cerr);
+    CompactLine parsed;
+    std::string previousSource, targets;
+    uint64_t source = 0, numTargets = 0, offset = 0;
+    while (true) {
+      StringPiece line;
+      bool eof = false;
+      try {
+        line = in.ReadLine();
+      } catch (util::EndOfFileException &e) {
+        eof = true;
+      }
+      if (!eof) {
+        ParseLine(line, numScoreComponent, parsed);
+        if (parsed.source.empty()) {
+          continue;
+        }
+      }
+      if (numTargets && (eof || parsed.source != previousSource)) {
+        std::string block;
+        WriteVarint(block, numTargets);
+        block += targets;
+        Entry &entry = entries[slots[source++]];
+        entry.fingerprint = MakeFingerprint(previousSource);
+        entry.offset = offset;
+        out.write(block.data(), block.size());
+        offset += block.size();
+        targets.clear();
+        numTargets = 0;
+      }
+      if (eof) {
+        break;
+      }
+      previousSource = parsed.source;
+      ++numTargets;
+      WriteVarint(targets, parsed.target.size());
+      for (size_t i = 0; i < parsed.target.size(); ++i) {
+        WriteVarint(targets, words[parsed.target[i]]);
+      }
+      for (size_t i = 0; i < numScoreComponent; ++i) {
+        if (quantizationBits) {
+          targets += static_cast<char>(QuantizeScore(codebooks[i], parsed.scores[i]));
+        } else {
+          targets.append(reinterpret_cast<const char*>(&parsed.scores[i]), sizeof(float));
+        }
+      }
+      if (hasAlignment) {
+        WriteVarint(targets, parsed.alignment.size());
+        targets += parsed.alignment;
+      }
+    }
+  }
+  WritePadding(out);
+  header.entriesOffset = out.tellp();
+  out.write(reinterpret_cast<const char*>(&entries[0]), entries.size() * sizeof(Entry));
+
+  header.magic = Magic;
+  header.version = Version;
+  header.numScores = numScoreComponent;
+  header.quantizationBits = quantizationBits;
+  header.hasAlignment = hasAlignment;
+  header.fileSize = out.tellp();
+  out.seekp(0);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.close();
+  if (!out) {
+    TRACE_ERR("ERROR: could not write " << outPath << "\n");
+    return false;
+  }
+  return true;
+}
+
+}
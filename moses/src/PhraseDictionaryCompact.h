@@ -0,0 +1,149 @@
+// $Id$
+
+/***********************************************************************
+Moses - factored phrase-based language decoder
+Copyright (C) 2012 University of Edinburgh
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+***********************************************************************/
+
+#ifndef moses_PhraseDictionaryCompact_h
+#define moses_PhraseDictionaryCompact_h
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include <boost/unordered_map.hpp>
+
+#include "PhraseDictionary.h"
+#include "Phrase.h"
+#include "Word.h"
+#include "util/file.hh"
+#include "util/mmap.hh"
+
+namespace Moses
+{
+
+/*** Read-only phrase table in a single memory-mapped file (.minphr), built
+ * from a text phrase table by processPhraseTable -compact.
+ *
+ * Source phrases are found through a minimal perfect hash of their 64 bit
+ * fingerprints, so a lookup touches one bucket, one index entry and the
+ * target phrases of the source phrase.  Target words are stored as their
+ * rank in the target vocabulary, most frequent first, in a variable byte
+ * code, and scores are quantized to one byte each unless the table was
+ * built with exact scores.  Only the pages used by lookups are read, and
+ * the copies of the table in different threads share them.
+ */
+class PhraseDictionaryCompact : public PhraseDictionary
+{
+  typedef PhraseDictionary MyBase;
+
+public:
+  PhraseDictionaryCompact(size_t numScoreComponent, const PhraseDictionaryFeature* feature)
+    : MyBase(numScoreComponent, feature)
+    , m_weightWP(0)
+    , m_languageModels(NULL)
+    , m_header(NULL) {}
+  virtual ~PhraseDictionaryCompact();
+
+  bool Load(const std::vector<FactorType> &input
+            , const std::vector<FactorType> &output
+            , const std::string &filePath
+            , const std::vector<float> &weight
+            , size_t tableLimit
+            , const LMList &languageModels
+            , float weightWP);
+
+  const TargetPhraseCollection *GetTargetPhraseCollection(const Phrase &source) const;
+
+  void InitializeForInput(InputType const&);
+
+  virtual ChartRuleLookupManager *CreateRuleLookupManager(
+    const InputType &,
+    const ChartCellCollection &) {
+    CHECK(false);
+    return 0;
+  }
+
+  /** convert the text phrase table inFileName, which must have the target
+   * phrases of each source phrase on consecutive lines, into
+   * outFileName + ".minphr".  quantizationBits is 8, or 0 to keep exact
+   * scores.  The input is read twice, so it can't be stdin */
+  static bool Create(const std::string &inFileName
+                     , const std::string &outFileName
+                     , size_t numScoreComponent
+                     , size_t quantizationBits);
+
+private:
+  struct Header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t numScores;
+    uint32_t quantizationBits;
+    uint32_t hasAlignment;
+    uint64_t numSources;
+    uint64_t numBuckets;
+    uint64_t numWords;
+    uint64_t bucketsOffset;
+    uint64_t entriesOffset;
+    uint64_t vocabOffset;
+    uint64_t dataOffset;
+    uint64_t fileSize;
+  };
+  //! index entry of a source phrase, in the slot given by the perfect hash
+  struct Entry {
+    uint64_t fingerprint;
+    uint64_t offset; //! of its target phrases, from dataOffset
+  };
+  static const uint64_t Magic = 0x3130305248504e4dULL; // "MNPHR001"
+  static const uint32_t Version = 1;
+  //! bucket displacements with this bit set hold the slot of their single source phrase
+  static const uint32_t DirectSlot = 0x80000000U;
+
+  static uint64_t MakeFingerprint(const std::string &source);
+  static uint64_t GetSlot(uint64_t fingerprint, uint32_t displacement, uint64_t numSources);
+
+  const Entry *Find(uint64_t fingerprint) const;
+  const Word &GetTargetWord(uint64_t id) const;
+  TargetPhraseCollection *Decode(const Entry &entry, const Phrase &source) const;
+  void CleanUp();
+
+  std::vector<FactorType> m_input, m_output;
+  std::vector<float> m_weight;
+  float m_weightWP;
+  const LMList *m_languageModels;
+
+  util::scoped_fd m_file;
+  util::scoped_memory m_memory;
+  const Header *m_header;
+  const float *m_codebook;
+  const uint32_t *m_buckets;
+  const Entry *m_entries;
+  const uint64_t *m_vocabOffsets;
+  const char *m_data;
+
+  //! target words decoded so far
+  mutable boost::unordered_map<uint64_t, Word> m_words;
+  //! target phrases looked up for the current sentence, keyed by source phrase
+  mutable std::map<Phrase, TargetPhraseCollection*> m_cache;
+};
+
+}
+
+#endif
@@ -11,12 +11,38 @@ namespace Moses
 PhraseDictionaryDynSuffixArray::PhraseDictionaryDynSuffixArray(size_t numScoreComponent,
     PhraseDictionaryFeature* feature): PhraseDictionary(numScoreComponent, feature)
 {
-  m_biSA = new BilingualDynSuffixArray();
+  m_biSA[0] = new BilingualDynSuffixArray();
+  m_biSA[1] = NULL;
+  m_updateStats.queued = 0;
+  m_updateStats.applied = 0;
+  m_updateStats.batches = 0;
+  m_updateStats.applyMs = 0;
+  m_updateStats.totalDelayMs = 0;
+  m_updateStats.maxDelayMs = 0;
+#ifdef WITH_THREADS
+  m_current = 0;
+  m_readers[0] = m_readers[1] = 0;
+  m_stopping = false;
+#endif
 }
 
 PhraseDictionaryDynSuffixArray::~PhraseDictionaryDynSuffixArray()
 {
-  delete m_biSA;
+#ifdef WITH_THREADS
+  // updates not yet applied are dropped with the table
+  {
+    boost::mutex::scoped_lock lock(m_mutex);
+    m_stopping = true;
+    m_updateQueued.notify_all();
+    // the update thread may be waiting for sentences that never finish
+    m_readersDone.notify_all();
+  }
+  if (m_updateThread.joinable()) {
+    m_updateThread.join();
+  }
+#endif
+  delete m_biSA[0];
+  delete m_biSA[1];
 }
 
 bool PhraseDictionaryDynSuffixArray::Load(const std::vector<FactorType>& input,
@@ -33,27 +59,89 @@ bool PhraseDictionaryDynSuffixArray::Load(const std::vector<FactorType>& input,
   m_weight = weight;
   m_weightWP = weightWP;
 
-  m_biSA->Load( input, output, source, target, alignments, weight);
+  // kept to load the second copy
+  m_input = input;
+  m_output = output;
+  m_source = source;
+  m_target = target;
+  m_alignments = alignments;
+
+  m_biSA[0]->Load( input, output, source, target, alignments, weight);
 
+#ifdef WITH_THREADS
+  boost::thread updateThread(boost::bind(&PhraseDictionaryDynSuffixArray::UpdateLoop, this));
+  m_updateThread.swap(updateThread);
+#endif
   return true;
 }
 
+BilingualDynSuffixArray *PhraseDictionaryDynSuffixArray::LoadCopy() const
+{
+  BilingualDynSuffixArray *biSA = new BilingualDynSuffixArray();
+  biSA->Load(m_input, m_output, m_source, m_target, m_alignments, m_weight);
+  return biSA;
+}
+
 void PhraseDictionaryDynSuffixArray::InitializeForInput(const InputType& input)
 {
   CHECK(&input == &input);
+#ifdef WITH_THREADS
+  // decode the sentence against the current copy until CleanUp()
+  ReleaseSnapshot();
+  AcquireSnapshot();
+#endif
 }
 
 void PhraseDictionaryDynSuffixArray::CleanUp()
 {
-  m_biSA->CleanUp();
+#ifdef WITH_THREADS
+  ReleaseSnapshot();
+#else
+  m_biSA[0]->CleanUp();
+#endif
+}
+
+#ifdef WITH_THREADS
+bool PhraseDictionaryDynSuffixArray::AcquireSnapshot() const
+{
+  if (m_snapshot.get() == NULL) {
+    m_snapshot.reset(new int(-1));
+  } else if (*m_snapshot != -1) {
+    return false;
+  }
+  boost::mutex::scoped_lock lock(m_mutex);
+  *m_snapshot = m_current;
+  ++m_readers[m_current];
+  return true;
+}
+
+void PhraseDictionaryDynSuffixArray::ReleaseSnapshot() const
+{
+  if (m_snapshot.get() == NULL || *m_snapshot == -1) {
+    return;
+  }
+  boost::mutex::scoped_lock lock(m_mutex);
+  if (--m_readers[*m_snapshot] == 0) {
+    m_readersDone.notify_all();
+  }
+  *m_snapshot = -1;
 }
+#endif
 
 const TargetPhraseCollection *PhraseDictionaryDynSuffixArray::GetTargetPhraseCollection(const Phrase& src) const
 {
+#ifdef WITH_THREADS
+  // outside of a sentence, the lookup gets a snapshot of its own
+  bool ownSnapshot = AcquireSnapshot();
+  const BilingualDynSuffixArray &biSA = *m_biSA[*m_snapshot];
+#else
+  const BilingualDynSuffixArray &biSA = *m_biSA[0];
+#endif
+
   TargetPhraseCollection *ret = new TargetPhraseCollection();
   std::vector< std::pair< Scores, TargetPhrase*> > trg;
   // extract target phrases and their scores from suffix array
-  m_biSA->GetTargetPhrasesByLexicalWeight( src, trg);
+  biSA.GetTargetPhrasesByLexicalWeight( src, trg);
 
   std::vector< std::pair< Scores, TargetPhrase*> >::iterator itr;
   for(itr = trg.begin(); itr != trg.end(); ++itr) {
@@ -66,14 +154,131 @@ const TargetPhraseCollection *PhraseDictionaryDynSuffixArray::GetTargetPhraseCol
     ret->Add(targetPhrase);
   }
   ret->NthElement(m_tableLimit); // sort the phrases for the dcoder
+
+#ifdef WITH_THREADS
+  if (ownSnapshot) {
+    ReleaseSnapshot();
+  }
+#endif
   return ret;
 }
 
 void PhraseDictionaryDynSuffixArray::insertSnt(string& source, string& target, string& alignment)
 {
-  m_biSA->addSntPair(source, target, alignment); // insert sentence pair into suffix arrays
-  //StaticData::Instance().ClearTransOptionCache(); // clear translation option cache 
+  SentencePair pair;
+  pair.m_source = source;
+  pair.m_target = target;
+  pair.m_alignment = alignment;
+  pair.m_queued = boost::posix_time::microsec_clock::universal_time();
+#ifdef WITH_THREADS
+  // applied by the update thread
+  boost::mutex::scoped_lock lock(m_mutex);
+  m_queue.push_back(pair);
+  ++m_updateStats.queued;
+  m_updateQueued.notify_all();
+#else
+  m_biSA[0]->addSntPair(pair.m_source, pair.m_target, pair.m_alignment); // insert sentence pair into suffix arrays
+  boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+  m_updateStats.applyMs += (now - pair.m_queued).total_microseconds() / 1000.0;
+  ++m_updateStats.batches;
+  AddDelay(pair, now);
+#endif
+}
+
+void PhraseDictionaryDynSuffixArray::AddDelay(const SentencePair &pair, const boost::posix_time::ptime &now)
+{
+  double delayMs = (now - pair.m_queued).total_microseconds() / 1000.0;
+  ++m_updateStats.applied;
+  m_updateStats.totalDelayMs += delayMs;
+  m_updateStats.maxDelayMs = std::max(m_updateStats.maxDelayMs, delayMs);
 }
+
+#ifdef WITH_THREADS
+void PhraseDictionaryDynSuffixArray::UpdateLoop()
+{
+  boost::mutex::scoped_lock lock(m_mutex);
+  while (true) {
+    while (m_queue.empty() && !m_stopping) {
+      m_updateQueued.wait(lock);
+    }
+    if (m_stopping) {
+      return;
+    }
+    // everything queued so far is one batch
+    std::vector<SentencePair> batch;
+    batch.swap(m_queue);
+    lock.unlock();
+    ApplyBatch(batch);
+    lock.lock();
+  }
+}
+
+bool PhraseDictionaryDynSuffixArray::IsStopping() const
+{
+  boost::mutex::scoped_lock lock(m_mutex);
+  return m_stopping;
+}
+
+void PhraseDictionaryDynSuffixArray::ApplyBatch(std::vector<SentencePair> &batch)
+{
+  // only this thread changes m_current
+  const boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+  const size_t spare = 1 - m_current;
+  if (m_biSA[spare] == NULL) {
+    m_biSA[spare] = LoadCopy();
+  }
+  for (size_t i = 0; i < batch.size(); ++i) {
+    if (IsStopping()) {
+      return;
+    }
+    SentencePair &pair = batch[i];
+    m_biSA[spare]->addSntPair(pair.m_source, pair.m_target, pair.m_alignment);
+  }
+
+  boost::posix_time::ptime swapped;
+  {
+    boost::mutex::scoped_lock lock(m_mutex);
+    m_current = spare;
+    swapped = boost::posix_time::microsec_clock::universal_time();
+    for (size_t i = 0; i < batch.size(); ++i) {
+      AddDelay(batch[i], swapped);
+    }
+    m_updateStats.queued -= batch.size();
+    ++m_updateStats.batches;
+    VERBOSE(1, "Added " << batch.size() << " sentence pairs to the suffix array phrase table" << endl);
+
+    // the old copy is free once the sentences decoding against it are done
+    while (m_readers[1 - spare] > 0 && !m_stopping) {
+      m_readersDone.wait(lock);
+    }
+    if (m_stopping) {
+      return;
+    }
+  }
+  const boost::posix_time::ptime waited = boost::posix_time::microsec_clock::universal_time();
+
+  for (size_t i = 0; i < batch.size(); ++i) {
+    if (IsStopping()) {
+      return;
+    }
+    SentencePair &pair = batch[i];
+    m_biSA[1 - spare]->addSntPair(pair.m_source, pair.m_target, pair.m_alignment);
+  }
+
+  const boost::posix_time::ptime end = boost::posix_time::microsec_clock::universal_time();
+  boost::mutex::scoped_lock lock(m_mutex);
+  m_updateStats.applyMs += ((swapped - start) + (end - waited)).total_microseconds() / 1000.0;
+}
+#endif
+
+PhraseDictionaryDynSuffixArray::UpdateStats PhraseDictionaryDynSuffixArray::GetUpdateStats() const
+{
+#ifdef WITH_THREADS
+  boost::mutex::scoped_lock lock(m_mutex);
+#endif
+  return m_updateStats;
+}
+
 void PhraseDictionaryDynSuffixArray::deleteSnt(unsigned /* idx */, unsigned /* num2Del */)
 {
   // need to implement --
@@ -3,15 +3,40 @@
 
 #include <map>
 
+#ifdef WITH_THREADS
+#include <boost/thread.hpp>
+#include <boost/thread/tss.hpp>
+#endif
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
 #include "PhraseDictionary.h"
 #include "BilingualDynSuffixArray.h"
 
 namespace Moses
 {
 
+/** Phrase table extracted at lookup time from a word-aligned parallel corpus,
+ * to which sentence pairs can be added while decoding.
+ *
+ * With threads, added sentence pairs are queued and applied in batches by an
+ * update thread, to two copies of the suffix arrays in turn.  A sentence is
+ * decoded against the copy that was current when it started.  A batch is
+ * applied to the other copy, which is then made current, and once the
+ * sentences still decoding against the old copy have finished, to that one
+ * too.  Decoding thus only waits for the swap.  The second copy is loaded on
+ * the first update.
+ */
 class PhraseDictionaryDynSuffixArray: public PhraseDictionary
 {
 public:
+  //! sentence pairs added by insertSnt()
+  struct UpdateStats {
+    size_t queued; //! not yet visible to new sentences
+    size_t applied, batches;
+    double applyMs; //! in the update thread, to both copies
+    double totalDelayMs, maxDelayMs; //! from insertSnt() until visible to new sentences
+  };
+
   PhraseDictionaryDynSuffixArray(size_t m_numScoreComponent, PhraseDictionaryFeature* feature);
   ~PhraseDictionaryDynSuffixArray();
   bool Load( const std::vector<FactorType>& m_input
@@ -30,14 +55,44 @@ public:
   void insertSnt(string&, string&, string&);
   void deleteSnt(unsigned, unsigned);
   ChartRuleLookupManager *CreateRuleLookupManager(const InputType&, const ChartCellCollection&);
+
+  UpdateStats GetUpdateStats() const;
+
 private:
-  BilingualDynSuffixArray *m_biSA;
+  struct SentencePair {
+    string m_source, m_target, m_alignment;
+    boost::posix_time::ptime m_queued;
+  };
+
+  BilingualDynSuffixArray *m_biSA[2];
+  std::vector<FactorType> m_input, m_output;
+  string m_source, m_target, m_alignments;
   std::vector<float> m_weight;
   size_t m_tableLimit;
   const LMList *m_languageModels;
   float m_weightWP;
+  UpdateStats m_updateStats;
 
+#ifdef WITH_THREADS
+  size_t m_current; // copy that new sentences are decoded against
+  mutable size_t m_readers[2]; // sentences decoding against each copy
+  mutable boost::thread_specific_ptr<int> m_snapshot; // copy of this thread's sentence, -1 if none
+  std::vector<SentencePair> m_queue;
+  bool m_stopping;
+  mutable boost::mutex m_mutex;
+  boost::condition_variable m_updateQueued;
+  mutable boost::condition_variable m_readersDone;
+  boost::thread m_updateThread;
+
+  bool AcquireSnapshot() const;
+  void ReleaseSnapshot() const;
+  bool IsStopping() const;
+  void UpdateLoop();
+  void ApplyBatch(std::vector<SentencePair> &batch);
+#endif
 
+  BilingualDynSuffixArray *LoadCopy() const;
+  void AddDelay(const SentencePair &pair, const boost::posix_time::ptime &now);
 };
 
 } // end namespace
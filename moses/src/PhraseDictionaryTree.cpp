@@ -119,12 +119,16 @@ PhraseDictionaryTree::PrefixPtr::operator bool() const
 
 typedef LVoc<std::string> WordVoc;
 
+#ifdef WITH_THREADS
+// the vocabularies are shared by the tables of all threads
+static boost::mutex vocsMutex;
+#endif
+
 static WordVoc* ReadVoc(const std::string& filename)
 {
   static std::map<std::string,WordVoc*> vocs;
 #ifdef WITH_THREADS
-  boost::mutex mutex;
-  boost::mutex::scoped_lock lock(mutex);
+  boost::mutex::scoped_lock lock(vocsMutex);
 #endif
   std::map<std::string,WordVoc*>::iterator vi = vocs.find(filename);
   if (vi == vocs.end()) {
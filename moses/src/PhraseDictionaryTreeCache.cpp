@@ -0,0 +1,53 @@
+// $Id$
+
+/***********************************************************************
+Moses - factored phrase-based language decoder
+Copyright (C) 2012 University of Edinburgh
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+***********************************************************************/
+
+#include <map>
+
+#include "PhraseDictionaryTreeCache.h"
+
+#ifdef WITH_THREADS
+#include <boost/thread/mutex.hpp>
+#endif
+
+namespace Moses
+{
+
+#ifdef WITH_THREADS
+namespace
+{
+boost::mutex sharedCachesMutex;
+}
+#endif
+
+PhraseDictionaryTreeCache &PhraseDictionaryTreeCache::GetShared(const void *feature, const void *system, size_t maxSize)
+{
+  static std::map<std::pair<const void*, const void*>, PhraseDictionaryTreeCache*> caches;
+#ifdef WITH_THREADS
+  boost::mutex::scoped_lock lock(sharedCachesMutex);
+#endif
+  PhraseDictionaryTreeCache *&cache = caches[std::make_pair(feature, system)];
+  if (!cache) {
+    cache = new PhraseDictionaryTreeCache(maxSize);
+  }
+  return *cache;
+}
+
+}
@@ -0,0 +1,74 @@
+// $Id$
+
+/***********************************************************************
+Moses - factored phrase-based language decoder
+Copyright (C) 2012 University of Edinburgh
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+***********************************************************************/
+
+#ifndef moses_PhraseDictionaryTreeCache_h
+#define moses_PhraseDictionaryTreeCache_h
+
+#include <string>
+
+#include <boost/shared_ptr.hpp>
+
+#include "Phrase.h"
+#include "ShardedLRUCache.h"
+#include "TargetPhraseCollection.h"
+
+namespace Moses
+{
+
+/** target phrases of one source phrase.  The target phrases point to the
+ * copy of the source phrase held here */
+struct PhraseDictionaryTreeCacheEntry {
+  explicit PhraseDictionaryTreeCacheEntry(const Phrase &source)
+    :m_source(source)
+    ,m_targetPhrases(NULL) {}
+  ~PhraseDictionaryTreeCacheEntry() {
+    delete m_targetPhrases;
+  }
+
+  Phrase m_source;
+  const TargetPhraseCollection *m_targetPhrases; //! NULL if the source phrase has no translation
+};
+
+/** Size-bounded cache of the decoded target phrases of a binary phrase table,
+ * keyed by the source phrase and bounded by their number.  It is kept across
+ * sentences and shared by the per-thread copies of the table; a thread keeps
+ * the entries it used until the end of its sentence.
+ */
+class PhraseDictionaryTreeCache
+  : public ShardedLRUCache<std::string, boost::shared_ptr<const PhraseDictionaryTreeCacheEntry> >
+{
+public:
+  typedef PhraseDictionaryTreeCacheEntry Entry;
+  typedef boost::shared_ptr<const Entry> EntryPtr;
+
+  //! maxSize is the number of source phrases kept over all shards
+  explicit PhraseDictionaryTreeCache(size_t maxSize)
+    :ShardedLRUCache<std::string, EntryPtr>(maxSize) {}
+
+  /** the cache shared by all tables with the same owner, i.e. all thread
+   * copies of one phrase table feature in one translation system.  Created
+   * with maxSize on first use, never destroyed */
+  static PhraseDictionaryTreeCache &GetShared(const void *feature, const void *system, size_t maxSize);
+};
+
+}
+
+#endif
@@ -128,6 +128,10 @@ public:
   IPhrase ConvertPhrase(const std::vector< std::string >& p, unsigned int voc) const;
   LabelId ConvertWord(const std::string& w, unsigned int voc) const;
   std::string ConvertWord(LabelId w, unsigned int voc) const;
+  /** call visit(key, cands) for every key that has candidates.  Parts of
+   * the tree are loaded for one first word at a time and freed again */
+  template<class Visitor> void ForEachKey(Visitor& visit);
+
 public: //low level
   PPimp* GetRoot();
   PPimp* Extend(PPimp* p, LabelId wi);
@@ -135,6 +139,8 @@ public: //low level
     return Extend(p, ConvertWord(w,voc));
   }
 private:
+  template<class Visitor> void ForEachKey(const PTF& tree, IPhrase& key, Visitor& visit);
+
   Data  m_Data;
   FILE* m_FileSrc;
   FILE* m_FileTgt;
@@ -143,6 +149,34 @@ private:
   ObjectPool<PPimp>     m_PtrPool;
 };
 
+template<class Visitor> void PrefixTreeMap::ForEachKey(Visitor& visit)
+{
+  IPhrase key;
+  for(size_t i = 0; i < m_Data.size(); ++i) {
+    if(m_Data[i]) {
+      ForEachKey(*m_Data[i], key, visit);
+      m_Data[i].free();
+    }
+  }
+}
+
+template<class Visitor> void PrefixTreeMap::ForEachKey(const PTF& tree, IPhrase& key, Visitor& visit)
+{
+  for(size_t i = 0; i < tree.size(); ++i) {
+    key.push_back(tree.getKey(i));
+    if(tree.getData(i) != InvalidOffT) {
+      Candidates cands;
+      fSeek(m_FileTgt, tree.getData(i));
+      cands.readBin(m_FileTgt);
+      visit(key, cands);
+    }
+    if(const PTF* next = tree.getPtr(i)) {
+      ForEachKey(*next, key, visit);
+    }
+    key.pop_back();
+  }
+}
+
 }
 
 #endif
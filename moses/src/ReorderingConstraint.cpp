@@ -31,11 +31,10 @@ namespace Moses
 void ReorderingConstraint::InitializeWalls(size_t size)
 {
   m_size = size;
-  m_wall      = (bool*)   malloc(sizeof(bool) * size);
+  m_wall      = new WordsBitmap(size);
   m_localWall = (size_t*) malloc(sizeof(size_t) * size);
 
   for (size_t pos = 0 ; pos < m_size ; pos++) {
-    m_wall[pos] = false;
     m_localWall[pos] = NOT_A_ZONE;
   }
 }
@@ -45,7 +44,7 @@ void ReorderingConstraint::InitializeWalls(size_t size)
 void ReorderingConstraint::SetWall( size_t pos, bool value )
 {
   VERBOSE(3,"SETTING reordering wall at position " << pos << std::endl);
-  m_wall[pos] = value;
+  m_wall->SetValue(pos, value);
   m_active = true;
 }
 
@@ -56,9 +55,9 @@ void ReorderingConstraint::FinalizeWalls()
     const size_t startZone = m_zone[z][0];
     const size_t endZone = m_zone[z][1];// note: wall after endZone is not local
     for( size_t pos = startZone; pos < endZone; pos++ ) {
-      if (m_wall[ pos ]) {
+      if (m_wall->GetValue( pos )) {
         m_localWall[ pos ] = z;
-        m_wall[ pos ] = false;
+        m_wall->SetValue( pos, false );
         VERBOSE(3,"SETTING local wall " << pos << std::endl);
       }
       // enforce that local walls only apply to innermost zone
@@ -118,11 +117,9 @@ bool ReorderingConstraint::Check( const WordsBitmap &bitmap, size_t startPos, si
     // if there is a wall before the last word,
     // we created a gap while moving through wall
     // -> violation
-    for( size_t pos = firstGapPos; pos < endPos; pos++ ) {
-      if( GetWall( pos ) ) {
-        VERBOSE(3," hitting wall " << pos << std::endl);
-        return false;
-      }
+    if( endPos > firstGapPos && m_wall->Overlap( WordsRange( firstGapPos, endPos-1 ) ) ) {
+      VERBOSE(3," hitting wall" << std::endl);
+      return false;
     }
   }
 
@@ -154,11 +151,7 @@ bool ReorderingConstraint::Check( const WordsBitmap &bitmap, size_t startPos, si
     // let's look closer if some are in the zone
     size_t numWordsInZoneTranslated = 0;
     if (lastPos >= startZone) {
-      for(size_t pos = startZone; pos <= endZone; pos++ ) {
-        if( bitmap.GetValue( pos ) ) {
-          numWordsInZoneTranslated++;
-        }
-      }
+      numWordsInZoneTranslated = bitmap.GetNumWordsCovered(WordsRange(startZone, endZone));
     }
 
     // all words in zone translated, no violation possible
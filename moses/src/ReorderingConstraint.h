@@ -46,7 +46,7 @@ class ReorderingConstraint
 protected:
   // const size_t m_size; /**< number of words in sentence */
   size_t m_size; /**< number of words in sentence */
-  bool *m_wall;	/**< flag for each word if it is a wall */
+  WordsBitmap *m_wall;	/**< flag for each word if it is a wall */
   size_t *m_localWall;	/**< flag for each word if it is a local wall */
   std::vector< std::vector< size_t > > m_zone; /** zones that limit reordering */
   bool   m_active; /**< flag indicating, if there are any active constraints */
@@ -58,7 +58,7 @@ public:
 
   //! destructer
   ~ReorderingConstraint() {
-    if (m_wall != NULL) free(m_wall);
+    delete m_wall;
     if (m_localWall != NULL) free(m_localWall);
   }
 
@@ -73,7 +73,7 @@ public:
 
   //! whether a word has been translated at a particular position
   bool GetWall(size_t pos) const {
-    return m_wall[pos];
+    return m_wall->GetValue(pos);
   }
 
   //! whether a word has been translated at a particular position
@@ -7,6 +7,8 @@
 #include "ReorderingStack.h"
 #include <vector>
 
+#include <boost/functional/hash.hpp>
+
 namespace Moses
 {
 int ReorderingStack::Compare(const ReorderingStack& o)  const
@@ -20,6 +22,16 @@ int ReorderingStack::Compare(const ReorderingStack& o)  const
   return 0;
 }
 
+size_t ReorderingStack::hash() const
+{
+  size_t seed = m_stack.size();
+  for (size_t i = 0; i < m_stack.size(); ++i) {
+    boost::hash_combine(seed, m_stack[i].GetStartPos());
+    boost::hash_combine(seed, m_stack[i].GetEndPos());
+  }
+  return seed;
+}
+
 // Method to push (shift element into the stack and reduce if reqd)
 int ReorderingStack::ShiftReduce(WordsRange input_span)
 {
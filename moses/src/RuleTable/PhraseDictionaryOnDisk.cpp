@@ -32,6 +32,12 @@ namespace Moses
 {
 PhraseDictionaryOnDisk::~PhraseDictionaryOnDisk()
 {
+  if (m_cache.get()) {
+    size_t hits = m_cache->GetHits(), misses = m_cache->GetMisses();
+    VERBOSE(2, "on-disk rule table cache: hits=" << hits << ";  misses=" << misses
+            << ";  hit rate=" << (hits + misses ? 100.0 * hits / (hits + misses) : 0.0)
+            << "%;  size=" << m_cache->GetBytes() / 1024 << "KB" << endl);
+  }
   CleanUp();
 }
 
@@ -57,11 +63,17 @@ bool PhraseDictionaryOnDisk::Load(const std::vector<FactorType> &input
   if (!m_dbWrapper.BeginLoad(filePath))
     return false;
 
-  CHECK(m_dbWrapper.GetMisc("Version") == 3);
+  CHECK(m_dbWrapper.GetVersion() == OnDiskPt::FIXED_WIDTH_VERSION
+        || m_dbWrapper.GetVersion() == OnDiskPt::COMPACT_VERSION);
   CHECK(m_dbWrapper.GetMisc("NumSourceFactors") == input.size());
   CHECK(m_dbWrapper.GetMisc("NumTargetFactors") == output.size());
   CHECK(m_dbWrapper.GetMisc("NumScores") == weight.size());
 
+  size_t cacheSize = StaticData::Instance().GetOnDiskCacheSize();
+  if (cacheSize > 0) {
+    m_cache.reset(new PhraseDictionaryOnDiskCache(cacheSize << 20));
+  }
+
   return true;
 }
 
@@ -22,9 +22,11 @@
 #pragma once
 
 #include <map>
+#include <memory>
 #include <vector>
 #include <string>
 #include "PhraseDictionary.h"
+#include "PhraseDictionaryOnDiskCache.h"
 #include "../../OnDiskPt/OnDiskWrapper.h"
 #include "../../OnDiskPt/Word.h"
 #include "../../OnDiskPt/PhraseNode.h"
@@ -47,6 +49,7 @@ protected:
   std::vector<FactorType> m_inputFactorsVec, m_outputFactorsVec;
   std::vector<float> m_weight;
   std::string m_filePath;
+  std::auto_ptr<PhraseDictionaryOnDiskCache> m_cache; //! NULL if disabled
 
   void LoadTargetLookup();
 
@@ -76,6 +79,11 @@ public:
   //! find list of translations that can translates src. Only for phrase input
   virtual const TargetPhraseCollection *GetTargetPhraseCollection(const Phrase& src) const;
 
+  //! rules shared by the lookups of all sentences and threads, or NULL
+  PhraseDictionaryOnDiskCache *GetCache() const {
+    return m_cache.get();
+  }
+
   void InitializeForInput(const InputType& input);
   void CleanUp();
 
@@ -0,0 +1,67 @@
+// vim:tabstop=2
+/***********************************************************************
+ Moses - factored phrase-based language decoder
+ Copyright (C) 2012 University of Edinburgh
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ ***********************************************************************/
+
+#include "PhraseDictionaryOnDiskCache.h"
+#include "TargetPhrase.h"
+
+namespace Moses
+{
+
+namespace
+{
+// rough cost of the LRU list node and hash table slot of an entry
+const size_t EntryOverhead = 8 * sizeof(void*);
+}
+
+size_t PhraseDictionaryOnDiskCache::EstimateBytes::operator()(const Entry &entry) const
+{
+  size_t bytes = EntryOverhead;
+  if (entry.m_node) {
+    // loaded nodes are views into the mapped file plus a single count
+    bytes += sizeof(OnDiskPt::PhraseNode) + sizeof(float);
+  }
+  if (entry.m_targetPhrases) {
+    bytes += sizeof(TargetPhraseCollection);
+    TargetPhraseCollection::const_iterator iter;
+    for (iter = entry.m_targetPhrases->begin(); iter != entry.m_targetPhrases->end(); ++iter) {
+      const TargetPhrase &targetPhrase = **iter;
+      bytes += sizeof(TargetPhrase*) + sizeof(TargetPhrase)
+               + targetPhrase.GetSize() * sizeof(Word)
+               + targetPhrase.GetScoreBreakdown().size() * sizeof(float);
+    }
+  }
+  return bytes;
+}
+
+void PhraseDictionaryOnDiskCache::PutNode(UINT64 filePos, const NodePtr &node)
+{
+  Entry entry;
+  entry.m_node = node;
+  m_entries.Put(MakeKey(filePos, NodeKind), entry);
+}
+
+void PhraseDictionaryOnDiskCache::PutTargetPhrases(UINT64 filePos, const TargetPhrasesPtr &targetPhrases)
+{
+  Entry entry;
+  entry.m_targetPhrases = targetPhrases;
+  m_entries.Put(MakeKey(filePos, TargetPhrasesKind), entry);
+}
+
+}
@@ -0,0 +1,97 @@
+// $Id$
+// vim:tabstop=2
+/***********************************************************************
+ Moses - factored phrase-based language decoder
+ Copyright (C) 2012 University of Edinburgh
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ ***********************************************************************/
+
+#pragma once
+
+#include <boost/shared_ptr.hpp>
+
+#include "ShardedLRUCache.h"
+#include "TargetPhraseCollection.h"
+#include "TypeDef.h"
+#include "../../OnDiskPt/PhraseNode.h"
+
+namespace Moses
+{
+
+/** Cache of the source nodes and converted target phrases of an on-disk rule
+ * table, kept across sentences and shared by all decoding threads.  Both are
+ * keyed by their file position, and the cache is bounded by an estimate of
+ * the memory its entries use.  A rule lookup manager keeps the entries it
+ * used until the end of its sentence, even if they are evicted meanwhile.
+ */
+class PhraseDictionaryOnDiskCache
+{
+public:
+  typedef boost::shared_ptr<const OnDiskPt::PhraseNode> NodePtr;
+  typedef boost::shared_ptr<const TargetPhraseCollection> TargetPhrasesPtr;
+
+  //! maxBytes is the estimated memory kept over all shards
+  explicit PhraseDictionaryOnDiskCache(size_t maxBytes)
+    :m_entries(maxBytes) {}
+
+  //! cached node at this position in the source file, or an empty pointer
+  NodePtr GetNode(UINT64 filePos) {
+    return m_entries.Get(MakeKey(filePos, NodeKind)).m_node;
+  }
+  void PutNode(UINT64 filePos, const NodePtr &node);
+
+  //! cached target phrases at this position in the collection file, or an empty pointer
+  TargetPhrasesPtr GetTargetPhrases(UINT64 filePos) {
+    return m_entries.Get(MakeKey(filePos, TargetPhrasesKind)).m_targetPhrases;
+  }
+  void PutTargetPhrases(UINT64 filePos, const TargetPhrasesPtr &targetPhrases);
+
+  size_t GetHits() const {
+    return m_entries.GetHits();
+  }
+  size_t GetMisses() const {
+    return m_entries.GetMisses();
+  }
+  size_t GetBytes() const {
+    return m_entries.GetCost();
+  }
+
+private:
+  // nodes and target phrases live in different files, so their positions
+  // are tagged with the kind of entry to form the key
+  enum Kind {
+    NodeKind = 0,
+    TargetPhrasesKind = 1
+  };
+
+  //! one of the two is set
+  struct Entry {
+    NodePtr m_node;
+    TargetPhrasesPtr m_targetPhrases;
+  };
+
+  struct EstimateBytes {
+    size_t operator()(const Entry &entry) const;
+  };
+
+  static UINT64 MakeKey(UINT64 filePos, Kind kind) {
+    return (filePos << 1) | kind;
+  }
+
+  ShardedLRUCache<UINT64, Entry, EstimateBytes> m_entries;
+};
+
+}
@@ -37,12 +37,17 @@
 namespace Moses
 {
 
-//MSPnew : optional minSpan argument set to 0
 void Scope3Parser::GetChartRuleCollection(
     const WordsRange &range,
     ChartTranslationOptionList &outColl,
-    size_t maxSpan)
+    size_t minSpan)
 {
+  // cells are filled independently, so a span no rule may cover is skipped
+  // before its stack lattices are built
+  if (minSpan > 0 && !m_spanConstraints.Allows(range, minSpan)) {
+    return;
+  }
+
   const size_t start = range.GetStartPos();
   const size_t end = range.GetEndPos();
 
@@ -20,6 +20,7 @@
 #pragma once
 
 #include "ChartRuleLookupManager.h"
+#include "ChartSpanConstraints.h"
 #include "ChartTranslationOptionList.h"
 #include "NonTerminal.h"
 #include "RuleTable/UTrieNode.h"
@@ -50,13 +51,14 @@ class Scope3Parser : public ChartRuleLookupManager
                const RuleTableUTrie &ruleTable,
                size_t maxChartSpan)
       : ChartRuleLookupManager(sentence, cellColl)
+      , m_spanConstraints(sentence)
       , m_ruleTable(ruleTable)
       , m_maxChartSpan(maxChartSpan)
   {
     Init();
   }
 
-  //MSPnew : optional minSpan argument set to 0
+  // minSpan > 0 for the min-span model, whose spans are constrained
   void GetChartRuleCollection(
     const WordsRange &range,
     ChartTranslationOptionList &outColl,
@@ -87,6 +89,7 @@ class Scope3Parser : public ChartRuleLookupManager
   void AddRulesToCells(const ApplicableRuleTrie &, std::pair<int, int>, int,
                        int);
 
+  const ChartSpanConstraints m_spanConstraints;
   const RuleTableUTrie &m_ruleTable;
   std::vector<std::vector<std::vector<
     std::pair<const UTrieNode *, const VarSpanNode *> > > > m_ruleApplications;
@@ -0,0 +1,60 @@
+// $Id$
+
+/***********************************************************************
+Moses - factored phrase-based language decoder
+Copyright (C) 2012 University of Edinburgh
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+***********************************************************************/
+
+#include <algorithm>
+
+#include "ScoreCodebook.h"
+
+namespace Moses
+{
+
+std::vector<float> MakeScoreCodebook(std::vector<float> values)
+{
+  std::sort(values.begin(), values.end());
+  std::vector<float> distinct(values);
+  distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+  if(distinct.size() <= ScoreCodebookSize) {
+    return distinct;
+  }
+  // the means of equally large groups of the sorted values
+  std::vector<float> codebook;
+  for(size_t i = 0; i < ScoreCodebookSize; ++i) {
+    size_t begin = values.size() * i / ScoreCodebookSize, end = values.size() * (i + 1) / ScoreCodebookSize;
+    double sum = 0;
+    for(size_t j = begin; j < end; ++j) {
+      sum += values[j];
+    }
+    codebook.push_back(sum / (end - begin));
+  }
+  codebook.erase(std::unique(codebook.begin(), codebook.end()), codebook.end());
+  return codebook;
+}
+
+unsigned char QuantizeScore(const std::vector<float>& codebook, float value)
+{
+  size_t i = std::lower_bound(codebook.begin(), codebook.end(), value) - codebook.begin();
+  if(i == codebook.size() || (i > 0 && value - codebook[i-1] < codebook[i] - value)) {
+    --i;
+  }
+  return (unsigned char) i;
+}
+
+}
@@ -0,0 +1,44 @@
+// $Id$
+
+/***********************************************************************
+Moses - factored phrase-based language decoder
+Copyright (C) 2012 University of Edinburgh
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+***********************************************************************/
+
+#ifndef moses_ScoreCodebook_h
+#define moses_ScoreCodebook_h
+
+#include <vector>
+
+namespace Moses
+{
+
+/** Quantization of feature scores to one byte, used by the compact binary
+ * tables.  Each score column gets its own codebook of ScoreCodebookSize
+ * values, and a score is stored as the index of the closest one.
+ */
+const size_t ScoreCodebookSize = 256;
+
+//! up to ScoreCodebookSize sorted representative values of a sample of scores
+std::vector<float> MakeScoreCodebook(std::vector<float> values);
+
+//! index of the codebook value closest to value
+unsigned char QuantizeScore(const std::vector<float>& codebook, float value);
+
+}
+
+#endif
@@ -1,11 +1,80 @@
 #include "Manager.h"
 #include "Timer.h"
 #include "SearchNormal.h"
+#include "TranslationSystem.h"
+
+#ifdef WITH_THREADS
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+#include "ThreadPool.h"
+#endif
 
 using namespace std;
 
 namespace Moses
 {
+
+namespace
+{
+
+//! expansions collected per search thread before they are scored
+const size_t PENDING_HYPOS_PER_THREAD = 256;
+
+#ifdef WITH_THREADS
+// sentences are numbered for the search threads, which serve all of them
+boost::mutex sentenceSerialMutex;
+size_t nextSentenceSerial = 1;
+
+//! serial of the sentence a search thread last set up the feature functions for
+boost::thread_specific_ptr<size_t> threadSentenceSerial;
+
+/** Scores a slice of the collected expansions */
+class ScoreHypothesesTask : public Task
+{
+public:
+  ScoreHypothesesTask(Hypothesis **begin, Hypothesis **end, Manager &manager
+                      , const InputType &source, size_t sentenceSerial
+                      , const SquareMatrix &futureScore, TaskLatch &latch)
+    :m_begin(begin)
+    ,m_end(end)
+    ,m_manager(manager)
+    ,m_source(source)
+    ,m_sentenceSerial(sentenceSerial)
+    ,m_futureScore(futureScore)
+    ,m_latch(latch) {
+  }
+
+  virtual void Run() {
+    // feature functions such as the global lexical model keep the sentence
+    // in thread-local storage, set up again whenever the thread moves on to
+    // another sentence
+    if (threadSentenceSerial.get() == NULL) {
+      threadSentenceSerial.reset(new size_t(0));
+    }
+    if (*threadSentenceSerial != m_sentenceSerial) {
+      m_manager.GetTranslationSystem()->InitializeThreadBeforeSentenceProcessing(m_source);
+      *threadSentenceSerial = m_sentenceSerial;
+    }
+
+    for (Hypothesis **hypo = m_begin; hypo != m_end; ++hypo) {
+      (*hypo)->CalcScore(m_futureScore);
+    }
+    m_latch.Done();
+  }
+
+private:
+  Hypothesis **m_begin, **m_end;
+  Manager &m_manager;
+  const InputType &m_source;
+  size_t m_sentenceSerial;
+  const SquareMatrix &m_futureScore;
+  TaskLatch &m_latch;
+};
+
+#endif
+
+}
+
 /**
  * Organizing main function
  *
@@ -24,6 +93,27 @@ SearchNormal::SearchNormal(Manager& manager, const InputType &source, const Tran
   VERBOSE(1, "Translating: " << m_source << endl);
   const StaticData &staticData = StaticData::Instance();
 
+  // early discarding depends on the stacks at the time an expansion is
+  // built, timing statistics are not thread-safe, and hypotheses only
+  // recombine if their LM states all come from the same thread
+  m_searchThreads = staticData.GetSearchThreadCount();
+  if (staticData.UseEarlyDiscarding() || staticData.GetVerboseLevel() >= 2) {
+    m_searchThreads = 1;
+  }
+  const LMList &languageModels = m_manager.GetTranslationSystem()->GetLanguageModels();
+  for (LMList::const_iterator lm = languageModels.begin(); lm != languageModels.end(); ++lm) {
+    if (!(*lm)->SharesStatesAcrossThreads()) {
+      m_searchThreads = 1;
+    }
+  }
+  m_sentenceSerial = 0;
+#ifdef WITH_THREADS
+  if (m_searchThreads > 1) {
+    boost::mutex::scoped_lock lock(sentenceSerialMutex);
+    m_sentenceSerial = nextSentenceSerial++;
+  }
+#endif
+
   if (m_initialTargetPhrase.GetSize() > 0) {
     VERBOSE(1, "Search extends partial output: " << m_initialTargetPhrase<<endl);
   }
@@ -89,12 +179,13 @@ void SearchNormal::ProcessSentence()
       stats.AddTimeStack( clock()-t );
     }
 
-    // go through each hypothesis on the stack and try to expand it
-    HypothesisStackNormal::const_iterator iterHypo;
-    for (iterHypo = sourceHypoColl.begin() ; iterHypo != sourceHypoColl.end() ; ++iterHypo) {
-      Hypothesis &hypothesis = **iterHypo;
-      ProcessOneHypothesis(hypothesis); // expand the hypothesis
+    // go through each hypothesis on the stack and try to expand it, in an
+    // order that is the same from run to run
+    const vector<const Hypothesis*> hypos = sourceHypoColl.GetListByCreation();
+    for (size_t i = 0; i < hypos.size(); ++i) {
+      ProcessOneHypothesis(*hypos[i]); // expand the hypothesis
     }
+    ScorePendingHypotheses();
     // some logging
     IFVERBOSE(2) {
       OutputHypoStackSize();
@@ -125,7 +216,7 @@ void SearchNormal::ProcessOneHypothesis(const Hypothesis &hypothesis)
 
   // no limit of reordering: only check for overlap
   if (maxDistortion < 0) {
-    const WordsBitmap hypoBitmap	= hypothesis.GetWordsBitmap();
+    const WordsBitmap &hypoBitmap	= hypothesis.GetWordsBitmap();
     const size_t hypoFirstGapPos	= hypoBitmap.GetFirstGapPos()
                                     , sourceSize			= m_source.GetSize();
 
@@ -155,7 +246,7 @@ void SearchNormal::ProcessOneHypothesis(const Hypothesis &hypothesis)
 
   // if there are reordering limits, make sure it is not violated
   // the coverage bitmap is handy here (and the position of the first gap)
-  const WordsBitmap hypoBitmap = hypothesis.GetWordsBitmap();
+  const WordsBitmap &hypoBitmap = hypothesis.GetWordsBitmap();
   const size_t	hypoFirstGapPos	= hypoBitmap.GetFirstGapPos()
                                   , sourceSize			= m_source.GetSize();
 
@@ -302,6 +393,14 @@ void SearchNormal::ExpandHypothesis(const Hypothesis &hypothesis, const Translat
       stats.AddTimeBuildHyp( clock()-t );
     }
     if (newHypo==NULL) return;
+    if (m_searchThreads > 1) {
+      // scored later, together with other expansions
+      m_pendingHypos.push_back(newHypo);
+      if (m_pendingHypos.size() >= m_searchThreads * PENDING_HYPOS_PER_THREAD) {
+        ScorePendingHypotheses();
+      }
+      return;
+    }
     newHypo->CalcScore(m_transOptColl.GetFutureScore());
   } else
     // early discarding: check if hypothesis is too bad to build
@@ -354,6 +453,17 @@ void SearchNormal::ExpandHypothesis(const Hypothesis &hypothesis, const Translat
 
   }
 
+  AddToStack(newHypo);
+}
+
+/**
+ * Add a scored hypothesis to the stack for its number of covered words
+ */
+void SearchNormal::AddToStack(Hypothesis *newHypo)
+{
+  SentenceStats &stats = m_manager.GetSentenceStats();
+  clock_t t=0; // used to track time for steps
+
   // logging for the curious
   IFVERBOSE(3) {
     newHypo->PrintHypothesis();
@@ -370,6 +480,40 @@ void SearchNormal::ExpandHypothesis(const Hypothesis &hypothesis, const Translat
   }
 }
 
+/**
+ * Score the collected expansions on the search threads, then add them to
+ * the stacks in the order in which they were created
+ */
+void SearchNormal::ScorePendingHypotheses()
+{
+  if (m_pendingHypos.empty()) return;
+
+#ifdef WITH_THREADS
+  // a few slices per thread, as hypotheses differ in cost
+  const size_t numHypos = m_pendingHypos.size();
+  const size_t numTasks = std::min(numHypos, 4 * m_searchThreads);
+  Hypothesis **hypos = &m_pendingHypos[0];
+  TaskLatch latch(numTasks);
+  for (size_t i = 0; i < numTasks; ++i) {
+    GetSearchThreadPool().Submit(new ScoreHypothesesTask(hypos + numHypos * i / numTasks
+                         , hypos + numHypos * (i + 1) / numTasks
+                         , m_manager, m_source, m_sentenceSerial
+                         , m_transOptColl.GetFutureScore()
+                         , latch));
+  }
+  latch.Wait();
+#else
+  for (size_t i = 0; i < m_pendingHypos.size(); ++i) {
+    m_pendingHypos[i]->CalcScore(m_transOptColl.GetFutureScore());
+  }
+#endif
+
+  for (size_t i = 0; i < m_pendingHypos.size(); ++i) {
+    AddToStack(m_pendingHypos[i]);
+  }
+  m_pendingHypos.clear();
+}
+
 const std::vector < HypothesisStack* >& SearchNormal::GetHypothesisStacks() const
 {
   return m_hypoStackColl;
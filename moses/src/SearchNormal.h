@@ -26,10 +26,21 @@ protected:
   HypothesisStackNormal* actual_hypoStack; /**actual (full expanded) stack of hypotheses*/
   const TranslationOptionCollection &m_transOptColl; /**< pre-computed list of translation options for the phrases in this sentence */
 
+  /** with search-threads > 1, expansions are created in search order and
+   * collected here, scored in parallel, and then added to the stacks in the
+   * same order.  Hypothesis ids and stack contents are thus the same as with
+   * single-threaded search.
+   */
+  size_t m_searchThreads;
+  size_t m_sentenceSerial; /**< tells the search threads when to set up feature functions for this sentence */
+  std::vector<Hypothesis*> m_pendingHypos;
+
   // functions for creating hypotheses
   void ProcessOneHypothesis(const Hypothesis &hypothesis);
   void ExpandAllHypotheses(const Hypothesis &hypothesis, size_t startPos, size_t endPos);
   void ExpandHypothesis(const Hypothesis &hypothesis,const TranslationOption &transOpt, float expectedScore);
+  void AddToStack(Hypothesis *newHypo);
+  void ScorePendingHypotheses();
 
 public:
   SearchNormal(Manager& manager, const InputType &source, const TranslationOptionCollection &transOptColl);
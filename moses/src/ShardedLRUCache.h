@@ -0,0 +1,161 @@
+// $Id$
+
+/***********************************************************************
+Moses - factored phrase-based language decoder
+Copyright (C) 2012 University of Edinburgh
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+***********************************************************************/
+
+#ifndef moses_ShardedLRUCache_h
+#define moses_ShardedLRUCache_h
+
+#include <cstddef>
+#include <list>
+
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
+
+#ifdef WITH_THREADS
+#include <boost/thread/mutex.hpp>
+#endif
+
+#include "TypeDef.h"
+
+namespace Moses
+{
+
+//! every value costs the same, so the cache is bounded by its number of entries
+template <class Value>
+struct UnitCost {
+  size_t operator()(const Value &) const {
+    return 1;
+  }
+};
+
+/** Cache shared by decoding threads and kept across sentences.  It is split
+ * into shards with their own lock and LRU list, so threads looking up
+ * different keys rarely wait for each other.  Each shard evicts its least
+ * recently used values while their total cost, as given by the functor Cost,
+ * exceeds its part of the bound.  Values are copied out of the cache, so
+ * they are typically shared pointers: a thread keeps what it looked up even
+ * if it is evicted meanwhile.
+ */
+template <class Key, class Value, class Cost = UnitCost<Value> >
+class ShardedLRUCache
+{
+public:
+  //! maxCost is the total cost kept over all shards
+  explicit ShardedLRUCache(size_t maxCost)
+    :m_maxShardCost((maxCost + NumShards - 1) / NumShards) {
+  }
+
+  //! cached value for this key, or a default constructed one
+  Value Get(const Key &key) {
+    Shard &shard = GetShard(key);
+#ifdef WITH_THREADS
+    boost::mutex::scoped_lock lock(shard.m_mutex);
+#endif
+    typename IndexType::iterator iter = shard.m_index.find(key);
+    if (iter == shard.m_index.end()) {
+      ++shard.m_misses;
+      return Value();
+    }
+    ++shard.m_hits;
+    shard.m_lru.splice(shard.m_lru.begin(), shard.m_lru, iter->second);
+    return iter->second->m_value;
+  }
+
+  void Put(const Key &key, const Value &value) {
+    const size_t cost = Cost()(value);
+    Shard &shard = GetShard(key);
+#ifdef WITH_THREADS
+    boost::mutex::scoped_lock lock(shard.m_mutex);
+#endif
+    // another thread may have created the same value meanwhile, keep theirs
+    if (shard.m_index.find(key) != shard.m_index.end()) {
+      return;
+    }
+    shard.m_lru.push_front(Item(key, value, cost));
+    shard.m_index[key] = shard.m_lru.begin();
+    shard.m_cost += cost;
+    while (shard.m_cost > m_maxShardCost) {
+      const Item &last = shard.m_lru.back();
+      shard.m_cost -= last.m_cost;
+      shard.m_index.erase(last.m_key);
+      shard.m_lru.pop_back();
+    }
+  }
+
+  size_t GetHits() const {
+    return Sum(&Shard::m_hits);
+  }
+  size_t GetMisses() const {
+    return Sum(&Shard::m_misses);
+  }
+  //! total cost of the cached values
+  size_t GetCost() const {
+    return Sum(&Shard::m_cost);
+  }
+
+private:
+  struct Item {
+    Item(const Key &key, const Value &value, size_t cost)
+      :m_key(key), m_value(value), m_cost(cost) {}
+    Key m_key;
+    Value m_value;
+    size_t m_cost;
+  };
+  typedef std::list<Item> LRUList;
+  typedef boost::unordered_map<Key, typename LRUList::iterator> IndexType;
+
+  struct Shard {
+    Shard() : m_cost(0), m_hits(0), m_misses(0) {}
+
+    LRUList m_lru; //! most recently used first
+    IndexType m_index;
+    size_t m_cost, m_hits, m_misses;
+#ifdef WITH_THREADS
+    mutable boost::mutex m_mutex;
+#endif
+  };
+
+  static const size_t NumShards = 16;
+
+  Shard &GetShard(const Key &key) {
+    // hashes of integer keys such as file positions are the keys themselves
+    // and not uniformly distributed in their low bits
+    UINT64 hash = boost::hash<Key>()(key);
+    return m_shards[((hash * 0x9E3779B97F4A7C15ULL) >> 32) % NumShards];
+  }
+
+  size_t Sum(size_t Shard::*counter) const {
+    size_t sum = 0;
+    for (size_t i = 0; i < NumShards; ++i) {
+#ifdef WITH_THREADS
+      boost::mutex::scoped_lock lock(m_shards[i].m_mutex);
+#endif
+      sum += m_shards[i].*counter;
+    }
+    return sum;
+  }
+
+  Shard m_shards[NumShards];
+  size_t m_maxShardCost;
+};
+
+}
+
+#endif
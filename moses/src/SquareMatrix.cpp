@@ -32,30 +32,26 @@ namespace Moses
 {
 
 /**
- * Calculare future score estimate for a given coverage bitmap
+ * Calculare future score estimate for a given coverage bitmap.
+ * Gaps are found a block of the bitmap at a time, so the cost depends on
+ * the number of gaps rather than on the sentence length.
  *
  * /param bitmap coverage bitmap
  */
 
 float SquareMatrix::CalcFutureScore( WordsBitmap const &bitmap ) const
 {
-  const size_t notInGap= numeric_limits<size_t>::max();
-  size_t startGap = notInGap;
   float futureScore = 0.0f;
-  for(size_t currPos = 0 ; currPos < bitmap.GetSize() ; currPos++) {
-    // start of a new gap?
-    if(bitmap.GetValue(currPos) == false && startGap == notInGap) {
-      startGap = currPos;
-    }
-    // end of a gap?
-    else if(bitmap.GetValue(currPos) == true && startGap != notInGap) {
-      futureScore += GetScore(startGap, currPos - 1);
-      startGap = notInGap;
+  size_t startGap = bitmap.GetFirstGapPos();
+  while (startGap != NOT_FOUND) {
+    size_t endGap = bitmap.FindFirstFrom(startGap, true);
+    if (endGap == NOT_FOUND) {
+      // coverage ending with gap
+      futureScore += GetScore(startGap, bitmap.GetSize() - 1);
+      break;
     }
-  }
-  // coverage ending with gap?
-  if (startGap != notInGap) {
-    futureScore += GetScore(startGap, bitmap.GetSize() - 1);
+    futureScore += GetScore(startGap, endGap - 1);
+    startGap = bitmap.FindFirstFrom(endGap, false);
   }
 
   return futureScore;
@@ -67,10 +63,6 @@ float SquareMatrix::CalcFutureScore( WordsBitmap const &bitmap ) const
  * to compute future score estimates for hypotheses that we may want
  * build, but first want to check.
  *
- * Note: this function is implemented a bit more complex than
- * the basic one (w/o additional phrase) for speed reasons,
- * which is probably overkill.
- *
  * /param bitmap coverage bitmap
  * /param startPos start of the span that is added to the coverage
  * /param endPos end of the span that is added to the coverage
@@ -78,38 +70,9 @@ float SquareMatrix::CalcFutureScore( WordsBitmap const &bitmap ) const
 
 float SquareMatrix::CalcFutureScore( WordsBitmap const &bitmap, size_t startPos, size_t endPos ) const
 {
-  const size_t notInGap= numeric_limits<size_t>::max();
-  float futureScore = 0.0f;
-  size_t startGap = bitmap.GetFirstGapPos();
-  if (startGap == NOT_FOUND) return futureScore; // everything filled
-
-  // start loop at first gap
-  size_t startLoop = startGap+1;
-  if (startPos == startGap) { // unless covered by phrase
-    startGap = notInGap;
-    startLoop = endPos+1; // -> postpone start
-  }
-
-  size_t lastCovered = bitmap.GetLastPos();
-  if (endPos > lastCovered || lastCovered == NOT_FOUND) lastCovered = endPos;
-
-  for(size_t currPos = startLoop; currPos <= lastCovered ; currPos++) {
-    // start of a new gap?
-    if(startGap == notInGap && bitmap.GetValue(currPos) == false && (currPos < startPos || currPos > endPos)) {
-      startGap = currPos;
-    }
-    // end of a gap?
-    else if(startGap != notInGap && (bitmap.GetValue(currPos) == true || (startPos <= currPos && currPos <= endPos))) {
-      futureScore += GetScore(startGap, currPos - 1);
-      startGap = notInGap;
-    }
-  }
-  // coverage ending with gap?
-  if (lastCovered != bitmap.GetSize() - 1) {
-    futureScore += GetScore(lastCovered+1, bitmap.GetSize() - 1);
-  }
-
-  return futureScore;
+  WordsBitmap covered(bitmap);
+  covered.SetValue(startPos, endPos, true);
+  return CalcFutureScore(covered);
 }
 
 TO_STRING_BODY(SquareMatrix);
@@ -40,6 +40,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include "TranslationOption.h"
 #include "DecodeGraph.h"
 #include "InputFileStream.h"
+#include "ChartClauseCache.h"
+#include "ModelSnapshot.h"
+#include "LM/Ken.h"
 
 #ifdef HAVE_SYNLM
 #include "SyntacticLanguageModel.h"
@@ -47,6 +50,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 
 #ifdef WITH_THREADS
 #include <boost/thread.hpp>
+#include <boost/thread/once.hpp>
+#include "ThreadPool.h"
 #endif
 
 using namespace std;
@@ -83,7 +88,12 @@ StaticData::StaticData()
   ,m_onlyDistinctNBest(false)
   ,m_factorDelimiter("|") // default delimiter between factors
   ,m_lmEnableOOVFeature(false)
+  ,m_lmCacheSize(DEFAULT_LM_CACHE_SIZE)
+  ,m_ttableCacheSize(DEFAULT_TTABLE_CACHE_SIZE)
+  ,m_onDiskCacheSize(DEFAULT_ONDISK_CACHE_SIZE)
   ,m_isAlwaysCreateDirectTranslationOption(false)
+  ,m_clauseCache(NULL)
+  ,m_modelSnapshot(NULL)
 {
   m_maxFactorIdx[0] = 0;  // source side
   m_maxFactorIdx[1] = 0;  // target side
@@ -407,6 +417,12 @@ bool StaticData::LoadData(Parameter *parameter)
 
   m_lmcache_cleanup_threshold = (m_parameter->GetParam("clean-lm-cache").size() > 0) ?
                                 Scan<size_t>(m_parameter->GetParam("clean-lm-cache")[0]) : 1;
+  m_lmCacheSize = (m_parameter->GetParam("lmodel-cache-size").size() > 0) ?
+                  Scan<size_t>(m_parameter->GetParam("lmodel-cache-size")[0]) : DEFAULT_LM_CACHE_SIZE;
+  m_ttableCacheSize = (m_parameter->GetParam("ttable-cache-size").size() > 0) ?
+                      Scan<size_t>(m_parameter->GetParam("ttable-cache-size")[0]) : DEFAULT_TTABLE_CACHE_SIZE;
+  m_onDiskCacheSize = (m_parameter->GetParam("ondisk-cache-size").size() > 0) ?
+                      Scan<size_t>(m_parameter->GetParam("ondisk-cache-size")[0]) : DEFAULT_ONDISK_CACHE_SIZE;
 
   m_threadCount = 1;
   const std::vector<std::string> &threadInfo = m_parameter->GetParam("threads");
@@ -437,6 +453,19 @@ bool StaticData::LoadData(Parameter *parameter)
     }
   }
 
+  m_searchThreadCount = (m_parameter->GetParam("search-threads").size() > 0) ?
+                        Scan<size_t>(m_parameter->GetParam("search-threads")[0]) : 1;
+  if (m_searchThreadCount < 1) {
+    UserMessage::Add("Specify at least one search thread.");
+    return false;
+  }
+#ifndef WITH_THREADS
+  if (m_searchThreadCount > 1) {
+    UserMessage::Add("Error: search-threads set but moses not built with thread support");
+    return false;
+  }
+#endif
+
   m_startTranslationId = (m_parameter->GetParam("start-translation-id").size() > 0) ?
           Scan<long>(m_parameter->GetParam("start-translation-id")[0]) : 0;
 
@@ -502,6 +531,13 @@ bool StaticData::LoadData(Parameter *parameter)
 	}
 #endif
 
+  if (m_parameter->GetParam("snapshot-dir").size() > 0) {
+    m_modelSnapshot = new ModelSnapshot(m_parameter->GetParam("snapshot-dir")[0], *m_parameter);
+    VERBOSE(1, (m_modelSnapshot->IsValid() ? "Loading models from snapshot " : "Creating model snapshot ")
+            << m_parameter->GetParam("snapshot-dir")[0] << endl);
+    if (!m_modelSnapshot->IsValid() && !m_modelSnapshot->CreateDirectory()) return false;
+  }
+
   if (!LoadLexicalReorderingModel()) return false;
   if (!LoadLanguageModels()) return false;
   if (!LoadGenerationTables()) return false;
@@ -600,6 +636,10 @@ bool StaticData::LoadData(Parameter *parameter)
 
   m_scoreIndexManager.InitFeatureNames();
 
+  if (m_modelSnapshot != NULL && !m_modelSnapshot->IsValid()) {
+    if (!m_modelSnapshot->Save()) return false;
+  }
+
   return true;
 }
 
@@ -641,6 +681,8 @@ StaticData::~StaticData()
 
   // delete trans opt
   ClearTransOptionCache();
+  delete m_clauseCache;
+  delete m_modelSnapshot;
 
   // small score producers
   delete m_unknownWordPenaltyProducer;
@@ -858,6 +900,17 @@ bool StaticData::LoadLanguageModels()
             return false;
           }
         }
+        // map a binary image from the snapshot instead of parsing ARPA, or
+        // write one while parsing for the next run
+        string kenImageFile;
+        if (m_modelSnapshot != NULL && (lmImplementation == Ken || lmImplementation == LazyKen)) {
+          if (m_modelSnapshot->IsValid()) {
+            languageModelFile = m_modelSnapshot->GetLanguageModelFile(languageModelFile);
+          } else if (!IsKenLMBinary(languageModelFile)) {
+            kenImageFile = m_modelSnapshot->AddLanguageModelImage(languageModelFile);
+          }
+        }
+
         IFVERBOSE(1)
         PrintUserTime(string("Start loading LanguageModel ") + languageModelFile);
 
@@ -867,7 +920,8 @@ bool StaticData::LoadLanguageModels()
                , nGramOrder
                , languageModelFile
                , m_scoreIndexManager
-               , LMdub[i]);
+               , LMdub[i]
+               , kenImageFile);
         if (lm == NULL) {
           UserMessage::Add("no LM created. We probably don't have it compiled");
           return false;
@@ -1062,6 +1116,9 @@ bool StaticData::LoadPhraseTables()
       if (implementation == SuffixArray) {
         targetPath		= token[5];
         alignmentsFile= token[6];
+        // sentence pairs may be added to the table while decoding, which the
+        // persistent cache would not see. The table caches its phrases itself
+        m_useTransOptCache = false;
       }
 
       CHECK(numScoreComponent==weight.size());
@@ -1154,6 +1211,15 @@ void StaticData::LoadChartDecodingParameters()
 
   m_ruleLimit = (m_parameter->GetParam("rule-limit").size() > 0)
                 ? Scan<size_t>(m_parameter->GetParam("rule-limit")[0]) : DEFAULT_MAX_TRANS_OPT_SIZE;
+
+  // clause sub-chart cache
+  bool useClauseCache;
+  SetBooleanParameter( &useClauseCache, "use-clause-cache", false );
+  if (useClauseCache) {
+    size_t clauseCacheSize = (m_parameter->GetParam("clause-cache-size").size() > 0)
+                             ? Scan<size_t>(m_parameter->GetParam("clause-cache-size")[0]) : DEFAULT_MAX_CLAUSE_CACHE_SIZE;
+    m_clauseCache = new ChartClauseCache(clauseCacheSize);
+  }
 }
 
 void StaticData::LoadPhraseBasedParameters()
@@ -1344,6 +1410,25 @@ void StaticData::ClearTransOptionCache() const {
   }
 }
 
+#ifdef WITH_THREADS
+namespace
+{
+ThreadPool *searchThreadPool = NULL;
+boost::once_flag searchThreadPoolOnce = BOOST_ONCE_INIT;
+
+void CreateSearchThreadPool()
+{
+  searchThreadPool = new ThreadPool(StaticData::Instance().GetSearchThreadCount());
+}
+}
+
+ThreadPool &GetSearchThreadPool()
+{
+  boost::call_once(searchThreadPoolOnce, &CreateSearchThreadPool);
+  return *searchThreadPool;
+}
+#endif
+
 }
 
 
@@ -58,6 +58,11 @@ class GenerationDictionary;
 class DistortionScoreProducer;
 class DecodeStep;
 class UnknownWordPenaltyProducer;
+class ChartClauseCache;
+class ModelSnapshot;
+#ifdef WITH_THREADS
+class ThreadPool;
+#endif
 #ifdef HAVE_SYNLM
 class SyntacticLanguageModel;
 #endif
@@ -170,6 +175,9 @@ protected:
 
   size_t m_lmcache_cleanup_threshold; //! number of translations after which LM claenup is performed (0=never, N=after N translations; default is 1)
   bool m_lmEnableOOVFeature;
+  size_t m_lmCacheSize; //! slots in the per-thread LM query cache, 0 = no cache
+  size_t m_ttableCacheSize; //! source phrases in the shared binary phrase table cache, 0 = no cache
+  size_t m_onDiskCacheSize; //! megabytes in the shared on-disk rule table cache, 0 = no cache
 
   bool m_timeout; //! use timeout
   size_t m_timeout_threshold; //! seconds after which time out is activated
@@ -197,6 +205,8 @@ protected:
   size_t m_cubePruningDiversity;
   bool m_cubePruningLazyScoring;
   size_t m_ruleLimit;
+  ChartClauseCache *m_clauseCache; //! clause sub-chart cache, NULL if not used
+  ModelSnapshot *m_modelSnapshot; //! images of the loaded models, NULL if not used
 
 
   // Initial = 0 = can be used when creating poss trans
@@ -207,6 +217,7 @@ protected:
   WordAlignmentSort m_wordAlignmentSort;
 
   int m_threadCount;
+  size_t m_searchThreadCount; //! threads scoring hypothesis expansions within one sentence
   long m_startTranslationId;
   
   StaticData();
@@ -538,6 +549,18 @@ public:
     return m_lmEnableOOVFeature;
   }
 
+  size_t GetLMCacheSize() const {
+    return m_lmCacheSize;
+  }
+
+  size_t GetTTableCacheSize() const {
+    return m_ttableCacheSize;
+  }
+
+  size_t GetOnDiskCacheSize() const {
+    return m_onDiskCacheSize;
+  }
+
   bool GetOutputSearchGraph() const {
     return m_outputSearchGraph;
   }
@@ -600,6 +623,9 @@ public:
   size_t GetRuleLimit() const {
     return m_ruleLimit;
   }
+  ChartClauseCache *GetClauseCache() const {
+    return m_clauseCache;
+  }
   float GetRuleCountThreshold() const {
     return 999999; /* TODO wtf! */
   }
@@ -615,10 +641,22 @@ public:
   int ThreadCount() const {
     return m_threadCount;
   }
+  size_t GetSearchThreadCount() const {
+    return m_searchThreadCount;
+  }
   
   long GetStartTranslationId() const
   { return m_startTranslationId; }
 };
 
+#ifdef WITH_THREADS
+/**
+ * The pool of search-threads threads that the parallel parts of translating
+ * one sentence run on.  One pool serves all sentences, so that per-thread
+ * caches of the feature functions are kept from one sentence to the next.
+ **/
+ThreadPool &GetSearchThreadPool();
+#endif
+
 }
 #endif
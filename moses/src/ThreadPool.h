@@ -102,6 +102,32 @@ private:
   size_t m_queueLimit;
 };
 
+/** Lets a thread wait until all tasks it submitted have finished */
+class TaskLatch
+{
+public:
+  explicit TaskLatch(size_t count) : m_count(count) {}
+
+  void Done() {
+    boost::mutex::scoped_lock lock(m_mutex);
+    if (--m_count == 0) {
+      m_finished.notify_all();
+    }
+  }
+
+  void Wait() {
+    boost::mutex::scoped_lock lock(m_mutex);
+    while (m_count > 0) {
+      m_finished.wait(lock);
+    }
+  }
+
+private:
+  size_t m_count;
+  boost::mutex m_mutex;
+  boost::condition_variable m_finished;
+};
+
 class TestTask : public Task
 {
 public:
@@ -300,24 +300,33 @@ void TranslationOptionCollection::CalcFutureScore()
   // now fill all the cells in the strictly upper triangle
   //   there is no way to modify the diagonal now, in the case
   //   where no translation option covers a single-word span,
-  //   we leave the +inf in the matrix
+  //   we leave the -inf in the matrix
   // like in chart parsing we want each cell to contain the highest score
-  // of the full-span trOpt or the sum of scores of joining two smaller spans
+  // of the full-span trOpt or the sum of scores of joining two smaller spans.
+  // byStart[startPos*size + joinAt] and byEnd[endPos*size + joinAt+1] hold the
+  // scores of the two parts, so the loop over joinAt reads both sequentially
+  // and can be vectorized
+
+  vector<float> byStart(size * size), byEnd(size * size);
+  for(size_t startPos = 0; startPos < size; startPos++) {
+    for(size_t endPos = startPos; endPos < size; endPos++) {
+      byStart[startPos * size + endPos] = byEnd[endPos * size + startPos] = m_futureScore.GetScore(startPos, endPos);
+    }
+  }
 
   for(size_t colstart = 1; colstart < size ; colstart++) {
     for(size_t diagshift = 0; diagshift < size-colstart ; diagshift++) {
       size_t startPos = diagshift;
       size_t endPos = colstart+diagshift;
+      const float *left = &byStart[startPos * size];
+      const float *right = &byEnd[endPos * size + 1];
+      float bestScore = left[endPos];
       for(size_t joinAt = startPos; joinAt < endPos ; joinAt++)  {
-        float joinedScore = m_futureScore.GetScore(startPos, joinAt)
-                            + m_futureScore.GetScore(joinAt+1, endPos);
-        /* // uncomment to see the cell filling scheme
-        TRACE_ERR( "[" <<startPos<<","<<endPos<<"] <-? ["<<startPos<<","<<joinAt<<"]+["<<joinAt+1<<","<<endPos
-          << "] (colstart: "<<colstart<<", diagshift: "<<diagshift<<")"<<endl);
-        */
-        if (joinedScore > m_futureScore.GetScore(startPos, endPos))
-          m_futureScore.SetScore(startPos, endPos, joinedScore);
+        float joinedScore = left[joinAt] + right[joinAt];
+        bestScore = (joinedScore > bestScore) ? joinedScore : bestScore;
       }
+      byStart[startPos * size + endPos] = byEnd[endPos * size + startPos] = bestScore;
+      m_futureScore.SetScore(startPos, endPos, bestScore);
     }
   }
 
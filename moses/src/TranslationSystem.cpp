@@ -124,6 +124,12 @@ void TranslationSystem::InitializeBeforeSentenceProcessing(const InputType& sour
   for(size_t i=0; i<m_reorderingTables.size(); ++i) {
     m_reorderingTables[i]->InitializeForInput(source);
   }
+
+  InitializeThreadBeforeSentenceProcessing(source);
+}
+
+void TranslationSystem::InitializeThreadBeforeSentenceProcessing(const InputType& source) const
+{
   for(size_t i=0; i<m_globalLexicalModels.size(); ++i) {
     m_globalLexicalModels[i]->InitializeForInput((Sentence const&)source);
   }
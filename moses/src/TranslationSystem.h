@@ -114,6 +114,9 @@ public:
 
   //sentence (and thread) specific initialisationn and cleanup
   void InitializeBeforeSentenceProcessing(const InputType& source) const;
+  //! the part of the above that sets up thread-local state, for threads
+  //! that score hypotheses of a sentence decoded on another thread
+  void InitializeThreadBeforeSentenceProcessing(const InputType& source) const;
   void CleanUpAfterSentenceProcessing() const;
 
 
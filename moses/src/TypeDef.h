@@ -55,6 +55,10 @@ const size_t DEFAULT_CUBE_PRUNING_POP_LIMIT = 1000;
 const size_t DEFAULT_CUBE_PRUNING_DIVERSITY = 0;
 const size_t DEFAULT_MAX_HYPOSTACK_SIZE = 200;
 const size_t DEFAULT_MAX_TRANS_OPT_CACHE_SIZE = 10000;
+const size_t DEFAULT_MAX_CLAUSE_CACHE_SIZE = 1000;
+const size_t DEFAULT_LM_CACHE_SIZE = 65536;
+const size_t DEFAULT_TTABLE_CACHE_SIZE = 100000;
+const size_t DEFAULT_ONDISK_CACHE_SIZE = 256;
 const size_t DEFAULT_MAX_TRANS_OPT_SIZE	= 5000;
 const size_t DEFAULT_MAX_PART_TRANS_OPT_SIZE = 10000;
 //MSPnew : max phrase length equal to max span
@@ -138,6 +142,7 @@ enum PhraseTableImplementation {
   ,ALSuffixArray = 10
   //MSPnew : phrase table implementation for large spans (to be found in PhraseDictionarySCFG_LargeSpan)
   ,SCFG_MIN_SPAN = 11
+  ,Compact = 12
 
 };
 
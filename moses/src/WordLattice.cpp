@@ -4,9 +4,19 @@
 #include "Util.h"
 #include "FloydWarshall.h"
 
+#include <algorithm>
+#include <climits>
+
 namespace Moses
 {
-WordLattice::WordLattice() {}
+
+namespace
+{
+//! distance of nodes without a path between them, as in floyd_warshall()
+const int MAX_DIST = INT_MAX / 2;
+}
+
+WordLattice::WordLattice() : num_nodes(0), reachable_words(0) {}
 
 size_t WordLattice::GetColumnIncrement(size_t i, size_t j) const
 {
@@ -89,15 +99,13 @@ int WordLattice::InitializeFromPCNDataType(const PCN::CN& cn, const std::vector<
     }
   }
   if (!cn.empty()) {
-    std::vector<std::vector<bool> > edges(0);
-    this->GetAsEdgeMatrix(edges);
-    floyd_warshall(edges,distances);
+    ComputeDistances();
 
     IFVERBOSE(2) {
       TRACE_ERR("Shortest paths:\n");
-      for (size_t i=0; i<edges.size(); ++i) {
-        for (size_t j=0; j<edges.size(); ++j) {
-          int d = distances[i][j];
+      for (size_t i=0; i<num_nodes; ++i) {
+        for (size_t j=0; j<num_nodes; ++j) {
+          int d = GetDistance(i,j);
           if (d > 99999) {
             d=-1;
           }
@@ -134,6 +142,59 @@ void WordLattice::GetAsEdgeMatrix(std::vector<std::vector<bool> >& edges) const
   }
 }
 
+void WordLattice::ComputeDistances()
+{
+  num_nodes = data.size() + 1;
+  reachable_words = (num_nodes + 63) / 64;
+  reachable.assign(num_nodes * reachable_words, 0);
+
+  bool forward = true;
+  for (size_t i=0; i<next_nodes.size() && forward; ++i) {
+    for (size_t j=0; j<next_nodes[i].size(); ++j) {
+      forward = forward && next_nodes[i][j] > 0;
+    }
+  }
+
+  if (!forward) {
+    std::vector<std::vector<bool> > edges(0);
+    this->GetAsEdgeMatrix(edges);
+    std::vector<std::vector<int> > dist;
+    floyd_warshall(edges,dist);
+    distances.resize(num_nodes * num_nodes);
+    for (size_t i=0; i<num_nodes; ++i) {
+      std::copy(dist[i].begin(), dist[i].end(), distances.begin() + i * num_nodes);
+      for (size_t j=0; j<num_nodes; ++j) {
+        if (dist[i][j] < MAX_DIST) {
+          reachable[i * reachable_words + j / 64] |= (uint64_t) 1 << (j % 64);
+        }
+      }
+    }
+    return;
+  }
+
+  // nodes only reach nodes after them, so the successors of a node are
+  // complete when it is visited.  A node doesn't reach itself
+  distances.assign(num_nodes * num_nodes, MAX_DIST);
+  for (size_t i=data.size(); i-- > 0; ) {
+    uint64_t *reach = &reachable[i * reachable_words];
+    int *dist = &distances[i * num_nodes];
+    for (size_t j=0; j<next_nodes[i].size(); ++j) {
+      const size_t next = i + next_nodes[i][j];
+      const uint64_t *nextReach = &reachable[next * reachable_words];
+      const int *nextDist = &distances[next * num_nodes];
+      reach[next / 64] |= (uint64_t) 1 << (next % 64);
+      dist[next] = 1;
+      for (size_t w=0; w<reachable_words; ++w) {
+        reach[w] |= nextReach[w];
+        for (uint64_t bits = nextReach[w]; bits; bits &= bits - 1) {
+          const size_t k = w * 64 + __builtin_ctzll(bits);
+          dist[k] = std::min(dist[k], nextDist[k] + 1);
+        }
+      }
+    }
+  }
+}
+
 int WordLattice::ComputeDistortionDistance(const WordsRange& prev, const WordsRange& current) const
 {
   int result;
@@ -147,7 +208,7 @@ int WordLattice::ComputeDistortionDistance(const WordsRange& prev, const WordsRa
 
     VERBOSE(4, "Word lattice distortion: monotonic step from " << prev.GetEndPos() << " to " << current.GetStartPos() << "\n");
   } else if (prev.GetStartPos() == NOT_FOUND) {
-    result = distances[0][current.GetStartPos()];
+    result = GetDistance(0, current.GetStartPos());
 
     VERBOSE(4, "Word lattice distortion: initial step from 0 to " << current.GetStartPos() << " of length " << result << "\n");
     if (result < 0 || result > 99999) {
@@ -155,7 +216,7 @@ int WordLattice::ComputeDistortionDistance(const WordsRange& prev, const WordsRa
       TRACE_ERR("A: got a weird distance from 0 to " << (current.GetStartPos()+1) << " of " << result << "\n");
     }
   } else if (prev.GetEndPos() > current.GetStartPos()) {
-    result = distances[current.GetStartPos()][prev.GetEndPos() + 1];
+    result = GetDistance(current.GetStartPos(), prev.GetEndPos() + 1);
 
     VERBOSE(4, "Word lattice distortion: backward step from " << (prev.GetEndPos()+1) << " to " << current.GetStartPos() << " of length " << result << "\n");
     if (result < 0 || result > 99999) {
@@ -163,7 +224,7 @@ int WordLattice::ComputeDistortionDistance(const WordsRange& prev, const WordsRa
       TRACE_ERR("B: got a weird distance from "<< current.GetStartPos() << " to " << prev.GetEndPos()+1 << " of " << result << "\n");
     }
   } else {
-    result = distances[prev.GetEndPos() + 1][current.GetStartPos()];
+    result = GetDistance(prev.GetEndPos() + 1, current.GetStartPos());
 
     VERBOSE(4, "Word lattice distortion: forward step from " << (prev.GetEndPos()+1) << " to " << current.GetStartPos() << " of length " << result << "\n");
     if (result < 0 || result > 99999) {
@@ -177,8 +238,7 @@ int WordLattice::ComputeDistortionDistance(const WordsRange& prev, const WordsRa
 
 bool WordLattice::CanIGetFromAToB(size_t start, size_t end) const
 {
-  //  std::cerr << "CanIgetFromAToB(" << start << "," << end << ")=" << distances[start][end] << std::endl;
-  return distances[start][end] < 100000;
+  return (reachable[start * reachable_words + end / 64] >> (end % 64)) & 1;
 }
 
 
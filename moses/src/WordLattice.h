@@ -2,6 +2,7 @@
 #define moses_WordLattice_h
 
 #include <vector>
+#include <stdint.h>
 #include "ConfusionNet.h"
 #include "PCNTools.h"
 
@@ -13,7 +14,20 @@ class WordLattice: public ConfusionNet
 {
 private:
   std::vector<std::vector<size_t> > next_nodes;
-  std::vector<std::vector<int> > distances;
+  size_t num_nodes;
+  std::vector<int> distances; //! shortest path lengths, num_nodes x num_nodes
+  std::vector<uint64_t> reachable; //! bitset per node of the nodes it can reach
+  size_t reachable_words; //! 64 bit words per bitset
+
+  /** All-pairs distances and reachability.  Lattices whose edges all go
+   * forward are walked in reverse topological order, merging the bitsets
+   * of the successors; others fall back to Floyd-Warshall.
+   */
+  void ComputeDistances();
+
+  int GetDistance(size_t from, size_t to) const {
+    return distances[from * num_nodes + to];
+  }
 
 public:
   WordLattice();
@@ -22,12 +22,14 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #ifndef moses_WordsBitmap_h
 #define moses_WordsBitmap_h
 
+#include <algorithm>
 #include <limits>
 #include <vector>
 #include <iostream>
 #include <cstring>
 #include <cmath>
 #include <cstdlib>
+#include <stdint.h>
 #include "TypeDef.h"
 #include "WordsRange.h"
 
@@ -35,115 +37,218 @@ namespace Moses
 {
 typedef unsigned long WordsBitmapID;
 
-/** vector of boolean used to represent whether a word has been translated or not
-*/
+/** vector of boolean used to represent whether a word has been translated or not.
+ * Bits are packed into 64 bit blocks which are kept inside the object for
+ * sentences of up to 256 words, so hypotheses don't allocate their coverage,
+ * and most operations work on a whole block at a time.
+ */
 class WordsBitmap
 {
   friend std::ostream& operator<<(std::ostream& out, const WordsBitmap& wordsBitmap);
 protected:
+  typedef uint64_t Block;
+  static const size_t BITS_PER_BLOCK = 64;
+  static const size_t INLINE_BLOCKS = 4;
+
   const size_t m_size; /**< number of words in sentence */
-  bool	*m_bitmap;	/**< ticks of words that have been done */
+  Block *m_blocks; /**< ticks of words that have been done. Points to m_inline unless the sentence is long */
+  Block m_inline[INLINE_BLOCKS];
 
   WordsBitmap(); // not implemented
+  WordsBitmap &operator=(const WordsBitmap &); // not implemented
+
+  size_t GetNumBlocks() const {
+    return (m_size + BITS_PER_BLOCK - 1) / BITS_PER_BLOCK;
+  }
+
+  void Allocate() {
+    m_blocks = (GetNumBlocks() <= INLINE_BLOCKS) ? m_inline : (Block*) malloc(sizeof(Block) * GetNumBlocks());
+  }
+
+  //! bits of block that correspond to words of the sentence
+  Block GetValidMask(size_t block) const {
+    size_t bits = m_size - block * BITS_PER_BLOCK;
+    return (bits >= BITS_PER_BLOCK) ? ~Block(0) : ((Block(1) << bits) - 1);
+  }
+
+  //! bits from startPos to endPos (inclusive) that fall into block
+  static Block GetRangeMask(size_t block, size_t startPos, size_t endPos) {
+    size_t first = block * BITS_PER_BLOCK;
+    size_t from = (startPos > first) ? startPos - first : 0;
+    size_t to = endPos - first;
+    Block upper = (to >= BITS_PER_BLOCK - 1) ? ~Block(0) : ((Block(1) << (to + 1)) - 1);
+    return upper & (~Block(0) << from);
+  }
+
+  static size_t CountBits(Block block) {
+#ifdef __GNUC__
+    return __builtin_popcountll(block);
+#else
+    size_t count = 0;
+    for (; block; block &= block - 1) ++count;
+    return count;
+#endif
+  }
+
+  //! index of lowest set bit.  block must not be 0
+  static size_t LowestBit(Block block) {
+#ifdef __GNUC__
+    return __builtin_ctzll(block);
+#else
+    size_t pos = 0;
+    for (; !(block & 1); block >>= 1) ++pos;
+    return pos;
+#endif
+  }
+
+  //! index of highest set bit.  block must not be 0
+  static size_t HighestBit(Block block) {
+#ifdef __GNUC__
+    return BITS_PER_BLOCK - 1 - __builtin_clzll(block);
+#else
+    size_t pos = 0;
+    for (; block >>= 1; ) ++pos;
+    return pos;
+#endif
+  }
+
+  //! count (at most 64) bits starting at startPos, startPos in lowest bit
+  Block GetBits(size_t startPos, size_t count) const {
+    if (count == 0) return 0;
+    size_t block = startPos / BITS_PER_BLOCK, offset = startPos % BITS_PER_BLOCK;
+    Block bits = m_blocks[block] >> offset;
+    if (offset && offset + count > BITS_PER_BLOCK && block + 1 < GetNumBlocks()) {
+      bits |= m_blocks[block + 1] << (BITS_PER_BLOCK - offset);
+    }
+    return (count >= BITS_PER_BLOCK) ? bits : (bits & ((Block(1) << count) - 1));
+  }
 
   //! set all elements to false
   void Initialize() {
-    for (size_t pos = 0 ; pos < m_size ; pos++) {
-      m_bitmap[pos] = false;
-    }
+    std::memset(m_blocks, 0, sizeof(Block) * GetNumBlocks());
   }
 
   //sets elements by vector
-  void Initialize(std::vector<bool> vector) {
+  void Initialize(const std::vector<bool> &vector) {
+    Initialize();
     size_t vector_size = vector.size();
-    for (size_t pos = 0 ; pos < m_size ; pos++) {
-      if (pos < vector_size && vector[pos] == true) m_bitmap[pos] = true;
-      else m_bitmap[pos] = false;
+    for (size_t pos = 0 ; pos < m_size && pos < vector_size ; pos++) {
+      if (vector[pos]) SetValue(pos, true);
     }
   }
 
 
 public:
   //! create WordsBitmap of length size and initialise with vector
-  WordsBitmap(size_t size, std::vector<bool> initialize_vector)
+  WordsBitmap(size_t size, const std::vector<bool> &initialize_vector)
     :m_size	(size) {
-    m_bitmap = (bool*) malloc(sizeof(bool) * size);
+    Allocate();
     Initialize(initialize_vector);
   }
   //! create WordsBitmap of length size and initialise
   WordsBitmap(size_t size)
     :m_size	(size) {
-    m_bitmap = (bool*) malloc(sizeof(bool) * size);
+    Allocate();
     Initialize();
   }
   //! deep copy
   WordsBitmap(const WordsBitmap &copy)
     :m_size	(copy.m_size) {
-    m_bitmap = (bool*) malloc(sizeof(bool) * m_size);
-    for (size_t pos = 0 ; pos < copy.m_size ; pos++) {
-      m_bitmap[pos] = copy.GetValue(pos);
-    }
+    Allocate();
+    std::memcpy(m_blocks, copy.m_blocks, sizeof(Block) * GetNumBlocks());
   }
   ~WordsBitmap() {
-    free(m_bitmap);
+    if (m_blocks != m_inline) free(m_blocks);
+  }
+
+  //! highest position before pos that is set (value) or not (!value), or NOT_FOUND
+  size_t FindLastBefore(size_t pos, bool value) const {
+    for (size_t block = (pos + BITS_PER_BLOCK - 1) / BITS_PER_BLOCK; block > 0; --block) {
+      Block bits = (value ? m_blocks[block - 1] : ~m_blocks[block - 1]) & GetValidMask(block - 1);
+      size_t first = (block - 1) * BITS_PER_BLOCK;
+      if (pos - first < BITS_PER_BLOCK) {
+        bits &= (Block(1) << (pos - first)) - 1;
+      }
+      if (bits) {
+        return first + HighestBit(bits);
+      }
+    }
+    return NOT_FOUND;
+  }
+
+  //! lowest position from pos on that is set (value) or not (!value), or NOT_FOUND
+  size_t FindFirstFrom(size_t pos, bool value) const {
+    for (size_t block = pos / BITS_PER_BLOCK; block < GetNumBlocks(); ++block) {
+      Block bits = (value ? m_blocks[block] : ~m_blocks[block]) & GetValidMask(block);
+      size_t first = block * BITS_PER_BLOCK;
+      if (pos > first) {
+        bits &= ~Block(0) << (pos - first);
+      }
+      if (bits) {
+        return first + LowestBit(bits);
+      }
+    }
+    return NOT_FOUND;
   }
+
   //! count of words translated
   size_t GetNumWordsCovered() const {
     size_t count = 0;
-    for (size_t pos = 0 ; pos < m_size ; pos++) {
-      if (m_bitmap[pos])
-        count++;
+    for (size_t block = 0 ; block < GetNumBlocks() ; block++) {
+      count += CountBits(m_blocks[block]);
+    }
+    return count;
+  }
+
+  //! count of words translated within range
+  size_t GetNumWordsCovered(const WordsRange &range) const {
+    const size_t startPos = range.GetStartPos(), endPos = range.GetEndPos();
+    size_t count = 0;
+    for (size_t block = startPos / BITS_PER_BLOCK; block <= endPos / BITS_PER_BLOCK; block++) {
+      count += CountBits(m_blocks[block] & GetRangeMask(block, startPos, endPos));
     }
     return count;
   }
 
   //! position of 1st word not yet translated, or NOT_FOUND if everything already translated
   size_t GetFirstGapPos() const {
-    for (size_t pos = 0 ; pos < m_size ; pos++) {
-      if (!m_bitmap[pos]) {
-        return pos;
-      }
-    }
-    // no starting pos
-    return NOT_FOUND;
+    return FindFirstFrom(0, false);
   }
 
 
   //! position of last word not yet translated, or NOT_FOUND if everything already translated
   size_t GetLastGapPos() const {
-    for (int pos = (int) m_size - 1 ; pos >= 0 ; pos--) {
-      if (!m_bitmap[pos]) {
-        return pos;
-      }
-    }
-    // no starting pos
-    return NOT_FOUND;
+    return FindLastBefore(m_size, false);
   }
 
 
   //! position of last translated word
   size_t GetLastPos() const {
-    for (int pos = (int) m_size - 1 ; pos >= 0 ; pos--) {
-      if (m_bitmap[pos]) {
-        return pos;
-      }
-    }
-    // no starting pos
-    return NOT_FOUND;
+    return FindLastBefore(m_size, true);
   }
 
   //! whether a word has been translated at a particular position
   bool GetValue(size_t pos) const {
-    return m_bitmap[pos];
+    return (m_blocks[pos / BITS_PER_BLOCK] >> (pos % BITS_PER_BLOCK)) & 1;
   }
   //! set value at a particular position
   void SetValue( size_t pos, bool value ) {
-    m_bitmap[pos] = value;
+    Block bit = Block(1) << (pos % BITS_PER_BLOCK);
+    if (value) {
+      m_blocks[pos / BITS_PER_BLOCK] |= bit;
+    } else {
+      m_blocks[pos / BITS_PER_BLOCK] &= ~bit;
+    }
   }
   //! set value between 2 positions, inclusive
   void SetValue( size_t startPos, size_t endPos, bool value ) {
-    for(size_t pos = startPos ; pos <= endPos ; pos++) {
-      m_bitmap[pos] = value;
+    for (size_t block = startPos / BITS_PER_BLOCK; block <= endPos / BITS_PER_BLOCK; block++) {
+      Block mask = GetRangeMask(block, startPos, endPos);
+      if (value) {
+        m_blocks[block] |= mask;
+      } else {
+        m_blocks[block] &= ~mask;
+      }
     }
   }
   //! whether every word has been translated
@@ -152,8 +257,9 @@ public:
   }
   //! whether the wordrange overlaps with any translated word in this bitmap
   bool Overlap(const WordsRange &compare) const {
-    for (size_t pos = compare.GetStartPos() ; pos <= compare.GetEndPos() ; pos++) {
-      if (m_bitmap[pos])
+    const size_t startPos = compare.GetStartPos(), endPos = compare.GetEndPos();
+    for (size_t block = startPos / BITS_PER_BLOCK; block <= endPos / BITS_PER_BLOCK; block++) {
+      if (m_blocks[block] & GetRangeMask(block, startPos, endPos))
         return true;
     }
     return false;
@@ -175,27 +281,37 @@ public:
     if (thisSize != compareSize) {
       return (thisSize < compareSize) ? -1 : 1;
     }
-    return std::memcmp(m_bitmap, compare.m_bitmap, thisSize * sizeof(bool));
+    // same order as comparing word by word: the first differing word decides
+    for (size_t block = 0 ; block < GetNumBlocks() ; block++) {
+      Block diff = m_blocks[block] ^ compare.m_blocks[block];
+      if (diff) {
+        return ((m_blocks[block] >> LowestBit(diff)) & 1) ? 1 : -1;
+      }
+    }
+    return 0;
   }
 
   bool operator< (const WordsBitmap &compare) const {
     return Compare(compare) < 0;
   }
 
+  bool operator== (const WordsBitmap &compare) const {
+    return m_size == compare.m_size
+           && std::memcmp(m_blocks, compare.m_blocks, sizeof(Block) * GetNumBlocks()) == 0;
+  }
+
+  size_t hash() const;
+
   inline size_t GetEdgeToTheLeftOf(size_t l) const {
     if (l == 0) return l;
-    while (l && !m_bitmap[l-1]) {
-      --l;
-    }
-    return l;
+    size_t covered = FindLastBefore(l, true);
+    return (covered == NOT_FOUND) ? 0 : covered + 1;
   }
 
   inline size_t GetEdgeToTheRightOf(size_t r) const {
     if (r+1 == m_size) return r;
-    while (r+1 < m_size && !m_bitmap[r+1]) {
-      ++r;
-    }
-    return r;
+    size_t covered = FindFirstFrom(r + 1, true);
+    return (covered == NOT_FOUND) ? m_size - 1 : covered - 1;
   }
 
 
@@ -213,10 +329,7 @@ public:
     if (end == NOT_FOUND) end = 0; // nothing translated yet
 
     CHECK(end < start || end-start <= 16);
-    WordsBitmapID id = 0;
-    for(size_t pos = end; pos > start; pos--) {
-      id = id*2 + (int) GetValue(pos);
-    }
+    WordsBitmapID id = (end > start) ? GetBits(start + 1, end - start) : 0;
     return id + (1<<16) * start;
   }
 
@@ -235,10 +348,13 @@ public:
 
     CHECK(end < start || end-start <= 16);
     WordsBitmapID id = 0;
-    for(size_t pos = end; pos > start; pos--) {
-      id = id*2;
-      if (GetValue(pos) || (startPos<=pos && pos<=endPos))
-        id++;
+    if (end > start) {
+      id = GetBits(start + 1, end - start);
+      // add the span, clipped to (start, end]
+      size_t from = std::max(startPos, start + 1), to = std::min(endPos, end);
+      if (from <= to) {
+        id |= ((WordsBitmapID(1) << (to - from + 1)) - 1) << (from - start - 1);
+      }
     }
     return id + (1<<16) * start;
   }
@@ -246,6 +362,11 @@ public:
   TO_STRING();
 };
 
+inline size_t hash_value(const WordsBitmap &wordsBitmap)
+{
+  return wordsBitmap.hash();
+}
+
 // friend
 inline std::ostream& operator<<(std::ostream& out, const WordsBitmap& wordsBitmap)
 {
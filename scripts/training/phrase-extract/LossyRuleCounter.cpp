@@ -0,0 +1,244 @@
+/***********************************************************************
+  Moses - factored phrase-based language decoder
+  Copyright (C) 2012 University of Edinburgh
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ ***********************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include <boost/functional/hash.hpp>
+
+#include "LossyRuleCounter.h"
+
+using namespace std;
+
+namespace
+{
+
+const string SEPARATOR = " ||| ";
+
+typedef pair<string, double> Line;
+
+bool LineOrder(const Line *a, const Line *b)
+{
+  return a->first < b->first;
+}
+
+void WriteSorted(vector<Line> &lines, ostream &out)
+{
+  vector<const Line*> order(lines.size());
+  for (size_t i = 0; i < lines.size(); ++i) {
+    order[i] = &lines[i];
+  }
+  sort(order.begin(), order.end(), LineOrder);
+  // summed counts may be large or fractional: print them so that they read
+  // back as the same double
+  const streamsize precision = out.precision(numeric_limits<double>::digits10 + 2);
+  for (size_t i = 0; i < order.size(); ++i) {
+    out << order[i]->first << SEPARATOR << order[i]->second << "\n";
+  }
+  out.precision(precision);
+}
+
+}
+
+size_t LossyRuleCounter::KeyHash::operator()(const Key &key) const
+{
+  return boost::hash_range(key.data, key.data + key.size);
+}
+
+bool LossyRuleCounter::KeyEqual::operator()(const Key &a, const Key &b) const
+{
+  return a.size == b.size && memcmp(a.data, b.data, a.size) == 0;
+}
+
+LossyRuleCounter::Arena::~Arena()
+{
+  for (size_t i = 0; i < m_blocks.size(); ++i) {
+    delete [] m_blocks[i];
+  }
+}
+
+LossyRuleCounter::Key LossyRuleCounter::Arena::Store(const char *data, size_t size)
+{
+  if (m_blocks.empty() || m_used + size > BlockSize) {
+    m_blocks.push_back(new char[max(size, (size_t) BlockSize)]);
+    m_used = 0;
+  }
+  Key key;
+  key.data = m_blocks.back() + m_used;
+  key.size = size;
+  memcpy(m_blocks.back() + m_used, data, size);
+  m_used += size;
+  return key;
+}
+
+void LossyRuleCounter::Arena::Swap(Arena &other)
+{
+  m_blocks.swap(other.m_blocks);
+  swap(m_used, other.m_used);
+}
+
+LossyRuleCounter::LossyRuleCounter(double error, double support, size_t numShards)
+  : m_error(error)
+  , m_support(support)
+{
+  for (size_t i = 0; i < max(numShards, (size_t) 1); ++i) {
+    m_shards.push_back(new Shard());
+  }
+}
+
+LossyRuleCounter::~LossyRuleCounter()
+{
+  for (size_t i = 0; i < m_shards.size(); ++i) {
+    delete m_shards[i];
+  }
+}
+
+void LossyRuleCounter::Add(const vector<ExtractedRule> &rules)
+{
+  // lock each shard once per sentence
+  boost::hash<string> hasher;
+  vector<KeyedRules> byShard(m_shards.size());
+  vector<ExtractedRule>::const_iterator rule;
+  for (rule = rules.begin(); rule != rules.end(); ++rule) {
+    if (rule->count == 0)
+      continue;
+    string key;
+    key.reserve(rule->source.size() + rule->target.size() + rule->alignment.size() + 2 * SEPARATOR.size());
+    key.append(rule->source).append(SEPARATOR).append(rule->target).append(SEPARATOR).append(rule->alignment);
+    KeyedRules &shardRules = byShard[hasher(key) % m_shards.size()];
+    shardRules.push_back(make_pair(string(), &*rule));
+    shardRules.back().first.swap(key);
+  }
+
+  for (size_t i = 0; i < m_shards.size(); ++i) {
+    if (!byShard[i].empty()) {
+      AddToShard(*m_shards[i], byShard[i]);
+    }
+  }
+}
+
+void LossyRuleCounter::AddToShard(Shard &shard, const KeyedRules &rules)
+{
+#ifdef WITH_THREADS
+  boost::mutex::scoped_lock lock(shard.mutex);
+#endif
+  for (KeyedRules::const_iterator rule = rules.begin(); rule != rules.end(); ++rule) {
+    Key key;
+    key.data = rule->first.data();
+    key.size = rule->first.size();
+    Storage::iterator counts = shard.storage.find(key);
+    if (counts == shard.storage.end()) {
+      // missed at most once per bucket before this one
+      const string &alignmentInv = rule->second->alignmentInv;
+      Counts newCounts;
+      newCounts.count = rule->second->count;
+      newCounts.maxError = shard.bucket - 1;
+      newCounts.alignmentInv = shard.arena.Store(alignmentInv.data(), alignmentInv.size());
+      shard.storage.insert(Storage::value_type(shard.arena.Store(key.data, key.size), newCounts));
+    } else {
+      counts->second.count += rule->second->count;
+    }
+    shard.total += rule->second->count;
+
+    if (m_error > 0) {
+      size_t bucket = (size_t) floor(shard.total * m_error) + 1;
+      if (bucket != shard.bucket) {
+        Prune(shard);
+        shard.bucket = bucket;
+      }
+    }
+  }
+}
+
+void LossyRuleCounter::Prune(Shard &shard)
+{
+  // the rules kept are copied to a new arena, to free the strings of the others
+  Storage storage;
+  Arena arena;
+  for (Storage::const_iterator counts = shard.storage.begin(); counts != shard.storage.end(); ++counts) {
+    if (counts->second.count + counts->second.maxError <= shard.bucket) {
+      ++shard.numPruned;
+      continue;
+    }
+    Counts keptCounts = counts->second;
+    keptCounts.alignmentInv = arena.Store(counts->second.alignmentInv.data, counts->second.alignmentInv.size);
+    storage.insert(Storage::value_type(arena.Store(counts->first.data, counts->first.size), keptCounts));
+  }
+  shard.storage.swap(storage);
+  shard.arena.Swap(arena);
+}
+
+void LossyRuleCounter::Write(ostream &out, ostream *outInv) const
+{
+  const double threshold = (m_support - m_error) * GetTotal();
+  vector<Line> lines, linesInv;
+  for (size_t i = 0; i < m_shards.size(); ++i) {
+    const Storage &storage = m_shards[i]->storage;
+    for (Storage::const_iterator counts = storage.begin(); counts != storage.end(); ++counts) {
+      if (counts->second.count < threshold)
+        continue;
+      const string key(counts->first.data, counts->first.size);
+      lines.push_back(Line(key, counts->second.count));
+
+      if (outInv != NULL) {
+        size_t endSource = key.find(SEPARATOR);
+        size_t startTarget = endSource + SEPARATOR.size();
+        size_t endTarget = key.find(SEPARATOR, startTarget);
+        linesInv.push_back(Line(key.substr(startTarget, endTarget - startTarget)
+                                + SEPARATOR + key.substr(0, endSource)
+                                + SEPARATOR + string(counts->second.alignmentInv.data, counts->second.alignmentInv.size),
+                                counts->second.count));
+      }
+    }
+  }
+
+  WriteSorted(lines, out);
+  if (outInv != NULL) {
+    WriteSorted(linesInv, *outInv);
+  }
+}
+
+double LossyRuleCounter::GetTotal() const
+{
+  double total = 0;
+  for (size_t i = 0; i < m_shards.size(); ++i) {
+    total += m_shards[i]->total;
+  }
+  return total;
+}
+
+size_t LossyRuleCounter::GetSize() const
+{
+  size_t size = 0;
+  for (size_t i = 0; i < m_shards.size(); ++i) {
+    size += m_shards[i]->storage.size();
+  }
+  return size;
+}
+
+size_t LossyRuleCounter::GetNumPruned() const
+{
+  size_t numPruned = 0;
+  for (size_t i = 0; i < m_shards.size(); ++i) {
+    numPruned += m_shards[i]->numPruned;
+  }
+  return numPruned;
+}
@@ -0,0 +1,122 @@
+/***********************************************************************
+  Moses - factored phrase-based language decoder
+  Copyright (C) 2012 University of Edinburgh
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ ***********************************************************************/
+
+#pragma once
+#ifndef LOSSYRULECOUNTER_H_INCLUDED_
+#define LOSSYRULECOUNTER_H_INCLUDED_
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+
+#ifdef WITH_THREADS
+#include <boost/thread/mutex.hpp>
+#endif
+
+#include "ExtractedRule.h"
+
+/** Counts extracted rules over the whole corpus in bounded memory, with
+ * lossy counting (Manku and Motwani, Approximate Frequency Counts over Data
+ * Streams, 2002), as contrib/eppex does for phrases.
+ *
+ * The stream of (fractional) rule counts is cut into buckets of total count
+ * 1/error.  At the end of each bucket, rules whose count plus maximum error
+ * is below the number of buckets so far are dropped, so a count is short of
+ * the true count by at most error * N, N being the total count.  Rules are
+ * spread over shards by hash, each with its own lock and buckets, so that
+ * extraction threads rarely wait for each other.  An error of 0 counts
+ * exactly.
+ */
+class LossyRuleCounter
+{
+public:
+  LossyRuleCounter(double error, double support, size_t numShards);
+  ~LossyRuleCounter();
+
+  //! add the rules of one sentence, those with count 0 are skipped
+  void Add(const std::vector<ExtractedRule> &rules);
+
+  //! write the rules counted at least (support - error) * N times, in the
+  //! format of the extract files, sorted.  outInv may be NULL
+  void Write(std::ostream &out, std::ostream *outInv) const;
+
+  double GetTotal() const;
+  size_t GetSize() const;
+  size_t GetNumPruned() const;
+
+private:
+  // a string in the arena of a shard
+  struct Key {
+    const char *data;
+    size_t size;
+  };
+  struct KeyHash {
+    size_t operator()(const Key &key) const;
+  };
+  struct KeyEqual {
+    bool operator()(const Key &a, const Key &b) const;
+  };
+
+  /** Holds the strings of a shard in large blocks, since many small strings
+   * that live long slow down the allocations of the extraction itself. */
+  class Arena
+  {
+  public:
+    Arena() : m_used(0) {}
+    ~Arena();
+    Key Store(const char *data, size_t size);
+    void Swap(Arena &other);
+  private:
+    static const size_t BlockSize = 1 << 20;
+    std::vector<char*> m_blocks;
+    size_t m_used; // in the last block
+  };
+
+  struct Counts {
+    double count;
+    double maxError;
+    Key alignmentInv;
+  };
+  // rules by "source ||| target ||| alignment"
+  typedef boost::unordered_map<Key, Counts, KeyHash, KeyEqual> Storage;
+
+  struct Shard {
+    Storage storage;
+    Arena arena;
+    double total;
+    size_t bucket; // number of the current bucket, from 1
+    size_t numPruned;
+#ifdef WITH_THREADS
+    boost::mutex mutex;
+#endif
+    Shard() : total(0), bucket(1), numPruned(0) {}
+  };
+
+  const double m_error, m_support;
+  std::vector<Shard*> m_shards;
+
+  typedef std::vector<std::pair<std::string, const ExtractedRule*> > KeyedRules;
+
+  void AddToShard(Shard &shard, const KeyedRules &rules);
+  void Prune(Shard &shard);
+};
+
+#endif
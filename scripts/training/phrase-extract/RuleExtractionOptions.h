@@ -46,6 +46,9 @@ public:
   bool duplicateRules;
   bool fractionalCounting;
   bool outputNTLengths;
+  bool lossyCountFlag;
+  double lossyCountError;
+  double lossyCountSupport;
 
   RuleExtractionOptions()
     : maxSpan(10)
@@ -74,6 +77,9 @@ public:
     , duplicateRules(true)
     , fractionalCounting(true)
     , outputNTLengths(false)
+    , lossyCountFlag(false)
+    , lossyCountError(0)
+    , lossyCountSupport(-1)
   {}
 };
 
@@ -45,6 +45,7 @@
 #include "tables-core.h"
 #include "XmlTree.h"
 #include "InputFileStream.h"
+#include "LossyRuleCounter.h"
 #include "../../../moses/src/ThreadPool.h"
 #include "../../../moses/src/OutputCollector.h"
 
@@ -62,14 +63,16 @@ private:
   RuleExtractionOptions &m_options;
   Moses::OutputCollector* m_extractCollector;
   Moses::OutputCollector* m_extractCollectorInv;
+  LossyRuleCounter* m_ruleCounter;
 
 public:
-  ExtractTask(size_t id, SentenceAlignmentWithSyntax *sentence, RuleExtractionOptions &options, Moses::OutputCollector* extractCollector, Moses::OutputCollector* extractCollectorInv):
+  ExtractTask(size_t id, SentenceAlignmentWithSyntax *sentence, RuleExtractionOptions &options, Moses::OutputCollector* extractCollector, Moses::OutputCollector* extractCollectorInv, LossyRuleCounter* ruleCounter):
     m_id(id),
     m_sentence(sentence),
     m_options(options),
     m_extractCollector(extractCollector),
-    m_extractCollectorInv(extractCollectorInv) {}
+    m_extractCollectorInv(extractCollectorInv),
+    m_ruleCounter(ruleCounter) {}
   ~ExtractTask() { delete m_sentence; }
   void Run();
 
@@ -130,6 +133,7 @@ int main(int argc, char* argv[])
          << " | --UnknownWordLabel FILE"
          << " | --OnlyDirect"
          << " | --OutputNTLengths"
+         << " | --LossyCount ERROR [--LossySupport SUPPORT]"
          << " | --MaxSpan[" << options.maxSpan << "]"
          << " | --MinHoleTarget[" << options.minHoleTarget << "]"
          << " | --MinHoleSource[" << options.minHoleSource << "]"
@@ -255,6 +259,21 @@ int main(int argc, char* argv[])
       options.fractionalCounting = false;
     } else if (strcmp(argv[i],"--OutputNTLengths") == 0) {
       options.outputNTLengths = true;
+    }
+    // count rules over the corpus in memory and write each rule once
+    else if (strcmp(argv[i],"--LossyCount") == 0) {
+      options.lossyCountFlag = true;
+      options.lossyCountError = atof(argv[++i]);
+      if (options.lossyCountError < 0 || options.lossyCountError >= 1) {
+        cerr << "extract error: --LossyCount should be in [0,1)" << endl;
+        exit(1);
+      }
+    } else if (strcmp(argv[i],"--LossySupport") == 0) {
+      options.lossyCountSupport = atof(argv[++i]);
+      if (options.lossyCountSupport < 0 || options.lossyCountSupport >= 1) {
+        cerr << "extract error: --LossySupport should be in [0,1)" << endl;
+        exit(1);
+      }
 #ifdef WITH_THREADS
     } else if (strcmp(argv[i],"-threads") == 0 || 
                strcmp(argv[i],"--threads") == 0 ||
@@ -267,6 +286,21 @@ int main(int argc, char* argv[])
     }
   }
 
+  if (options.lossyCountFlag) {
+    if (options.outputNTLengths || options.onlyOutputSpanInfo) {
+      cerr << "extract error: --LossyCount can not be combined with --OutputNTLengths or --OnlyOutputSpanInfo" << endl;
+      exit(1);
+    }
+    // by default, all rules that survive pruning are written
+    if (options.lossyCountSupport < 0) {
+      options.lossyCountSupport = options.lossyCountError;
+    }
+    if (options.lossyCountSupport < options.lossyCountError) {
+      cerr << "extract error: --LossySupport should be at least the --LossyCount error" << endl;
+      exit(1);
+    }
+  }
+
   cerr << "extracting hierarchical rules" << endl;
 
   // open input files
@@ -290,6 +324,16 @@ int main(int argc, char* argv[])
   Moses::OutputCollector* extractCollector = new Moses::OutputCollector(&extractFile);
   Moses::OutputCollector* extractCollectorInv = new Moses::OutputCollector(&extractFileInv);
 
+  // rules counted over the corpus, instead of written per sentence
+  LossyRuleCounter *ruleCounter = NULL;
+  if (options.lossyCountFlag) {
+    size_t numShards = 1;
+#ifdef WITH_THREADS
+    numShards = 16 * thread_count;
+#endif
+    ruleCounter = new LossyRuleCounter(options.lossyCountError, options.lossyCountSupport, numShards);
+  }
+
   // stats on labels for glue grammar and unknown word label probabilities
   set< string > targetLabelCollection, sourceLabelCollection;
   map< string, int > targetTopLabelCollection, sourceTopLabelCollection;
@@ -330,7 +374,7 @@ int main(int argc, char* argv[])
       if (options.unknownWordLabelFlag) {
         collectWordLabelCounts(*sentence);
       }
-      ExtractTask *task = new ExtractTask(i-1, sentence, options, extractCollector, extractCollectorInv);
+      ExtractTask *task = new ExtractTask(i-1, sentence, options, extractCollector, extractCollectorInv, ruleCounter);
 #ifdef WITH_THREADS
       if (thread_count == 1) {
         task->Run();
@@ -355,6 +399,14 @@ int main(int argc, char* argv[])
   tFile.Close();
   sFile.Close();
   aFile.Close();
+  if (ruleCounter != NULL) {
+    cerr << endl << "total rule count " << ruleCounter->GetTotal() << ", kept "
+         << ruleCounter->GetSize() << " distinct rules, pruned "
+         << ruleCounter->GetNumPruned() << endl;
+    ruleCounter->Write(extractFile, options.onlyDirectFlag ? NULL : &extractFileInv);
+    delete ruleCounter;
+  }
+
   // only close if we actually opened it
   if (!options.onlyOutputSpanInfo) {
     extractFile.close();
@@ -371,7 +423,11 @@ int main(int argc, char* argv[])
 void ExtractTask::Run() {
   extractRules();
   consolidateRules();
-  writeRulesToFile();
+  if (m_ruleCounter != NULL) {
+    m_ruleCounter->Add(m_extractedRules);
+  } else {
+    writeRulesToFile();
+  }
   m_extractedRules.clear();
 }
 
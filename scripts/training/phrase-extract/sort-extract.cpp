@@ -0,0 +1,538 @@
+/***********************************************************************
+  Moses - factored phrase-based language decoder
+  Copyright (C) 2012 University of Edinburgh
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ ***********************************************************************/
+
+// External merge sort of extract files and phrase table halves, in the
+// byte order of LC_ALL=C sort.  Chunks of the input are sorted and written
+// to compressed runs by a pool of threads while the next chunk is read, and
+// the runs are merged, in parallel passes if there are more than
+// --batch-size of them.  The options it shares with GNU sort have the same
+// meaning, so that it can be used in its place.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+#include <zlib.h>
+
+#include "../../../moses/src/ThreadPool.h"
+
+using namespace std;
+
+size_t keyFields = 0; // compare the first keyFields fields only, 0 for the whole line
+size_t bufferSize = 1 << 30;
+size_t batchSize = 64;
+int compressLevel = 1; // of the runs, 0 to write them uncompressed
+string tempDir = "/tmp";
+#ifdef WITH_THREADS
+size_t threadCount = 1;
+#endif
+
+const char SEPARATOR[] = " ||| ";
+const size_t SEPARATOR_SIZE = 5;
+
+// size of the key of a line: its first keyFields fields with the separator
+// after them, so that keys are ordered as the lines are
+size_t GetKeySize(const char *line, size_t size)
+{
+  if (keyFields == 0)
+    return size;
+  const char *end = line + size;
+  const char *pos = line;
+  for (size_t field = 0; field < keyFields; ++field) {
+    pos = search(pos, end, SEPARATOR, SEPARATOR + SEPARATOR_SIZE);
+    if (pos == end)
+      return size;
+    pos += SEPARATOR_SIZE;
+  }
+  return pos - line;
+}
+
+int CompareKeys(const char *a, size_t sizeA, const char *b, size_t sizeB)
+{
+  int cmp = memcmp(a, b, min(sizeA, sizeB));
+  if (cmp != 0)
+    return cmp;
+  return sizeA < sizeB ? -1 : (sizeA > sizeB ? 1 : 0);
+}
+
+// reads lines from a file, compressed or not, or from stdin for "-"
+class LineReader
+{
+public:
+  explicit LineReader(const string &fileName) {
+    m_file = (fileName == "-") ? gzdopen(fileno(stdin), "rb") : gzopen(fileName.c_str(), "rb");
+    if (m_file == NULL) {
+      cerr << "ERROR: could not open " << fileName << endl;
+      exit(1);
+    }
+  }
+  ~LineReader() {
+    gzclose(m_file);
+  }
+
+  bool ReadLine(string &line) {
+    line.clear();
+    while (gzgets(m_file, m_buffer, sizeof(m_buffer)) != NULL) {
+      size_t size = strlen(m_buffer);
+      if (size > 0 && m_buffer[size - 1] == '\n') {
+        line.append(m_buffer, size - 1);
+        return true;
+      }
+      line.append(m_buffer, size);
+    }
+    return !line.empty();
+  }
+
+private:
+  gzFile m_file;
+  char m_buffer[1 << 16];
+};
+
+// writes lines to a file, compressed if its name ends in .gz, or to stdout for "-"
+class LineWriter
+{
+public:
+  LineWriter(const string &fileName, const char *gzMode = "wb6")
+    : m_file(NULL)
+    , m_gzFile(NULL) {
+    if (fileName == "-") {
+      m_file = stdout;
+    } else if (fileName.size() > 3 && fileName.substr(fileName.size() - 3) == ".gz") {
+      m_gzFile = gzopen(fileName.c_str(), gzMode);
+    } else {
+      m_file = fopen(fileName.c_str(), "w");
+    }
+    if (m_file == NULL && m_gzFile == NULL) {
+      cerr << "ERROR: could not write " << fileName << endl;
+      exit(1);
+    }
+  }
+  ~LineWriter() {
+    bool failed;
+    if (m_gzFile != NULL) {
+      failed = gzclose(m_gzFile) != Z_OK;
+    } else if (m_file != stdout) {
+      failed = fclose(m_file) != 0;
+    } else {
+      failed = fflush(m_file) != 0;
+    }
+    if (failed) {
+      cerr << "ERROR: could not write all lines" << endl;
+      exit(1);
+    }
+  }
+
+  void Write(const char *line, size_t size) {
+    if (m_gzFile != NULL) {
+      gzwrite(m_gzFile, line, size);
+      gzputc(m_gzFile, '\n');
+    } else {
+      fwrite(line, 1, size, m_file);
+      putc('\n', m_file);
+    }
+  }
+
+private:
+  FILE *m_file;
+  gzFile m_gzFile;
+};
+
+// lines of the input sorted in memory, the text of all lines in one buffer
+class Chunk
+{
+public:
+  void Add(const string &line) {
+    Line entry;
+    entry.start = m_text.size();
+    entry.size = line.size();
+    entry.keySize = GetKeySize(line.data(), line.size());
+    // the first bytes of the key, to settle most comparisons without the text
+    entry.prefix = 0;
+    for (size_t i = 0; i < sizeof(entry.prefix); ++i) {
+      entry.prefix <<= 8;
+      if (i < entry.keySize)
+        entry.prefix |= (unsigned char) line[i];
+    }
+    m_text.insert(m_text.end(), line.begin(), line.end());
+    m_lines.push_back(entry);
+  }
+
+  size_t GetBytes() const {
+    return m_text.size() + m_lines.size() * sizeof(Line);
+  }
+  bool IsEmpty() const {
+    return m_lines.empty();
+  }
+
+  void Sort() {
+    // equal keys keep the input order
+    LineOrder order(m_text.empty() ? NULL : &m_text[0]);
+    if (keyFields == 0) {
+      sort(m_lines.begin(), m_lines.end(), order);
+    } else {
+      stable_sort(m_lines.begin(), m_lines.end(), order);
+    }
+  }
+
+  void Write(LineWriter &out) const {
+    for (size_t i = 0; i < m_lines.size(); ++i) {
+      out.Write(&m_text[0] + m_lines[i].start, m_lines[i].size);
+    }
+  }
+
+private:
+  struct Line {
+    size_t start, size, keySize;
+    unsigned long long prefix;
+  };
+
+  struct LineOrder {
+    const char *text;
+    explicit LineOrder(const char *t) : text(t) {}
+    bool operator()(const Line &a, const Line &b) const {
+      if (a.prefix != b.prefix)
+        return a.prefix < b.prefix;
+      return CompareKeys(text + a.start, a.keySize, text + b.start, b.keySize) < 0;
+    }
+  };
+
+  vector<char> m_text;
+  vector<Line> m_lines;
+};
+
+// the current line of each run being merged
+class RunHead
+{
+public:
+  explicit RunHead(const string &fileName) : m_reader(fileName) {}
+
+  bool Next() {
+    if (!m_reader.ReadLine(m_line))
+      return false;
+    m_keySize = GetKeySize(m_line.data(), m_line.size());
+    return true;
+  }
+  const string &GetLine() const {
+    return m_line;
+  }
+  int Compare(const RunHead &other) const {
+    return CompareKeys(m_line.data(), m_keySize, other.m_line.data(), other.m_keySize);
+  }
+
+private:
+  LineReader m_reader;
+  string m_line;
+  size_t m_keySize;
+};
+
+// order of the heap of runs: smallest line on top, earlier run first for equal keys
+class HeadOrder
+{
+public:
+  explicit HeadOrder(const vector<RunHead*> &heads) : m_heads(heads) {}
+  bool operator()(size_t a, size_t b) const {
+    int cmp = m_heads[a]->Compare(*m_heads[b]);
+    return cmp > 0 || (cmp == 0 && a > b);
+  }
+private:
+  const vector<RunHead*> &m_heads;
+};
+
+// merges sorted runs, which are deleted afterwards
+void MergeRuns(const vector<string> &runs, LineWriter &out)
+{
+  vector<RunHead*> heads;
+  vector<size_t> heap;
+  for (size_t i = 0; i < runs.size(); ++i) {
+    heads.push_back(new RunHead(runs[i]));
+    if (heads.back()->Next())
+      heap.push_back(i);
+  }
+  HeadOrder order(heads);
+  make_heap(heap.begin(), heap.end(), order);
+
+  while (!heap.empty()) {
+    pop_heap(heap.begin(), heap.end(), order);
+    RunHead &head = *heads[heap.back()];
+    out.Write(head.GetLine().data(), head.GetLine().size());
+    if (head.Next()) {
+      push_heap(heap.begin(), heap.end(), order);
+    } else {
+      heap.pop_back();
+    }
+  }
+
+  for (size_t i = 0; i < runs.size(); ++i) {
+    delete heads[i];
+    unlink(runs[i].c_str());
+  }
+}
+
+string GetRunFileName()
+{
+  static size_t runCount = 0;
+  ostringstream fileName;
+  fileName << tempDir << "/sort-extract." << getpid() << "." << runCount++;
+  if (compressLevel > 0)
+    fileName << ".gz";
+  return fileName.str();
+}
+
+string GetRunMode()
+{
+  ostringstream mode;
+  mode << "wb" << compressLevel;
+  return mode.str();
+}
+
+// runs are compressed quickly by default, they are read back once
+class SortTask : public Moses::Task
+{
+public:
+  SortTask(Chunk *chunk, const string &runFileName)
+    : m_chunk(chunk)
+    , m_runFileName(runFileName) {}
+  ~SortTask() {
+    delete m_chunk;
+  }
+  void Run() {
+    m_chunk->Sort();
+    LineWriter out(m_runFileName, GetRunMode().c_str());
+    m_chunk->Write(out);
+  }
+private:
+  Chunk *m_chunk;
+  string m_runFileName;
+};
+
+class MergeTask : public Moses::Task
+{
+public:
+  MergeTask(const vector<string> &runs, const string &runFileName)
+    : m_runs(runs)
+    , m_runFileName(runFileName) {}
+  void Run() {
+    LineWriter out(m_runFileName, GetRunMode().c_str());
+    MergeRuns(m_runs, out);
+  }
+private:
+  vector<string> m_runs;
+  string m_runFileName;
+};
+
+#ifdef WITH_THREADS
+void RunTask(Moses::Task *task, Moses::ThreadPool &pool)
+{
+  if (threadCount == 1) {
+    task->Run();
+    delete task;
+  } else {
+    pool.Submit(task);
+  }
+}
+#else
+void RunTask(Moses::Task *task)
+{
+  task->Run();
+  delete task;
+}
+#endif
+
+size_t ParseSize(const char *arg)
+{
+  char *end;
+  double size = strtod(arg, &end);
+  switch (*end) {
+  case '%': {
+    // of physical memory, as with GNU sort
+    const double memory = (double) sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
+    if (memory <= 0) {
+      cerr << "ERROR: can not determine the size of physical memory for buffer size " << arg << endl;
+      exit(1);
+    }
+    size *= memory / 100.0;
+    break;
+  }
+  case 'b':
+    break;
+  case '\0':
+  case 'K':
+  case 'k':
+    size *= 1024.0;
+    break;
+  case 'M':
+    size *= 1024.0 * 1024.0;
+    break;
+  case 'G':
+    size *= 1024.0 * 1024.0 * 1024.0;
+    break;
+  case 'T':
+    size *= 1024.0 * 1024.0 * 1024.0 * 1024.0;
+    break;
+  default:
+    cerr << "ERROR: can not parse buffer size " << arg << endl;
+    exit(1);
+  }
+  return (size_t) size;
+}
+
+int main(int argc, char* argv[])
+{
+  cerr << "sort-extract: sorting lines in byte order\n";
+
+  string fileNameOutput = "-";
+  vector<string> fileNamesInput;
+  const char *tmpdir = getenv("TMPDIR");
+  if (tmpdir != NULL)
+    tempDir = tmpdir;
+
+  for(int i=1; i<argc; i++) {
+    string arg = argv[i];
+    if (arg == "-S" || arg == "--buffer-size") {
+      bufferSize = ParseSize(argv[++i]);
+    } else if (arg.substr(0, 14) == "--buffer-size=") {
+      bufferSize = ParseSize(argv[i] + 14);
+    } else if (arg == "-T" || arg == "--temporary-directory") {
+      tempDir = argv[++i];
+    } else if (arg == "-o" || arg == "--output") {
+      fileNameOutput = argv[++i];
+    } else if (arg == "--batch-size") {
+      batchSize = atoi(argv[++i]);
+    } else if (arg.substr(0, 13) == "--batch-size=") {
+      batchSize = atoi(argv[i] + 13);
+    } else if (arg == "--CompressLevel") {
+      compressLevel = atoi(argv[++i]);
+    } else if (arg == "--KeyFields") {
+      keyFields = atoi(argv[++i]);
+#ifdef WITH_THREADS
+    } else if (arg == "--parallel" || arg == "--threads") {
+      threadCount = max(atoi(argv[++i]), 1);
+    } else if (arg.substr(0, 11) == "--parallel=") {
+      threadCount = max(atoi(argv[i] + 11), 1);
+#endif
+    } else if (arg.size() > 1 && arg[0] == '-') {
+      cerr << "syntax: sort-extract [-S SIZE] [-T DIR] [-o FILE] [--batch-size NUM]"
+#ifdef WITH_THREADS
+           << " [--parallel NUM]"
+#endif
+           << " [--CompressLevel NUM(" << compressLevel << ")] [--KeyFields NUM] [FILE...]\n"
+           << "files may be gzipped, an output file ending in .gz is gzipped\n";
+      exit(1);
+    } else {
+      fileNamesInput.push_back(arg);
+    }
+  }
+  if (fileNamesInput.empty())
+    fileNamesInput.push_back("-");
+  if (compressLevel < 0 || compressLevel > 9) {
+    cerr << "ERROR: --CompressLevel should be between 0 and 9" << endl;
+    exit(1);
+  }
+  if (batchSize < 2) {
+    cerr << "ERROR: --batch-size should be at least 2" << endl;
+    exit(1);
+  }
+
+  // one chunk is read while others are sorted, one more waits for a thread
+  size_t chunkBytes = bufferSize;
+#ifdef WITH_THREADS
+  chunkBytes = bufferSize / (threadCount == 1 ? 1 : threadCount + 2);
+  Moses::ThreadPool *pool = new Moses::ThreadPool(threadCount);
+  pool->SetQueueLimit(1);
+#endif
+
+  vector<string> runs;
+  Chunk *chunk = new Chunk();
+  string line;
+  for (size_t i = 0; i < fileNamesInput.size(); ++i) {
+    LineReader in(fileNamesInput[i]);
+    while (in.ReadLine(line)) {
+      chunk->Add(line);
+      if (chunk->GetBytes() >= chunkBytes) {
+        runs.push_back(GetRunFileName());
+#ifdef WITH_THREADS
+        RunTask(new SortTask(chunk, runs.back()), *pool);
+#else
+        RunTask(new SortTask(chunk, runs.back()));
+#endif
+        chunk = new Chunk();
+      }
+    }
+  }
+
+  // it all fit in memory
+  if (runs.empty()) {
+#ifdef WITH_THREADS
+    delete pool;
+#endif
+    chunk->Sort();
+    LineWriter out(fileNameOutput);
+    chunk->Write(out);
+    delete chunk;
+    return 0;
+  }
+
+  if (!chunk->IsEmpty()) {
+    runs.push_back(GetRunFileName());
+#ifdef WITH_THREADS
+    RunTask(new SortTask(chunk, runs.back()), *pool);
+#else
+    RunTask(new SortTask(chunk, runs.back()));
+#endif
+  } else {
+    delete chunk;
+  }
+#ifdef WITH_THREADS
+  pool->Stop(true);
+  delete pool;
+#endif
+  cerr << "sorted " << runs.size() << " runs" << endl;
+
+  // merge batches of runs in parallel until one batch is left
+  while (runs.size() > batchSize) {
+#ifdef WITH_THREADS
+    pool = new Moses::ThreadPool(threadCount);
+#endif
+    vector<string> merged;
+    for (size_t start = 0; start < runs.size(); start += batchSize) {
+      vector<string> batch(runs.begin() + start, runs.begin() + min(start + batchSize, runs.size()));
+      merged.push_back(GetRunFileName());
+#ifdef WITH_THREADS
+      RunTask(new MergeTask(batch, merged.back()), *pool);
+#else
+      RunTask(new MergeTask(batch, merged.back()));
+#endif
+    }
+#ifdef WITH_THREADS
+    pool->Stop(true);
+    delete pool;
+#endif
+    runs.swap(merged);
+    cerr << "merged into " << runs.size() << " runs" << endl;
+  }
+
+  LineWriter out(fileNameOutput);
+  MergeRuns(runs, out);
+}